@@ -0,0 +1,738 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/FFIHandler.h"
+#include "implementation/Features.h"
+#include "implementation/Implementation.h"
+#include "implementation/NaNBits.h"
+#include "implementation/TrapHandler.h"
+#include "semantics/CodeCache.h"
+#include "semantics/Host.h"
+#include "semantics/Run.h"
+#include "module/Module.h"
+#include "module/ModuleFormat.h"
+#include "process/Environment.h"
+#include "process/GlobalVariables.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "process/TrustedStack.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace wasm;
+
+// Microbenchmarks of the operators, linear memory accesses and growth, and
+// NaN bit generation. Each benchmark is run with enough iterations that a
+// repetition takes at least --min-time, then repeated --repetitions times,
+// and reported as nanoseconds per operation, with the median's 95%
+// confidence interval, as JSON on standard output. The interval is null with
+// fewer than six repetitions, which are too few to give one.
+
+static int
+Error(const char* what, ...) {
+  va_list ap;
+  va_start(ap, what);
+  fprintf(stderr, "wasm-bench: command-line error: ");
+  vfprintf(stderr, what, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  return 2; // as in sh(1).
+}
+
+static double
+Now() {
+  return std::chrono::duration<double>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// Results are stored here so that the loops computing them aren't optimized
+// away.
+static volatile std::uint64_t sink;
+
+// Runs iterations operations and returns the seconds they took.
+typedef std::function<double(std::uint64_t iterations)> Body;
+
+struct Benchmark {
+  std::string name;
+  const char* family;
+  Body body;
+};
+
+struct Options {
+  unsigned repetitions;
+  double minTime;
+  const char* filter;
+
+  Options()
+    : repetitions(15)
+    , minTime(20e-3)
+    , filter(nullptr) {}
+};
+
+// Operator loops count down an int32.
+static const std::uint64_t maxIterations = 0x7fffffff;
+
+// Find a number of iterations taking at least minTime. This also warms up
+// caches and compiles the code under test.
+static std::uint64_t
+Calibrate(const Body& body, double minTime) {
+  std::uint64_t iterations = 1;
+  for (;;) {
+    double seconds = body(iterations);
+    if (seconds >= minTime || iterations >= maxIterations)
+      return iterations;
+    // Aim a little past minTime, but grow at most tenfold at a time, since
+    // short runs are noisy.
+    double scale = seconds > 0 ? minTime * 1.2 / seconds : 10;
+    scale = std::min(std::max(scale, 2.0), 10.0);
+    iterations = std::min(maxIterations, std::uint64_t(iterations * scale));
+  }
+}
+
+// The index of the lowest of the sorted samples bounding the median's 95%
+// confidence interval, which runs from samples[low] to samples[n - 1 - low].
+// The number of samples below the true median is binomial, with p = 1/2, so
+// the interval misses it with probability 2 * P(X <= low); low is the
+// greatest index for which that's at most 5%. This assumes nothing about the
+// distribution of the timings, which is rarely normal. Returns false if even
+// the whole range isn't enough.
+static bool
+MedianInterval(std::size_t n, std::size_t* low) {
+  bool found = false;
+  double missed = 0;
+  for (std::size_t k = 0; 2 * k + 1 < n; ++k) {
+    missed += 2 * std::exp(std::lgamma(n + 1.0) - std::lgamma(k + 1.0) -
+                           std::lgamma(n - k + 1.0) - n * std::log(2.0));
+    if (missed > 0.05)
+      break;
+    *low = k;
+    found = true;
+  }
+  return found;
+}
+
+static void
+Report(const Benchmark& benchmark, std::uint64_t iterations,
+       std::vector<double> samples, bool first) {
+  std::size_t n = samples.size();
+  std::sort(samples.begin(), samples.end());
+  double median = n % 2 ? samples[n / 2]
+                        : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  double mean = 0;
+  for (double sample : samples)
+    mean += sample;
+  mean /= n;
+  double variance = 0;
+  for (double sample : samples)
+    variance += (sample - mean) * (sample - mean);
+  double stddev = n > 1 ? std::sqrt(variance / (n - 1)) : 0;
+  std::size_t low;
+  char interval[64] = "null";
+  if (MedianInterval(n, &low))
+    snprintf(interval, sizeof(interval), "[%.4f, %.4f]", samples[low],
+             samples[n - 1 - low]);
+
+  printf("%s\n    {\"name\": \"%s\", \"family\": \"%s\", "
+         "\"iterations\": %llu,\n",
+         first ? "" : ",", benchmark.name.c_str(), benchmark.family,
+         (unsigned long long)iterations);
+  printf("     \"ns_per_op\": {\"min\": %.4f, \"median\": %.4f, "
+         "\"mean\": %.4f, \"stddev\": %.4f,\n",
+         samples[0], median, mean, stddev);
+  printf("                   \"median_ci95\": %s, \"max\": %.4f},\n",
+         interval, samples[n - 1]);
+  printf("     \"samples\": [");
+  for (std::size_t i = 0; i < n; ++i)
+    printf("%s%.4f", i ? ", " : "", samples[i]);
+  printf("]}");
+}
+
+static void
+Measure(const Benchmark& benchmark, const Options& options, bool first) {
+  std::uint64_t iterations = Calibrate(benchmark.body, options.minTime);
+  std::vector<double> samples;
+  for (unsigned i = 0; i < options.repetitions; ++i)
+    samples.push_back(benchmark.body(iterations) * 1e9 / iterations);
+  Report(benchmark, iterations, samples, first);
+}
+
+// Operators are measured as the engine under test executes them, in a
+// routine whose loop applies step to local x, over and over, then sinks x
+// with a comparison into the loop counter, so the operand stack is empty at
+// the branch. Loop overhead is amortized over unroll steps. Each is measured
+// again as metered code, as run with --fuel, named with a .metered suffix.
+struct OpCase {
+  const char* name;
+  const char* family;
+  // The type of x and of y, which binary steps take as their right operand.
+  Types type;
+  std::vector<Node> step;
+  unsigned opsPerStep;
+  std::uint64_t x;
+  std::uint64_t y;
+};
+
+static const unsigned unroll = 16;
+
+enum : std::uint32_t { counterLocal, xLocal, yLocal, numLocals };
+enum : std::uint32_t { xLiteral, yLiteral, minusOneLiteral };
+
+static Node
+N(Types type, Opcode opcode, std::uint32_t payload = 0) {
+  return Node{type, opcode, payload};
+}
+
+// An int32 node that consumes two values of type and pushes zero.
+static Node
+Sink(Types type) {
+  switch (type) {
+    case Types::int64:
+      return N(Types::int32, Int64Ult);
+    case Types::float32:
+      return N(Types::int32, Float32Lt);
+    case Types::float64:
+      return N(Types::int32, Float64Lt);
+    default:
+      return N(Types::int32, Int32Ult);
+  }
+}
+
+static std::vector<Node>
+OpRoutine(const OpCase& op) {
+  Types I = Types::int32;
+  Types T = op.type;
+  std::vector<Node> body = {
+    // counter = (x = literal) < x + (y = literal) < y + global 0, branching
+    // to the loop to leave the stack empty.
+    N(T, Literal, xLiteral), N(T, SetLocal, xLocal), N(T, GetLocal, xLocal),
+    Sink(T), N(T, Literal, yLiteral), N(T, SetLocal, yLocal),
+    N(T, GetLocal, yLocal), Sink(T), N(I, Int32Add), N(I, LoadGlobal, 0),
+    N(I, Int32Add), N(I, SetLocal, counterLocal),
+  };
+  std::uint32_t top = body.size() + 1;
+  body.push_back(N(Types::void_, BrIf, top));
+
+  body.push_back(N(T, GetLocal, xLocal));
+  for (unsigned i = 0; i < unroll; ++i)
+    body.insert(body.end(), op.step.begin(), op.step.end());
+  std::vector<Node> tail = {
+    N(T, SetLocal, xLocal), N(T, GetLocal, xLocal), Sink(T),
+    N(I, GetLocal, counterLocal), N(I, Int32Add),
+    N(I, Literal, minusOneLiteral), N(I, Int32Add),
+    N(I, SetLocal, counterLocal), N(Types::void_, BrIf, top),
+  };
+  body.insert(body.end(), tail.begin(), tail.end());
+  return body;
+}
+
+// Write a module with the single routine body to a temporary file and load
+// it. The file is unlinked once it's mapped.
+static bool
+LoadModule(const std::vector<Node>& body,
+           const std::vector<std::uint64_t>& literals, Module* module,
+           const char** why) {
+  std::vector<std::uint8_t> out(sizeof(ModuleHeader) +
+                                2 * sizeof(SectionHeader));
+  auto append = [&out](const void* data, std::size_t size) {
+    std::size_t offset = (out.size() + 7) & ~std::size_t(7);
+    out.resize(offset + size);
+    memcpy(&out[offset], data, size);
+    return offset;
+  };
+
+  RoutineHeader routine = RoutineHeader();
+  routine.numLocals = numLocals;
+  routine.numNodes = body.size();
+  routine.bodyOffset = append(body.data(), body.size() * sizeof(Node));
+
+  SectionHeader sections[2] = {};
+  sections[0].id = SectionID::routines;
+  sections[0].size = sizeof(routine);
+  sections[0].offset = append(&routine, sizeof(routine));
+  sections[1].id = SectionID::literals;
+  sections[1].size = literals.size() * sizeof(std::uint64_t);
+  sections[1].offset = append(literals.data(), sections[1].size);
+
+  ModuleHeader header = ModuleHeader();
+  memcpy(header.magic, moduleMagic, sizeof(moduleMagic));
+  header.version = moduleVersion;
+  header.numSections = 2;
+  header.numGlobals = 1;
+  memcpy(&out[0], &header, sizeof(header));
+  memcpy(&out[sizeof(header)], sections, sizeof(sections));
+
+  const char* dir = getenv("TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/wasm-bench-XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    *why = "cannot create a temporary module file";
+    return false;
+  }
+  bool written = write(fd, out.data(), out.size()) == ssize_t(out.size());
+  close(fd);
+  bool ok = written && module->load(path.c_str(), why);
+  unlink(path.c_str());
+  if (!written)
+    *why = "cannot write a temporary module file";
+  return ok;
+}
+
+static std::uint64_t
+Float32Bits(float x) {
+  std::uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static std::uint64_t
+Float64Bits(double x) {
+  std::uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static std::vector<OpCase>
+OpCases() {
+  Types i32 = Types::int32, i64 = Types::int64;
+  Types f32 = Types::float32, f64 = Types::float64;
+  std::uint64_t one32 = Float32Bits(1), one64 = Float64Bits(1);
+  std::uint64_t nan32 = Float32Bits(NAN), nan64 = Float64Bits(NAN);
+  // Binary steps operate on x and y; dividing by one, or taking the
+  // remainder of a larger divisor, leaves x large, so division takes the
+  // same time in every iteration.
+  auto binary = [](const char* name, const char* family, Types type,
+                   Opcode opcode, std::uint64_t x, std::uint64_t y) {
+    return OpCase{name,
+                  family,
+                  type,
+                  {N(type, GetLocal, yLocal), N(type, opcode)},
+                  1,
+                  x,
+                  y};
+  };
+  auto unary = [](const char* name, const char* family, Types type,
+                  Opcode opcode, std::uint64_t x) {
+    return OpCase{name, family, type, {N(type, opcode)}, 1, x, 0};
+  };
+  // Conversions go there and back.
+  auto convert = [](const char* name, Types type, Types via, Opcode to,
+                    Opcode from, std::uint64_t x) {
+    return OpCase{name,
+                  "conversion",
+                  type,
+                  {N(via, to), N(type, from)},
+                  2,
+                  x,
+                  0};
+  };
+  std::uint64_t large32 = 0x7654321, large64 = 0x76543210fedcba9;
+  return {
+    binary("int32.add", "int32", i32, Int32Add, 1, 3),
+    binary("int32.sub", "int32", i32, Int32Sub, 1, 3),
+    binary("int32.mul", "int32", i32, Int32Mul, 1, 3),
+    binary("int32.and", "int32", i32, Int32And, large32, 0xff00ff),
+    binary("int32.xor", "int32", i32, Int32Xor, 1, 3),
+    binary("int32.sdiv", "int32.division", i32, Int32SDiv, large32, 1),
+    binary("int32.udiv", "int32.division", i32, Int32UDiv, large32, 1),
+    binary("int32.srem", "int32.division", i32, Int32SRem, large32,
+           0x7fffffff),
+    binary("int32.urem", "int32.division", i32, Int32URem, large32,
+           0x7fffffff),
+    binary("int32.shl", "int32.shift", i32, Int32Shl, 1, 3),
+    binary("int32.shr", "int32.shift", i32, Int32Shr, large32, 3),
+    binary("int32.sar", "int32.shift", i32, Int32Sar, large32, 3),
+    binary("int32.shl.wide", "int32.shift", i32, Int32Shl, 1, 40),
+    binary("int64.add", "int64", i64, Int64Add, 1, 3),
+    binary("int64.mul", "int64", i64, Int64Mul, 1, 3),
+    binary("int64.sdiv", "int64.division", i64, Int64SDiv, large64, 1),
+    binary("int64.urem", "int64.division", i64, Int64URem, large64,
+           0x7fffffffffffffff),
+    binary("int64.shl", "int64.shift", i64, Int64Shl, 1, 3),
+    binary("float32.add", "float32", f32, Float32Add, one32, one32),
+    binary("float32.mul", "float32", f32, Float32Mul, one32, one32),
+    binary("float32.div", "float32", f32, Float32Div, one32, one32),
+    unary("float32.sqrt", "float32", f32, Float32Sqrt, one32),
+    unary("float32.floor", "float32", f32, Float32Floor, one32),
+    binary("float32.copysign", "float32", f32, Float32Copysign, one32,
+           one32),
+    binary("float64.add", "float64", f64, Float64Add, one64, one64),
+    binary("float64.mul", "float64", f64, Float64Mul, one64, one64),
+    binary("float64.div", "float64", f64, Float64Div, one64, one64),
+    unary("float64.sqrt", "float64", f64, Float64Sqrt, one64),
+    unary("float64.ceil", "float64", f64, Float64Ceil, one64),
+    // A NaN operand makes every result NaN, so every operation chooses NaN
+    // bits.
+    binary("float32.add.nan", "float.nan", f32, Float32Add, nan32, one32),
+    binary("float32.div.nan", "float.nan", f32, Float32Div, nan32, one32),
+    binary("float64.add.nan", "float.nan", f64, Float64Add, nan64, one64),
+    binary("float64.mul.nan", "float.nan", f64, Float64Mul, nan64, one64),
+    convert("int32.float64", i32, f64, Float64FromSInt32, SInt32FromFloat64,
+            12345),
+    convert("uint32.float32", i32, f32, Float32FromUInt32, Uint32FromFloat32,
+            12345),
+    convert("int32.int64", i32, i64, Int64FromSInt32, Int32FromInt64, 12345),
+    convert("int64.float64", i64, f64, Float64FromSInt64, SInt64FromFloat64,
+            12345),
+    convert("uint64.float32", i64, f32, Float32FromUInt64, Uint64FromFloat32,
+            12345),
+    convert("float32.float64", f32, f64, Float64FromFloat32,
+            Float32FromFloat64, Float32Bits(1.5)),
+    convert("float32.bits", f32, i32, Int32fromFloat32Bits,
+            Float32FromInt32Bits, Float32Bits(1.5)),
+    convert("float64.bits", f64, i64, Int64FromFloat64Bits,
+            Float64FromInt64Bits, one64),
+  };
+}
+
+// A module and a process running it, with the code compiled once.
+struct OpRunner {
+  std::shared_ptr<Module> module;
+  Process process;
+  RunOptions runOptions;
+  std::unique_ptr<CodeCache> codeCache;
+};
+
+static bool
+AddOpBenchmarks(Implementation& implementation, const RunOptions& runOptions,
+                std::vector<Benchmark>* benchmarks, const char** why) {
+  TrapHandler* trapHandler = implementation.trapHandler_.get();
+  for (const OpCase& op : OpCases()) {
+    for (bool metered : {false, true}) {
+      std::shared_ptr<OpRunner> runner = std::make_shared<OpRunner>();
+      runner->module = std::make_shared<Module>();
+      if (!LoadModule(OpRoutine(op), {op.x, op.y, 0xffffffff},
+                      runner->module.get(), why))
+        return false;
+      runner->process.load(runner->module, trapHandler);
+      runner->runOptions = runOptions;
+      if (metered)
+        runner->runOptions.fuel = INT64_MAX;
+      runner->codeCache.reset(
+        new CodeCache(*runner->module, trapHandler, runner->runOptions));
+      unsigned opsPerIteration = op.opsPerStep * unroll;
+      benchmarks->push_back(Benchmark{
+        std::string(op.name) + (metered ? ".metered" : ""), op.family,
+        [&implementation, runner, opsPerIteration](std::uint64_t iterations) {
+          // Each iteration of the loop is opsPerIteration iterations of the
+          // benchmark.
+          std::uint64_t loops = (iterations + opsPerIteration - 1) /
+                                opsPerIteration;
+          runner->process.globalVariables_->store<std::int32_t>(0, loops);
+          double start = Now();
+          run(implementation, runner->process, *runner->codeCache,
+              runner->runOptions);
+          return (Now() - start) * iterations / (loops * opsPerIteration);
+        }});
+    }
+  }
+  return true;
+}
+
+// Linear memory is measured directly, with explicit bounds checks and, if the
+// host supports them, with guard pages.
+static const std::size_t memorySize = 1 << 16;
+
+static std::unique_ptr<LinearMemory>
+MakeMemory(bool guarded, TrapHandler* trapHandler) {
+  std::unique_ptr<LinearMemory> memory(new LinearMemory());
+  if (guarded && !memory->reserveGuarded(trapHandler))
+    return nullptr;
+  memory->resize<std::uint64_t>(memorySize, trapHandler);
+  return memory;
+}
+
+// Addresses sweep half the memory, stride bytes at a time, from offset,
+// which makes them unaligned if it isn't a multiple of the access size.
+template <typename T>
+static Body
+LoadBody(std::shared_ptr<LinearMemory> memory, TrapHandler* trapHandler,
+         std::uint64_t offset, std::uint8_t p2align) {
+  return [memory, trapHandler, offset, p2align](std::uint64_t iterations) {
+    std::uint64_t sum = 0;
+    double start = Now();
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      std::uint64_t addr = ((i * sizeof(T)) & (memorySize / 2 - 1)) + offset;
+      sum += memory->load<std::uint64_t, T>(addr, p2align, trapHandler);
+    }
+    double seconds = Now() - start;
+    sink = sum;
+    return seconds;
+  };
+}
+
+template <typename T>
+static Body
+StoreBody(std::shared_ptr<LinearMemory> memory, TrapHandler* trapHandler,
+          std::uint64_t offset, std::uint8_t p2align) {
+  return [memory, trapHandler, offset, p2align](std::uint64_t iterations) {
+    double start = Now();
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      std::uint64_t addr = ((i * sizeof(T)) & (memorySize / 2 - 1)) + offset;
+      memory->store<std::uint64_t, T>(addr, p2align, trapHandler, T(i));
+    }
+    double seconds = Now() - start;
+    sink = memory->data()[offset];
+    return seconds;
+  };
+}
+
+// Growth is measured a page at a time, up to growthPages before starting
+// again with a fresh memory; releasing it isn't timed.
+static const std::size_t pageSize = 1 << 16;
+static const std::size_t growthPages = 256;
+
+static Body
+ResizeBody(bool guarded, TrapHandler* trapHandler) {
+  return [guarded, trapHandler](std::uint64_t iterations) {
+    double seconds = 0;
+    for (std::uint64_t done = 0; done < iterations;) {
+      LinearMemory memory;
+      if (guarded)
+        memory.reserveGuarded(trapHandler);
+      std::uint64_t pages = std::min<std::uint64_t>(growthPages,
+                                                     iterations - done);
+      double start = Now();
+      for (std::uint64_t page = 1; page <= pages; ++page)
+        memory.resize<std::uint64_t>(page * pageSize, trapHandler);
+      seconds += Now() - start;
+      done += pages;
+    }
+    return seconds;
+  };
+}
+
+static void
+AddMemoryBenchmarks(TrapHandler* trapHandler,
+                    std::vector<Benchmark>* benchmarks) {
+  for (bool guarded : {false, true}) {
+    std::shared_ptr<LinearMemory> memory = MakeMemory(guarded, trapHandler);
+    if (!memory) {
+      fprintf(stderr, "wasm-bench: guard pages unavailable; skipping "
+                      "guarded memory benchmarks\n");
+      continue;
+    }
+    std::string suffix = guarded ? ".guard" : ".explicit";
+    auto add = [&](const char* name, const char* family, Body body) {
+      benchmarks->push_back(Benchmark{name + suffix, family, body});
+    };
+    add("memory.load.int32.aligned", "memory.load",
+        LoadBody<std::uint32_t>(memory, trapHandler, 0, 2));
+    add("memory.load.int32.unaligned", "memory.load",
+        LoadBody<std::uint32_t>(memory, trapHandler, 1, 0));
+    add("memory.load.int64.aligned", "memory.load",
+        LoadBody<std::uint64_t>(memory, trapHandler, 0, 3));
+    add("memory.load.int64.unaligned", "memory.load",
+        LoadBody<std::uint64_t>(memory, trapHandler, 3, 0));
+    add("memory.store.int32.aligned", "memory.store",
+        StoreBody<std::uint32_t>(memory, trapHandler, 0, 2));
+    add("memory.store.int32.unaligned", "memory.store",
+        StoreBody<std::uint32_t>(memory, trapHandler, 1, 0));
+    add("memory.store.int64.aligned", "memory.store",
+        StoreBody<std::uint64_t>(memory, trapHandler, 0, 3));
+    add("memory.store.int64.unaligned", "memory.store",
+        StoreBody<std::uint64_t>(memory, trapHandler, 3, 0));
+    add("memory.resize", "memory.resize", ResizeBody(guarded, trapHandler));
+  }
+}
+
+// Operands which aren't NaNs, so that bits are generated rather than
+// propagated.
+static void
+AddNaNBitsBenchmarks(std::vector<Benchmark>* benchmarks) {
+  static const struct {
+    const char* name;
+    NaNBits::Kind kind;
+  } kinds[] = {
+    {"canonical", NaNBits::Kind::Canonical},
+    {"inverse", NaNBits::Kind::Inverse},
+    {"random", NaNBits::Kind::Random},
+  };
+  for (const auto& kind : kinds) {
+    std::shared_ptr<NaNBits> bits = std::make_shared<NaNBits>(kind.kind);
+    benchmarks->push_back(Benchmark{
+      std::string("nanbits.float32.") + kind.name, "nanbits",
+      [bits](std::uint64_t iterations) {
+        std::uint64_t sum = 0;
+        double start = Now();
+        for (std::uint64_t i = 0; i < iterations; ++i)
+          sum += Float32Bits(bits->float32(0, 0));
+        double seconds = Now() - start;
+        sink = sum;
+        return seconds;
+      }});
+    benchmarks->push_back(Benchmark{
+      std::string("nanbits.float64.") + kind.name, "nanbits",
+      [bits](std::uint64_t iterations) {
+        std::uint64_t sum = 0;
+        double start = Now();
+        for (std::uint64_t i = 0; i < iterations; ++i)
+          sum += Float64Bits(bits->float64(0, 0));
+        double seconds = Now() - start;
+        sink = sum;
+        return seconds;
+      }});
+  }
+}
+
+static const char*
+EngineName(Engine engine) {
+  switch (engine) {
+    case Engine::stack:
+      return "stack";
+    case Engine::register_:
+      return "register";
+    case Engine::jit:
+      return "jit";
+    case Engine::aot:
+      return "aot";
+  }
+  return "";
+}
+
+int
+main(int argc, char* argv[]) {
+  AssertHostRequirements();
+
+  NaNBits::Kind nanBitsKind = NaNBits::Kind::Random;
+  const char* nanBitsName = "random";
+  RunOptions runOptions;
+  Options options;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (arg[0] != '-' || arg[1] != '-')
+      return Error("unexpected argument: %s", arg);
+
+    const char* argName = arg + 2;
+    const char* equals = strchr(argName, '=');
+    size_t len = equals ? equals - argName : strlen(argName);
+    const char* val = equals ? equals + 1 : nullptr;
+
+    if (strncmp(argName, "nanbits", len) == 0) {
+      if (val && strcmp(val, "random") == 0)
+        nanBitsKind = NaNBits::Kind::Random;
+      else if (val && strcmp(val, "canonical") == 0)
+        nanBitsKind = NaNBits::Kind::Canonical;
+      else if (val && strcmp(val, "inverse") == 0)
+        nanBitsKind = NaNBits::Kind::Inverse;
+      else
+        return Error("--nanbits usage: --nanbits=<random|canonical|inverse>");
+      nanBitsName = val;
+      continue;
+    }
+
+    if (strncmp(argName, "dispatch", len) == 0) {
+      if (val && strcmp(val, "switch") == 0)
+        runOptions.dispatch = Dispatch::switch_;
+      else if (val && strcmp(val, "threaded") == 0)
+        runOptions.dispatch = Dispatch::threaded;
+      else
+        return Error("--dispatch usage: --dispatch=<switch|threaded>");
+      continue;
+    }
+
+    if (strncmp(argName, "engine", len) == 0) {
+      if (val && strcmp(val, "stack") == 0)
+        runOptions.engine = Engine::stack;
+      else if (val && strcmp(val, "register") == 0)
+        runOptions.engine = Engine::register_;
+      else if (val && strcmp(val, "jit") == 0) {
+        if (!WASM_HAVE_JIT)
+          return Error("--engine=jit is unavailable on this host");
+        runOptions.engine = Engine::jit;
+      } else
+        return Error("--engine usage: --engine=<stack|register|jit>");
+      continue;
+    }
+
+    if (strncmp(argName, "fuse", len) == 0) {
+      if (val && strcmp(val, "on") == 0)
+        runOptions.fuse = true;
+      else if (val && strcmp(val, "off") == 0)
+        runOptions.fuse = false;
+      else
+        return Error("--fuse usage: --fuse=<on|off>");
+      continue;
+    }
+
+    if (strncmp(argName, "repetitions", len) == 0) {
+      char* end;
+      options.repetitions = val ? strtoul(val, &end, 10) : 0;
+      if (options.repetitions == 0 || *end != '\0')
+        return Error("--repetitions usage: --repetitions=<count>");
+      continue;
+    }
+
+    if (strncmp(argName, "min-time", len) == 0) {
+      char* end;
+      double ms = val ? strtod(val, &end) : -1;
+      if (!val || *end != '\0' || !(ms > 0))
+        return Error("--min-time usage: --min-time=<milliseconds>");
+      options.minTime = ms / 1e3;
+      continue;
+    }
+
+    if (strncmp(argName, "filter", len) == 0) {
+      if (!val)
+        return Error("--filter usage: --filter=<substring>");
+      options.filter = val;
+      continue;
+    }
+
+    return Error("unknown command-line option: %s", arg);
+  }
+
+  Implementation implementation(nanBitsKind);
+  TrapHandler* trapHandler = implementation.trapHandler_.get();
+
+  std::vector<Benchmark> benchmarks;
+  const char* why;
+  if (!AddOpBenchmarks(implementation, runOptions, &benchmarks, &why)) {
+    fprintf(stderr, "wasm-bench: %s\n", why);
+    return EXIT_FAILURE;
+  }
+  AddMemoryBenchmarks(trapHandler, &benchmarks);
+  AddNaNBitsBenchmarks(&benchmarks);
+
+  printf("{\"engine\": \"%s\", \"dispatch\": \"%s\", \"fuse\": %s, "
+         "\"nanbits\": \"%s\",\n",
+         EngineName(runOptions.engine),
+         runOptions.dispatch == Dispatch::threaded ? "threaded" : "switch",
+         runOptions.fuse ? "true" : "false", nanBitsName);
+  printf(" \"repetitions\": %u, \"min_time_ms\": %g,\n \"benchmarks\": [",
+         options.repetitions, options.minTime * 1e3);
+  bool first = true;
+  for (const Benchmark& benchmark : benchmarks) {
+    if (options.filter &&
+        benchmark.name.find(options.filter) == std::string::npos)
+      continue;
+    Measure(benchmark, options, first);
+    first = false;
+    fflush(stdout);
+  }
+  printf("\n ]}\n");
+  return EXIT_SUCCESS;
+}
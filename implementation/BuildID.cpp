@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/BuildID.h"
+#include "implementation/Hash.h"
+#include <cstring>
+#include <elf.h>
+#include <link.h>
+#include <sys/stat.h>
+using namespace std;
+using namespace wasm;
+
+namespace {
+
+struct Note {
+  uint64_t hash;
+  bool found;
+};
+
+} // namespace
+
+// Look for an NT_GNU_BUILD_ID note in the main executable, which
+// dl_iterate_phdr reports first.
+static int
+FindBuildIDNote(dl_phdr_info* info, size_t, void* data) {
+  Note* note = static_cast<Note*>(data);
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_NOTE)
+      continue;
+    const char* p =
+      reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+    const char* end = p + phdr.p_memsz;
+    while (p + sizeof(ElfW(Nhdr)) <= end) {
+      ElfW(Nhdr) nhdr;
+      memcpy(&nhdr, p, sizeof(nhdr));
+      const char* name = p + sizeof(nhdr);
+      const char* desc = name + ((nhdr.n_namesz + 3) & ~3);
+      if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0 && desc + nhdr.n_descsz <= end) {
+        note->hash = Hash64(desc, nhdr.n_descsz);
+        note->found = true;
+        return 1;
+      }
+      p = desc + ((nhdr.n_descsz + 3) & ~3);
+    }
+  }
+  return 1;
+}
+
+static uint64_t
+ComputeBuildID() {
+  Note note = {0, false};
+  dl_iterate_phdr(FindBuildIDNote, &note);
+  if (note.found)
+    return note.hash;
+
+  struct stat st;
+  if (stat("/proc/self/exe", &st) != 0)
+    return 0;
+  uint64_t identity[] = {uint64_t(st.st_dev), uint64_t(st.st_ino),
+                         uint64_t(st.st_size), uint64_t(st.st_mtime)};
+  return Hash64(identity, sizeof(identity));
+}
+
+uint64_t
+wasm::BuildID() {
+  static const uint64_t id = ComputeBuildID();
+  return id;
+}
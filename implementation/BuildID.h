@@ -0,0 +1,32 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_BUILDID_H
+#define WEBASSEMBLY_IMPLEMENTATION_BUILDID_H
+
+#include <cstdint>
+
+namespace wasm {
+
+// Identify the build of the running executable, so that anything it caches
+// on disk can be invalidated when it is rebuilt. This is a hash of the
+// linker's build ID note where there is one, and otherwise of the
+// executable's identity and modification time.
+std::uint64_t BuildID();
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/BulkMemory.h"
+#include "implementation/Features.h"
+#include <cstring>
+#if WASM_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+using namespace std;
+using namespace wasm;
+
+namespace {
+
+struct Kernels {
+  void (*copy)(uint8_t* dst, const uint8_t* src, size_t size);
+  void (*fill)(uint8_t* dst, uint8_t value, size_t size);
+  const char* name;
+};
+
+} // namespace
+
+// Below this size, a call to the C library is as fast as anything.
+static const size_t minVectorSize = 256;
+
+static void
+CopyPortable(uint8_t* dst, const uint8_t* src, size_t size) {
+  memmove(dst, src, size);
+}
+
+static void
+FillPortable(uint8_t* dst, uint8_t value, size_t size) {
+  memset(dst, value, size);
+}
+
+#if WASM_HAVE_X86_SIMD
+
+// Stores of this size or more bypass the cache, since the data wouldn't fit
+// anyway and would only evict everything else.
+static const size_t streamSize = size_t(8) << 20;
+
+// The vector kernels, for a vector type V and its intrinsics. Unless the
+// ranges overlap, the first and last vectors are copied unaligned and the
+// rest with aligned stores. Overlapping copies move four vectors at a time,
+// loading all four before storing any, from whichever end keeps them from
+// reading bytes they've already overwritten; the remainder is left to the
+// C library.
+#define VECTOR_KERNELS(name, target, V, loadu, storeu, store, stream, set1,    \
+                       finish)                                                 \
+  static target void Copy##name(uint8_t* dst, const uint8_t* src,              \
+                                size_t size) {                                 \
+    const size_t w = sizeof(V);                                                \
+    if (size < minVectorSize) {                                                \
+      memmove(dst, src, size);                                                 \
+      return;                                                                  \
+    }                                                                          \
+    bool forward = uintptr_t(dst) - uintptr_t(src) >= size;                    \
+    if (forward && uintptr_t(src) - uintptr_t(dst) >= size) {                  \
+      V first = loadu((const V*)src);                                          \
+      V last = loadu((const V*)(src + size - w));                              \
+      size_t i = w - (uintptr_t(dst) & (w - 1));                               \
+      if (size >= streamSize) {                                                \
+        for (; i + w <= size; i += w)                                          \
+          stream((V*)(dst + i), loadu((const V*)(src + i)));                   \
+        _mm_sfence();                                                          \
+      } else {                                                                 \
+        for (; i + 4 * w <= size; i += 4 * w) {                                \
+          V a = loadu((const V*)(src + i));                                    \
+          V b = loadu((const V*)(src + i + w));                                \
+          V c = loadu((const V*)(src + i + 2 * w));                            \
+          V d = loadu((const V*)(src + i + 3 * w));                            \
+          store((V*)(dst + i), a);                                             \
+          store((V*)(dst + i + w), b);                                         \
+          store((V*)(dst + i + 2 * w), c);                                     \
+          store((V*)(dst + i + 3 * w), d);                                     \
+        }                                                                      \
+        for (; i + w <= size; i += w)                                          \
+          store((V*)(dst + i), loadu((const V*)(src + i)));                    \
+      }                                                                        \
+      storeu((V*)dst, first);                                                  \
+      storeu((V*)(dst + size - w), last);                                      \
+    } else if (forward) {                                                      \
+      size_t i = 0;                                                            \
+      for (; i + 4 * w <= size; i += 4 * w) {                                  \
+        V a = loadu((const V*)(src + i));                                      \
+        V b = loadu((const V*)(src + i + w));                                  \
+        V c = loadu((const V*)(src + i + 2 * w));                              \
+        V d = loadu((const V*)(src + i + 3 * w));                              \
+        storeu((V*)(dst + i), a);                                              \
+        storeu((V*)(dst + i + w), b);                                          \
+        storeu((V*)(dst + i + 2 * w), c);                                      \
+        storeu((V*)(dst + i + 3 * w), d);                                      \
+      }                                                                        \
+      memmove(dst + i, src + i, size - i);                                     \
+    } else {                                                                   \
+      size_t n = size;                                                         \
+      for (; n >= 4 * w; n -= 4 * w) {                                        \
+        V a = loadu((const V*)(src + n - 4 * w));                              \
+        V b = loadu((const V*)(src + n - 3 * w));                              \
+        V c = loadu((const V*)(src + n - 2 * w));                              \
+        V d = loadu((const V*)(src + n - w));                                  \
+        storeu((V*)(dst + n - 4 * w), a);                                      \
+        storeu((V*)(dst + n - 3 * w), b);                                      \
+        storeu((V*)(dst + n - 2 * w), c);                                      \
+        storeu((V*)(dst + n - w), d);                                          \
+      }                                                                        \
+      memmove(dst, src, n);                                                    \
+    }                                                                          \
+    finish;                                                                    \
+  }                                                                            \
+                                                                               \
+  static target void Fill##name(uint8_t* dst, uint8_t value, size_t size) {    \
+    const size_t w = sizeof(V);                                                \
+    if (size < minVectorSize) {                                                \
+      memset(dst, value, size);                                                \
+      return;                                                                  \
+    }                                                                          \
+    V v = set1(char(value));                                                   \
+    size_t i = w - (uintptr_t(dst) & (w - 1));                                 \
+    if (size >= streamSize) {                                                  \
+      for (; i + w <= size; i += w)                                            \
+        stream((V*)(dst + i), v);                                              \
+      _mm_sfence();                                                            \
+    } else {                                                                   \
+      for (; i + 4 * w <= size; i += 4 * w) {                                  \
+        store((V*)(dst + i), v);                                               \
+        store((V*)(dst + i + w), v);                                           \
+        store((V*)(dst + i + 2 * w), v);                                       \
+        store((V*)(dst + i + 3 * w), v);                                       \
+      }                                                                        \
+      for (; i + w <= size; i += w)                                            \
+        store((V*)(dst + i), v);                                               \
+    }                                                                          \
+    storeu((V*)dst, v);                                                        \
+    storeu((V*)(dst + size - w), v);                                           \
+    finish;                                                                    \
+  }
+
+VECTOR_KERNELS(Sse2, , __m128i, _mm_loadu_si128, _mm_storeu_si128,
+               _mm_store_si128, _mm_stream_si128, _mm_set1_epi8, (void)0)
+
+// Clearing the upper halves of the vector registers avoids a penalty for
+// mixing AVX and SSE code in the caller.
+VECTOR_KERNELS(Avx2, __attribute__((target("avx2"))), __m256i,
+               _mm256_loadu_si256, _mm256_storeu_si256, _mm256_store_si256,
+               _mm256_stream_si256, _mm256_set1_epi8, _mm256_zeroupper())
+
+#undef VECTOR_KERNELS
+
+#endif
+
+// __builtin_cpu_supports reads CPUID, and also checks that the OS saves the
+// AVX registers.
+static Kernels
+SelectKernels() {
+#if WASM_HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Kernels{CopyAvx2, FillAvx2, "avx2"};
+  if (__builtin_cpu_supports("sse2"))
+    return Kernels{CopySse2, FillSse2, "sse2"};
+#endif
+  return Kernels{CopyPortable, FillPortable, "portable"};
+}
+
+static const Kernels&
+Selected() {
+  static const Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+void
+wasm::BulkCopy(uint8_t* dst, const uint8_t* src, size_t size) {
+  Selected().copy(dst, src, size);
+}
+
+void
+wasm::BulkFill(uint8_t* dst, uint8_t value, size_t size) {
+  Selected().fill(dst, value, size);
+}
+
+const char*
+wasm::BulkKernelName() {
+  return Selected().name;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_BULKMEMORY_H
+#define WEBASSEMBLY_IMPLEMENTATION_BULKMEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wasm {
+
+// Kernels for linear memory's bulk operations. They move whole vectors at a
+// time, using the widest vector unit the host has; the choice is made with
+// CPUID on first use. The caller checks bounds.
+
+// Copy size bytes from src to dst, which may overlap, as memmove does.
+void BulkCopy(std::uint8_t* dst, const std::uint8_t* src, std::size_t size);
+
+// Set size bytes at dst to value.
+void BulkFill(std::uint8_t* dst, std::uint8_t value, std::size_t size);
+
+// The name of the kernels in use, for diagnostics.
+const char* BulkKernelName();
+
+} // namespace wasm
+
+#endif // include guard
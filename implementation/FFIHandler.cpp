@@ -15,7 +15,133 @@
  */
 
 #include "implementation/FFIHandler.h"
+#include "implementation/IOQueue.h"
+#include "semantics/Context.h"
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+using namespace std;
 using namespace wasm;
 
+namespace {
+
+struct Registry {
+  mutex lock;
+  unordered_set<FFIHandler*> handlers;
+};
+
+} // namespace
+
+static void FinishAll();
+
+// The live handlers. A trap outside a run, such as one from compiling a
+// routine up front, exits without unwinding, so they're finished by an exit
+// handler rather than their destructors. The registry is never destroyed, so
+// that it's still there when the exit handler runs.
+static Registry&
+Handlers() {
+  static Registry* registry = [] {
+    Registry* created = new Registry();
+    atexit(FinishAll);
+    return created;
+  }();
+  return *registry;
+}
+
+static void
+FinishAll() {
+  Registry& registry = Handlers();
+  lock_guard<mutex> hold(registry.lock);
+  for (FFIHandler* handler : registry.handlers)
+    handler->finish();
+}
+
+unsigned
+FFIHandler::arity(CallID callee) {
+  switch (callee) {
+    case CallID::write:
+    case CallID::read:
+      return 3;
+    case CallID::wait:
+      return 1;
+    case CallID::fail:
+    case CallID::flush:
+      return 0;
+  }
+  return 0;
+}
+
+FFIHandler::FFIHandler(Backend backend)
+  : backend_(backend) {
+  Registry& registry = Handlers();
+  lock_guard<mutex> hold(registry.lock);
+  registry.handlers.insert(this);
+}
+
+FFIHandler::~FFIHandler() {
+  {
+    Registry& registry = Handlers();
+    lock_guard<mutex> hold(registry.lock);
+    registry.handlers.erase(this);
+  }
+  finish();
+}
+
+// A host without io_uring gets buffered I/O, even if it asked for io_uring.
+IOQueue&
+FFIHandler::queue() {
+  if (!queue_) {
+    if (backend_ != Backend::buffered)
+      queue_ = CreateUringIOQueue();
+    if (!queue_)
+      queue_ = CreateBufferedIOQueue();
+  }
+  return *queue_;
+}
+
 void
-FFIHandler::call(CallID callee, Context* context) {}
+FFIHandler::call(CallID callee, Context* context) {
+  switch (callee) {
+    case CallID::write: {
+      int32_t n = context->pop_int32();
+      int32_t p = context->pop_int32();
+      int32_t fd = context->pop_int32();
+      const uint8_t* data = context->heap_range(p, n);
+      context->push_int32(queue().write(fd, data, uint32_t(n)));
+      break;
+    }
+    case CallID::read: {
+      int32_t n = context->pop_int32();
+      int32_t p = context->pop_int32();
+      int32_t fd = context->pop_int32();
+      uint8_t* data = context->heap_range(p, n);
+      context->push_int32(queue().read(fd, data, uint32_t(n)));
+      break;
+    }
+    case CallID::fail:
+      finish();
+      context->trap("program failed");
+      context->push_int32(0);
+      break;
+    case CallID::wait: {
+      int32_t ticket = context->pop_int32();
+      context->push_int32(queue().wait(ticket));
+      break;
+    }
+    case CallID::flush:
+      context->push_int32(queue().flush());
+      break;
+  }
+}
+
+void
+FFIHandler::finish() {
+  if (queue_)
+    queue_->close();
+}
+
+const char*
+FFIHandler::backendName() {
+  return queue().name();
+}
@@ -17,19 +17,66 @@
 #ifndef WEBASSEMBLY_IMPLEMENTATION_FFIHANDLER_H
 #define WEBASSEMBLY_IMPLEMENTATION_FFIHANDLER_H
 
+#include <memory>
+
 namespace wasm {
 
 class Context;
+class IOQueue;
 
+// The host functions a program calls with CallFFI. Each takes int32
+// operands and returns an int32, as a negative errno value on failure:
+//
+//   write(fd, p, n) queues a write of memory [p, p + n) to fd, returning 0.
+//   read(fd, p, n) starts a read of up to n bytes from fd into memory at p,
+//     returning a ticket for wait.
+//   fail() flushes and traps.
+//   wait(ticket) returns the result of a read once it's done.
+//   flush() makes the queued writes, returning the first error since the
+//     last flush.
+//
+// Memory is neither copied nor checked beyond its range, so the program must
+// leave a write's bytes alone until the next flush, and a read's until it's
+// waited for. Queued writes are also made when the handler finishes, which
+// is when the program's run ends, even by a trap, before its memory is
+// released, or when the host process exits, if it traps outside a run.
 class FFIHandler {
 public:
   enum class CallID {
     write,
     read,
     fail,
+    wait,
+    flush,
   };
+  static const unsigned numCalls = 5;
+
+  // The number of operands callee takes.
+  static unsigned arity(CallID callee);
+
+  // Where I/O is performed. Automatic uses io_uring where the host allows
+  // it, and otherwise buffered I/O; see IOQueue.
+  enum class Backend { automatic, uring, buffered };
+
+private:
+  Backend backend_;
+  // Created by the first call.
+  std::unique_ptr<IOQueue> queue_;
+
+  IOQueue& queue();
 
+public:
+  explicit FFIHandler(Backend backend = Backend::automatic);
+  ~FFIHandler();
+
+  // Pop callee's operands from context's operand stack and push its result.
   void call(CallID callee, Context* context);
+
+  // Make the queued writes and cancel outstanding reads.
+  void finish();
+
+  // The name of the I/O backend in use, for diagnostics.
+  const char* backendName();
 };
 
 } // namespace wasm
@@ -14,9 +14,76 @@
  * limitations under the License.
  */
 
-#ifndef WEBASSEMBLY_IMPLEMENTATION_ROUTINE_H
-#define WEBASSEMBLY_IMPLEMENTATION_ROUTINE_H
+#ifndef WEBASSEMBLY_IMPLEMENTATION_FEATURES_H
+#define WEBASSEMBLY_IMPLEMENTATION_FEATURES_H
 
-namespace wasm {} // namespace wasm
+// Computed goto ("labels as values") is a GNU extension supported by GCC and
+// Clang. The interpreter uses it for direct-threaded dispatch when available.
+#if defined(__GNUC__)
+#define WASM_HAVE_COMPUTED_GOTO 1
+#else
+#define WASM_HAVE_COMPUTED_GOTO 0
+#endif
+
+// memfd_create, which creates anonymous files for snapshots, is
+// Linux-specific.
+#if defined(__linux__)
+#define WASM_HAVE_MEMFD 1
+#else
+#define WASM_HAVE_MEMFD 0
+#endif
+
+// makecontext and swapcontext, which run the scheduler's processes on stacks
+// of their own, are removed from POSIX but remain in glibc.
+#if defined(__linux__)
+#define WASM_HAVE_UCONTEXT 1
+#else
+#define WASM_HAVE_UCONTEXT 0
+#endif
+
+// pthread_getattr_np, which finds the bounds of a thread's stack, is a GNU
+// extension, available on Linux.
+#if defined(__linux__)
+#define WASM_HAVE_PTHREAD_GETATTR_NP 1
+#else
+#define WASM_HAVE_PTHREAD_GETATTR_NP 0
+#endif
+
+// The baseline JIT emits x86-64 code using the System V calling convention,
+// and maps it executable with mmap.
+#if defined(__x86_64__) && defined(__linux__)
+#define WASM_HAVE_JIT 1
+#else
+#define WASM_HAVE_JIT 0
+#endif
+
+// The bulk memory kernels use SSE2 and AVX2 intrinsics in functions compiled
+// for those targets, and choose between them at run time with
+// __builtin_cpu_supports, which GCC and Clang provide on x86.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define WASM_HAVE_X86_SIMD 1
+#else
+#define WASM_HAVE_X86_SIMD 0
+#endif
+
+// io_uring, which guest I/O uses when the kernel allows it, is
+// Linux-specific. It's used through its system calls, so it only needs the
+// kernel's header.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WASM_HAVE_IO_URING 1
+#endif
+#endif
+#ifndef WASM_HAVE_IO_URING
+#define WASM_HAVE_IO_URING 0
+#endif
+
+// The sampler's timer measures the CPU time of one thread and signals that
+// thread, using Linux's SIGEV_THREAD_ID.
+#if defined(__linux__)
+#define WASM_HAVE_SAMPLER 1
+#else
+#define WASM_HAVE_SAMPLER 0
+#endif
 
 #endif // include guard
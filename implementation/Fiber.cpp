@@ -0,0 +1,171 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/Fiber.h"
+#include "implementation/Features.h"
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+#if WASM_HAVE_PTHREAD_GETATTR_NP
+#include <pthread.h>
+#endif
+#if WASM_HAVE_UCONTEXT
+#include <ucontext.h>
+#endif
+using namespace std;
+using namespace wasm;
+
+// The thread's stack doesn't move, so it's found once.
+static const void*
+ThreadStackLimit() {
+#if WASM_HAVE_PTHREAD_GETATTR_NP
+  static thread_local const void* limit = nullptr;
+  if (!limit) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      void* address;
+      size_t size;
+      if (pthread_attr_getstack(&attr, &address, &size) == 0)
+        limit = address;
+      pthread_attr_destroy(&attr);
+    }
+  }
+  return limit;
+#else
+  return nullptr;
+#endif
+}
+
+#if WASM_HAVE_UCONTEXT
+
+struct Fiber::State {
+  void* mapping;
+  size_t mappingSize;
+  // The lowest address of the stack, just above its guard page.
+  const void* stackLimit;
+  ucontext_t fiber;
+  ucontext_t resumer;
+  void (*body)(void*);
+  void* arg;
+  bool finished;
+
+  // makecontext passes only int arguments, so the state's address arrives in
+  // two halves.
+  static void Start(unsigned hi, unsigned lo) {
+    State* state =
+      reinterpret_cast<State*>((uintptr_t(hi) << 32) | uintptr_t(lo));
+    state->body(state->arg);
+    state->finished = true;
+    // Returning continues at fiber.uc_link, which is the resumer.
+  }
+};
+
+// The limit of the stack of the fiber running on this thread, if any.
+static thread_local const void* runningStackLimit = nullptr;
+
+Fiber::Fiber() {}
+
+Fiber::~Fiber() {
+  if (state_)
+    munmap(state_->mapping, state_->mappingSize);
+}
+
+bool
+Fiber::create(size_t stackSize, void (*body)(void*), void* arg) {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t size = (stackSize + pageSize - 1) & ~(pageSize - 1);
+  void* mapping =
+    mmap(nullptr, size + pageSize, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  if (mprotect(mapping, pageSize, PROT_NONE) != 0) {
+    munmap(mapping, size + pageSize);
+    return false;
+  }
+
+  unique_ptr<State> state(new State());
+  state->mapping = mapping;
+  state->mappingSize = size + pageSize;
+  state->stackLimit = static_cast<uint8_t*>(mapping) + pageSize;
+  state->body = body;
+  state->arg = arg;
+  state->finished = false;
+  if (getcontext(&state->fiber) != 0) {
+    munmap(mapping, size + pageSize);
+    return false;
+  }
+  state->fiber.uc_stack.ss_sp = static_cast<uint8_t*>(mapping) + pageSize;
+  state->fiber.uc_stack.ss_size = size;
+  state->fiber.uc_link = &state->resumer;
+  uintptr_t address = uintptr_t(state.get());
+  makecontext(&state->fiber, reinterpret_cast<void (*)()>(State::Start), 2,
+              unsigned(address >> 32), unsigned(address));
+
+  if (state_)
+    munmap(state_->mapping, state_->mappingSize);
+  state_ = move(state);
+  return true;
+}
+
+// A fiber may resume another, so the resumer's limit is put back when the
+// fiber returns to it.
+bool
+Fiber::resume() {
+  const void* resumerStackLimit = runningStackLimit;
+  runningStackLimit = state_->stackLimit;
+  swapcontext(&state_->resumer, &state_->fiber);
+  runningStackLimit = resumerStackLimit;
+  return state_->finished;
+}
+
+void
+Fiber::suspend() {
+  swapcontext(&state_->fiber, &state_->resumer);
+}
+
+const void*
+Fiber::StackLimit() {
+  return runningStackLimit ? runningStackLimit : ThreadStackLimit();
+}
+
+#else
+
+struct Fiber::State {};
+
+Fiber::Fiber() {}
+
+Fiber::~Fiber() {}
+
+bool
+Fiber::create(size_t, void (*)(void*), void*) {
+  return false;
+}
+
+bool
+Fiber::resume() {
+  return true;
+}
+
+void
+Fiber::suspend() {}
+
+const void*
+Fiber::StackLimit() {
+  return ThreadStackLimit();
+}
+
+#endif
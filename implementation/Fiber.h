@@ -0,0 +1,60 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_FIBER_H
+#define WEBASSEMBLY_IMPLEMENTATION_FIBER_H
+
+#include <cstddef>
+#include <memory>
+
+namespace wasm {
+
+// A function running on a stack of its own, which can suspend itself partway
+// through and be resumed later, possibly by another thread. A fiber which is
+// destroyed while suspended is simply abandoned: nothing on its stack is
+// unwound.
+class Fiber {
+  struct State;
+  std::unique_ptr<State> state_;
+
+public:
+  Fiber();
+  ~Fiber();
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  // Map a stack of stackSize bytes, committed as it's touched, with a guard
+  // page below it, on which the first resume calls body(arg). Returns false
+  // if the stack can't be mapped or the host doesn't support fibers.
+  bool create(std::size_t stackSize, void (*body)(void*), void* arg);
+
+  // Run the fiber on the calling thread until it suspends or body returns.
+  // Returns true once body has returned.
+  bool resume();
+
+  // Called on the fiber, return to the resume which is running it.
+  void suspend();
+
+  // The lowest address that the stack the caller is running on, the running
+  // fiber's or else its thread's, may grow down to. Returns null if it can't
+  // be found.
+  static const void* StackLimit();
+};
+
+} // namespace wasm
+
+#endif // include guard
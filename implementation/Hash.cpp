@@ -0,0 +1,59 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/Hash.h"
+#include <cstring>
+using namespace std;
+using namespace wasm;
+
+static const uint64_t k1 = 0x87c37b91114253d5ULL;
+static const uint64_t k2 = 0x4cf5ad432745937fULL;
+
+static inline uint64_t
+Rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// The final mix of MurmurHash3, which makes every output bit depend on every
+// input bit.
+static inline uint64_t
+Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t
+wasm::Hash64(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t h = seed ^ (size * k2);
+
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    h ^= Rotl(word * k1, 31) * k2;
+    h = Rotl(h, 27) * 5 + 0x52dce729;
+  }
+
+  uint64_t tail = 0;
+  memcpy(&tail, bytes + i, size - i);
+  h ^= Rotl(tail * k1, 31) * k2;
+  return Mix(h);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_HASH_H
+#define WEBASSEMBLY_IMPLEMENTATION_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wasm {
+
+// A fast non-cryptographic 64-bit hash, for keying caches by content. It
+// reads eight bytes at a time, so hashing is limited by memory bandwidth
+// rather than by a per-byte loop.
+std::uint64_t Hash64(const void* data, std::size_t size,
+                     std::uint64_t seed = 0);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,588 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/IOQueue.h"
+#include "implementation/Features.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <sys/uio.h>
+#include <unistd.h>
+#if WASM_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+using namespace std;
+using namespace wasm;
+
+// Writes this small are copied into their batch, where consecutive ones to a
+// descriptor share an iovec; larger ones are written from the caller's
+// buffer.
+static const size_t copiedWriteSize = 512;
+static const size_t batchBufferSize = size_t(64) << 10;
+// A descriptor's writes in a batch are made by a single writev.
+static const size_t maxIovecs = IOV_MAX;
+static const size_t maxFiles = 16;
+// A single read transfers at most this much, so that its count fits in its
+// result.
+static const size_t maxReadSize = INT32_MAX;
+
+namespace {
+
+// Writes queued to be made together, grouped by descriptor.
+class Batch {
+public:
+  struct File {
+    int fd;
+    std::vector<iovec> iovecs;
+    // The first iovec not yet completely written.
+    size_t next;
+  };
+
+private:
+  vector<File> files_;
+  unique_ptr<uint8_t[]> buffer_;
+  size_t used_;
+
+public:
+  Batch()
+    : buffer_(new uint8_t[batchBufferSize])
+    , used_(0) {}
+
+  bool empty() const { return files_.empty(); }
+  size_t numFiles() const { return files_.size(); }
+  File& file(size_t index) { return files_[index]; }
+
+  // Add a write, or return false if the batch is full.
+  bool add(int fd, const uint8_t* data, size_t size);
+
+  void clear() {
+    files_.clear();
+    used_ = 0;
+  }
+};
+
+} // namespace
+
+bool
+Batch::add(int fd, const uint8_t* data, size_t size) {
+  bool copied = size <= copiedWriteSize;
+  if (copied && size > batchBufferSize - used_)
+    return false;
+
+  File* file = nullptr;
+  for (File& candidate : files_)
+    if (candidate.fd == fd)
+      file = &candidate;
+  if (!file && files_.size() == maxFiles)
+    return false;
+
+  uint8_t* copy = buffer_.get() + used_;
+  iovec* last = file && !file->iovecs.empty() ? &file->iovecs.back() : nullptr;
+  bool extends = copied && last &&
+                 static_cast<uint8_t*>(last->iov_base) + last->iov_len == copy;
+  if (!extends && file && file->iovecs.size() == maxIovecs)
+    return false;
+
+  if (!file) {
+    files_.push_back(File{fd, vector<iovec>(), 0});
+    file = &files_.back();
+  }
+  if (copied) {
+    memcpy(copy, data, size);
+    used_ += size;
+    data = copy;
+  }
+  if (extends)
+    last->iov_len += size;
+  else
+    file->iovecs.push_back(iovec{const_cast<uint8_t*>(data), size});
+  return true;
+}
+
+// Account for n more bytes of file having been written. Returns true if
+// that's all of them.
+static bool
+Consume(Batch::File& file, size_t n) {
+  vector<iovec>& iovecs = file.iovecs;
+  while (file.next < iovecs.size() && n >= iovecs[file.next].iov_len)
+    n -= iovecs[file.next++].iov_len;
+  if (file.next == iovecs.size())
+    return true;
+  iovec& partial = iovecs[file.next];
+  partial.iov_base = static_cast<uint8_t*>(partial.iov_base) + n;
+  partial.iov_len -= n;
+  return false;
+}
+
+namespace {
+
+class BufferedIOQueue final : public IOQueue {
+  Batch batch_;
+  int error_;
+  int32_t nextTicket_;
+  unordered_map<int32_t, int32_t> results_;
+
+  void writeBatch();
+
+public:
+  BufferedIOQueue()
+    : error_(0)
+    , nextTicket_(0) {}
+
+  int write(int fd, const uint8_t* data, size_t size) override;
+  int32_t read(int fd, uint8_t* data, size_t size) override;
+  int32_t wait(int32_t ticket) override;
+  int flush() override;
+  void close() override;
+  const char* name() const override { return "buffered"; }
+};
+
+} // namespace
+
+// Only the first error is kept; the rest of that descriptor's writes are
+// dropped.
+void
+BufferedIOQueue::writeBatch() {
+  for (size_t i = 0; i < batch_.numFiles(); ++i) {
+    Batch::File& file = batch_.file(i);
+    for (;;) {
+      ssize_t n = writev(file.fd, file.iovecs.data() + file.next,
+                         int(file.iovecs.size() - file.next));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        if (error_ == 0)
+          error_ = n < 0 ? -errno : -EIO;
+        break;
+      }
+      if (Consume(file, n))
+        break;
+    }
+  }
+  batch_.clear();
+}
+
+int
+BufferedIOQueue::write(int fd, const uint8_t* data, size_t size) {
+  if (size == 0)
+    return 0;
+  if (!batch_.add(fd, data, size)) {
+    writeBatch();
+    batch_.add(fd, data, size);
+  }
+  return 0;
+}
+
+int32_t
+BufferedIOQueue::read(int fd, uint8_t* data, size_t size) {
+  writeBatch();
+  ssize_t n;
+  do
+    n = ::read(fd, data, min(size, maxReadSize));
+  while (n < 0 && errno == EINTR);
+  int32_t ticket = nextTicket_;
+  nextTicket_ = (nextTicket_ + 1) & INT32_MAX;
+  results_[ticket] = n < 0 ? -errno : int32_t(n);
+  return ticket;
+}
+
+int32_t
+BufferedIOQueue::wait(int32_t ticket) {
+  auto it = results_.find(ticket);
+  if (it == results_.end())
+    return -EINVAL;
+  int32_t result = it->second;
+  results_.erase(it);
+  return result;
+}
+
+int
+BufferedIOQueue::flush() {
+  writeBatch();
+  int error = error_;
+  error_ = 0;
+  return error;
+}
+
+void
+BufferedIOQueue::close() {
+  flush();
+  results_.clear();
+}
+
+unique_ptr<IOQueue>
+wasm::CreateBufferedIOQueue() {
+  return unique_ptr<IOQueue>(new BufferedIOQueue());
+}
+
+#if WASM_HAVE_IO_URING
+
+static const unsigned ringEntries = 256;
+// Enough that the completion queue, twice the size of the submission queue,
+// can't overflow with every read and its cancellation outstanding.
+static const size_t maxReads = 64;
+
+// The high half of a request's user_data says what it is; the low half is a
+// read's ticket or a write's file index.
+static const uint64_t readTag = 0;
+static const uint64_t writeTag = uint64_t(1) << 32;
+static const uint64_t cancelTag = uint64_t(2) << 32;
+
+namespace {
+
+// Writes are made from one batch while the next fills. The batch being
+// written has at most one request per descriptor in flight, resubmitted
+// after a short write, so that its writes stay in order.
+class UringIOQueue final : public IOQueue {
+  int ring_;
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  io_uring_sqe* sqes_;
+  size_t sqesSize_;
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned* sqArray_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  io_uring_cqe* cqes_;
+  unsigned cqMask_;
+  unsigned unsubmitted_;
+
+  Batch batches_[2];
+  Batch* filling_;
+  Batch* writing_;
+  size_t writesInFlight_;
+  int error_;
+  int32_t nextTicket_;
+  unordered_set<int32_t> reading_;
+  unordered_map<int32_t, int32_t> results_;
+
+  io_uring_sqe* sqe();
+  int enter(unsigned minComplete);
+  void reap();
+  void complete(const io_uring_cqe& cqe);
+  void submitWrite(size_t index);
+  void startBatch();
+  void finishWrites();
+
+public:
+  UringIOQueue()
+    : ring_(-1)
+    , sqRing_(nullptr)
+    , sqRingSize_(0)
+    , cqRing_(nullptr)
+    , cqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , unsubmitted_(0)
+    , filling_(&batches_[0])
+    , writing_(&batches_[1])
+    , writesInFlight_(0)
+    , error_(0)
+    , nextTicket_(0) {}
+  ~UringIOQueue();
+
+  bool setup();
+
+  int write(int fd, const uint8_t* data, size_t size) override;
+  int32_t read(int fd, uint8_t* data, size_t size) override;
+  int32_t wait(int32_t ticket) override;
+  int flush() override;
+  void close() override;
+  const char* name() const override { return "io_uring"; }
+};
+
+} // namespace
+
+bool
+UringIOQueue::setup() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_ = syscall(__NR_io_uring_setup, ringEntries, &params);
+  if (ring_ < 0)
+    return false;
+  // Reads and writes use the descriptor's position, as read and write do.
+  if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    return false;
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single)
+    sqRingSize_ = cqRingSize_ = max(sqRingSize_, cqRingSize_);
+
+  void* sq = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED)
+    return false;
+  sqRing_ = sq;
+  void* cq = sq;
+  if (!single) {
+    cq = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED)
+      return false;
+  }
+  cqRing_ = cq;
+  sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return false;
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  uint8_t* sqBytes = static_cast<uint8_t*>(sq);
+  sqHead_ = reinterpret_cast<unsigned*>(sqBytes + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned*>(sqBytes + params.sq_off.tail);
+  sqArray_ = reinterpret_cast<unsigned*>(sqBytes + params.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned*>(sqBytes + params.sq_off.ring_mask);
+  sqEntries_ = params.sq_entries;
+  uint8_t* cqBytes = static_cast<uint8_t*>(cq);
+  cqHead_ = reinterpret_cast<unsigned*>(cqBytes + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(cqBytes + params.cq_off.tail);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cqBytes + params.cq_off.cqes);
+  cqMask_ = *reinterpret_cast<unsigned*>(cqBytes + params.cq_off.ring_mask);
+  return true;
+}
+
+UringIOQueue::~UringIOQueue() {
+  if (sqes_)
+    close();
+  if (sqes_)
+    munmap(sqes_, sqesSize_);
+  if (cqRing_ && cqRing_ != sqRing_)
+    munmap(cqRing_, cqRingSize_);
+  if (sqRing_)
+    munmap(sqRing_, sqRingSize_);
+  if (ring_ >= 0)
+    ::close(ring_);
+}
+
+// Return a cleared submission entry, to be submitted by the next enter. The
+// kernel takes entries as they're submitted, so a full queue is emptied by
+// submitting it.
+io_uring_sqe*
+UringIOQueue::sqe() {
+  unsigned tail = *sqTail_;
+  if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+    enter(0);
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_)
+      return nullptr;
+  }
+  unsigned index = tail & sqMask_;
+  io_uring_sqe* entry = &sqes_[index];
+  memset(entry, 0, sizeof(*entry));
+  sqArray_[index] = index;
+  __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+  ++unsubmitted_;
+  return entry;
+}
+
+// Submit any new entries and wait for at least minComplete completions.
+int
+UringIOQueue::enter(unsigned minComplete) {
+  for (;;) {
+    long n = syscall(__NR_io_uring_enter, ring_, unsubmitted_, minComplete,
+                     minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    if (n >= 0) {
+      unsubmitted_ -= unsigned(n);
+      return 0;
+    }
+    if (errno == EINTR)
+      continue;
+    // The completion queue is full; make room.
+    if (errno == EBUSY || errno == EAGAIN) {
+      reap();
+      continue;
+    }
+    return -errno;
+  }
+}
+
+void
+UringIOQueue::reap() {
+  unsigned head = *cqHead_;
+  unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head)
+    complete(cqes_[head & cqMask_]);
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void
+UringIOQueue::complete(const io_uring_cqe& cqe) {
+  uint64_t tag = cqe.user_data & ~uint64_t(UINT32_MAX);
+  uint32_t index = uint32_t(cqe.user_data);
+  if (tag == readTag) {
+    reading_.erase(int32_t(index));
+    results_[int32_t(index)] = cqe.res;
+  } else if (tag == writeTag) {
+    Batch::File& file = writing_->file(index);
+    if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+      submitWrite(index);
+      return;
+    }
+    if (cqe.res <= 0) {
+      if (error_ == 0)
+        error_ = cqe.res < 0 ? cqe.res : -EIO;
+    } else if (!Consume(file, cqe.res)) {
+      submitWrite(index);
+      return;
+    }
+    --writesInFlight_;
+  }
+}
+
+void
+UringIOQueue::submitWrite(size_t index) {
+  Batch::File& file = writing_->file(index);
+  io_uring_sqe* entry = sqe();
+  if (!entry) {
+    if (error_ == 0)
+      error_ = -EBUSY;
+    --writesInFlight_;
+    return;
+  }
+  entry->opcode = IORING_OP_WRITEV;
+  entry->fd = file.fd;
+  entry->addr = reinterpret_cast<uint64_t>(file.iovecs.data() + file.next);
+  entry->len = unsigned(file.iovecs.size() - file.next);
+  entry->off = uint64_t(-1);
+  entry->user_data = writeTag | index;
+}
+
+// Start writing the filling batch, once the last one is done.
+void
+UringIOQueue::startBatch() {
+  finishWrites();
+  swap(filling_, writing_);
+  writesInFlight_ = writing_->numFiles();
+  for (size_t i = 0; i < writing_->numFiles(); ++i)
+    submitWrite(i);
+  enter(0);
+}
+
+void
+UringIOQueue::finishWrites() {
+  while (writesInFlight_ > 0) {
+    if (enter(1) != 0) {
+      if (error_ == 0)
+        error_ = -EIO;
+      break;
+    }
+    reap();
+  }
+  writing_->clear();
+}
+
+int
+UringIOQueue::write(int fd, const uint8_t* data, size_t size) {
+  if (size == 0)
+    return 0;
+  if (!filling_->add(fd, data, size)) {
+    startBatch();
+    filling_->add(fd, data, size);
+  }
+  return 0;
+}
+
+int32_t
+UringIOQueue::read(int fd, uint8_t* data, size_t size) {
+  if (reading_.size() >= maxReads)
+    return -EAGAIN;
+  if (!filling_->empty())
+    startBatch();
+  io_uring_sqe* entry = sqe();
+  if (!entry)
+    return -EAGAIN;
+  int32_t ticket = nextTicket_;
+  nextTicket_ = (nextTicket_ + 1) & INT32_MAX;
+  entry->opcode = IORING_OP_READ;
+  entry->fd = fd;
+  entry->addr = reinterpret_cast<uint64_t>(data);
+  entry->len = unsigned(min(size, maxReadSize));
+  entry->off = uint64_t(-1);
+  entry->user_data = readTag | uint32_t(ticket);
+  reading_.insert(ticket);
+  enter(0);
+  return ticket;
+}
+
+int32_t
+UringIOQueue::wait(int32_t ticket) {
+  while (reading_.count(ticket)) {
+    if (enter(1) != 0)
+      return -EIO;
+    reap();
+  }
+  auto it = results_.find(ticket);
+  if (it == results_.end())
+    return -EINVAL;
+  int32_t result = it->second;
+  results_.erase(it);
+  return result;
+}
+
+int
+UringIOQueue::flush() {
+  if (!filling_->empty())
+    startBatch();
+  finishWrites();
+  int error = error_;
+  error_ = 0;
+  return error;
+}
+
+void
+UringIOQueue::close() {
+  flush();
+  for (int32_t ticket : reading_) {
+    io_uring_sqe* entry = sqe();
+    if (!entry)
+      break;
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = readTag | uint32_t(ticket);
+    entry->user_data = cancelTag;
+  }
+  while (!reading_.empty()) {
+    if (enter(1) != 0)
+      break;
+    reap();
+  }
+  results_.clear();
+}
+
+#endif
+
+unique_ptr<IOQueue>
+wasm::CreateUringIOQueue() {
+#if WASM_HAVE_IO_URING
+  unique_ptr<UringIOQueue> queue(new UringIOQueue());
+  if (queue->setup())
+    return unique_ptr<IOQueue>(queue.release());
+#endif
+  return nullptr;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_IOQUEUE_H
+#define WEBASSEMBLY_IMPLEMENTATION_IOQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace wasm {
+
+// Reads and writes on the host's file descriptors, performed directly on the
+// caller's buffers, which are left alone until the operation completes: a
+// write's until the next flush, a read's until it's waited for. Writes are
+// queued and made in batches. Those to one descriptor are made in order, but
+// writes to different descriptors, and reads, aren't ordered with each
+// other, except that a read is only started after the writes queued before
+// it.
+//
+// Errors are returned as negative errno values.
+class IOQueue {
+public:
+  virtual ~IOQueue() {}
+
+  // Queue a write of size bytes at data to fd. Returns zero; errors in
+  // writing are reported by flush.
+  virtual int write(int fd, const std::uint8_t* data, std::size_t size) = 0;
+
+  // Start a read of up to size bytes from fd into data. Returns a
+  // nonnegative ticket to wait for, or an error if it can't be started.
+  virtual std::int32_t read(int fd, std::uint8_t* data, std::size_t size) = 0;
+
+  // Wait for the read with the given ticket, returning the number of bytes
+  // read or its error. Each ticket may be waited for once.
+  virtual std::int32_t wait(std::int32_t ticket) = 0;
+
+  // Make every queued write, waiting until they're done. Returns zero, or
+  // the first error since the last flush.
+  virtual int flush() = 0;
+
+  // Flush, and cancel outstanding reads, waiting until the host no longer
+  // refers to any buffer.
+  virtual void close() = 0;
+
+  // The name of the backend, for diagnostics.
+  virtual const char* name() const = 0;
+};
+
+// Make batches of writes with writev, one system call per descriptor, and
+// reads with read, each as soon as it's started.
+std::unique_ptr<IOQueue> CreateBufferedIOQueue();
+
+// Submit batches of writes and reads to an io_uring, so that the caller
+// continues while they're in progress. Returns null if the host doesn't
+// provide io_uring or doesn't allow it.
+std::unique_ptr<IOQueue> CreateUringIOQueue();
+
+} // namespace wasm
+
+#endif // include guard
@@ -16,61 +16,116 @@
 
 #include "implementation/NaNBits.h"
 #include <cstring>
+#include <random>
 using namespace std;
 using namespace wasm;
 
-NaNBits::NaNBits(Kind kind)
+// The result is always a quiet NaN, so a zero payload doesn't make it an
+// infinity.
+static const uint32_t quietFloat32 = UINT32_C(0x7FC00000);
+static const uint64_t quietFloat64 = UINT64_C(0x7FF8000000000000);
+
+NaNBits::NaNBits(Kind kind, bool propagating)
   : kind_(kind)
-  , randEngine_(randDev_()) {}
+  , propagating_(propagating)
+  , state_(0)
+  , spare_(0)
+  , haveSpare_(false) {
+  // Only Random mode uses the generator, so only it pays for seeding.
+  if (kind == Kind::Random) {
+    random_device device;
+    state_ = uint64_t(device()) << 32 | device();
+    if (state_ == 0)
+      state_ = 1;
+  }
 
-float
-NaNBits::getFloat32() {
-  uint32_t x = 0;
-  switch (kind_) {
+  static const Float32Fn float32s[3][2] = {
+    {Float32<Kind::Canonical, false>, Float32<Kind::Canonical, true>},
+    {Float32<Kind::Inverse, false>, Float32<Kind::Inverse, true>},
+    {Float32<Kind::Random, false>, Float32<Kind::Random, true>},
+  };
+  static const Float64Fn float64s[3][2] = {
+    {Float64<Kind::Canonical, false>, Float64<Kind::Canonical, true>},
+    {Float64<Kind::Inverse, false>, Float64<Kind::Inverse, true>},
+    {Float64<Kind::Random, false>, Float64<Kind::Random, true>},
+  };
+  float32_ = float32s[size_t(kind)][propagating];
+  float64_ = float64s[size_t(kind)][propagating];
+}
+
+// xorshift64*: a few cycles a step, and plenty random for NaN payloads.
+uint64_t
+NaNBits::random64() {
+  state_ ^= state_ >> 12;
+  state_ ^= state_ << 25;
+  state_ ^= state_ >> 27;
+  return state_ * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+uint32_t
+NaNBits::random32() {
+  if (haveSpare_) {
+    haveSpare_ = false;
+    return spare_;
+  }
+  uint64_t x = random64();
+  spare_ = uint32_t(x);
+  haveSpare_ = true;
+  return uint32_t(x >> 32);
+}
+
+template <NaNBits::Kind K>
+uint32_t
+NaNBits::bits32() {
+  switch (K) {
     case Kind::Canonical:
-      break;
+      return quietFloat32;
     case Kind::Inverse:
-      x = ~x;
-      break;
+      return ~UINT32_C(0);
     case Kind::Random:
-      x = uint32_t(randDist_(randEngine_));
-      break;
+      return random32() | quietFloat32;
   }
-  x |= UINT32_C(0x7F800000);
-  float f;
-  memcpy(&f, &x, sizeof(f));
-  return f;
 }
 
-double
-NaNBits::getFloat64() {
-  uint64_t x = 0;
-  switch (kind_) {
+template <NaNBits::Kind K>
+uint64_t
+NaNBits::bits64() {
+  switch (K) {
     case Kind::Canonical:
-      break;
+      return quietFloat64;
     case Kind::Inverse:
-      x = ~x;
-      break;
+      return ~UINT64_C(0);
     case Kind::Random:
-      x = randDist_(randEngine_);
-      break;
+      return random64() | quietFloat64;
   }
-  x |= UINT64_C(0x7ff0000000000000);
-  double d;
-  memcpy(&d, &x, sizeof(d));
-  return d;
 }
 
+template <NaNBits::Kind K, bool Propagating>
 float
-NaNBits::transformFloat32(float old) {
-  if (propagating_)
-    return old;
-  return getFloat32();
+NaNBits::Float32(NaNBits& self, float l, float r) {
+  if (Propagating) {
+    if (l != l)
+      return l;
+    if (r != r)
+      return r;
+  }
+  uint32_t x = self.bits32<K>();
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
 }
 
+template <NaNBits::Kind K, bool Propagating>
 double
-NaNBits::transformFloat64(double old) {
-  if (propagating_)
-    return old;
-  return getFloat64();
+NaNBits::Float64(NaNBits& self, double l, double r) {
+  if (Propagating) {
+    if (l != l)
+      return l;
+    if (r != r)
+      return r;
+  }
+  uint64_t x = self.bits64<K>();
+  double d;
+  memcpy(&d, &x, sizeof(d));
+  return d;
 }
@@ -17,10 +17,15 @@
 #ifndef WEBASSEMBLY_IMPLEMENTATION_NANBITS_H
 #define WEBASSEMBLY_IMPLEMENTATION_NANBITS_H
 
-#include <random>
+#include <cstdint>
 
 namespace wasm {
 
+// Chooses the bits of NaNs produced by float operators. The policy is fixed
+// when the object is constructed, which selects functions specialized for it,
+// so choosing bits doesn't test the policy again. In Random mode, bits come
+// from a xorshift generator, each step of which yields one float64 NaN or two
+// float32 NaNs.
 class NaNBits {
 public:
   enum class Kind {
@@ -30,20 +35,42 @@ public:
   };
 
 private:
+  typedef float (*Float32Fn)(NaNBits& self, float l, float r);
+  typedef double (*Float64Fn)(NaNBits& self, double l, double r);
+
   Kind kind_;
+  // Whether a NaN operand's bits are passed on to the result, rather than
+  // replaced according to kind_.
   bool propagating_;
-  std::random_device randDev_;
-  std::default_random_engine randEngine_;
-  std::uniform_int_distribution<uint64_t> randDist_;
+  Float32Fn float32_;
+  Float64Fn float64_;
+  std::uint64_t state_;
+  // Random bits left over from the last step, and whether there are any.
+  std::uint32_t spare_;
+  bool haveSpare_;
+
+  std::uint64_t random64();
+  std::uint32_t random32();
+
+  template <Kind K>
+  std::uint32_t bits32();
+  template <Kind K>
+  std::uint64_t bits64();
+  template <Kind K, bool Propagating>
+  static float Float32(NaNBits& self, float l, float r);
+  template <Kind K, bool Propagating>
+  static double Float64(NaNBits& self, double l, double r);
 
 public:
-  explicit NaNBits(Kind kind);
+  explicit NaNBits(Kind kind, bool propagating = false);
 
-  float getFloat32();
-  double getFloat64();
+  Kind kind() const { return kind_; }
+  bool propagating() const { return propagating_; }
 
-  float transformFloat32(float old);
-  double transformFloat64(double old);
+  // The result of a float operator whose result was NaN, given its operands;
+  // r is zero for unary operators.
+  float float32(float l, float r) { return float32_(*this, l, r); }
+  double float64(double l, double r) { return float64_(*this, l, r); }
 };
 
 } // namespace wasm
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/ParallelFor.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace wasm;
+
+namespace {
+
+// The indices a thread has yet to process. The owner takes from begin and
+// thieves take from end, both under lock.
+struct Share {
+  mutex lock;
+  size_t begin;
+  size_t end;
+};
+
+class Workers {
+  vector<unique_ptr<Share>> shares_;
+  const function<void(unsigned, size_t)>& body_;
+
+  bool take(unsigned worker, size_t* index) {
+    Share& share = *shares_[worker];
+    lock_guard<mutex> guard(share.lock);
+    if (share.begin == share.end)
+      return false;
+    *index = share.begin++;
+    return true;
+  }
+
+  // Move the back half of some other thread's share into worker's, which is
+  // empty. Returns false if there was nothing left to steal.
+  bool steal(unsigned worker) {
+    for (size_t i = 1; i < shares_.size(); ++i) {
+      Share& victim = *shares_[(worker + i) % shares_.size()];
+      size_t begin, end;
+      {
+        lock_guard<mutex> guard(victim.lock);
+        if (victim.begin == victim.end)
+          continue;
+        begin = victim.begin + (victim.end - victim.begin) / 2;
+        end = victim.end;
+        victim.end = begin;
+      }
+      Share& own = *shares_[worker];
+      lock_guard<mutex> guard(own.lock);
+      own.begin = begin;
+      own.end = end;
+      return true;
+    }
+    return false;
+  }
+
+public:
+  Workers(size_t count, unsigned jobs,
+          const function<void(unsigned, size_t)>& body)
+    : body_(body) {
+    for (unsigned i = 0; i < jobs; ++i) {
+      shares_.emplace_back(new Share());
+      shares_[i]->begin = count * i / jobs;
+      shares_[i]->end = count * (i + 1) / jobs;
+    }
+  }
+
+  void run(unsigned worker) {
+    size_t index;
+    do {
+      while (take(worker, &index))
+        body_(worker, index);
+    } while (steal(worker));
+  }
+};
+
+} // namespace
+
+void
+wasm::ParallelFor(size_t count, unsigned jobs,
+                  const function<void(unsigned, size_t)>& body) {
+  if (jobs > count)
+    jobs = count;
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; ++i)
+      body(0, i);
+    return;
+  }
+
+  Workers workers(count, jobs, body);
+  vector<thread> threads;
+  for (unsigned worker = 1; worker < jobs; ++worker)
+    threads.emplace_back([&workers, worker] { workers.run(worker); });
+  workers.run(0);
+  for (thread& t : threads)
+    t.join();
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_IMPLEMENTATION_PARALLELFOR_H
+#define WEBASSEMBLY_IMPLEMENTATION_PARALLELFOR_H
+
+#include <cstddef>
+#include <functional>
+
+namespace wasm {
+
+// Call body(worker, index) for every index in [0, count), using up to jobs
+// threads including the calling one. worker identifies the thread, in
+// [0, jobs), so that callers can keep per-thread state without locking.
+//
+// Each thread starts with an equal contiguous share of the indices and takes
+// them from the front. A thread which runs out steals the back half of
+// another thread's remaining share, so uneven work balances out. Returns once
+// every index has been processed.
+void ParallelFor(std::size_t count, unsigned jobs,
+                 const std::function<void(unsigned, std::size_t)>& body);
+
+} // namespace wasm
+
+#endif // include guard
@@ -15,20 +15,286 @@
  */
 
 #include "implementation/TrapHandler.h"
+#include <atomic>
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
 using namespace std;
 using namespace wasm;
 
-TrapHandler::TrapHandler() {}
+namespace {
+
+// A region whose faults are traps. Entries are claimed and filled in under
+// guardRegionsMutex, and published to the fault handler through inUse.
+struct GuardRegion {
+  atomic<bool> inUse;
+  uintptr_t begin;
+  size_t size;
+  TrapHandler* trapHandler;
+  const char* why;
+};
+
+// The regions are kept in chunks, which are added as they fill up and never
+// freed, so that the fault handler can walk them without taking a lock. A
+// guarded process has two regions: its linear memory and its trusted stack.
+struct GuardRegionChunk {
+  static const size_t numRegions = 128;
+  GuardRegion regions[numRegions];
+  atomic<GuardRegionChunk*> next;
+};
+
+} // namespace
+
+static GuardRegionChunk firstGuardRegionChunk;
+static mutex guardRegionsMutex;
+static bool faultHandlerInstalled = false;
+static struct sigaction previousSegvAction;
+static struct sigaction previousBusAction;
+
+// Faults in guard regions trap through trapFromFault, which leaves the
+// handler first if it can. Other faults are handed to the previous handler,
+// which stays registered with us in front of it.
+static void
+ForwardFault(int sig, siginfo_t* info, void* context) {
+  const struct sigaction& previous =
+    sig == SIGSEGV ? previousSegvAction : previousBusAction;
+  if (previous.sa_flags & SA_SIGINFO) {
+    previous.sa_sigaction(sig, info, context);
+    return;
+  }
+  if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(sig);
+    return;
+  }
+
+  // The default action ends the process, once the faulting access is
+  // re-executed on return, or once a signal that was sent to it is raised
+  // again, so there's no handler left to run.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = SIG_DFL;
+  sigemptyset(&action.sa_mask);
+  sigaction(sig, &action, nullptr);
+  if (info->si_code <= 0)
+    raise(sig);
+}
+
+static void
+HandleFault(int sig, siginfo_t* info, void* context) {
+  // A signal sent by kill(2) and the like has no faulting address.
+  if (info->si_code > 0) {
+    uintptr_t addr = uintptr_t(info->si_addr);
+    for (GuardRegionChunk* chunk = &firstGuardRegionChunk; chunk;
+         chunk = chunk->next.load(memory_order_acquire)) {
+      for (GuardRegion& region : chunk->regions) {
+        if (!region.inUse.load(memory_order_acquire))
+          continue;
+        if (addr - region.begin < region.size)
+          region.trapHandler->trapFromFault(region.why);
+      }
+    }
+  }
+
+  ForwardFault(sig, info, context);
+}
+
+static bool
+InstallFaultHandler() {
+  if (faultHandlerInstalled)
+    return true;
+
+  // The handler runs on the thread's signal stack, if it has one, so that it
+  // can handle the thread overflowing its own stack.
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = HandleFault;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGSEGV, &action, &previousSegvAction) != 0)
+    return false;
+  if (sigaction(SIGBUS, &action, &previousBusAction) != 0) {
+    sigaction(SIGSEGV, &previousSegvAction, nullptr);
+    return false;
+  }
+
+  faultHandlerInstalled = true;
+  return true;
+}
+
+namespace {
+
+// A thread's stack for handling faults, unregistered and unmapped when the
+// thread exits.
+struct SignalStack {
+  void* mapping;
+
+  ~SignalStack() {
+    if (!mapping)
+      return;
+    stack_t disable;
+    memset(&disable, 0, sizeof(disable));
+    disable.ss_flags = SS_DISABLE;
+    sigaltstack(&disable, nullptr);
+    munmap(mapping, signalStackSize);
+  }
+
+  static const size_t signalStackSize = size_t(64) << 10;
+};
+
+} // namespace
+
+static thread_local SignalStack signalStack = {nullptr};
+
+struct TrapHandler::Landing {
+  sigjmp_buf buffer;
+};
+
+TrapHandler::TrapHandler()
+  : landing_(nullptr)
+  , trapWhy_(nullptr) {}
 
 void
 TrapHandler::trap(const char* why) {
+  if (landing_) {
+    trapWhy_ = why;
+    siglongjmp(landing_->buffer, 1);
+  }
   fprintf(stderr, "TRAP: %s\n", why);
   exit(EXIT_FAILURE);
 }
 
+// The landing saves the signal mask, which the jump out of the handler
+// restores, unblocking the fault's signal.
+bool
+TrapHandler::runGuarded(void (*body)(void*), void* arg) {
+  PrepareThread();
+  Landing landing;
+  Landing* outer = landing_;
+  if (sigsetjmp(landing.buffer, 1) != 0) {
+    landing_ = outer;
+    fprintf(stderr, "TRAP: %s\n", trapWhy_);
+    return false;
+  }
+  landing_ = &landing;
+  body(arg);
+  landing_ = outer;
+  return true;
+}
+
+static void
+WriteAll(const char* text) {
+  size_t size = strlen(text);
+  while (size != 0) {
+    ssize_t written = write(STDERR_FILENO, text, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return;
+    text += written;
+    size -= size_t(written);
+  }
+}
+
+void
+TrapHandler::trapFromFault(const char* why) {
+  if (landing_) {
+    trapWhy_ = why;
+    siglongjmp(landing_->buffer, 1);
+  }
+
+  WriteAll("TRAP: ");
+  WriteAll(why);
+  WriteAll("\n");
+  _exit(EXIT_FAILURE);
+}
+
+bool
+TrapHandler::PrepareThread() {
+  if (signalStack.mapping)
+    return true;
+
+  // Leave a signal stack set up by someone else alone.
+  stack_t current;
+  if (sigaltstack(nullptr, &current) == 0 && !(current.ss_flags & SS_DISABLE))
+    return true;
+
+  void* mapping = mmap(nullptr, SignalStack::signalStackSize,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  stack_t stack;
+  memset(&stack, 0, sizeof(stack));
+  stack.ss_sp = mapping;
+  stack.ss_size = SignalStack::signalStackSize;
+  if (sigaltstack(&stack, nullptr) != 0) {
+    munmap(mapping, SignalStack::signalStackSize);
+    return false;
+  }
+  signalStack.mapping = mapping;
+  return true;
+}
+
 void
 TrapHandler::slow(const char* why) {
   fprintf(stderr, "SLOW: %s\n", why);
 }
+
+bool
+TrapHandler::addGuardRegion(const void* begin, size_t size, const char* why) {
+  lock_guard<mutex> lock(guardRegionsMutex);
+  if (!InstallFaultHandler())
+    return false;
+
+  GuardRegion* free = nullptr;
+  GuardRegionChunk* last = nullptr;
+  for (GuardRegionChunk* chunk = &firstGuardRegionChunk; chunk && !free;
+       chunk = chunk->next.load(memory_order_relaxed)) {
+    for (GuardRegion& region : chunk->regions) {
+      if (!region.inUse.load(memory_order_relaxed)) {
+        free = &region;
+        break;
+      }
+    }
+    last = chunk;
+  }
+  if (!free) {
+    GuardRegionChunk* chunk = new (nothrow) GuardRegionChunk();
+    if (!chunk)
+      return false;
+    last->next.store(chunk, memory_order_release);
+    free = &chunk->regions[0];
+  }
+
+  free->begin = uintptr_t(begin);
+  free->size = size;
+  free->trapHandler = this;
+  free->why = why;
+  free->inUse.store(true, memory_order_release);
+  return true;
+}
+
+void
+TrapHandler::removeGuardRegion(const void* begin) {
+  lock_guard<mutex> lock(guardRegionsMutex);
+  for (GuardRegionChunk* chunk = &firstGuardRegionChunk; chunk;
+       chunk = chunk->next.load(memory_order_relaxed)) {
+    for (GuardRegion& region : chunk->regions) {
+      if (region.inUse.load(memory_order_relaxed) &&
+          region.begin == uintptr_t(begin) && region.trapHandler == this) {
+        region.inUse.store(false, memory_order_release);
+        return;
+      }
+    }
+  }
+}
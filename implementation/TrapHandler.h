@@ -17,14 +17,48 @@
 #ifndef WEBASSEMBLY_IMPLEMENTATION_TRAPHANDLER_H
 #define WEBASSEMBLY_IMPLEMENTATION_TRAPHANDLER_H
 
+#include <cstddef>
+
 namespace wasm {
 
 class TrapHandler {
+  // Where a trap, or a fault in one of the guard regions, lands while
+  // runGuarded is running, and why it trapped.
+  struct Landing;
+  Landing* landing_;
+  const char* trapWhy_;
+
 public:
   TrapHandler();
 
+  // Report why, and leave the body runGuarded is running, or outside
+  // runGuarded, exit the host process.
   void trap(const char* why);
   void slow(const char* why);
+
+  // Call body(arg), such that a trap in it, or a fault in one of this
+  // handler's guard regions, which first leaves the signal handler, ends
+  // body and returns false here. Frames between are abandoned without
+  // unwinding, so they mustn't own anything. Runs one body at a time. body
+  // may run on a fiber, which is suspended and resumed on other threads, as
+  // long as each of them is prepared.
+  bool runGuarded(void (*body)(void*), void* arg);
+
+  // Called by the fault handler: trap from runGuarded's frame, or, outside
+  // runGuarded, from the signal handler, with only async-signal-safe calls.
+  [[noreturn]] void trapFromFault(const char* why);
+
+  // Give the calling thread a stack to handle faults on, so that a fault
+  // from overflowing the stack it's running on can be handled. Call on every
+  // thread that runs guest code. Returns false if it can't be mapped.
+  static bool PrepareThread();
+
+  // Arrange for a hardware fault on an address in [begin, begin + size) to be
+  // reported as a trap with the given reason. Returns false if the region
+  // can't be registered, in which case accesses to it must be checked
+  // explicitly.
+  bool addGuardRegion(const void* begin, std::size_t size, const char* why);
+  void removeGuardRegion(const void* begin);
 };
 
 } // namespace wasm
@@ -17,6 +17,154 @@
 #ifndef WEBASSEMBLY_MODULE_EXPRESSION_H
 #define WEBASSEMBLY_MODULE_EXPRESSION_H
 
-namespace wasm {} // namespace wasm
+#include "semantics/Types.h"
+#include <cstdint>
+
+namespace wasm {
+
+// Expression opcodes. The first group is overloaded by the node's type; for
+// example, GetLocal in an int32 node loads an int32 local. AddressOf is only
+// valid in int32 nodes. The rest are only valid in a node of the type named
+// by their result.
+enum Opcode : std::uint8_t {
+  GetLocal,
+  SetLocal,
+  LoadHeap,
+  StoreHeap,
+  LoadHeapWithOffset,
+  StoreHeapWithOffset,
+  LoadGlobal,
+  StoreGlobal,
+  CallDirect,
+  CallIndirect,
+  AddressOf,
+  Literal,
+
+  Int32Add,
+  Int32Sub,
+  Int32Mul,
+  Int32SDiv,
+  Int32UDiv,
+  Int32SRem,
+  Int32URem,
+  Int32And,
+  Int32Ior,
+  Int32Xor,
+  Int32Shl,
+  Int32Shr,
+  Int32Sar,
+  Int32Eq,
+  Int32Slt,
+  Int32Sle,
+  Int32Ult,
+  Int32Ule,
+  Float32Eq,
+  Float32Lt,
+  Float32Le,
+  Float64Eq,
+  Float64Lt,
+  Float64Le,
+  SInt32FromFloat64,
+  SInt32FromFloat32,
+  Uint32FromFloat64,
+  Uint32FromFloat32,
+  Int32fromFloat32Bits,
+
+  Float32Add,
+  Float32Sub,
+  Float32Mul,
+  Float32Div,
+  Float32Abs,
+  Float32Neg,
+  Float32Copysign,
+  Float32Ceil,
+  Float32Floor,
+  Float32Sqrt,
+  Float32FromFloat64,
+  Float32FromSInt32,
+  Float32FromUInt32,
+  Float32FromInt32Bits,
+
+  Float64Add,
+  Float64Sub,
+  Float64Mul,
+  Float64Div,
+  Float64Abs,
+  Float64Neg,
+  Float64Copysign,
+  Float64Ceil,
+  Float64Floor,
+  Float64Sqrt,
+  Float64FromFloat32,
+  Float64FromSInt32,
+  Float64FromUInt32,
+
+  // Statements, which appear in void nodes. The payload of a branch is the
+  // index of the node it branches to. Apart from BrIf's int32 condition, the
+  // operand stack must be empty at a branch and at its target.
+  Br,
+  BrIf,
+
+  // int64 operators, numbered after the statements so that modules written
+  // before they existed keep their encoding. The comparisons and
+  // Int32FromInt64 are valid in int32 nodes; the rest in int64 nodes.
+  Int64Add,
+  Int64Sub,
+  Int64Mul,
+  Int64SDiv,
+  Int64UDiv,
+  Int64SRem,
+  Int64URem,
+  Int64And,
+  Int64Ior,
+  Int64Xor,
+  Int64Shl,
+  Int64Shr,
+  Int64Sar,
+  Int64Eq,
+  Int64Slt,
+  Int64Sle,
+  Int64Ult,
+  Int64Ule,
+  Int32FromInt64,
+  Int64FromSInt32,
+  Int64FromUInt32,
+
+  // Bulk memory statements, in void nodes. MemoryCopy takes int32
+  // destination, source and size operands and copies as memmove does.
+  // MemoryFill takes a destination, a value whose low byte is stored, and a
+  // size. Either traps, writing nothing, if a range is out of bounds.
+  MemoryCopy,
+  MemoryFill,
+
+  // A call to the host function FFIHandler::CallID(payload), in an int32
+  // node. Its int32 operands are pushed in order.
+  CallFFI,
+
+  // Conversions between int64 and the float types. The first five are valid
+  // in int64 nodes and trap, as their int32 counterparts do, on operands
+  // outside the integer's range; the rest are valid in float nodes of the
+  // type they produce. The Bits conversions reinterpret the operand's bits.
+  SInt64FromFloat64,
+  SInt64FromFloat32,
+  Uint64FromFloat64,
+  Uint64FromFloat32,
+  Int64FromFloat64Bits,
+  Float32FromSInt64,
+  Float32FromUInt64,
+  Float64FromSInt64,
+  Float64FromUInt64,
+  Float64FromInt64Bits,
+};
+
+// A node of an expression tree. Trees are stored in postorder, so by the time
+// a node executes, its operands have already been evaluated and pushed.
+struct Node {
+  Types type;
+  Opcode opcode;
+  std::uint32_t payload;
+};
+
+} // namespace wasm
 
 #endif // include guard
@@ -17,6 +17,17 @@
 #ifndef WEBASSEMBLY_MODULE_LINEARMEMORYINITIALIZER_H
 #define WEBASSEMBLY_MODULE_LINEARMEMORYINITIALIZER_H
 
-namespace wasm {} // namespace wasm
+#include "module/View.h"
+#include <cstdint>
+
+namespace wasm {
+
+// Bytes to copy into linear memory at address_ when a process is loaded.
+struct LinearMemoryInitializer {
+  std::uint32_t address_;
+  View<std::uint8_t> bytes_;
+};
+
+} // namespace wasm
 
 #endif // include guard
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_MODULE_MAPPEDFILE_H
+#define WEBASSEMBLY_MODULE_MAPPEDFILE_H
+
+#include "module/View.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace wasm {
+
+// A file mapped read-only into memory. Pages are read from the file as they
+// are touched, so the cost of mapping doesn't depend on the file's size.
+class MappedFile {
+  const std::uint8_t* data_;
+  std::size_t size_;
+
+public:
+  MappedFile()
+    : data_(nullptr)
+    , size_(0) {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const char* path);
+
+  const std::uint8_t* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+  // Set out to the count elements of type T at offset. Returns false if they
+  // are misaligned or extend past the end of the file.
+  template <typename T>
+  bool array(std::uint64_t offset, std::uint64_t count, View<T>* out) const {
+    if (offset % alignof(T) != 0 || offset > size_ ||
+        count > (size_ - offset) / sizeof(T))
+      return false;
+    *out = View<T>(reinterpret_cast<const T*>(data_ + offset), count);
+    return true;
+  }
+};
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "module/Module.h"
+#include "module/ModuleFormat.h"
+#include <cstring>
+using namespace std;
+using namespace wasm;
+
+static bool
+IsLittleEndian() {
+  uint16_t x = 1;
+  uint8_t first;
+  memcpy(&first, &x, 1);
+  return first == 1;
+}
+
+bool
+Module::load(const char* path, const char** why) {
+  if (!IsLittleEndian()) {
+    *why = "module files are only supported on little-endian hosts";
+    return false;
+  }
+
+  shared_ptr<MappedFile> file = make_shared<MappedFile>();
+  if (!file->open(path)) {
+    *why = "cannot map module file";
+    return false;
+  }
+
+  View<ModuleHeader> header;
+  if (!file->array(0, 1, &header) ||
+      memcmp(header[0].magic, moduleMagic, sizeof(moduleMagic)) != 0) {
+    *why = "not a module file";
+    return false;
+  }
+  if (header[0].version != moduleVersion) {
+    *why = "unsupported module file version";
+    return false;
+  }
+
+  View<SectionHeader> sections;
+  if (!file->array(sizeof(ModuleHeader), header[0].numSections, &sections)) {
+    *why = "truncated section table";
+    return false;
+  }
+
+  View<InitializerHeader> initializers;
+  for (const SectionHeader& section : sections) {
+    bool ok = true;
+    switch (section.id) {
+      case SectionID::routines:
+        ok = file->array(section.offset, section.size / sizeof(RoutineHeader),
+                         &routines_);
+        break;
+      case SectionID::literals:
+        ok = file->array(section.offset, section.size / sizeof(uint64_t),
+                         &literals_);
+        break;
+      case SectionID::initializers:
+        ok = file->array(section.offset,
+                         section.size / sizeof(InitializerHeader),
+                         &initializers);
+        break;
+      default:
+        // Unknown sections are skipped, so that they can be added without
+        // breaking older readers.
+        break;
+    }
+    if (!ok) {
+      *why = "section out of bounds";
+      return false;
+    }
+  }
+
+  initializers_.resize(initializers.size());
+  for (size_t i = 0; i < initializers.size(); ++i) {
+    LinearMemoryInitializer& initializer = initializers_[i];
+    initializer.address_ = initializers[i].address;
+    if (!file->array(initializers[i].dataOffset, initializers[i].size,
+                     &initializer.bytes_) ||
+        uint64_t(initializer.address_) + initializer.bytes_.size() >
+          header[0].memorySize) {
+      *why = "linear memory initializer out of bounds";
+      return false;
+    }
+  }
+
+  startRoutine_ = header[0].startRoutine;
+  numGlobals_ = header[0].numGlobals;
+  memorySize_ = header[0].memorySize;
+  file_ = file;
+  return true;
+}
+
+bool
+Module::routine(uint32_t index, Routine* out) const {
+  if (index >= routines_.size() || !file_)
+    return false;
+  const RoutineHeader& header = routines_[index];
+  out->numLocals_ = header.numLocals;
+  return file_->array(header.bodyOffset, header.numNodes, &out->body_);
+}
@@ -17,9 +17,49 @@
 #ifndef WEBASSEMBLY_MODULE_MODULE_H
 #define WEBASSEMBLY_MODULE_MODULE_H
 
+#include "module/LinearMemoryInitializer.h"
+#include "module/MappedFile.h"
+#include "module/ModuleFormat.h"
+#include "module/Routine.h"
+#include "module/View.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace wasm {
 
-class Module {};
+// A module's routine bodies, literals and initializer bytes are views of the
+// storage they were loaded from, and are never copied. Routine headers aren't
+// even indexed when loading: a routine's body is only located and checked
+// when it is first needed, so loading takes the same time however many
+// routines there are.
+struct Module {
+  View<RoutineHeader> routines_;
+  // Literal pool, indexed by the payload of Literal nodes. Values are stored
+  // as raw bits, zero-extended to 64 bits.
+  View<std::uint64_t> literals_;
+  std::vector<LinearMemoryInitializer> initializers_;
+  std::uint32_t startRoutine_;
+  std::uint32_t numGlobals_;
+  std::uint64_t memorySize_;
+  // Keeps the storage the views point into alive.
+  std::shared_ptr<MappedFile> file_;
+
+  Module()
+    : startRoutine_(0)
+    , numGlobals_(0)
+    , memorySize_(0) {}
+
+  // Map the module file at path and index it. On failure, returns false and
+  // sets why to the reason.
+  bool load(const char* path, const char** why);
+
+  std::uint32_t numRoutines() const { return routines_.size(); }
+
+  // Locate the body of the routine at index. Returns false if index is out of
+  // range or the body lies outside the module file.
+  bool routine(std::uint32_t index, Routine* out) const;
+};
 
 } // namespace wasm
 
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_MODULE_MODULEFORMAT_H
+#define WEBASSEMBLY_MODULE_MODULEFORMAT_H
+
+#include "module/Expression.h"
+#include <cstdint>
+
+namespace wasm {
+
+// The layout of a module file. Files are little-endian and are used in place
+// by mapping them, so every array is aligned to its element's size, and
+// routine bodies are stored as arrays of Node.
+//
+// A file starts with a ModuleHeader, followed by numSections SectionHeaders.
+// Offsets are from the start of the file.
+
+static const char moduleMagic[8] = {'\0', 'w', 'a', 's', 'm', 'p', 'r', 't'};
+static const std::uint32_t moduleVersion = 1;
+
+enum class SectionID : std::uint32_t {
+  routines = 1,     // RoutineHeader[]
+  literals = 2,     // std::uint64_t[]
+  initializers = 3, // InitializerHeader[]
+};
+
+struct ModuleHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t numSections;
+  std::uint32_t startRoutine;
+  std::uint32_t numGlobals;
+  std::uint64_t memorySize;
+};
+
+struct SectionHeader {
+  SectionID id;
+  std::uint32_t reserved;
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct RoutineHeader {
+  std::uint32_t numLocals;
+  std::uint32_t numNodes;
+  std::uint64_t bodyOffset;
+};
+
+struct InitializerHeader {
+  std::uint32_t address;
+  std::uint32_t size;
+  std::uint64_t dataOffset;
+};
+
+static_assert(sizeof(Node) == 8, "Node must match its file layout");
+static_assert(sizeof(ModuleHeader) == 32, "unexpected padding");
+static_assert(sizeof(SectionHeader) == 24, "unexpected padding");
+static_assert(sizeof(RoutineHeader) == 16, "unexpected padding");
+static_assert(sizeof(InitializerHeader) == 16, "unexpected padding");
+
+} // namespace wasm
+
+#endif // include guard
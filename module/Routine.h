@@ -17,6 +17,22 @@
 #ifndef WEBASSEMBLY_MODULE_ROUTINE_H
 #define WEBASSEMBLY_MODULE_ROUTINE_H
 
-namespace wasm {} // namespace wasm
+#include "module/Expression.h"
+#include "module/View.h"
+#include <cstdint>
+
+namespace wasm {
+
+// A routine's body is a view of its nodes where they are stored, which is
+// normally in the mapping of the module file.
+struct Routine {
+  View<Node> body_;
+  std::uint32_t numLocals_;
+
+  Routine()
+    : numLocals_(0) {}
+};
+
+} // namespace wasm
 
 #endif // include guard
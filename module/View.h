@@ -0,0 +1,49 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_MODULE_VIEW_H
+#define WEBASSEMBLY_MODULE_VIEW_H
+
+#include <cstddef>
+
+namespace wasm {
+
+// A read-only view of an array owned elsewhere, typically the mapping of a
+// module file.
+template <typename T>
+class View {
+  const T* data_;
+  std::size_t size_;
+
+public:
+  View()
+    : data_(nullptr)
+    , size_(0) {}
+  View(const T* data, std::size_t size)
+    : data_(data)
+    , size_(size) {}
+
+  const T* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T& operator[](std::size_t i) const { return data_[i]; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+};
+
+} // namespace wasm
+
+#endif // include guard
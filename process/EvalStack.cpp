@@ -0,0 +1,48 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "process/EvalStack.h"
+#include <sys/mman.h>
+using namespace std;
+using namespace wasm;
+
+// The slots start a cache line into the mapping, leaving room for the spare
+// slot below them.
+static const size_t cacheLineSize = 64;
+
+EvalStack::EvalStack(size_t capacity)
+  : mapping_(nullptr)
+  , mappingSize_(0)
+  , base_(nullptr)
+  , limit_(nullptr)
+  , top_(nullptr) {
+  size_t size = cacheLineSize + capacity * sizeof(uint64_t);
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED)
+    return;
+  mapping_ = mapping;
+  mappingSize_ = size;
+  base_ = reinterpret_cast<uint64_t*>(static_cast<uint8_t*>(mapping) +
+                                      cacheLineSize);
+  limit_ = base_ + capacity;
+  top_ = base_;
+}
+
+EvalStack::~EvalStack() {
+  if (mapping_)
+    munmap(mapping_, mappingSize_);
+}
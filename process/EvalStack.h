@@ -17,6 +17,62 @@
 #ifndef WEBASSEMBLY_PROCESS_EVALSTACK_H
 #define WEBASSEMBLY_PROCESS_EVALSTACK_H
 
-namespace wasm {} // namespace wasm
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wasm {
+
+// The operand stack, shared by every frame: a frame's operands are pushed
+// above its caller's. Each entry is a 64-bit slot holding the raw bits of a
+// value, zero-extended. The capacity is fixed, and a frame checks once, on
+// entry, that there's room for the greatest depth its routine reaches, so
+// pushes and pops never check. The slots are mapped lazily, starting on a
+// cache line, with a spare slot below the first, which ExprStack reads when
+// the stack is empty.
+class EvalStack {
+  void* mapping_;
+  std::size_t mappingSize_;
+  std::uint64_t* base_;
+  std::uint64_t* limit_;
+  std::uint64_t* top_;
+
+public:
+  // 8 MiB of address space, committed as it's touched.
+  static const std::size_t defaultCapacity = std::size_t(1) << 20;
+
+  // If the stack can't be mapped, its capacity is zero.
+  explicit EvalStack(std::size_t capacity = defaultCapacity);
+  ~EvalStack();
+
+  EvalStack(const EvalStack&) = delete;
+  EvalStack& operator=(const EvalStack&) = delete;
+
+  // One past the top entry.
+  std::uint64_t* top() const { return top_; }
+  void set_top(std::uint64_t* top) { top_ = top; }
+  std::size_t size() const { return top_ - base_; }
+
+  // Whether count more entries fit.
+  bool fits(std::size_t count) const {
+    return std::size_t(limit_ - top_) >= count;
+  }
+
+  template <typename T>
+  void push(T value) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    *top_++ = bits;
+  }
+
+  template <typename T>
+  T pop() {
+    T value;
+    std::memcpy(&value, --top_, sizeof(T));
+    return value;
+  }
+};
+
+} // namespace wasm
 
 #endif // include guard
@@ -17,6 +17,71 @@
 #ifndef WEBASSEMBLY_PROCESS_EXPRSTACK_H
 #define WEBASSEMBLY_PROCESS_EXPRSTACK_H
 
-namespace wasm {} // namespace wasm
+#include <cstdint>
+#include <cstring>
+
+namespace wasm {
+
+// The interpreter's cursor on an EvalStack, kept in locals of its loop so
+// that the compiler holds it in registers. The top entry is cached in top_,
+// and sp_ points at the slot it belongs in, which is only written when
+// another entry is pushed over it or the stack is flushed; the entries below
+// are in memory. With nothing of its own frame on the stack, top_ caches the
+// caller's top entry, or the spare slot below an empty stack, which is never
+// changed since it's only ever written back as it was read.
+class ExprStack {
+  std::uint64_t* sp_;
+  std::uint64_t top_;
+
+  template <typename T>
+  void push(T value) {
+    *sp_++ = top_;
+    top_ = 0;
+    std::memcpy(&top_, &value, sizeof(T));
+  }
+
+  template <typename T>
+  T pop() {
+    T value;
+    std::memcpy(&value, &top_, sizeof(T));
+    top_ = *--sp_;
+    return value;
+  }
+
+public:
+  // Take over the stack whose top entry is below top.
+  explicit ExprStack(std::uint64_t* top) { reload(top); }
+
+  // Write the cached entry back, for code which uses the stack in memory,
+  // and return one past the top entry.
+  std::uint64_t* flush() {
+    *sp_ = top_;
+    return sp_ + 1;
+  }
+  // Take over the stack again after such code has run.
+  void reload(std::uint64_t* top) {
+    sp_ = top - 1;
+    top_ = *sp_;
+  }
+
+  // Discard entries of the frame starting at frame beyond depth, as a branch
+  // to an instruction at that depth does.
+  void reset(std::uint64_t* frame, std::uint32_t depth) {
+    flush();
+    reload(frame + depth);
+  }
+
+  void push_int32(std::int32_t x) { push(x); }
+  void push_int64(std::int64_t x) { push(x); }
+  void push_float32(float x) { push(x); }
+  void push_float64(double x) { push(x); }
+  void push_boolean(bool x) { push(std::int32_t(x)); }
+  std::int32_t pop_int32() { return pop<std::int32_t>(); }
+  std::int64_t pop_int64() { return pop<std::int64_t>(); }
+  float pop_float32() { return pop<float>(); }
+  double pop_float64() { return pop<double>(); }
+};
+
+} // namespace wasm
 
 #endif // include guard
@@ -23,7 +23,7 @@ namespace wasm {
 
 class GlobalVariables final : public Variables {
 public:
-  GlobalVariables();
+  GlobalVariables() {}
 };
 
 } // namespace wasm
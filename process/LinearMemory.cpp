@@ -15,22 +15,181 @@
  */
 
 #include "process/LinearMemory.h"
+#include "implementation/BulkMemory.h"
 #include "implementation/TrapHandler.h"
+#include <algorithm>
 #include <climits>
 #include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
 using namespace std;
 using namespace wasm;
 
+// The largest address a guest can form is a 32-bit base plus a 32-bit offset,
+// and an access extends at most 8 bytes beyond that. The guard region covers
+// the overhang, rounded up generously to a page.
+static const size_t guardedAddressRange = size_t(1) << 33;
+static const size_t guardSize = size_t(1) << 16;
+static const size_t maxGuardedSize = size_t(1) << 32;
+
+// Unguarded memories reserve enough for any 32-bit memory up front where the
+// host's address space allows it, so that growth never moves them.
+static const size_t defaultReservation =
+  sizeof(size_t) >= 8 ? size_t(1) << 32 : size_t(1) << 26;
+
+static size_t
+PageSize() {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+}
+
+static size_t
+RoundUpToPage(size_t size) {
+  size_t pageSize = PageSize();
+  return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+static void*
+Reserve(size_t size) {
+  void* base = mmap(nullptr, size, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return base == MAP_FAILED ? nullptr : base;
+}
+
+bool
+LinearMemory::reserveGuarded(TrapHandler* trapHandler) {
+  if (sizeof(size_t) < 8 || data_ != nullptr || reserved_ != 0)
+    return false;
+
+  size_t reservation = guardedAddressRange + guardSize;
+  void* base = Reserve(reservation);
+  if (base == nullptr)
+    return false;
+
+  if (!trapHandler->addGuardRegion(base, reservation,
+                                   "linear memory address out of bounds")) {
+    munmap(base, reservation);
+    return false;
+  }
+
+  data_ = static_cast<uint8_t*>(base);
+  reserved_ = reservation;
+  guardTrapHandler_ = trapHandler;
+  checked_ = false;
+  return true;
+}
+
+// Reserve address space for an unguarded memory, preferring the default size
+// but settling for as much as the host allows, down to what is needed now.
+// Mappings are usually placed below the ones before them, so the space after
+// a reservation is rarely free for extending it later.
+bool
+LinearMemory::reserveUnguarded(size_t minSize) {
+  size_t needed = RoundUpToPage(minSize);
+  size_t reservation = max(needed, defaultReservation);
+  void* base = Reserve(reservation);
+  while (base == nullptr && reservation > needed) {
+    reservation = max(needed, RoundUpToPage(reservation / 2));
+    base = Reserve(reservation);
+  }
+  if (base == nullptr)
+    return false;
+
+  data_ = static_cast<uint8_t*>(base);
+  reserved_ = reservation;
+  return true;
+}
+
+// Extend an unguarded reservation to at least minSize, by reserving the
+// address space right after it. data_ never moves, so this fails if that
+// space is taken.
+bool
+LinearMemory::extendReservation(size_t minSize) {
+  size_t needed = RoundUpToPage(minSize) - reserved_;
+  for (size_t extension : {max(needed, reserved_), needed}) {
+    uint8_t* end = data_ + reserved_;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    // A host without MAP_FIXED_NOREPLACE takes the address as a hint.
+    void* tail = mmap(end, extension, PROT_NONE, flags, -1, 0);
+    if (tail == MAP_FAILED)
+      continue;
+    if (tail != end) {
+      munmap(tail, extension);
+      continue;
+    }
+    reserved_ += extension;
+    return true;
+  }
+  return false;
+}
+
 void
-LinearMemory::fail(const char* why, TrapHandler* trapHandler) {
-  free(data_);
+LinearMemory::release() {
+  if (guardTrapHandler_ != nullptr) {
+    guardTrapHandler_->removeGuardRegion(data_);
+    guardTrapHandler_ = nullptr;
+  }
+  if (reserved_ != 0) {
+    munmap(data_, reserved_);
+    reserved_ = 0;
+  } else {
+    free(data_);
+  }
   data_ = nullptr;
   size_ = 0;
-  trapHandler->trap(why);
+  checked_ = true;
+}
+
+// Commit or decommit pages at the end of the reservation. Pages are zero when
+// first committed, and are replaced when decommitted, so growth neither
+// copies nor clears memory, except for the partial page left by shrinking.
+bool
+LinearMemory::resizeReserved(size_t newSize) {
+  bool guarded = guardTrapHandler_ != nullptr;
+  if (guarded && newSize > maxGuardedSize)
+    return false;
+  if (RoundUpToPage(newSize) > reserved_ && !extendReservation(newSize))
+    return false;
+
+  size_t oldCommitted = RoundUpToPage(size_);
+  size_t newCommitted = RoundUpToPage(newSize);
+  if (newCommitted > oldCommitted) {
+    if (mprotect(data_ + oldCommitted, newCommitted - oldCommitted,
+                 PROT_READ | PROT_WRITE) != 0)
+      return false;
+  } else if (newCommitted < oldCommitted) {
+    // Map fresh anonymous pages over the tail rather than just discarding
+    // it, since discarded pages of a snapshot mapping would revert to the
+    // snapshot's contents instead of to zero.
+    if (mmap(data_ + newCommitted, oldCommitted - newCommitted, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1,
+             0) == MAP_FAILED)
+      return false;
+  }
+  if (newSize < size_)
+    memset(data_ + newSize, 0, newCommitted - newSize);
+
+  size_ = newSize;
+  // Accesses in the committed tail of a partial page wouldn't fault.
+  checked_ = !guarded || newSize != newCommitted;
+  return true;
 }
 
 void
 LinearMemory::resizeImpl(size_t newSize, TrapHandler* trapHandler) {
+  if (data_ == nullptr && reserved_ == 0 && newSize != 0)
+    reserveUnguarded(newSize);
+
+  if (reserved_ != 0) {
+    if (!resizeReserved(newSize))
+      resizeFailed(trapHandler);
+    return;
+  }
+
+  // The host couldn't reserve address space; fall back to the heap.
   uint8_t* newData = static_cast<uint8_t*>(realloc(data_, newSize));
   if (newData == nullptr) {
     resizeFailed(trapHandler);
@@ -43,9 +202,88 @@ LinearMemory::resizeImpl(size_t newSize, TrapHandler* trapHandler) {
   size_ = newSize;
 }
 
+void
+LinearMemory::initialize(size_t addr, const uint8_t* bytes, size_t size,
+                         TrapHandler* trapHandler) {
+  if (!inBounds(addr, size)) {
+    outOfBounds(trapHandler);
+    return;
+  }
+  memcpy(data_ + addr, bytes, size);
+}
+
+void
+LinearMemory::copy(uint64_t dst, uint64_t src, uint64_t size,
+                   TrapHandler* trapHandler) {
+  if (!inBounds(dst, size) || !inBounds(src, size)) {
+    outOfBounds(trapHandler);
+    return;
+  }
+  BulkCopy(data_ + dst, data_ + src, size);
+}
+
+void
+LinearMemory::fill(uint64_t dst, uint8_t value, uint64_t size,
+                   TrapHandler* trapHandler) {
+  if (!inBounds(dst, size)) {
+    outOfBounds(trapHandler);
+    return;
+  }
+  BulkFill(data_ + dst, value, size);
+}
+
+uint8_t*
+LinearMemory::range(uint64_t addr, uint64_t size, TrapHandler* trapHandler) {
+  if (!inBounds(addr, size)) {
+    outOfBounds(trapHandler);
+    return nullptr;
+  }
+  return data_ + addr;
+}
+
+bool
+LinearMemory::writeSnapshot(int fd) const {
+  size_t committed = RoundUpToPage(size_);
+  if (ftruncate(fd, committed) != 0)
+    return false;
+
+  size_t written = 0;
+  while (written < size_) {
+    ssize_t n = pwrite(fd, data_ + written, size_ - written, written);
+    if (n <= 0)
+      return false;
+    written += n;
+  }
+  return true;
+}
+
+bool
+LinearMemory::mapSnapshot(int fd, size_t size) {
+  if (size_ != 0 || (reserved_ == 0 && data_ != nullptr))
+    return false;
+  if (reserved_ == 0 && !reserveUnguarded(size))
+    return false;
+  if (guardTrapHandler_ != nullptr && size > maxGuardedSize)
+    return false;
+  if (RoundUpToPage(size) > reserved_ && !extendReservation(size))
+    return false;
+
+  size_t committed = RoundUpToPage(size);
+  if (committed != 0 &&
+      mmap(data_, committed, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, 0) == MAP_FAILED)
+    return false;
+
+  size_ = size;
+  checked_ = guardTrapHandler_ == nullptr || size != committed;
+  return true;
+}
+
+// Trapping leaves the memory in place, since writes queued from it are made
+// after the trap, when the run ends.
 void
 LinearMemory::resizeFailed(TrapHandler* trapHandler) {
-  fail("linear memory resize failed", trapHandler);
+  trapHandler->trap("linear memory resize failed");
 }
 
 void
@@ -57,7 +295,7 @@ LinearMemory::checkAddr(size_t accessSize, size_t addr, uint8_t p2align,
     return;
   }
 
-  if (p2align < CHAR_BIT * sizeof(size_t)) {
+  if (p2align != 0 && p2align < CHAR_BIT * sizeof(size_t)) {
     if (addr & (~size_t(0) >> (CHAR_BIT * sizeof(size_t) - p2align)))
       trapHandler->slow("linear memory access address underaligned");
   }
@@ -65,9 +303,9 @@ LinearMemory::checkAddr(size_t accessSize, size_t addr, uint8_t p2align,
 
 void
 LinearMemory::outOfBounds(TrapHandler* trapHandler) {
-  fail("linear memory address out of bounds", trapHandler);
+  trapHandler->trap("linear memory address out of bounds");
 }
 
 LinearMemory::~LinearMemory() {
-  free(data_);
+  release();
 }
@@ -27,10 +27,25 @@ class TrapHandler;
 class LinearMemory {
   std::uint8_t* data_;
   std::size_t size_;
+  // Whether accesses are checked explicitly. They aren't when the memory is
+  // guarded and its size is a whole number of pages, so that every
+  // out-of-bounds address faults.
+  bool checked_;
+  // The size of the address-space reservation data_ points into, or zero if
+  // data_ is from malloc.
+  std::size_t reserved_;
+  // When guarded, the trap handler the reservation's faults are reported to.
+  TrapHandler* guardTrapHandler_;
 
-  void fail(const char* why, TrapHandler* trapHandler);
+  void release();
+  bool reserveUnguarded(std::size_t minSize);
+  bool extendReservation(std::size_t minSize);
   void resizeImpl(std::size_t newSize, TrapHandler* trapHandler);
+  bool resizeReserved(std::size_t newSize);
   void resizeFailed(TrapHandler* trapHandler);
+  bool inBounds(std::uint64_t addr, std::uint64_t size) const {
+    return addr <= size_ && size <= size_ - addr;
+  }
   void checkAddr(std::size_t accessSize, std::size_t addr, std::uint8_t p2align,
                  TrapHandler* trapHandler);
   void outOfBounds(TrapHandler* trapHandler);
@@ -38,9 +53,56 @@ class LinearMemory {
 public:
   LinearMemory()
     : data_(nullptr)
-    , size_(0) {}
+    , size_(0)
+    , checked_(true)
+    , reserved_(0)
+    , guardTrapHandler_(nullptr) {}
   ~LinearMemory();
 
+  // Reserve address space covering every address formed from a 32-bit base
+  // and a 32-bit offset, plus a guard region, so that out-of-bounds accesses
+  // fault instead of being checked. Only the live size is committed. Must be
+  // called while the memory is empty. Returns false, leaving explicit checks
+  // in place, if the host can't provide the reservation or catch its faults.
+  bool reserveGuarded(TrapHandler* trapHandler);
+
+  std::size_t size() const { return size_; }
+  std::uint8_t* data() const { return data_; }
+
+  // Whether loads and stores check addresses explicitly. If not, every
+  // address formed from a 32-bit base and a 32-bit offset is either in
+  // bounds or faults.
+  bool checked() const { return checked_; }
+
+  // Copy size bytes into memory at addr, trapping if they don't fit.
+  void initialize(std::size_t addr, const std::uint8_t* bytes,
+                  std::size_t size, TrapHandler* trapHandler);
+
+  // Copy size bytes from src to dst, which may overlap, as memmove does.
+  // Both ranges are checked once, up front, whether or not the memory is
+  // guarded, so an operation which traps writes nothing.
+  void copy(std::uint64_t dst, std::uint64_t src, std::uint64_t size,
+            TrapHandler* trapHandler);
+
+  // Set size bytes at dst to value, checking the range as copy does.
+  void fill(std::uint64_t dst, std::uint8_t value, std::uint64_t size,
+            TrapHandler* trapHandler);
+
+  // The host address of size bytes at addr, trapping if they're out of
+  // bounds. It stays valid until the memory is resized.
+  std::uint8_t* range(std::uint64_t addr, std::uint64_t size,
+                      TrapHandler* trapHandler);
+
+  // Write the contents of the memory to the start of the file fd, sized to a
+  // whole number of pages.
+  bool writeSnapshot(int fd) const;
+
+  // Map the contents written by writeSnapshot as a private, copy-on-write
+  // mapping, so that pages are only copied when written. Must be called while
+  // the memory is empty, though it may already be reserved by
+  // reserveGuarded.
+  bool mapSnapshot(int fd, std::size_t size);
+
   template <typename AddrTy>
   void resize(AddrTy newSize, TrapHandler* trapHandler) {
     std::size_t castedNewSize = newSize;
@@ -56,9 +118,10 @@ public:
     std::size_t castedAddr = addr;
     if (castedAddr != addr) {
       outOfBounds(trapHandler);
-      return;
+      return T();
     }
-    checkAddr(sizeof(T), castedAddr, p2align, trapHandler);
+    if (checked_)
+      checkAddr(sizeof(T), castedAddr, p2align, trapHandler);
     T value;
     std::memcpy(&value, data_ + castedAddr, sizeof(T));
     return value;
@@ -72,7 +135,8 @@ public:
       outOfBounds(trapHandler);
       return;
     }
-    checkAddr(sizeof(T), castedAddr, p2align, trapHandler);
+    if (checked_)
+      checkAddr(sizeof(T), castedAddr, p2align, trapHandler);
     std::memcpy(data_ + castedAddr, &value, sizeof(T));
   }
 };
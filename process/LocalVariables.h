@@ -17,11 +17,39 @@
 #ifndef WEBASSEMBLY_PROCESS_LOCALVARIABLES_H
 #define WEBASSEMBLY_PROCESS_LOCALVARIABLES_H
 
+#include <cstdint>
+#include <cstring>
+
 namespace wasm {
 
-class LocalVariables final : public Variables {
+// The locals of the executing frame, which live in its frame on the trusted
+// stack; see TrustedStack::push_frame. Like other variables, each occupies a
+// 64-bit slot holding the raw bits of its value, so each access is a single
+// indexed load or store.
+class LocalVariables {
+  std::uint64_t* slots_;
+
 public:
-  LocalVariables();
+  LocalVariables()
+    : slots_(nullptr) {}
+  explicit LocalVariables(std::uint64_t* slots)
+    : slots_(slots) {}
+
+  std::uint64_t* data() const { return slots_; }
+
+  template <typename T>
+  T load(std::uint32_t index) const {
+    T value;
+    std::memcpy(&value, &slots_[index], sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  void store(std::uint32_t index, T value) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    slots_[index] = bits;
+  }
 };
 
 } // namespace wasm
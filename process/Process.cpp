@@ -20,6 +20,7 @@
 #include "process/LinearMemory.h"
 #include "process/TrustedStack.h"
 #include "module/Module.h"
+using namespace std;
 using namespace wasm;
 
 Process::Process()
@@ -28,3 +29,14 @@ Process::Process()
   , linearMemory_(new LinearMemory())
   , trustedStack_(new TrustedStack())
   , module_(new Module()) {}
+
+void
+Process::load(shared_ptr<const Module> module, TrapHandler* trapHandler) {
+  globalVariables_->resize(module->numGlobals_);
+  linearMemory_->resize(module->memorySize_, trapHandler);
+  for (const LinearMemoryInitializer& initializer : module->initializers_)
+    linearMemory_->initialize(initializer.address_,
+                              initializer.bytes_.data(),
+                              initializer.bytes_.size(), trapHandler);
+  module_ = module;
+}
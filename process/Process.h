@@ -25,16 +25,22 @@ class Environment;
 class GlobalVariables;
 class LinearMemory;
 class TrustedStack;
-class Module;
+class TrapHandler;
+struct Module;
 
 struct Process {
   std::unique_ptr<Environment> environment_;
   std::unique_ptr<GlobalVariables> globalVariables_;
   std::unique_ptr<LinearMemory> linearMemory_;
   std::unique_ptr<TrustedStack> trustedStack_;
-  std::unique_ptr<Module> module_;
+  // Immutable once loaded, so any number of processes, on any threads, can
+  // share it.
+  std::shared_ptr<const Module> module_;
 
   Process();
+
+  // Set up globals and linear memory for running module.
+  void load(std::shared_ptr<const Module> module, TrapHandler* trapHandler);
 };
 
 } // namespace wasm
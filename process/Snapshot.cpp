@@ -0,0 +1,63 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "process/Snapshot.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "implementation/Features.h"
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace wasm;
+
+Snapshot::~Snapshot() {
+  if (memoryFd_ >= 0)
+    close(memoryFd_);
+}
+
+bool
+Snapshot::capture(const Process& process) {
+#if WASM_HAVE_MEMFD
+  int fd = memfd_create("wasm-snapshot", MFD_CLOEXEC);
+  if (fd < 0)
+    return false;
+  if (!process.linearMemory_->writeSnapshot(fd)) {
+    close(fd);
+    return false;
+  }
+
+  if (memoryFd_ >= 0)
+    close(memoryFd_);
+  memoryFd_ = fd;
+  memorySize_ = process.linearMemory_->size();
+  globalVariables_ = *process.globalVariables_;
+  module_ = process.module_;
+  return true;
+#else
+  (void)process;
+  return false;
+#endif
+}
+
+bool
+Snapshot::instantiate(Process& process) const {
+  if (memoryFd_ < 0 ||
+      !process.linearMemory_->mapSnapshot(memoryFd_, memorySize_))
+    return false;
+
+  *process.globalVariables_ = globalVariables_;
+  process.module_ = module_;
+  return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_PROCESS_SNAPSHOT_H
+#define WEBASSEMBLY_PROCESS_SNAPSHOT_H
+
+#include "process/GlobalVariables.h"
+#include <cstddef>
+#include <memory>
+
+namespace wasm {
+
+struct Module;
+struct Process;
+
+// The state of an initialized process, from which new processes can be
+// created cheaply. Linear memory is kept in an anonymous file and mapped
+// copy-on-write into each new process, so instantiation costs a few system
+// calls rather than time proportional to the size of memory.
+//
+// A snapshot is taken between runs, when the trusted stack is empty, so new
+// processes start with a fresh one.
+class Snapshot {
+  std::shared_ptr<const Module> module_;
+  GlobalVariables globalVariables_;
+  int memoryFd_;
+  std::size_t memorySize_;
+
+public:
+  Snapshot()
+    : memoryFd_(-1)
+    , memorySize_(0) {}
+  ~Snapshot();
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  // Capture the state of process. Returns false if the host doesn't support
+  // snapshots.
+  bool capture(const Process& process);
+
+  // Make process, which must be freshly constructed, a copy of the captured
+  // state. Its linear memory may already have been reserved with guard
+  // pages. Returns false if the memory can't be mapped.
+  bool instantiate(Process& process) const;
+
+  // The captured process's module, shared by every process instantiated.
+  const std::shared_ptr<const Module>& module() const { return module_; }
+};
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "process/TrustedStack.h"
+#include "implementation/TrapHandler.h"
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+using namespace wasm;
+
+static size_t
+PageSize() {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+}
+
+TrustedStack::TrustedStack(size_t capacity)
+  : frames_(new Frame[capacity])
+  , capacity_(capacity)
+  , depth_(0)
+  , arena_(nullptr)
+  , arenaSize_(0)
+  , arenaTop_(nullptr)
+  , arenaLimit_(nullptr)
+  , guardTrapHandler_(nullptr) {
+  reserve(defaultArenaSize, nullptr);
+}
+
+TrustedStack::~TrustedStack() {
+  release();
+}
+
+void
+TrustedStack::release() {
+  if (guardTrapHandler_ != nullptr) {
+    guardTrapHandler_->removeGuardRegion(arenaLimit_);
+    guardTrapHandler_ = nullptr;
+  }
+  if (arena_ != nullptr)
+    munmap(arena_, arenaSize_);
+  arena_ = nullptr;
+  arenaSize_ = 0;
+  arenaTop_ = nullptr;
+  arenaLimit_ = nullptr;
+}
+
+// The guard page follows the arena, which is a whole number of pages, so that
+// the first slot past the end is on it.
+bool
+TrustedStack::reserve(size_t size, TrapHandler* trapHandler) {
+  size_t pageSize = PageSize();
+  size = (size + pageSize - 1) & ~(pageSize - 1);
+  size_t mappingSize = size + pageSize;
+  void* mapping = mmap(nullptr, mappingSize, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  if (mprotect(mapping, size, PROT_READ | PROT_WRITE) != 0) {
+    munmap(mapping, mappingSize);
+    return false;
+  }
+
+  release();
+  arena_ = mapping;
+  arenaSize_ = mappingSize;
+  arenaTop_ = static_cast<uint64_t*>(mapping);
+  arenaLimit_ = arenaTop_ + size / sizeof(uint64_t);
+  if (trapHandler == nullptr)
+    return true;
+  if (!trapHandler->addGuardRegion(arenaLimit_, pageSize,
+                                   "call stack exhausted"))
+    return false;
+  guardTrapHandler_ = trapHandler;
+  return true;
+}
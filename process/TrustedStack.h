@@ -17,9 +17,173 @@
 #ifndef WEBASSEMBLY_PROCESS_TRUSTEDSTACK_H
 #define WEBASSEMBLY_PROCESS_TRUSTEDSTACK_H
 
+#include "implementation/Features.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#if WASM_HAVE_X86_SIMD
+#include <emmintrin.h>
+#endif
+
 namespace wasm {
 
-class TrustedStack {};
+class TrapHandler;
+
+// The program's call stack: a frame for each routine executing, outermost
+// first. It's kept apart from the machine stack, where the program can't
+// reach it. It's only written by the thread running the process, but a
+// signal handler on that thread may read it at any point, so a frame is
+// filled in before it's counted, and the frames never move.
+//
+// The frames' variables are kept alongside, in an arena of 64-bit slots
+// which is allocated by bumping a pointer, so that calls never allocate
+// memory. Each routine's frame there holds a FrameLink followed by its
+// locals, and register and machine code allocate their slots above it. When
+// the arena is guarded, it's followed by a guard page, and allocations aren't
+// checked: every slot allocated is written in order, so an allocation which
+// overflows faults on the guard page, which traps.
+class TrustedStack {
+public:
+  struct Frame {
+    std::uint32_t routine;
+    // The index of the instruction executing, if the code running records
+    // it, and otherwise noPosition.
+    std::uint32_t position;
+  };
+  static const std::uint32_t noPosition = ~std::uint32_t(0);
+
+  // What a routine's frame in the arena returns to: its caller's locals, and
+  // the height of the operand stack when it was called.
+  struct FrameLink {
+    std::uint64_t* callerLocals;
+    std::uint64_t* stackHeight;
+  };
+
+  // Frames beyond this depth are counted but not recorded.
+  static const std::size_t defaultCapacity = std::size_t(1) << 14;
+  // The arena's size in bytes, committed as it's touched. The interpreter
+  // also recurses on the machine stack, which is sized from the arena so
+  // that the arena runs out first; see MachineStackSize.
+  static const std::size_t defaultArenaSize = std::size_t(1) << 20;
+
+private:
+  std::unique_ptr<Frame[]> frames_;
+  std::size_t capacity_;
+  std::atomic<std::size_t> depth_;
+  // The mapping holding the arena and, when guarded, its guard page.
+  void* arena_;
+  std::size_t arenaSize_;
+  std::uint64_t* arenaTop_;
+  std::uint64_t* arenaLimit_;
+  // When guarded, the trap handler the guard page's faults are reported to.
+  TrapHandler* guardTrapHandler_;
+
+  void release();
+
+  static const std::size_t linkSlots =
+    sizeof(FrameLink) / sizeof(std::uint64_t);
+
+  // Allocations are rounded up to pairs of slots, which keeps them 16-byte
+  // aligned so that they can be zeroed with whole vector stores.
+  std::uint64_t* allocate(std::size_t count) {
+    count = (count + 1) & ~std::size_t(1);
+    if (!guardTrapHandler_ && count > std::size_t(arenaLimit_ - arenaTop_))
+      return nullptr;
+    std::uint64_t* slots = arenaTop_;
+    arenaTop_ += count;
+    for (std::size_t i = 0; i < count; i += 2) {
+#if defined(__GNUC__)
+      // Keep the compiler from turning this into a call to memset, which
+      // costs more than the few stores a frame usually needs, and which
+      // needn't write in order, as overflowing onto the guard page relies on.
+      __asm__("" : "+r"(slots));
+#endif
+#if WASM_HAVE_X86_SIMD
+      _mm_store_si128(reinterpret_cast<__m128i*>(slots + i),
+                      _mm_setzero_si128());
+#else
+      slots[i] = 0;
+      slots[i + 1] = 0;
+#endif
+    }
+    return slots;
+  }
+
+public:
+  // The arena starts out unguarded and of the default size, or empty if it
+  // can't be mapped.
+  explicit TrustedStack(std::size_t capacity = defaultCapacity);
+  ~TrustedStack();
+
+  // Replace the arena, which must be empty, with one of size bytes. If
+  // trapHandler is non-null, the arena is guarded and overflowing it traps
+  // with "call stack exhausted". Returns false, leaving allocations checked,
+  // if the arena can't be mapped, in which case the old one is kept, or
+  // can't be guarded.
+  bool reserve(std::size_t size, TrapHandler* trapHandler);
+
+  TrustedStack(const TrustedStack&) = delete;
+  TrustedStack& operator=(const TrustedStack&) = delete;
+
+  void push(std::uint32_t routine) {
+    std::size_t depth = depth_.load(std::memory_order_relaxed);
+    if (depth < capacity_)
+      frames_[depth] = Frame{routine, noPosition};
+    std::atomic_signal_fence(std::memory_order_release);
+    depth_.store(depth + 1, std::memory_order_relaxed);
+  }
+  void pop() {
+    depth_.store(depth_.load(std::memory_order_relaxed) - 1,
+                 std::memory_order_relaxed);
+  }
+
+  // Allocate a routine's frame in the arena, with numLocals zeroed locals,
+  // and return its locals, or null if the arena is unguarded and full.
+  std::uint64_t* push_frame(std::size_t numLocals, std::uint64_t* callerLocals,
+                            std::uint64_t* stackHeight) {
+    std::uint64_t* slots = allocate(linkSlots + numLocals);
+    if (!slots)
+      return nullptr;
+    *reinterpret_cast<FrameLink*>(slots) = FrameLink{callerLocals, stackHeight};
+    return slots + linkSlots;
+  }
+  // Free the frame whose locals are at locals, and everything above it.
+  FrameLink pop_frame(std::uint64_t* locals) {
+    std::uint64_t* slots = locals - linkSlots;
+    arenaTop_ = slots;
+    return *reinterpret_cast<const FrameLink*>(slots);
+  }
+
+  // Allocate count zeroed slots for register or machine code, or return
+  // null if the arena is unguarded and full. They stay in place until
+  // pop_slots frees them.
+  std::uint64_t* push_slots(std::size_t count) { return allocate(count); }
+  void pop_slots(std::uint64_t* slots) { arenaTop_ = slots; }
+
+  // The number of frames, of which the first min(depth, capacity) are
+  // recorded.
+  std::size_t depth() const {
+    std::size_t depth = depth_.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return depth;
+  }
+  std::size_t capacity() const { return capacity_; }
+  // The arena's size in bytes, not counting its guard page.
+  std::size_t arena_size() const {
+    return (arenaLimit_ - static_cast<std::uint64_t*>(arena_)) *
+           sizeof(std::uint64_t);
+  }
+  const Frame& frame(std::size_t index) const { return frames_[index]; }
+
+  // Where the innermost frame's position is recorded, or null if the frame
+  // isn't recorded.
+  std::uint32_t* position() {
+    std::size_t depth = depth_.load(std::memory_order_relaxed);
+    return depth != 0 && depth <= capacity_ ? &frames_[depth - 1].position
+                                            : nullptr;
+  }
+};
 
 } // namespace wasm
 
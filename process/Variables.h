@@ -17,9 +17,35 @@
 #ifndef WEBASSEMBLY_PROCESS_VARIABLES_H
 #define WEBASSEMBLY_PROCESS_VARIABLES_H
 
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
 namespace wasm {
 
-class Variables {};
+// Storage for a set of variables. Each variable occupies one 64-bit slot and
+// holds the raw bits of its value.
+class Variables {
+  std::vector<std::uint64_t> slots_;
+
+public:
+  void resize(std::size_t count) { slots_.assign(count, 0); }
+  std::uint64_t* data() { return slots_.data(); }
+
+  template <typename T>
+  T load(std::uint32_t index) const {
+    T value;
+    std::memcpy(&value, &slots_[index], sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  void store(std::uint32_t index, T value) {
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    slots_[index] = bits;
+  }
+};
 
 } // namespace wasm
 
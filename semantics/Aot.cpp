@@ -0,0 +1,861 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Aot.h"
+#include "semantics/Context.h"
+#include "semantics/Instr.h"
+#include "semantics/Operators.h"
+#include "implementation/FFIHandler.h"
+#include "implementation/Hash.h"
+#include "module/MappedFile.h"
+#include "module/Module.h"
+#include <cinttypes>
+#include <cstdarg>
+#include <cstring>
+#include <dlfcn.h>
+#include <math.h>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace wasm;
+
+// Statements computing x from l and r, as the interpreter does. type is the
+// operands' type. Returns null if op isn't a binary operator.
+#define TRAP_IF(cond, why)                                                     \
+  "if (" cond ") {\n"                                                          \
+  "  runtime->trap(runtime->context, \"" why "\");\n"                          \
+  "  return;\n"                                                                \
+  "}\n"
+#define NAN_CHECK(bits, l, r)                                                  \
+  "if (x != x)\n"                                                              \
+  "  x = runtime->nanFloat" #bits "(runtime->context, " l ", " r ");"
+
+// The integer operators of width W, as IntOperators computes them. Negative
+// shift counts are masked, as the host's shift instructions do in the
+// interpreter; written unmasked, the host compiler could fold them
+// differently.
+#define INT_OPERATORS(W)                                                       \
+  case InstrOp::Int##W##Add:                                                   \
+    return "int" #W "_t x = uint" #W "_t(l) + uint" #W "_t(r);";               \
+  case InstrOp::Int##W##Sub:                                                   \
+    return "int" #W "_t x = uint" #W "_t(l) - uint" #W "_t(r);";               \
+  case InstrOp::Int##W##Mul:                                                   \
+    return "int" #W "_t x = uint" #W "_t(l) * uint" #W "_t(r);";               \
+  case InstrOp::Int##W##SDiv:                                                  \
+    return TRAP_IF("r == 0", "signed integer division by zero")                \
+      TRAP_IF("l == INT" #W "_MIN && r == -1",                                 \
+              "signed integer division overflow") "int" #W "_t x = l / r;";    \
+  case InstrOp::Int##W##UDiv:                                                  \
+    return TRAP_IF("r == 0", "unsigned integer division by zero")              \
+      "int" #W "_t x = uint" #W "_t(l) / uint" #W "_t(r);";                    \
+  case InstrOp::Int##W##SRem:                                                  \
+    return TRAP_IF("r == 0", "unsigned integer remainder by zero")             \
+      "int" #W "_t x = r == -1 ? 0 : l % r;";                                  \
+  case InstrOp::Int##W##URem:                                                  \
+    return TRAP_IF("r == 0", "unsigned integer remainder by zero")             \
+      "int" #W "_t x = uint" #W "_t(l) % uint" #W "_t(r);";                    \
+  case InstrOp::Int##W##And: return "int" #W "_t x = l & r;";                  \
+  case InstrOp::Int##W##Ior: return "int" #W "_t x = l | r;";                  \
+  case InstrOp::Int##W##Xor: return "int" #W "_t x = l ^ r;";                  \
+  case InstrOp::Int##W##Shl:                                                   \
+    return "int" #W "_t x = r >= " #W " ? 0 : "                                \
+           "uint" #W "_t(l) << (r & (" #W " - 1));";                           \
+  case InstrOp::Int##W##Shr:                                                   \
+    return "int" #W "_t x = r >= " #W " ? 0 : "                                \
+           "uint" #W "_t(l) >> (r & (" #W " - 1));";                           \
+  case InstrOp::Int##W##Sar:                                                   \
+    return "int" #W "_t x = l >> ((r > " #W " - 1 ? " #W " - 1 : r) & "        \
+           "(" #W " - 1));";                                                   \
+  case InstrOp::Int##W##Eq: return "int32_t x = l == r;";                      \
+  case InstrOp::Int##W##Slt: return "int32_t x = l < r;";                      \
+  case InstrOp::Int##W##Sle: return "int32_t x = l <= r;";                     \
+  case InstrOp::Int##W##Ult:                                                   \
+    return "int32_t x = uint" #W "_t(l) < uint" #W "_t(r);";                   \
+  case InstrOp::Int##W##Ule:                                                   \
+    return "int32_t x = uint" #W "_t(l) <= uint" #W "_t(r);";
+
+static const char*
+BinaryOperator(InstrOp op, const char** type) {
+  *type = "int32_t";
+  switch (op) {
+    INT_OPERATORS(32)
+    default: break;
+  }
+
+  *type = "int64_t";
+  switch (op) {
+    INT_OPERATORS(64)
+    default: break;
+  }
+
+  *type = "float";
+  switch (op) {
+    case InstrOp::Float32Eq: return "int32_t x = l == r;";
+    case InstrOp::Float32Lt: return "int32_t x = l < r;";
+    case InstrOp::Float32Le: return "int32_t x = l <= r;";
+    case InstrOp::Float32Add:
+      return "float x = l + r;\n" NAN_CHECK(32, "l", "r");
+    case InstrOp::Float32Sub:
+      return "float x = l - r;\n" NAN_CHECK(32, "l", "r");
+    case InstrOp::Float32Mul:
+      return "float x = l * r;\n" NAN_CHECK(32, "l", "r");
+    case InstrOp::Float32Div:
+      return "float x = r == 0 ? runtime->divideByZeroFloat32(l, r) : l / r;\n"
+        NAN_CHECK(32, "l", "r");
+    case InstrOp::Float32Copysign: return "float x = copysignf(l, r);";
+    default: break;
+  }
+
+  *type = "double";
+  switch (op) {
+    case InstrOp::Float64Eq: return "int32_t x = l == r;";
+    case InstrOp::Float64Lt: return "int32_t x = l < r;";
+    case InstrOp::Float64Le: return "int32_t x = l <= r;";
+    case InstrOp::Float64Add:
+      return "double x = l + r;\n" NAN_CHECK(64, "l", "r");
+    case InstrOp::Float64Sub:
+      return "double x = l - r;\n" NAN_CHECK(64, "l", "r");
+    case InstrOp::Float64Mul:
+      return "double x = l * r;\n" NAN_CHECK(64, "l", "r");
+    case InstrOp::Float64Div:
+      return "double x = r == 0 ? runtime->divideByZeroFloat64(l, r) : l / r;\n"
+        NAN_CHECK(64, "l", "r");
+    case InstrOp::Float64Copysign: return "double x = copysign(l, r);";
+    default: break;
+  }
+  return nullptr;
+}
+
+// Statements computing x from o, as the interpreter does. type is the
+// operand's type. Returns null if op isn't a unary operator.
+static const char*
+UnaryOperator(InstrOp op, const char** type) {
+  switch (op) {
+    case InstrOp::Int32FromInt64:
+      *type = "int64_t";
+      return "int32_t x = int32_t(o);";
+    case InstrOp::Int64FromSInt32:
+      *type = "int32_t";
+      return "int64_t x = o;";
+    case InstrOp::Int64FromUInt32:
+      *type = "int32_t";
+      return "int64_t x = uint32_t(o);";
+
+    case InstrOp::SInt32FromFloat64:
+      *type = "double";
+      return TRAP_IF("!(o > double(INT32_MIN) - 1 && "
+                     "o < double(INT32_MAX) + 1)",
+                     "float to signed integer conversion failure")
+        "int32_t x = o;";
+    case InstrOp::SInt32FromFloat32:
+      *type = "float";
+      return TRAP_IF("!(o > double(INT32_MIN) - 1 && "
+                     "o < double(INT32_MAX) + 1)",
+                     "float to signed integer conversion failure")
+        "int32_t x = o;";
+    case InstrOp::Uint32FromFloat64:
+      *type = "double";
+      return TRAP_IF("!(o > -1.0 && o < double(UINT32_MAX) + 1)",
+                     "float to unsigned integer conversion failure")
+        "int32_t x = uint32_t(o);";
+    case InstrOp::Uint32FromFloat32:
+      *type = "float";
+      return TRAP_IF("!(o > -1.0 && o < double(UINT32_MAX) + 1)",
+                     "float to unsigned integer conversion failure")
+        "int32_t x = uint32_t(o);";
+    case InstrOp::SInt64FromFloat64:
+      *type = "double";
+      return TRAP_IF("!(o >= double(INT64_MIN) && o < -double(INT64_MIN))",
+                     "float to signed integer conversion failure")
+        "int64_t x = o;";
+    case InstrOp::SInt64FromFloat32:
+      *type = "float";
+      return TRAP_IF("!(o >= double(INT64_MIN) && o < -double(INT64_MIN))",
+                     "float to signed integer conversion failure")
+        "int64_t x = o;";
+    case InstrOp::Uint64FromFloat64:
+      *type = "double";
+      return TRAP_IF("!(o > -1.0 && o < -2 * double(INT64_MIN))",
+                     "float to unsigned integer conversion failure")
+        "int64_t x = uint64_t(o);";
+    case InstrOp::Uint64FromFloat32:
+      *type = "float";
+      return TRAP_IF("!(o > -1.0 && o < -2 * double(INT64_MIN))",
+                     "float to unsigned integer conversion failure")
+        "int64_t x = uint64_t(o);";
+
+    case InstrOp::Float32Abs:
+      *type = "float";
+      return "float x = fabsf(o);";
+    case InstrOp::Float32Neg:
+      *type = "float";
+      return "float x = -o;";
+    case InstrOp::Float32Ceil:
+      *type = "float";
+      return "float x = ceilf(o);\n" NAN_CHECK(32, "o", "0");
+    case InstrOp::Float32Floor:
+      *type = "float";
+      return "float x = floorf(o);\n" NAN_CHECK(32, "o", "0");
+    case InstrOp::Float32Sqrt:
+      *type = "float";
+      return "float x = sqrtf(o);\n" NAN_CHECK(32, "o", "0");
+    case InstrOp::Float32FromFloat64:
+      *type = "double";
+      return "float x = o;\n" NAN_CHECK(32, "float(o)", "0");
+    case InstrOp::Float32FromSInt32:
+      *type = "int32_t";
+      return "float x = o;";
+    case InstrOp::Float32FromUInt32:
+      *type = "int32_t";
+      return "float x = uint32_t(o);";
+    case InstrOp::Float32FromSInt64:
+      *type = "int64_t";
+      return "float x = o;";
+    case InstrOp::Float32FromUInt64:
+      *type = "int64_t";
+      return "float x = uint64_t(o);";
+
+    case InstrOp::Float64Abs:
+      *type = "double";
+      return "double x = fabs(o);";
+    case InstrOp::Float64Neg:
+      *type = "double";
+      return "double x = -o;";
+    case InstrOp::Float64Ceil:
+      *type = "double";
+      return "double x = ceil(o);\n" NAN_CHECK(64, "o", "0");
+    case InstrOp::Float64Floor:
+      *type = "double";
+      return "double x = floor(o);\n" NAN_CHECK(64, "o", "0");
+    case InstrOp::Float64Sqrt:
+      *type = "double";
+      return "double x = sqrt(o);\n" NAN_CHECK(64, "o", "0");
+    case InstrOp::Float64FromFloat32:
+      *type = "float";
+      return "double x = o;\n" NAN_CHECK(64, "o", "0");
+    case InstrOp::Float64FromSInt32:
+      *type = "int32_t";
+      return "double x = o;";
+    case InstrOp::Float64FromUInt32:
+      *type = "int32_t";
+      return "double x = uint32_t(o);";
+    case InstrOp::Float64FromSInt64:
+      *type = "int64_t";
+      return "double x = o;";
+    case InstrOp::Float64FromUInt64:
+      *type = "int64_t";
+      return "double x = uint64_t(o);";
+
+    default:
+      return nullptr;
+  }
+}
+
+#undef INT_OPERATORS
+#undef TRAP_IF
+#undef NAN_CHECK
+
+// Whether a heap access moves 64 bits.
+static bool
+Is64(InstrOp op) {
+  switch (op) {
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float64LoadHeap:
+    case InstrOp::Float64LoadHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static const char*
+Getter(const char* type) {
+  if (strcmp(type, "int32_t") == 0)
+    return "AotInt32";
+  if (strcmp(type, "int64_t") == 0)
+    return "AotInt64";
+  if (strcmp(type, "float") == 0)
+    return "AotFloat32";
+  return "AotFloat64";
+}
+
+static uint64_t
+ModuleHash(const Module& module) {
+  return Hash64(module.file_->data(), module.file_->size());
+}
+
+namespace {
+
+const uint32_t noDepth = ~uint32_t(0);
+
+// Routines with more locals than this are interpreted, rather than handing
+// the host compiler a function with that many variables.
+const uint32_t maxLocals = 1 << 16;
+
+// Like the JIT, translation gives each operand stack depth a variable, since
+// depths are known statically; see JitCompiler. Values are held as 64-bit
+// slots, as in the interpreter, and each operator is a block which converts
+// its operands to their types, computes x, and stores x back.
+class AotEmitter {
+  const Module& module_;
+  const vector<Instr>& code_;
+  uint32_t numLocals_;
+  string body_;
+  uint32_t depth_;
+  uint32_t maxDepth_;
+  bool ok_;
+  vector<bool> isTarget_;
+  vector<uint32_t> targetDepths_;
+
+  void line(const char* format, ...);
+
+  // Emit each line of text indented within a block.
+  void lines(const char* text) {
+    while (*text) {
+      const char* end = strchr(text, '\n');
+      size_t length = end ? end - text : strlen(text);
+      body_ += "    ";
+      body_.append(text, length);
+      body_ += '\n';
+      text += length + (end ? 1 : 0);
+    }
+  }
+
+  // The variable of the nth entry from the top of the stack.
+  uint32_t top(uint32_t n = 0) const { return depth_ - 1 - n; }
+
+  bool need(uint32_t count) {
+    if (depth_ < count)
+      ok_ = false;
+    return ok_;
+  }
+
+  uint32_t push() {
+    maxDepth_ = max(maxDepth_, ++depth_);
+    return top();
+  }
+
+  void branch(uint32_t target) {
+    if (targetDepths_[target] == noDepth)
+      targetDepths_[target] = depth_;
+  }
+
+  uint64_t literal(uint32_t index) const { return module_.literals_[index]; }
+
+  void instr(const Instr& instr);
+
+public:
+  AotEmitter(const Module& module, const vector<Instr>& code,
+             uint32_t numLocals)
+    : module_(module)
+    , code_(code)
+    , numLocals_(numLocals)
+    , depth_(0)
+    , maxDepth_(0)
+    , ok_(true)
+    , isTarget_(code.size(), false)
+    , targetDepths_(code.size(), noDepth) {}
+
+  bool emit(uint32_t index, string* out);
+};
+
+} // namespace
+
+void
+AotEmitter::line(const char* format, ...) {
+  char buffer[256];
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+  body_ += "  ";
+  body_ += buffer;
+  body_ += '\n';
+}
+
+void
+AotEmitter::instr(const Instr& instr) {
+  uint32_t index = uint32_t(&instr - code_.data());
+  uint32_t payload = instr.payload;
+  const char* type;
+
+  if (const char* body = BinaryOperator(instr.op, &type)) {
+    if (!need(2))
+      return;
+    line("{");
+    line("  %s l = %s(s%u), r = %s(s%u);", type, Getter(type), top(1),
+         Getter(type), top());
+    lines(body);
+    line("  s%u = AotBits(x);", top(1));
+    line("}");
+    --depth_;
+    return;
+  }
+
+  if (const char* body = UnaryOperator(instr.op, &type)) {
+    if (!need(1))
+      return;
+    line("{");
+    line("  %s o = %s(s%u);", type, Getter(type), top());
+    lines(body);
+    line("  s%u = AotBits(x);", top());
+    line("}");
+    return;
+  }
+
+  // 32-bit values are zero-extended in their slots.
+  switch (instr.op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Float32GetLocal:
+      line("s%u = uint32_t(l%u);", push(), payload);
+      break;
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float64GetLocal:
+      line("s%u = l%u;", push(), payload);
+      break;
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Float32SetLocal:
+      if (need(1))
+        line("l%u = s%u = uint32_t(s%u);", payload, top(), top());
+      break;
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float64SetLocal:
+      if (need(1))
+        line("l%u = s%u;", payload, top());
+      break;
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+      line("s%u = uint32_t(runtime->globals[%u]);", push(), payload);
+      break;
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+      line("s%u = runtime->globals[%u];", push(), payload);
+      break;
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+      if (need(1))
+        line("runtime->globals[%u] = s%u = uint32_t(s%u);", payload, top(),
+             top());
+      break;
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float64StoreGlobal:
+      if (need(1))
+        line("runtime->globals[%u] = s%u;", payload, top());
+      break;
+    case InstrOp::Int32Literal:
+    case InstrOp::Float32Literal:
+      line("s%u = UINT64_C(0x%" PRIx64 ");", push(),
+           literal(payload) & UINT32_MAX);
+      break;
+    case InstrOp::Int64Literal:
+    case InstrOp::Float64Literal:
+      line("s%u = UINT64_C(0x%" PRIx64 ");", push(), literal(payload));
+      break;
+    case InstrOp::Int32AddressOf:
+      line("s%u = %uu;", push(), payload);
+      break;
+
+    case InstrOp::Int32LoadHeap:
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Float32LoadHeap:
+    case InstrOp::Float64LoadHeap:
+      if (need(1))
+        line("s%u = AotLoadHeap<%s>(runtime, AotInt32(s%u), 0, %u);", top(),
+             Is64(instr.op) ? "uint64_t" : "uint32_t", top(), payload);
+      break;
+    case InstrOp::Int32LoadHeapWithOffset:
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Float32LoadHeapWithOffset:
+    case InstrOp::Float64LoadHeapWithOffset:
+      if (need(1))
+        line("s%u = AotLoadHeap<%s>(runtime, AotInt32(s%u), "
+             "AotInt32(UINT64_C(0x%" PRIx64 ")), 0);",
+             top(), Is64(instr.op) ? "uint64_t" : "uint32_t", top(),
+             literal(payload) & UINT32_MAX);
+      break;
+    case InstrOp::Int32StoreHeap:
+    case InstrOp::Float32StoreHeap:
+      if (!need(2))
+        break;
+      line("s%u = uint32_t(s%u);", top(1), top(1));
+      line("AotStoreHeap<uint32_t>(runtime, AotInt32(s%u), 0, %u, s%u);",
+           top(), payload, top(1));
+      --depth_;
+      break;
+    case InstrOp::Int64StoreHeap:
+    case InstrOp::Float64StoreHeap:
+      if (!need(2))
+        break;
+      line("AotStoreHeap<uint64_t>(runtime, AotInt32(s%u), 0, %u, s%u);",
+           top(), payload, top(1));
+      --depth_;
+      break;
+    case InstrOp::Int32StoreHeapWithOffset:
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float32StoreHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset: {
+      if (!need(2))
+        break;
+      bool is64 = Is64(instr.op);
+      if (!is64)
+        line("s%u = uint32_t(s%u);", top(1), top(1));
+      line("AotStoreHeap<%s>(runtime, AotInt32(s%u), "
+           "AotInt32(UINT64_C(0x%" PRIx64 ")), 0, s%u);",
+           is64 ? "uint64_t" : "uint32_t", top(),
+           literal(payload) & UINT32_MAX, top(1));
+      --depth_;
+      break;
+    }
+
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Float64CallDirect:
+      line("s%u = runtime->call(runtime->context, %u);", push(), payload);
+      break;
+
+    case InstrOp::Int32fromFloat32Bits:
+    case InstrOp::Float32FromInt32Bits:
+      if (need(1))
+        line("s%u = uint32_t(s%u);", top(), top());
+      break;
+    case InstrOp::Int64FromFloat64Bits:
+    case InstrOp::Float64FromInt64Bits:
+      // The bits are unchanged.
+      need(1);
+      break;
+
+    case InstrOp::Br:
+      branch(payload);
+      if (payload <= index)
+        line("AotSafePoint(runtime);");
+      line("goto L%u;", payload);
+      break;
+    case InstrOp::BrIf:
+      if (!need(1))
+        break;
+      --depth_;
+      branch(payload);
+      if (payload > index) {
+        line("if (AotInt32(s%u))", depth_);
+        line("  goto L%u;", payload);
+        break;
+      }
+      line("if (AotInt32(s%u)) {", depth_);
+      line("  AotSafePoint(runtime);");
+      line("  goto L%u;", payload);
+      line("}");
+      break;
+
+    case InstrOp::MemoryCopy:
+    case InstrOp::MemoryFill:
+      if (!need(3))
+        break;
+      depth_ -= 3;
+      line("runtime->%s(runtime->context, AotInt32(s%u), AotInt32(s%u), "
+           "AotInt32(s%u));",
+           instr.op == InstrOp::MemoryCopy ? "copyHeap" : "fillHeap", depth_,
+           depth_ + 1, depth_ + 2);
+      break;
+    case InstrOp::Int32CallFFI: {
+      uint32_t arity = FFIHandler::arity(FFIHandler::CallID(payload));
+      if (!need(arity))
+        break;
+      depth_ -= arity;
+      if (arity == 0) {
+        line("s%u = runtime->callForeign(runtime->context, %uu, nullptr);",
+             push(), payload);
+        break;
+      }
+      string args;
+      for (uint32_t i = 0; i < arity; ++i)
+        args += (i ? ", s" : "s") + to_string(depth_ + i);
+      line("{");
+      line("  const uint64_t args[] = {%s};", args.c_str());
+      line("  s%u = runtime->callForeign(runtime->context, %uu, args);", push(),
+           payload);
+      line("}");
+      break;
+    }
+
+    case InstrOp::Fuel:
+      line("AotConsumeFuel(runtime, %uu);", payload);
+      break;
+
+    case InstrOp::End:
+      if (depth_ > 0)
+        line("runtime->result(runtime->context, s%u);", top());
+      line("return;");
+      break;
+
+    default:
+      // Indirect calls, and superinstructions, which only fused code has.
+      ok_ = false;
+      break;
+  }
+}
+
+bool
+AotEmitter::emit(uint32_t index, string* out) {
+  if (numLocals_ > maxLocals)
+    return false;
+
+  for (const Instr& instr : code_)
+    if (instr.op == InstrOp::Br || instr.op == InstrOp::BrIf)
+      isTarget_[instr.payload] = true;
+
+  bool fallsThrough = true;
+  for (size_t i = 0; i < code_.size() && ok_; ++i) {
+    if (!fallsThrough)
+      depth_ = targetDepths_[i] != noDepth ? targetDepths_[i] : 0;
+    else if (targetDepths_[i] == noDepth)
+      targetDepths_[i] = depth_;
+    if (isTarget_[i])
+      body_ += "L" + to_string(i) + ":\n";
+    instr(code_[i]);
+    fallsThrough = code_[i].op != InstrOp::Br;
+  }
+  if (!ok_)
+    return false;
+
+  *out = "\nstatic void\nRoutine" + to_string(index) +
+         "(const AotRuntime* runtime) {\n";
+  for (uint32_t i = 0; i < numLocals_; ++i)
+    *out += "  uint64_t l" + to_string(i) + " = 0;\n";
+  for (uint32_t i = 0; i < maxDepth_; ++i)
+    *out += "  uint64_t s" + to_string(i) + " = 0;\n";
+  *out += body_;
+  *out += "}\n";
+  return true;
+}
+
+bool
+wasm::EmitAot(const Module& module, FILE* out, const char** why) {
+  if (!module.file_) {
+    *why = "module wasn't loaded from a file";
+    return false;
+  }
+
+  fputs("// Translated from a WebAssembly module by wasm-shell --aot-emit.\n"
+        "// Do not edit; see semantics/AotRuntime.h.\n"
+        "\n"
+        "#include \"semantics/AotRuntime.h\"\n"
+        "#include <cstdint>\n"
+        "#include <math.h>\n"
+        "using namespace wasm;\n",
+        out);
+
+  uint32_t numRoutines = module.numRoutines();
+  vector<bool> translated(numRoutines, false);
+  for (uint32_t index = 0; index < numRoutines; ++index) {
+    Routine routine;
+    if (!module.routine(index, &routine)) {
+      *why = "routine body out of bounds";
+      return false;
+    }
+    vector<Instr> code;
+    if (!Decode(module, routine, &code, why))
+      return false;
+    Meter(code);
+    uint32_t maxDepth;
+    if (!MeasureDepths(code, &maxDepth, why))
+      return false;
+    AotEmitter emitter(module, code, routine.numLocals_);
+    string source;
+    if (emitter.emit(index, &source)) {
+      fputs(source.c_str(), out);
+      translated[index] = true;
+    }
+  }
+
+  // The table ends with an extra null, so that it's never empty.
+  fputs("\nstatic const AotRoutine routines[] = {\n", out);
+  for (uint32_t index = 0; index < numRoutines; ++index) {
+    if (translated[index])
+      fprintf(out, "  Routine%u,\n", index);
+    else
+      fputs("  nullptr,\n", out);
+  }
+  fputs("  nullptr,\n};\n", out);
+  fprintf(out,
+          "\nextern \"C\" const AotModule wasm_aot_module = {\n"
+          "  aotVersion, %u, UINT64_C(0x%016" PRIx64 "), routines,\n};\n",
+          numRoutines, ModuleHash(module));
+
+  if (ferror(out)) {
+    *why = "error writing translated code";
+    return false;
+  }
+  return true;
+}
+
+AotLibrary::~AotLibrary() {
+  if (handle_)
+    dlclose(handle_);
+}
+
+bool
+AotLibrary::open(const char* path, const Module& module, const char** why) {
+  if (!module.file_) {
+    *why = "module wasn't loaded from a file";
+    return false;
+  }
+
+  // dlopen only searches for names without a slash.
+  string name = strchr(path, '/') ? string(path) : "./" + string(path);
+  void* handle = dlopen(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    *why = dlerror();
+    return false;
+  }
+
+  const AotModule* aot =
+    static_cast<const AotModule*>(dlsym(handle, "wasm_aot_module"));
+  if (!aot)
+    *why = "not a translated module";
+  else if (aot->version != aotVersion)
+    *why = "translated by a different version of wasm-shell";
+  else if (aot->numRoutines != module.numRoutines() ||
+           aot->moduleHash != ModuleHash(module))
+    *why = "translated from a different module";
+  else {
+    if (handle_)
+      dlclose(handle_);
+    handle_ = handle;
+    module_ = aot;
+    return true;
+  }
+  dlclose(handle);
+  return false;
+}
+
+// Slow paths, called from translated code through AotRuntime.
+
+static float
+NaNFloat32(Context* context, float l, float r) {
+  return nan_float32(context, l, r);
+}
+
+static double
+NaNFloat64(Context* context, double l, double r) {
+  return nan_float64(context, l, r);
+}
+
+// The interpreter takes the sign of an infinite quotient from l * r, which
+// for an infinite l is the sign of the host's default NaN. Computing it here
+// keeps the host compiler from folding it differently in translated code.
+static float
+DivideByZeroFloat32(float l, float r) {
+  return l == 0 ? float(NAN) : copysignf(INFINITY, l * r);
+}
+
+static double
+DivideByZeroFloat64(double l, double r) {
+  return l == 0 ? NAN : copysign(INFINITY, l * r);
+}
+
+static void
+Trap(Context* context, const char* why) {
+  context->trap(why);
+}
+
+static uint64_t
+LoadHeap32(Context* context, int32_t p, int32_t i, uint32_t p2align) {
+  return AotBits(context->load_heap_int32(p, i, p2align));
+}
+
+static uint64_t
+LoadHeap64(Context* context, int32_t p, int32_t i, uint32_t p2align) {
+  return AotBits(context->load_heap_float64(p, i, p2align));
+}
+
+static void
+StoreHeap32(Context* context, int32_t p, int32_t i, uint32_t p2align,
+            uint64_t v) {
+  context->store_heap_int32(p, i, p2align, AotInt32(v));
+}
+
+static void
+StoreHeap64(Context* context, int32_t p, int32_t i, uint32_t p2align,
+            uint64_t v) {
+  context->store_heap_float64(p, i, p2align, AotFloat64(v));
+}
+
+static void
+CopyHeap(Context* context, int32_t d, int32_t s, int32_t n) {
+  context->copy_heap(d, s, n);
+}
+
+static void
+FillHeap(Context* context, int32_t d, int32_t v, int32_t n) {
+  context->fill_heap(d, v, n);
+}
+
+static uint64_t
+CallForeign(Context* context, uint32_t callee, const uint64_t* args) {
+  return AotBits(context->call_ffi(callee, args));
+}
+
+static uint64_t
+Call(Context* context, uint32_t index) {
+  context->call(index);
+  return context->pop_bits();
+}
+
+static void
+Result(Context* context, uint64_t bits) {
+  context->push_bits(bits);
+}
+
+static void
+Poll(Context* context) {
+  context->poll();
+}
+
+static void
+OutOfFuel(Context* context) {
+  context->out_of_fuel();
+}
+
+void
+wasm::ExecuteAot(AotRoutine routine, Context* context, uint64_t* globals,
+                 uint8_t* memory) {
+  AotRuntime runtime = {context,
+                        globals,
+                        memory,
+                        NaNFloat32,
+                        NaNFloat64,
+                        DivideByZeroFloat32,
+                        DivideByZeroFloat64,
+                        Trap,
+                        LoadHeap32,
+                        LoadHeap64,
+                        StoreHeap32,
+                        StoreHeap64,
+                        CopyHeap,
+                        FillHeap,
+                        CallForeign,
+                        Call,
+                        Result,
+                        &context->counters()->countdown,
+                        Poll,
+                        &context->counters()->fuel,
+                        OutOfFuel};
+  routine(&runtime);
+}
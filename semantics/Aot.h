@@ -0,0 +1,75 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_AOT_H
+#define WEBASSEMBLY_SEMANTICS_AOT_H
+
+#include "semantics/AotRuntime.h"
+#include <cstdint>
+#include <cstdio>
+
+namespace wasm {
+
+class Context;
+struct Module;
+
+// Translate every routine of module to C++ and write it to out, as a source
+// file to be compiled into a shared object and loaded with AotLibrary; see
+// AotRuntime.h. Each routine becomes a function whose operand stack is
+// resolved to local variables and whose branches are gotos, with each
+// operator written out as the interpreter computes it. Routines using
+// something the translation doesn't support, such as indirect calls, are
+// left to the interpreter. Translated code is metered as by Meter, so it
+// consumes fuel exactly as interpreted code does.
+//
+// The module must have been loaded from a file, since the output is keyed by
+// its contents. On failure, including an invalid routine, returns false and
+// sets why to the reason; out may have been partly written.
+bool EmitAot(const Module& module, FILE* out, const char** why);
+
+// A shared object compiled from EmitAot's output, loaded into the process.
+class AotLibrary {
+  void* handle_;
+  const AotModule* module_;
+
+public:
+  AotLibrary()
+    : handle_(nullptr)
+    , module_(nullptr) {}
+  ~AotLibrary();
+
+  AotLibrary(const AotLibrary&) = delete;
+  AotLibrary& operator=(const AotLibrary&) = delete;
+
+  // Load the shared object at path, checking that it was translated from
+  // exactly this module against this version of AotRuntime. On failure,
+  // returns false and sets why to the reason.
+  bool open(const char* path, const Module& module, const char** why);
+
+  // The translated routine at index, or null if it's interpreted.
+  AotRoutine routine(std::uint32_t index) const {
+    return module_->routines[index];
+  }
+};
+
+// Run a translated routine with the given globals and linear memory. memory
+// must be null unless the memory needs no explicit bounds checks.
+void ExecuteAot(AotRoutine routine, Context* context, std::uint64_t* globals,
+                std::uint8_t* memory);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_AOTRUNTIME_H
+#define WEBASSEMBLY_SEMANTICS_AOTRUNTIME_H
+
+// The interface between wasm-shell and modules translated ahead of time to
+// C++. Translated sources include this header and nothing else from the
+// interpreter, and are compiled into a shared object with, for example,
+//
+//   c++ -std=c++11 -O2 -shared -fPIC -I<source root> module.cpp -o module.so
+//
+// They call back into wasm-shell through the function pointers here rather
+// than linking against it, so the shared object needs no symbols from the
+// executable that loads it.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wasm {
+
+class Context;
+
+// Changed whenever this interface or the code translated against it changes.
+const std::uint32_t aotVersion = 8;
+
+// What translated code needs from the process running it. The slow paths are
+// the interpreter's own, so translated code traps, chooses NaN bits and
+// checks heap accesses exactly as the interpreter does.
+struct AotRuntime {
+  Context* context;
+  std::uint64_t* globals;
+  // The linear memory, if every address formed from a 32-bit base and a
+  // 32-bit offset is either in bounds or faults. Otherwise null, and heap
+  // accesses go through the checked slow paths.
+  std::uint8_t* memory;
+
+  float (*nanFloat32)(Context* context, float l, float r);
+  double (*nanFloat64)(Context* context, double l, double r);
+  float (*divideByZeroFloat32)(float l, float r);
+  double (*divideByZeroFloat64)(double l, double r);
+  void (*trap)(Context* context, const char* why);
+  std::uint64_t (*loadHeap32)(Context* context, std::int32_t p,
+                              std::int32_t i, std::uint32_t p2align);
+  std::uint64_t (*loadHeap64)(Context* context, std::int32_t p,
+                              std::int32_t i, std::uint32_t p2align);
+  void (*storeHeap32)(Context* context, std::int32_t p, std::int32_t i,
+                      std::uint32_t p2align, std::uint64_t v);
+  void (*storeHeap64)(Context* context, std::int32_t p, std::int32_t i,
+                      std::uint32_t p2align, std::uint64_t v);
+  // Bulk operations, which always check their ranges, even in guarded
+  // memory.
+  void (*copyHeap)(Context* context, std::int32_t d, std::int32_t s,
+                   std::int32_t n);
+  void (*fillHeap)(Context* context, std::int32_t d, std::int32_t v,
+                   std::int32_t n);
+  // Call the host function FFIHandler::CallID(callee) with its operands'
+  // bits in args, returning its result.
+  std::uint64_t (*callForeign)(Context* context, std::uint32_t callee,
+                               const std::uint64_t* args);
+  // Call the routine at index, returning its result.
+  std::uint64_t (*call)(Context* context, std::uint32_t index);
+  // Leave bits on the operand stack as the routine's result.
+  void (*result)(Context* context, std::uint64_t bits);
+  // Safe points remaining before poll must be called; see Context.h.
+  std::int32_t* countdown;
+  void (*poll)(Context* context);
+  // Fuel remaining, charged once per basic block; see Meter in Instr.h.
+  std::int64_t* fuel;
+  void (*outOfFuel)(Context* context);
+};
+
+typedef void (*AotRoutine)(const AotRuntime* runtime);
+
+// The table a translated module exports, as the C symbol wasm_aot_module.
+struct AotModule {
+  std::uint32_t version;
+  std::uint32_t numRoutines;
+  // Hash64 of the module file the code was translated from.
+  std::uint64_t moduleHash;
+  // Indexed by routine. Null for routines which weren't translated, which are
+  // interpreted instead.
+  const AotRoutine* routines;
+};
+
+// Translated code holds every value as the 64 bits of its operand stack slot
+// or local, exactly as the interpreter does, and converts with these.
+
+inline std::int32_t
+AotInt32(std::uint64_t bits) {
+  std::int32_t value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline std::int64_t
+AotInt64(std::uint64_t bits) {
+  std::int64_t value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline float
+AotFloat32(std::uint64_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline double
+AotFloat64(std::uint64_t bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+template <typename T>
+inline std::uint64_t
+AotBits(T value) {
+  std::uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(T));
+  return bits;
+}
+
+// Backward branches are safe points, as in the interpreter.
+inline void
+AotSafePoint(const AotRuntime* runtime) {
+  if (--*runtime->countdown == 0)
+    runtime->poll(runtime->context);
+}
+
+// Translated code is always metered. Unless the process has a fuel limit,
+// it starts with more fuel than it can use.
+inline void
+AotConsumeFuel(const AotRuntime* runtime, std::uint32_t amount) {
+  if ((*runtime->fuel -= amount) < 0)
+    runtime->outOfFuel(runtime->context);
+}
+
+// An access to guarded memory traps by faulting, so the host compiler must
+// make every one as written, in order: unlike with memcpy, it mustn't drop a
+// load whose value is unused, or merge or move stores. Accesses are volatile,
+// and of unaligned types, since addresses needn't be aligned.
+template <typename T>
+inline T
+AotLoadGuarded(const std::uint8_t* address) {
+#if defined(__GNUC__)
+  struct __attribute__((packed, may_alias)) Unaligned {
+    T value;
+  };
+  return reinterpret_cast<const volatile Unaligned*>(address)->value;
+#else
+  const volatile std::uint8_t* bytes = address;
+  std::uint8_t copy[sizeof(T)];
+  for (std::size_t i = 0; i < sizeof(T); ++i)
+    copy[i] = bytes[i];
+  T value;
+  std::memcpy(&value, copy, sizeof(T));
+  return value;
+#endif
+}
+
+template <typename T>
+inline void
+AotStoreGuarded(std::uint8_t* address, T value) {
+#if defined(__GNUC__)
+  struct __attribute__((packed, may_alias)) Unaligned {
+    T value;
+  };
+  reinterpret_cast<volatile Unaligned*>(address)->value = value;
+#else
+  std::uint8_t copy[sizeof(T)];
+  std::memcpy(copy, &value, sizeof(T));
+  volatile std::uint8_t* bytes = address;
+  for (std::size_t i = 0; i < sizeof(T); ++i)
+    bytes[i] = copy[i];
+#endif
+}
+
+// Heap accesses move raw bits, like LinearMemory's, so one pair per size
+// serves every type.
+template <typename T>
+inline std::uint64_t
+AotLoadHeap(const AotRuntime* runtime, std::int32_t p, std::int32_t i,
+            std::uint32_t p2align) {
+  if (!runtime->memory)
+    return sizeof(T) == 8
+             ? runtime->loadHeap64(runtime->context, p, i, p2align)
+             : runtime->loadHeap32(runtime->context, p, i, p2align);
+  return AotBits(AotLoadGuarded<T>(runtime->memory +
+                                  std::uint64_t(std::uint32_t(p)) +
+                                  std::uint32_t(i)));
+}
+
+template <typename T>
+inline void
+AotStoreHeap(const AotRuntime* runtime, std::int32_t p, std::int32_t i,
+             std::uint32_t p2align, std::uint64_t v) {
+  if (!runtime->memory) {
+    if (sizeof(T) == 8)
+      runtime->storeHeap64(runtime->context, p, i, p2align, v);
+    else
+      runtime->storeHeap32(runtime->context, p, i, p2align, v);
+    return;
+  }
+  AotStoreGuarded(runtime->memory + std::uint64_t(std::uint32_t(p)) +
+                    std::uint32_t(i),
+                  T(v));
+}
+
+} // namespace wasm
+
+#endif // include guard
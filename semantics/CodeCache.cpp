@@ -0,0 +1,614 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/CodeCache.h"
+#include "semantics/Aot.h"
+#include "semantics/CodeCacheFormat.h"
+#include "implementation/BuildID.h"
+#include "implementation/FFIHandler.h"
+#include "implementation/Hash.h"
+#include "implementation/ParallelFor.h"
+#include "implementation/TrapHandler.h"
+#include "module/MappedFile.h"
+#include "module/Module.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+using namespace std;
+using namespace wasm;
+
+size_t
+CompiledRoutine::bytes() const {
+  return sizeof(*this) + code.capacity() * sizeof(Instr) +
+         registerCode.code.capacity() * sizeof(RegInstr) +
+         registerCode.constants.capacity() * sizeof(uint64_t) +
+         jitCode.size();
+}
+
+CodeCache::CodeCache(const Module& module, TrapHandler* trapHandler,
+                     const RunOptions& options, bool uncheckedHeap)
+  : module_(module)
+  , trapHandler_(trapHandler)
+  , dispatch_(options.dispatch)
+  , engine_(options.engine)
+  , fuse_(options.fuse)
+  , meter_(options.fuel != 0)
+  , uncheckedHeap_(uncheckedHeap)
+  , frozen_(false)
+  , aotLibrary_(options.aotLibrary)
+  , limit_(options.codeCacheLimit)
+  , bytes_(0)
+  , clock_(0)
+  , entries_(module.numRoutines())
+  , key_(0) {}
+
+// Compile the routine at index, from its saved code if that checks out. This
+// only reads the module, so it can run on several threads at once.
+shared_ptr<CompiledRoutine>
+CodeCache::build(uint32_t index, const char** why) const {
+  Routine routine;
+  if (!module_.routine(index, &routine)) {
+    *why = "routine body out of bounds";
+    return nullptr;
+  }
+  if (savedFile_) {
+    if (shared_ptr<CompiledRoutine> restored = restore(index, routine))
+      return restored;
+  }
+
+  shared_ptr<CompiledRoutine> compiled = make_shared<CompiledRoutine>();
+  compiled->numLocals = routine.numLocals_;
+  compiled->aotRoutine =
+    engine_ == Engine::aot ? aotLibrary_->routine(index) : nullptr;
+  // Translated routines were validated when they were translated.
+  if (compiled->aotRoutine)
+    return compiled;
+
+  vector<Instr> code;
+  if (!Decode(module_, routine, &code, why))
+    return nullptr;
+  if (meter_)
+    Meter(code);
+  if (!MeasureDepths(code, &compiled->maxDepth, why))
+    return nullptr;
+  switch (engine_) {
+    case Engine::jit:
+      if (JitCompile(code, module_, routine.numLocals_, uncheckedHeap_,
+                     &compiled->jitCode))
+        break;
+      // Interpret routines the JIT doesn't support.
+      // Fall through.
+    case Engine::stack:
+    case Engine::aot:
+      if (fuse_)
+        Fuse(code);
+      Link(code, dispatch_);
+      compiled->code.swap(code);
+      break;
+    case Engine::register_:
+      compiled->registerCode = Translate(code, module_, routine, dispatch_);
+      break;
+  }
+  return compiled;
+}
+
+// The instruction whose payloads a superinstruction reads and which it
+// skips over are left in place after it, so it checks as the first of them.
+static InstrOp
+Unfused(InstrOp op) {
+  switch (op) {
+    case InstrOp::Int32AddLocalLiteral:
+    case InstrOp::Int32LoadHeapLocalWithOffset:
+    case InstrOp::Float32LoadHeapLocalWithOffset:
+    case InstrOp::Float64LoadHeapLocalWithOffset:
+      return InstrOp::Int32GetLocal;
+    case InstrOp::BrIfInt32Slt:
+      return InstrOp::Int32Slt;
+    case InstrOp::BrIfInt32Eq:
+      return InstrOp::Int32Eq;
+    default:
+      return op;
+  }
+}
+
+// Whether the instructions a superinstruction at code[i] skips over are the
+// ones Fuse absorbed into it.
+static bool
+CheckAbsorbed(const vector<Instr>& code, size_t i) {
+  auto next = [&code, i](size_t n, InstrOp op) {
+    return i + n < code.size() && code[i + n].op == op;
+  };
+  switch (code[i].op) {
+    case InstrOp::Int32AddLocalLiteral:
+      return next(1, InstrOp::Int32Literal) && next(2, InstrOp::Int32Add);
+    case InstrOp::Int32LoadHeapLocalWithOffset:
+      return next(1, InstrOp::Int32LoadHeapWithOffset);
+    case InstrOp::Float32LoadHeapLocalWithOffset:
+      return next(1, InstrOp::Float32LoadHeapWithOffset);
+    case InstrOp::Float64LoadHeapLocalWithOffset:
+      return next(1, InstrOp::Float64LoadHeapWithOffset);
+    case InstrOp::BrIfInt32Slt:
+    case InstrOp::BrIfInt32Eq:
+      return next(1, InstrOp::BrIf);
+    default:
+      return true;
+  }
+}
+
+// Whether the payload of an unfused stack-form instruction indexes something
+// that exists, as Decode checks of the node it came from.
+static bool
+CheckPayload(InstrOp op, uint32_t payload, const Module& module,
+             uint32_t numLocals, size_t numInstrs) {
+  switch (op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float32GetLocal:
+    case InstrOp::Float64GetLocal:
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float32SetLocal:
+    case InstrOp::Float64SetLocal:
+      return payload < numLocals;
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+    case InstrOp::Float64StoreGlobal:
+      return payload < module.numGlobals_;
+    case InstrOp::Int32Literal:
+    case InstrOp::Int64Literal:
+    case InstrOp::Float32Literal:
+    case InstrOp::Float64Literal:
+    case InstrOp::Int32LoadHeapWithOffset:
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Float32LoadHeapWithOffset:
+    case InstrOp::Float64LoadHeapWithOffset:
+    case InstrOp::Int32StoreHeapWithOffset:
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float32StoreHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset:
+      return payload < module.literals_.size();
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Float64CallDirect:
+    case InstrOp::Int32AddressOf:
+      return payload < module.numRoutines();
+    case InstrOp::Int32CallFFI:
+      return payload < FFIHandler::numCalls;
+    case InstrOp::Br:
+    case InstrOp::BrIf:
+      return payload < numInstrs;
+    default:
+      return true;
+  }
+}
+
+// Whether the slots and payload of a register instruction are in range, by
+// the rules Translate follows; see RegInstr.h.
+static bool
+CheckRegInstr(const RegInstr& instr, const Module& module,
+              const RegisterCode& code, size_t numInstrs) {
+  uint32_t numSlots = code.numSlots;
+  auto slot = [numSlots](uint32_t index) { return index < numSlots; };
+  switch (instr.op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float32GetLocal:
+    case InstrOp::Float64GetLocal:
+    case InstrOp::Int32Literal:
+    case InstrOp::Int64Literal:
+    case InstrOp::Float32Literal:
+    case InstrOp::Float64Literal:
+    case InstrOp::Int32AddressOf:
+    case InstrOp::Int32AddLocalLiteral:
+    case InstrOp::Int32LoadHeapLocalWithOffset:
+    case InstrOp::Float32LoadHeapLocalWithOffset:
+    case InstrOp::Float64LoadHeapLocalWithOffset:
+    case InstrOp::BrIfInt32Slt:
+    case InstrOp::BrIfInt32Eq:
+      // Folded into operands, or only formed in the stack form.
+      return false;
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float32SetLocal:
+    case InstrOp::Float64SetLocal:
+    case InstrOp::Int32LoadHeap:
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Float32LoadHeap:
+    case InstrOp::Float64LoadHeap:
+      return slot(instr.dst) && slot(instr.a);
+    case InstrOp::Int32StoreHeap:
+    case InstrOp::Int64StoreHeap:
+    case InstrOp::Float32StoreHeap:
+    case InstrOp::Float64StoreHeap:
+      return slot(instr.a) && slot(instr.b);
+    case InstrOp::Int32StoreHeapWithOffset:
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float32StoreHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset:
+    case InstrOp::MemoryCopy:
+    case InstrOp::MemoryFill:
+      return slot(instr.a) && slot(instr.b) && slot(instr.payload);
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+      return slot(instr.dst) && instr.payload < module.numGlobals_;
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+    case InstrOp::Float64StoreGlobal:
+      return slot(instr.a) && instr.payload < module.numGlobals_;
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Float64CallDirect:
+      return slot(instr.dst) && instr.payload < module.numRoutines();
+    case InstrOp::Int32CallIndirect:
+    case InstrOp::Int64CallIndirect:
+    case InstrOp::Float32CallIndirect:
+    case InstrOp::Float64CallIndirect:
+      return slot(instr.dst);
+    case InstrOp::Int32CallFFI:
+      return instr.payload < FFIHandler::numCalls && slot(instr.dst) &&
+             instr.a <= numSlots &&
+             FFIHandler::arity(FFIHandler::CallID(instr.payload)) <=
+               numSlots - instr.a;
+    case InstrOp::Br:
+      return instr.payload < numInstrs;
+    case InstrOp::BrIf:
+      return slot(instr.a) && instr.payload < numInstrs;
+    case InstrOp::Fuel:
+      return true;
+    case InstrOp::End:
+      return instr.a == noSlot || slot(instr.a);
+    default:
+      // Everything else is a unary or binary operator, whose unused b is 0.
+      return slot(instr.dst) && slot(instr.a) && slot(instr.b);
+  }
+}
+
+// Copy the saved code of the routine at index, filling in its handlers. The
+// file may be corrupt or stale, so the code is checked by the rules it was
+// compiled under, as for code that was decoded and translated: every payload
+// and slot must index something that exists, and saved stack-form depths
+// must be those MeasureDepths finds again. Returns null if any check fails,
+// so the routine is compiled from the module instead.
+shared_ptr<CompiledRoutine>
+CodeCache::restore(uint32_t index, const Routine& routine) const {
+  const SavedRoutine& saved = saved_[index];
+  if (saved.numLocals != routine.numLocals_ || saved.numInstrs == 0)
+    return nullptr;
+  shared_ptr<CompiledRoutine> compiled = make_shared<CompiledRoutine>();
+  compiled->numLocals = saved.numLocals;
+  compiled->maxDepth = saved.maxDepth;
+
+  switch (engine_) {
+    case Engine::stack: {
+      View<SavedInstr> code;
+      if (!savedFile_->array(saved.codeOffset, saved.numInstrs, &code))
+        return nullptr;
+      vector<Instr>& out = compiled->code;
+      out.reserve(code.size());
+      for (const SavedInstr& instr : code) {
+        if (instr.op >= numInstrOps)
+          return nullptr;
+        out.push_back(
+          Instr{nullptr, InstrOp(instr.op), instr.depth, instr.payload});
+      }
+      if (out.back().op != InstrOp::End)
+        return nullptr;
+
+      vector<Instr> unfused = out;
+      for (size_t i = 0; i < out.size(); ++i) {
+        if (!CheckAbsorbed(out, i))
+          return nullptr;
+        unfused[i].op = Unfused(out[i].op);
+        if (!CheckPayload(unfused[i].op, out[i].payload, module_,
+                          saved.numLocals, out.size()))
+          return nullptr;
+      }
+      uint32_t maxDepth;
+      const char* why;
+      if (!MeasureDepths(unfused, &maxDepth, &why) ||
+          maxDepth != saved.maxDepth)
+        return nullptr;
+      for (size_t i = 0; i < out.size(); ++i)
+        if (unfused[i].depth != out[i].depth)
+          return nullptr;
+      Link(out, dispatch_);
+      break;
+    }
+    case Engine::register_: {
+      View<SavedRegInstr> code;
+      View<uint64_t> constants;
+      if (!savedFile_->array(saved.codeOffset, saved.numInstrs, &code) ||
+          !savedFile_->array(saved.constantsOffset, saved.numConstants,
+                             &constants))
+        return nullptr;
+      RegisterCode& out = compiled->registerCode;
+      out.constants.assign(constants.begin(), constants.end());
+      out.constantBase = saved.constantBase;
+      out.numSlots = saved.numSlots;
+      if (out.constantBase != saved.numLocals ||
+          out.constantBase > out.numSlots ||
+          out.constants.size() > out.numSlots - out.constantBase)
+        return nullptr;
+      out.code.reserve(code.size());
+      for (const SavedRegInstr& instr : code) {
+        if (instr.op >= numInstrOps)
+          return nullptr;
+        InstrOp op = InstrOp(instr.op);
+        out.code.push_back(RegInstr{
+          dispatch_ == Dispatch::threaded ? RegisterHandler(op) : nullptr, op,
+          instr.dst, instr.a, instr.b, instr.payload});
+        if (!CheckRegInstr(out.code.back(), module_, out, code.size()))
+          return nullptr;
+      }
+      if (out.code.back().op != InstrOp::End)
+        return nullptr;
+      break;
+    }
+    case Engine::jit:
+    case Engine::aot:
+      // Never saved.
+      return nullptr;
+  }
+  return compiled;
+}
+
+shared_ptr<const CompiledRoutine>
+CodeCache::compile(uint32_t index) {
+  const char* why;
+  shared_ptr<const CompiledRoutine> compiled = build(index, &why);
+  if (!compiled) {
+    trapHandler_->trap(why);
+    return nullptr;
+  }
+  if (limit_ != 0)
+    evict(compiled->bytes());
+  insert(index, compiled);
+  return compiled;
+}
+
+void
+CodeCache::insert(uint32_t index,
+                  const shared_ptr<const CompiledRoutine>& compiled) {
+  bytes_ += compiled->bytes();
+  resident_.push_back(index);
+  entries_[index].compiled = compiled;
+}
+
+// CPU time consumed by the calling thread. Unlike elapsed time, this doesn't
+// count time the thread spent waiting for a core.
+static double
+ThreadSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+CodeCache::compileAll(unsigned jobs, CompileStats* stats) {
+  size_t count = entries_.size();
+  vector<shared_ptr<const CompiledRoutine>> compiled(count);
+  vector<const char*> why(count, nullptr);
+  vector<double> work(max(jobs, 1u), 0);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  ParallelFor(count, jobs, [&](unsigned worker, size_t index) {
+    if (entries_[index].compiled)
+      return;
+    double begin = ThreadSeconds();
+    compiled[index] = build(index, &why[index]);
+    work[worker] += ThreadSeconds() - begin;
+  });
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  for (size_t index = 0; index < count; ++index) {
+    if (why[index]) {
+      trapHandler_->trap(why[index]);
+      return;
+    }
+    if (compiled[index])
+      insert(index, compiled[index]);
+  }
+  if (limit_ != 0)
+    evict(0);
+
+  if (stats) {
+    stats->routines = count;
+    stats->jobs = jobs;
+    stats->seconds = elapsed.count();
+    stats->workSeconds = 0;
+    for (double seconds : work)
+      stats->workSeconds += seconds;
+  }
+}
+
+void
+CodeCache::freeze(unsigned jobs, CompileStats* stats) {
+  limit_ = 0;
+  compileAll(jobs, stats);
+  frozen_ = true;
+}
+
+// Evict least recently used routines until needed more bytes fit under the
+// limit, or nothing is left to evict.
+void
+CodeCache::evict(size_t needed) {
+  while (!resident_.empty() && bytes_ + needed > limit_) {
+    auto oldest = min_element(resident_.begin(), resident_.end(),
+                              [this](uint32_t l, uint32_t r) {
+                                return entries_[l].lastUse <
+                                       entries_[r].lastUse;
+                              });
+    Entry& entry = entries_[*oldest];
+    bytes_ -= entry.compiled->bytes();
+    entry.compiled.reset();
+    *oldest = resident_.back();
+    resident_.pop_back();
+  }
+}
+
+uint64_t
+CodeCache::key() const {
+  if (key_ == 0 && module_.file_) {
+    uint64_t options =
+      uint64_t(engine_) << 2 | uint64_t(meter_) << 1 | uint64_t(fuse_);
+    key_ = Hash64(module_.file_->data(), module_.file_->size(),
+                  BuildID() ^ options);
+  }
+  return key_;
+}
+
+bool
+CodeCache::open(const char* path) {
+  shared_ptr<MappedFile> file = make_shared<MappedFile>();
+  View<CodeCacheHeader> header;
+  View<SavedRoutine> saved;
+  if (!module_.file_ || engine_ == Engine::jit || engine_ == Engine::aot ||
+      !file->open(path) ||
+      !file->array(0, 1, &header) ||
+      !file->array(sizeof(CodeCacheHeader), header[0].numRoutines, &saved))
+    return false;
+
+  const CodeCacheHeader& h = header[0];
+  if (memcmp(h.magic, codeCacheMagic, sizeof(codeCacheMagic)) != 0 ||
+      h.version != codeCacheVersion ||
+      h.numRoutines != module_.numRoutines() || h.key != key() ||
+      h.moduleSize != module_.file_->size() || h.buildID != BuildID() ||
+      h.engine != uint32_t(engine_) || h.fuse != uint32_t(fuse_) ||
+      h.meter != uint32_t(meter_))
+    return false;
+
+  savedFile_ = file;
+  saved_ = saved;
+  return true;
+}
+
+// Append count elements of data to out, aligned to 8 bytes, and return
+// their offset.
+template <typename T>
+static uint64_t
+Append(vector<uint8_t>& out, const T* data, size_t count) {
+  size_t offset = (out.size() + 7) & ~size_t(7);
+  out.resize(offset + count * sizeof(T));
+  if (count != 0)
+    memcpy(&out[offset], data, count * sizeof(T));
+  return offset;
+}
+
+static bool
+WriteFile(const char* path, const vector<uint8_t>& bytes) {
+  string temp = string(path) + "." + to_string(getpid()) + ".tmp";
+  int fd =
+    ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+
+  size_t written = 0;
+  while (written < bytes.size()) {
+    ssize_t n = write(fd, bytes.data() + written, bytes.size() - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  bool ok = close(fd) == 0 && written == bytes.size() &&
+            rename(temp.c_str(), path) == 0;
+  if (!ok)
+    unlink(temp.c_str());
+  return ok;
+}
+
+bool
+CodeCache::save(const char* path) {
+  if (!module_.file_ || engine_ == Engine::jit || engine_ == Engine::aot)
+    return false;
+
+  uint32_t count = entries_.size();
+  vector<SavedRoutine> saved(count);
+  vector<uint8_t> out(sizeof(CodeCacheHeader) + count * sizeof(SavedRoutine));
+
+  for (uint32_t index = 0; index < count; ++index) {
+    shared_ptr<const CompiledRoutine> compiled = entries_[index].compiled;
+    const char* why;
+    if (!compiled && !(compiled = build(index, &why)))
+      return false;
+
+    SavedRoutine& routine = saved[index];
+    memset(&routine, 0, sizeof(routine));
+    routine.numLocals = compiled->numLocals;
+    routine.maxDepth = compiled->maxDepth;
+    switch (engine_) {
+      case Engine::stack: {
+        vector<SavedInstr> code;
+        for (const Instr& instr : compiled->code)
+          code.push_back(
+            SavedInstr{uint16_t(instr.op), instr.depth, instr.payload});
+        routine.numInstrs = code.size();
+        routine.codeOffset = Append(out, code.data(), code.size());
+        break;
+      }
+      case Engine::register_: {
+        const RegisterCode& registerCode = compiled->registerCode;
+        vector<SavedRegInstr> code;
+        for (const RegInstr& instr : registerCode.code)
+          code.push_back(SavedRegInstr{uint32_t(instr.op), instr.dst, instr.a,
+                                       instr.b, instr.payload});
+        routine.numInstrs = code.size();
+        routine.codeOffset = Append(out, code.data(), code.size());
+        routine.numConstants = registerCode.constants.size();
+        routine.constantBase = registerCode.constantBase;
+        routine.numSlots = registerCode.numSlots;
+        routine.constantsOffset =
+          Append(out, registerCode.constants.data(),
+                 registerCode.constants.size());
+        break;
+      }
+      case Engine::jit:
+      case Engine::aot:
+        break;
+    }
+  }
+
+  CodeCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, codeCacheMagic, sizeof(codeCacheMagic));
+  header.version = codeCacheVersion;
+  header.numRoutines = count;
+  header.key = key();
+  header.moduleSize = module_.file_->size();
+  header.buildID = BuildID();
+  header.engine = uint32_t(engine_);
+  header.fuse = fuse_;
+  header.meter = meter_;
+  memcpy(&out[0], &header, sizeof(header));
+  if (count != 0)
+    memcpy(&out[sizeof(header)], saved.data(), count * sizeof(SavedRoutine));
+
+  return WriteFile(path, out);
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_CODECACHE_H
+#define WEBASSEMBLY_SEMANTICS_CODECACHE_H
+
+#include "semantics/AotRuntime.h"
+#include "semantics/Instr.h"
+#include "semantics/Jit.h"
+#include "semantics/RegInstr.h"
+#include "semantics/Run.h"
+#include "module/View.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace wasm {
+
+class MappedFile;
+class TrapHandler;
+struct Module;
+struct Routine;
+struct SavedRoutine;
+
+// A routine decoded and validated into the form the chosen engine executes.
+struct CompiledRoutine {
+  std::uint32_t numLocals;
+  // The greatest depth of the routine's operands; see MeasureDepths.
+  std::uint32_t maxDepth;
+  // Stack form, for Engine::stack.
+  std::vector<Instr> code;
+  // Register form, for Engine::register_.
+  RegisterCode registerCode;
+  // Machine code, for Engine::jit. If the routine couldn't be compiled, it's
+  // empty and code holds the routine to interpret instead.
+  JitCode jitCode;
+  // Translated code, for Engine::aot. Likewise, if it's null, code holds the
+  // routine to interpret.
+  AotRoutine aotRoutine;
+
+  std::size_t bytes() const;
+};
+
+// Timings of compiling all of a module's routines at once.
+struct CompileStats {
+  std::size_t routines;
+  unsigned jobs;
+  // Elapsed time, and the CPU time spent compiling summed over all threads.
+  // Their ratio is the speedup over compiling on one thread.
+  double seconds;
+  double workSeconds;
+};
+
+// The compiled routines of a module. Every routine starts out as an empty
+// stub; calling it decodes, validates and links it, so routines which are
+// never called are never materialized. If a limit is set, the least recently
+// called routines are evicted to stay under it, and are compiled again if
+// they are called again. Routines still executing hold a reference to their
+// code, so evicting them is safe.
+//
+// Compiled code can be saved to a file and used by later runs, in which case
+// compiling a routine only copies its saved instructions, checks them and
+// fills in their handlers, without decoding or translating it again. Saved
+// code which doesn't check out is compiled from the module instead.
+class CodeCache {
+  struct Entry {
+    std::shared_ptr<const CompiledRoutine> compiled;
+    std::uint64_t lastUse;
+  };
+
+  const Module& module_;
+  TrapHandler* trapHandler_;
+  Dispatch dispatch_;
+  Engine engine_;
+  bool fuse_;
+  bool meter_;
+  bool uncheckedHeap_;
+  bool frozen_;
+  const AotLibrary* aotLibrary_;
+  std::size_t limit_;
+  std::size_t bytes_;
+  std::uint64_t clock_;
+  std::vector<Entry> entries_;
+  // Indices of the entries which are currently compiled.
+  std::vector<std::uint32_t> resident_;
+  // Computed on first use, since it hashes the whole module.
+  mutable std::uint64_t key_;
+  // The saved code in use, if any.
+  std::shared_ptr<MappedFile> savedFile_;
+  View<SavedRoutine> saved_;
+
+  std::shared_ptr<CompiledRoutine> build(std::uint32_t index,
+                                         const char** why) const;
+  std::shared_ptr<CompiledRoutine> restore(std::uint32_t index,
+                                           const Routine& routine) const;
+  std::shared_ptr<const CompiledRoutine> compile(std::uint32_t index);
+  void insert(std::uint32_t index,
+              const std::shared_ptr<const CompiledRoutine>& compiled);
+  void evict(std::size_t needed);
+
+public:
+  // If uncheckedHeap is set, the process's linear memory needs no explicit
+  // bounds checks, so compiled code may access it directly.
+  CodeCache(const Module& module, TrapHandler* trapHandler,
+            const RunOptions& options, bool uncheckedHeap = false);
+
+  // Return the compiled routine at index, which must be a valid routine
+  // index, compiling it if necessary. Traps if the routine is invalid. Not
+  // for use on a frozen cache, since it records the call.
+  std::shared_ptr<const CompiledRoutine> get(std::uint32_t index) {
+    Entry& entry = entries_[index];
+    entry.lastUse = ++clock_;
+    if (entry.compiled)
+      return entry.compiled;
+    return compile(index);
+  }
+
+  // Compile every routine now, on up to jobs threads, as for validating a
+  // module before it is deployed. The result is the same as compiling each
+  // routine serially; if several are invalid, the one with the lowest index
+  // traps. If stats is non-null, it receives the timings.
+  void compileAll(unsigned jobs, CompileStats* stats = nullptr);
+
+  // Compile every routine as compileAll does, then stop tracking calls and
+  // evicting. A frozen cache is never written again, so processes running on
+  // several threads can share it, fetching routines with compiled.
+  void freeze(unsigned jobs, CompileStats* stats = nullptr);
+  bool frozen() const { return frozen_; }
+
+  // Return the compiled routine at index in a frozen cache.
+  const CompiledRoutine& compiled(std::uint32_t index) const {
+    return *entries_[index].compiled;
+  }
+
+  // Whether compiled code accesses linear memory without bounds checks, so
+  // it may only run in processes whose memory is guarded.
+  bool uncheckedHeap() const { return uncheckedHeap_; }
+
+  // A hash of the module's contents, the executable's build and the options
+  // which affect compiled code. Saved code is only valid for the same key.
+  std::uint64_t key() const;
+
+  // Use the code saved in the file at path, if it was saved for the same
+  // module, build and options. Returns false, leaving the cache unchanged,
+  // if it wasn't or the file can't be read.
+  bool open(const char* path);
+
+  // Save the compiled code of every routine to the file at path, compiling
+  // any routines which aren't already. The file is written under a temporary
+  // name and renamed into place, so concurrent readers never see a partial
+  // file. Returns false if a routine is invalid or the file can't be written,
+  // or for Engine::jit and Engine::aot, whose code lives in this process.
+  bool save(const char* path);
+};
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_CODECACHEFORMAT_H
+#define WEBASSEMBLY_SEMANTICS_CODECACHEFORMAT_H
+
+#include <cstdint>
+
+namespace wasm {
+
+// The layout of a saved code cache file, which holds every routine of one
+// module compiled for one engine. Like module files, these are little-endian
+// and used in place by mapping them. They hold no pointers: instructions are
+// stored without their handlers, which are filled in when a routine is first
+// used, so a file stays valid wherever the executable is loaded.
+//
+// A file starts with a CodeCacheHeader, followed by numRoutines
+// SavedRoutines. Offsets are from the start of the file.
+
+static const char codeCacheMagic[8] = {'\0', 'w', 'a', 's', 'm', 'c', 'c',
+                                       '\0'};
+static const std::uint32_t codeCacheVersion = 3;
+
+// A file is only used if all of these match the module being run, the
+// executable running it, and its options.
+struct CodeCacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t numRoutines;
+  std::uint64_t key;
+  std::uint64_t moduleSize;
+  std::uint64_t buildID;
+  std::uint32_t engine;
+  std::uint32_t fuse;
+  std::uint32_t meter;
+  std::uint32_t reserved;
+};
+
+// For Engine::stack, code holds numInstrs SavedInstrs. For Engine::register_,
+// it holds numInstrs SavedRegInstrs, and constants holds numConstants
+// std::uint64_ts.
+struct SavedRoutine {
+  std::uint32_t numLocals;
+  std::uint32_t numInstrs;
+  std::uint32_t numConstants;
+  std::uint32_t constantBase;
+  std::uint32_t numSlots;
+  std::uint32_t maxDepth;
+  std::uint64_t codeOffset;
+  std::uint64_t constantsOffset;
+};
+
+struct SavedInstr {
+  std::uint16_t op;
+  std::uint16_t depth;
+  std::uint32_t payload;
+};
+
+struct SavedRegInstr {
+  std::uint32_t op;
+  std::uint32_t dst;
+  std::uint32_t a;
+  std::uint32_t b;
+  std::uint32_t payload;
+};
+
+static_assert(sizeof(CodeCacheHeader) == 56, "unexpected padding");
+static_assert(sizeof(SavedRoutine) == 40, "unexpected padding");
+static_assert(sizeof(SavedInstr) == 8, "unexpected padding");
+static_assert(sizeof(SavedRegInstr) == 20, "unexpected padding");
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Context.h"
+#include "semantics/Aot.h"
+#include "semantics/CodeCache.h"
+#include "semantics/Instr.h"
+#include "semantics/RegInstr.h"
+#include "implementation/FFIHandler.h"
+#include "implementation/Fiber.h"
+#include "implementation/TrapHandler.h"
+#include "process/TrustedStack.h"
+#include <memory>
+using namespace std;
+using namespace wasm;
+
+Context::Context(Implementation& implementation, Process& process,
+                 CodeCache& codeCache, const RunOptions& options)
+  : implementation_(implementation)
+  , process_(process)
+  , module_(*process.module_)
+  , codeCache_(codeCache)
+  , options_(options)
+  , counters_{pollInterval,
+              options.fuel != 0 ? int64_t(options.fuel) : INT64_MAX}
+  , poller_(nullptr)
+  , stackLimit_(0) {}
+
+Context::~Context() {
+  implementation_.ffiHandler_->finish();
+}
+
+void
+Context::interpret(const CompiledRoutine& routine, uint32_t index) {
+  Interpret(routine.code.data(), options_.dispatch, this, options_.pairCounts,
+            options_.profile, index,
+            options_.sampler ? process_.trustedStack_->position() : nullptr);
+}
+
+// Operands a frame may push beyond its routine's greatest depth: the result
+// of a call, or the operands of an FFI call, from code not interpreted.
+static const size_t maxExtraDepth = 4;
+
+// Each frame gets fresh locals on the trusted stack; the caller's are
+// restored on return. The operand stack is checked once here for room for the
+// whole frame, so pushes never check.
+void
+Context::execute(const CompiledRoutine& routine, uint32_t index) {
+  TrustedStack& trustedStack = *process_.trustedStack_;
+  if (!evalStack_.fits(routine.maxDepth + maxExtraDepth)) {
+    trap("operand stack exhausted");
+    return;
+  }
+  uint64_t* locals = trustedStack.push_frame(routine.numLocals, locals_.data(),
+                                             evalStack_.top());
+  if (!locals) {
+    trap("call stack exhausted");
+    return;
+  }
+  locals_ = LocalVariables(locals);
+
+  switch (options_.engine) {
+    case Engine::stack:
+      interpret(routine, index);
+      break;
+    case Engine::register_:
+      InterpretRegisters(routine.registerCode, options_.dispatch, this);
+      break;
+    case Engine::jit:
+      if (routine.jitCode.entry())
+        ExecuteJit(routine.jitCode, this, process_.globalVariables_->data(),
+                   process_.linearMemory_->data());
+      else
+        interpret(routine, index);
+      break;
+    case Engine::aot:
+      if (routine.aotRoutine)
+        ExecuteAot(routine.aotRoutine, this, process_.globalVariables_->data(),
+                   process_.linearMemory_->checked()
+                     ? nullptr
+                     : process_.linearMemory_->data());
+      else
+        interpret(routine, index);
+      break;
+  }
+
+  // Keep only the frame's result, the last operand it left, if any.
+  TrustedStack::FrameLink link = trustedStack.pop_frame(locals);
+  uint64_t* top = evalStack_.top();
+  if (top > link.stackHeight) {
+    *link.stackHeight = top[-1];
+    evalStack_.set_top(link.stackHeight + 1);
+  }
+  locals_ = LocalVariables(link.callerLocals);
+}
+
+// Calls trap with this much machine stack left, which is meant to be enough
+// for anything a call does before it makes another: the engine's frames,
+// compiling the callee, a host function, and trapping.
+static const size_t machineStackReserve = size_t(256) << 10;
+
+// A frozen cache may be shared with other threads, so it's only read. Any
+// other cache may evict the routine while it runs, so hold a reference, in
+// the context like the rest of the frame's state. The frame is on the trusted
+// stack while the routine is fetched, since a miss compiles it.
+void
+Context::invoke(uint32_t index) {
+  char here;
+  if (uintptr_t(&here) < stackLimit_) {
+    trap("call stack exhausted");
+    return;
+  }
+  TrustedStack& trustedStack = *process_.trustedStack_;
+  trustedStack.push(index);
+  if (codeCache_.frozen()) {
+    execute(codeCache_.compiled(index), index);
+  } else {
+    routines_.push_back(codeCache_.get(index));
+    execute(*routines_.back(), index);
+    routines_.pop_back();
+  }
+  trustedStack.pop();
+}
+
+// Traps, and faults in the process's guard regions, land here, off the
+// signal handler. The machine stack is the one the process starts on, which
+// it keeps even if it's suspended and resumed on another thread. The frames
+// a trap abandons keep their state in the context, as when a process times
+// out.
+bool
+Context::start(uint32_t index) {
+  const void* stackLimit = Fiber::StackLimit();
+  stackLimit_ = stackLimit ? uintptr_t(stackLimit) + machineStackReserve : 0;
+  struct Start {
+    Context* context;
+    uint32_t index;
+  } start = {this, index};
+  return implementation_.trapHandler_->runGuarded(
+    [](void* arg) {
+      Start* start = static_cast<Start*>(arg);
+      start->context->invoke(start->index);
+    },
+    &start);
+}
+
+void
+Context::call(uint32_t index) {
+  safe_point();
+  size_t height = evalStack_.size();
+  invoke(index);
+  if (evalStack_.size() <= height)
+    trap("routine returned no value");
+}
+
+uint64_t*
+Context::push_slots(size_t numSlots) {
+  uint64_t* slots = process_.trustedStack_->push_slots(numSlots);
+  if (!slots)
+    trap("call stack exhausted");
+  return slots;
+}
+
+void
+Context::pop_slots(uint64_t* slots) {
+  process_.trustedStack_->pop_slots(slots);
+}
+
+void
+Context::call_ffi(uint32_t callee) {
+  implementation_.ffiHandler_->call(FFIHandler::CallID(callee), this);
+}
+
+int32_t
+Context::call_ffi(uint32_t callee, const uint64_t* args) {
+  unsigned arity = FFIHandler::arity(FFIHandler::CallID(callee));
+  for (unsigned i = 0; i < arity; ++i)
+    push_bits(args[i]);
+  call_ffi(callee);
+  return pop_int32();
+}
+
+void
+Context::poll() {
+  counters_.countdown = pollInterval;
+  if (poller_)
+    poller_->poll();
+}
+
+// Without a poller, there's no way to stop just this process.
+void
+Context::out_of_fuel() {
+  if (poller_)
+    poller_->time_out();
+  trap("out of fuel");
+}
+
+void
+Context::trap(const char* why) {
+  implementation_.trapHandler_->trap(why);
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_CONTEXT_H
+#define WEBASSEMBLY_SEMANTICS_CONTEXT_H
+
+#include "implementation/Implementation.h"
+#include "semantics/Run.h"
+#include "process/EvalStack.h"
+#include "process/GlobalVariables.h"
+#include "process/LinearMemory.h"
+#include "process/LocalVariables.h"
+#include "process/Process.h"
+#include "module/Module.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace wasm {
+
+class CodeCache;
+struct CompiledRoutine;
+
+// Consulted periodically at a context's safe points: loop back-edges and
+// calls, where no frame's state is held on the machine stack outside the
+// context. The scheduler uses this to suspend a process whose time slice has
+// run out.
+class Poller {
+public:
+  virtual void poll() = 0;
+
+  // Stop the process for good, as it has run out of fuel or time. Doesn't
+  // return.
+  virtual void time_out() = 0;
+
+protected:
+  ~Poller() {}
+};
+
+// The state an executing routine operates on: the operand stack, the current
+// frame's locals, and access to the process and implementation.
+class Context {
+public:
+  // Counters which compiled code updates in place.
+  struct Counters {
+    // Safe points remaining before the poller is next consulted.
+    std::int32_t countdown;
+    // Fuel remaining. Unmetered code never charges it.
+    std::int64_t fuel;
+  };
+
+private:
+  Implementation& implementation_;
+  Process& process_;
+  const Module& module_;
+  CodeCache& codeCache_;
+  const RunOptions& options_;
+  // The current frame's locals. The state of the frames below it, and the
+  // slots of frames of register and machine code, are on the process's
+  // trusted stack rather than the machine stack, so that a suspended process
+  // can be discarded without unwinding.
+  LocalVariables locals_;
+  EvalStack evalStack_;
+  Counters counters_;
+  Poller* poller_;
+  // Calls trap once the machine stack reaches down to here, since each call
+  // also recurses on it. Zero if its limit isn't known.
+  std::uintptr_t stackLimit_;
+  // Compiled routines held while they execute, if they may be evicted.
+  std::vector<std::shared_ptr<const CompiledRoutine>> routines_;
+
+  void interpret(const CompiledRoutine& routine, std::uint32_t index);
+  void execute(const CompiledRoutine& routine, std::uint32_t index);
+  void invoke(std::uint32_t index);
+
+  template <typename T>
+  void push(T value) {
+    evalStack_.push(value);
+  }
+
+  template <typename T>
+  T pop() {
+    return evalStack_.pop<T>();
+  }
+
+  // Heap addresses are an unsigned base plus an unsigned offset. The sum is
+  // computed in 64 bits so that it can't wrap around into bounds.
+  static std::uint64_t effective_address(std::int32_t p, std::int32_t i) {
+    return std::uint64_t(std::uint32_t(p)) + std::uint32_t(i);
+  }
+
+  template <typename T>
+  T load_heap(std::int32_t p, std::int32_t i, std::uint8_t p2align) {
+    return process_.linearMemory_->load<std::uint64_t, T>(
+      effective_address(p, i), p2align, implementation_.trapHandler_.get());
+  }
+
+  template <typename T>
+  void store_heap(std::int32_t p, std::int32_t i, std::uint8_t p2align,
+                  T value) {
+    process_.linearMemory_->store<std::uint64_t, T>(
+      effective_address(p, i), p2align, implementation_.trapHandler_.get(),
+      value);
+  }
+
+  template <typename T>
+  T read_literal(std::uint32_t index) const {
+    std::uint64_t bits = module_.literals_[index];
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+
+public:
+  Context(Implementation& implementation, Process& process,
+          CodeCache& codeCache, const RunOptions& options);
+  // Makes the writes the process queued, while its memory is still there.
+  ~Context();
+
+  // Run the routine at index in a new frame, leaving its result, the last
+  // operand it leaves, if any, on the operand stack. Returns false if it
+  // trapped.
+  bool start(std::uint32_t index);
+
+  // Call the routine at index, which takes no operands and leaves its result
+  // on the operand stack.
+  void call(std::uint32_t index);
+
+  // Safe points consult poller once every pollInterval times they're reached.
+  static const std::int32_t pollInterval = 1024;
+  void set_poller(Poller* poller) { poller_ = poller; }
+
+  // Called at every safe point. Compiled code decrements the countdown
+  // itself and calls poll when it reaches zero.
+  void safe_point() {
+    if (--counters_.countdown == 0)
+      poll();
+  }
+  void poll();
+
+  // Charge fuel on entry to a basic block of metered code; see Meter.
+  void consume_fuel(std::uint32_t amount) {
+    counters_.fuel -= amount;
+    if (counters_.fuel < 0)
+      out_of_fuel();
+  }
+  void out_of_fuel();
+
+  Counters* counters() { return &counters_; }
+
+  // Allocate numSlots zeroed slots for a frame of register or machine code.
+  // They stay in place until the matching pop_slots.
+  std::uint64_t* push_slots(std::size_t numSlots);
+  void pop_slots(std::uint64_t* slots);
+
+  // The operand stack, which the interpreter keeps its own cursor on between
+  // calls; other code goes through the pushes and pops below.
+  EvalStack& eval_stack() { return evalStack_; }
+
+  void push_int32(std::int32_t x) { push(x); }
+  void push_int64(std::int64_t x) { push(x); }
+  void push_float32(float x) { push(x); }
+  void push_float64(double x) { push(x); }
+  void push_boolean(bool x) { push(std::int32_t(x)); }
+  // Values as raw bits, zero-extended to 64 bits, for code which moves them
+  // without knowing their type.
+  void push_bits(std::uint64_t bits) { push(bits); }
+  std::uint64_t pop_bits() { return pop<std::uint64_t>(); }
+  std::int32_t pop_int32() { return pop<std::int32_t>(); }
+  std::int64_t pop_int64() { return pop<std::int64_t>(); }
+  float pop_float32() { return pop<float>(); }
+  double pop_float64() { return pop<double>(); }
+
+  std::int32_t load_local_int32(std::uint32_t index) const {
+    return locals_.load<std::int32_t>(index);
+  }
+  std::int64_t load_local_int64(std::uint32_t index) const {
+    return locals_.load<std::int64_t>(index);
+  }
+  float load_local_float32(std::uint32_t index) const {
+    return locals_.load<float>(index);
+  }
+  double load_local_float64(std::uint32_t index) const {
+    return locals_.load<double>(index);
+  }
+  void store_local_int32(std::uint32_t index, std::int32_t v) {
+    locals_.store(index, v);
+  }
+  void store_local_int64(std::uint32_t index, std::int64_t v) {
+    locals_.store(index, v);
+  }
+  void store_local_float32(std::uint32_t index, float v) {
+    locals_.store(index, v);
+  }
+  void store_local_float64(std::uint32_t index, double v) {
+    locals_.store(index, v);
+  }
+
+  std::int32_t load_global_int32(std::uint32_t index) const {
+    return process_.globalVariables_->load<std::int32_t>(index);
+  }
+  std::int64_t load_global_int64(std::uint32_t index) const {
+    return process_.globalVariables_->load<std::int64_t>(index);
+  }
+  float load_global_float32(std::uint32_t index) const {
+    return process_.globalVariables_->load<float>(index);
+  }
+  double load_global_float64(std::uint32_t index) const {
+    return process_.globalVariables_->load<double>(index);
+  }
+  void store_global_int32(std::uint32_t index, std::int32_t v) {
+    process_.globalVariables_->store(index, v);
+  }
+  void store_global_int64(std::uint32_t index, std::int64_t v) {
+    process_.globalVariables_->store(index, v);
+  }
+  void store_global_float32(std::uint32_t index, float v) {
+    process_.globalVariables_->store(index, v);
+  }
+  void store_global_float64(std::uint32_t index, double v) {
+    process_.globalVariables_->store(index, v);
+  }
+
+  std::int32_t load_heap_int32(std::int32_t p, std::int32_t i,
+                               std::uint8_t p2align = 0) {
+    return load_heap<std::int32_t>(p, i, p2align);
+  }
+  std::int64_t load_heap_int64(std::int32_t p, std::int32_t i,
+                               std::uint8_t p2align = 0) {
+    return load_heap<std::int64_t>(p, i, p2align);
+  }
+  float load_heap_float32(std::int32_t p, std::int32_t i,
+                          std::uint8_t p2align = 0) {
+    return load_heap<float>(p, i, p2align);
+  }
+  double load_heap_float64(std::int32_t p, std::int32_t i,
+                           std::uint8_t p2align = 0) {
+    return load_heap<double>(p, i, p2align);
+  }
+  void store_heap_int32(std::int32_t p, std::int32_t i, std::uint8_t p2align,
+                        std::int32_t v) {
+    store_heap(p, i, p2align, v);
+  }
+  void store_heap_int64(std::int32_t p, std::int32_t i, std::uint8_t p2align,
+                        std::int64_t v) {
+    store_heap(p, i, p2align, v);
+  }
+  void store_heap_float32(std::int32_t p, std::int32_t i, std::uint8_t p2align,
+                          float v) {
+    store_heap(p, i, p2align, v);
+  }
+  void store_heap_float64(std::int32_t p, std::int32_t i, std::uint8_t p2align,
+                          double v) {
+    store_heap(p, i, p2align, v);
+  }
+
+  // Bulk operations take an unsigned address and size.
+  void copy_heap(std::int32_t d, std::int32_t s, std::int32_t n) {
+    process_.linearMemory_->copy(std::uint32_t(d), std::uint32_t(s),
+                                 std::uint32_t(n),
+                                 implementation_.trapHandler_.get());
+  }
+  void fill_heap(std::int32_t d, std::int32_t v, std::int32_t n) {
+    process_.linearMemory_->fill(std::uint32_t(d), std::uint8_t(v),
+                                 std::uint32_t(n),
+                                 implementation_.trapHandler_.get());
+  }
+
+  // The host address of n bytes of memory at p, for host functions which
+  // operate on memory in place.
+  std::uint8_t* heap_range(std::int32_t p, std::int32_t n) {
+    return process_.linearMemory_->range(std::uint32_t(p), std::uint32_t(n),
+                                         implementation_.trapHandler_.get());
+  }
+
+  // Call the host function FFIHandler::CallID(callee), which pops its
+  // operands and pushes its result.
+  void call_ffi(std::uint32_t callee);
+  // Call it with its operands' bits in args instead, returning its result.
+  std::int32_t call_ffi(std::uint32_t callee, const std::uint64_t* args);
+
+  std::int32_t read_literal_int32(std::uint32_t index) const {
+    return read_literal<std::int32_t>(index);
+  }
+  std::int64_t read_literal_int64(std::uint32_t index) const {
+    return read_literal<std::int64_t>(index);
+  }
+  float read_literal_float32(std::uint32_t index) const {
+    return read_literal<float>(index);
+  }
+  double read_literal_float64(std::uint32_t index) const {
+    return read_literal<double>(index);
+  }
+
+  // Routines are addressed by their index in the module's routine table.
+  std::int32_t addressof(std::uint32_t index) const { return index; }
+
+  NaNBits& nan_bits() { return *implementation_.nanBits_; }
+
+  void trap(const char* why);
+};
+
+} // namespace wasm
+
+#endif // include guard
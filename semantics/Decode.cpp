@@ -0,0 +1,291 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Instr.h"
+#include "implementation/FFIHandler.h"
+#include "module/Module.h"
+using namespace std;
+using namespace wasm;
+
+// Map an int32 node to its instruction. Returns End for opcodes which aren't
+// valid in an int32 node.
+static InstrOp
+DecodeInt32(Opcode opcode) {
+  switch (opcode) {
+    case GetLocal: return InstrOp::Int32GetLocal;
+    case SetLocal: return InstrOp::Int32SetLocal;
+    case LoadHeap: return InstrOp::Int32LoadHeap;
+    case StoreHeap: return InstrOp::Int32StoreHeap;
+    case LoadHeapWithOffset: return InstrOp::Int32LoadHeapWithOffset;
+    case StoreHeapWithOffset: return InstrOp::Int32StoreHeapWithOffset;
+    case LoadGlobal: return InstrOp::Int32LoadGlobal;
+    case StoreGlobal: return InstrOp::Int32StoreGlobal;
+    case CallDirect: return InstrOp::Int32CallDirect;
+    case CallIndirect: return InstrOp::Int32CallIndirect;
+    case AddressOf: return InstrOp::Int32AddressOf;
+    case CallFFI: return InstrOp::Int32CallFFI;
+    case Literal: return InstrOp::Int32Literal;
+    case Int32Add: return InstrOp::Int32Add;
+    case Int32Sub: return InstrOp::Int32Sub;
+    case Int32Mul: return InstrOp::Int32Mul;
+    case Int32SDiv: return InstrOp::Int32SDiv;
+    case Int32UDiv: return InstrOp::Int32UDiv;
+    case Int32SRem: return InstrOp::Int32SRem;
+    case Int32URem: return InstrOp::Int32URem;
+    case Int32And: return InstrOp::Int32And;
+    case Int32Ior: return InstrOp::Int32Ior;
+    case Int32Xor: return InstrOp::Int32Xor;
+    case Int32Shl: return InstrOp::Int32Shl;
+    case Int32Shr: return InstrOp::Int32Shr;
+    case Int32Sar: return InstrOp::Int32Sar;
+    case Int32Eq: return InstrOp::Int32Eq;
+    case Int32Slt: return InstrOp::Int32Slt;
+    case Int32Sle: return InstrOp::Int32Sle;
+    case Int32Ult: return InstrOp::Int32Ult;
+    case Int32Ule: return InstrOp::Int32Ule;
+    case Float32Eq: return InstrOp::Float32Eq;
+    case Float32Lt: return InstrOp::Float32Lt;
+    case Float32Le: return InstrOp::Float32Le;
+    case Float64Eq: return InstrOp::Float64Eq;
+    case Float64Lt: return InstrOp::Float64Lt;
+    case Float64Le: return InstrOp::Float64Le;
+    case SInt32FromFloat64: return InstrOp::SInt32FromFloat64;
+    case SInt32FromFloat32: return InstrOp::SInt32FromFloat32;
+    case Uint32FromFloat64: return InstrOp::Uint32FromFloat64;
+    case Uint32FromFloat32: return InstrOp::Uint32FromFloat32;
+    case Int32fromFloat32Bits: return InstrOp::Int32fromFloat32Bits;
+    case Int64Eq: return InstrOp::Int64Eq;
+    case Int64Slt: return InstrOp::Int64Slt;
+    case Int64Sle: return InstrOp::Int64Sle;
+    case Int64Ult: return InstrOp::Int64Ult;
+    case Int64Ule: return InstrOp::Int64Ule;
+    case Int32FromInt64: return InstrOp::Int32FromInt64;
+    default: return InstrOp::End;
+  }
+}
+
+static InstrOp
+DecodeInt64(Opcode opcode) {
+  switch (opcode) {
+    case GetLocal: return InstrOp::Int64GetLocal;
+    case SetLocal: return InstrOp::Int64SetLocal;
+    case LoadHeap: return InstrOp::Int64LoadHeap;
+    case StoreHeap: return InstrOp::Int64StoreHeap;
+    case LoadHeapWithOffset: return InstrOp::Int64LoadHeapWithOffset;
+    case StoreHeapWithOffset: return InstrOp::Int64StoreHeapWithOffset;
+    case LoadGlobal: return InstrOp::Int64LoadGlobal;
+    case StoreGlobal: return InstrOp::Int64StoreGlobal;
+    case CallDirect: return InstrOp::Int64CallDirect;
+    case CallIndirect: return InstrOp::Int64CallIndirect;
+    case Literal: return InstrOp::Int64Literal;
+    case Int64Add: return InstrOp::Int64Add;
+    case Int64Sub: return InstrOp::Int64Sub;
+    case Int64Mul: return InstrOp::Int64Mul;
+    case Int64SDiv: return InstrOp::Int64SDiv;
+    case Int64UDiv: return InstrOp::Int64UDiv;
+    case Int64SRem: return InstrOp::Int64SRem;
+    case Int64URem: return InstrOp::Int64URem;
+    case Int64And: return InstrOp::Int64And;
+    case Int64Ior: return InstrOp::Int64Ior;
+    case Int64Xor: return InstrOp::Int64Xor;
+    case Int64Shl: return InstrOp::Int64Shl;
+    case Int64Shr: return InstrOp::Int64Shr;
+    case Int64Sar: return InstrOp::Int64Sar;
+    case Int64FromSInt32: return InstrOp::Int64FromSInt32;
+    case Int64FromUInt32: return InstrOp::Int64FromUInt32;
+    case SInt64FromFloat64: return InstrOp::SInt64FromFloat64;
+    case SInt64FromFloat32: return InstrOp::SInt64FromFloat32;
+    case Uint64FromFloat64: return InstrOp::Uint64FromFloat64;
+    case Uint64FromFloat32: return InstrOp::Uint64FromFloat32;
+    case Int64FromFloat64Bits: return InstrOp::Int64FromFloat64Bits;
+    default: return InstrOp::End;
+  }
+}
+
+static InstrOp
+DecodeFloat32(Opcode opcode) {
+  switch (opcode) {
+    case GetLocal: return InstrOp::Float32GetLocal;
+    case SetLocal: return InstrOp::Float32SetLocal;
+    case LoadHeap: return InstrOp::Float32LoadHeap;
+    case StoreHeap: return InstrOp::Float32StoreHeap;
+    case LoadHeapWithOffset: return InstrOp::Float32LoadHeapWithOffset;
+    case StoreHeapWithOffset: return InstrOp::Float32StoreHeapWithOffset;
+    case LoadGlobal: return InstrOp::Float32LoadGlobal;
+    case StoreGlobal: return InstrOp::Float32StoreGlobal;
+    case CallDirect: return InstrOp::Float32CallDirect;
+    case CallIndirect: return InstrOp::Float32CallIndirect;
+    case Literal: return InstrOp::Float32Literal;
+    case Float32Add: return InstrOp::Float32Add;
+    case Float32Sub: return InstrOp::Float32Sub;
+    case Float32Mul: return InstrOp::Float32Mul;
+    case Float32Div: return InstrOp::Float32Div;
+    case Float32Abs: return InstrOp::Float32Abs;
+    case Float32Neg: return InstrOp::Float32Neg;
+    case Float32Copysign: return InstrOp::Float32Copysign;
+    case Float32Ceil: return InstrOp::Float32Ceil;
+    case Float32Floor: return InstrOp::Float32Floor;
+    case Float32Sqrt: return InstrOp::Float32Sqrt;
+    case Float32FromFloat64: return InstrOp::Float32FromFloat64;
+    case Float32FromSInt32: return InstrOp::Float32FromSInt32;
+    case Float32FromUInt32: return InstrOp::Float32FromUInt32;
+    case Float32FromInt32Bits: return InstrOp::Float32FromInt32Bits;
+    case Float32FromSInt64: return InstrOp::Float32FromSInt64;
+    case Float32FromUInt64: return InstrOp::Float32FromUInt64;
+    default: return InstrOp::End;
+  }
+}
+
+static InstrOp
+DecodeFloat64(Opcode opcode) {
+  switch (opcode) {
+    case GetLocal: return InstrOp::Float64GetLocal;
+    case SetLocal: return InstrOp::Float64SetLocal;
+    case LoadHeap: return InstrOp::Float64LoadHeap;
+    case StoreHeap: return InstrOp::Float64StoreHeap;
+    case LoadHeapWithOffset: return InstrOp::Float64LoadHeapWithOffset;
+    case StoreHeapWithOffset: return InstrOp::Float64StoreHeapWithOffset;
+    case LoadGlobal: return InstrOp::Float64LoadGlobal;
+    case StoreGlobal: return InstrOp::Float64StoreGlobal;
+    case CallDirect: return InstrOp::Float64CallDirect;
+    case CallIndirect: return InstrOp::Float64CallIndirect;
+    case Literal: return InstrOp::Float64Literal;
+    case Float64Add: return InstrOp::Float64Add;
+    case Float64Sub: return InstrOp::Float64Sub;
+    case Float64Mul: return InstrOp::Float64Mul;
+    case Float64Div: return InstrOp::Float64Div;
+    case Float64Abs: return InstrOp::Float64Abs;
+    case Float64Neg: return InstrOp::Float64Neg;
+    case Float64Copysign: return InstrOp::Float64Copysign;
+    case Float64Ceil: return InstrOp::Float64Ceil;
+    case Float64Floor: return InstrOp::Float64Floor;
+    case Float64Sqrt: return InstrOp::Float64Sqrt;
+    case Float64FromFloat32: return InstrOp::Float64FromFloat32;
+    case Float64FromSInt32: return InstrOp::Float64FromSInt32;
+    case Float64FromUInt32: return InstrOp::Float64FromUInt32;
+    case Float64FromSInt64: return InstrOp::Float64FromSInt64;
+    case Float64FromUInt64: return InstrOp::Float64FromUInt64;
+    case Float64FromInt64Bits: return InstrOp::Float64FromInt64Bits;
+    default: return InstrOp::End;
+  }
+}
+
+static InstrOp
+DecodeVoid(Opcode opcode) {
+  switch (opcode) {
+    case Br: return InstrOp::Br;
+    case BrIf: return InstrOp::BrIf;
+    case MemoryCopy: return InstrOp::MemoryCopy;
+    case MemoryFill: return InstrOp::MemoryFill;
+    default: return InstrOp::End;
+  }
+}
+
+static InstrOp
+DecodeNode(const Node& node) {
+  switch (node.type) {
+    case Types::int32:
+      return DecodeInt32(node.opcode);
+    case Types::int64:
+      return DecodeInt64(node.opcode);
+    case Types::float32:
+      return DecodeFloat32(node.opcode);
+    case Types::float64:
+      return DecodeFloat64(node.opcode);
+    case Types::void_:
+      return DecodeVoid(node.opcode);
+  }
+  return InstrOp::End;
+}
+
+static const char* const instrNames[] = {
+#define INSTR(name) #name,
+#include "semantics/Instrs.def"
+#undef INSTR
+};
+
+const char*
+wasm::InstrName(InstrOp op) {
+  return instrNames[size_t(op)];
+}
+
+// Check that the payload of node indexes something that exists. Returns
+// null if it does, and otherwise the reason it doesn't.
+static const char*
+CheckPayload(const Node& node, const Module& module, const Routine& routine) {
+  switch (node.opcode) {
+    case GetLocal:
+    case SetLocal:
+      if (node.payload >= routine.numLocals_)
+        return "invalid local index";
+      break;
+    case LoadGlobal:
+    case StoreGlobal:
+      if (node.payload >= module.numGlobals_)
+        return "invalid global index";
+      break;
+    case LoadHeapWithOffset:
+    case StoreHeapWithOffset:
+    case Literal:
+      if (node.payload >= module.literals_.size())
+        return "invalid literal index";
+      break;
+    case CallDirect:
+    case AddressOf:
+      if (node.payload >= module.numRoutines())
+        return "invalid routine index";
+      break;
+    case CallFFI:
+      if (node.payload >= FFIHandler::numCalls)
+        return "invalid foreign function";
+      break;
+    case Br:
+    case BrIf:
+      if (node.payload > routine.body_.size())
+        return "invalid branch target";
+      break;
+    default:
+      break;
+  }
+  return nullptr;
+}
+
+bool
+wasm::Decode(const Module& module, const Routine& routine,
+             vector<Instr>* code, const char** why) {
+  code->clear();
+  code->reserve(routine.body_.size() + 1);
+
+  for (const Node& node : routine.body_) {
+    InstrOp op = DecodeNode(node);
+    if (op == InstrOp::End) {
+      *why = "invalid opcode for expression type";
+      return false;
+    }
+    if ((*why = CheckPayload(node, module, routine)))
+      return false;
+    code->push_back(Instr{nullptr, op, 0, node.payload});
+  }
+  code->push_back(Instr{nullptr, InstrOp::End, 0, 0});
+  return true;
+}
+
+void
+wasm::Link(vector<Instr>& code, Dispatch dispatch) {
+  for (Instr& instr : code)
+    instr.handler =
+      dispatch == Dispatch::threaded ? ThreadedHandler(instr.op) : nullptr;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Instr.h"
+#include "implementation/FFIHandler.h"
+using namespace std;
+using namespace wasm;
+
+static const uint32_t noDepth = ~uint32_t(0);
+
+// The number of operands op pops, and sets pushes to the number it pushes.
+static uint32_t
+Pops(InstrOp op, uint32_t payload, uint32_t* pushes) {
+  *pushes = 1;
+  switch (op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float32GetLocal:
+    case InstrOp::Float64GetLocal:
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+    case InstrOp::Int32Literal:
+    case InstrOp::Int64Literal:
+    case InstrOp::Float32Literal:
+    case InstrOp::Float64Literal:
+    case InstrOp::Int32AddressOf:
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Int32CallIndirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Int64CallIndirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Float32CallIndirect:
+    case InstrOp::Float64CallDirect:
+    case InstrOp::Float64CallIndirect:
+      return 0;
+
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float32SetLocal:
+    case InstrOp::Float64SetLocal:
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+    case InstrOp::Float64StoreGlobal:
+    case InstrOp::Int32LoadHeap:
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Float32LoadHeap:
+    case InstrOp::Float64LoadHeap:
+    case InstrOp::Int32LoadHeapWithOffset:
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Float32LoadHeapWithOffset:
+    case InstrOp::Float64LoadHeapWithOffset:
+    case InstrOp::SInt32FromFloat64:
+    case InstrOp::SInt32FromFloat32:
+    case InstrOp::Uint32FromFloat64:
+    case InstrOp::Uint32FromFloat32:
+    case InstrOp::Int32fromFloat32Bits:
+    case InstrOp::Int32FromInt64:
+    case InstrOp::Int64FromSInt32:
+    case InstrOp::Int64FromUInt32:
+    case InstrOp::SInt64FromFloat64:
+    case InstrOp::SInt64FromFloat32:
+    case InstrOp::Uint64FromFloat64:
+    case InstrOp::Uint64FromFloat32:
+    case InstrOp::Int64FromFloat64Bits:
+    case InstrOp::Float32Abs:
+    case InstrOp::Float32Neg:
+    case InstrOp::Float32Ceil:
+    case InstrOp::Float32Floor:
+    case InstrOp::Float32Sqrt:
+    case InstrOp::Float32FromFloat64:
+    case InstrOp::Float32FromSInt32:
+    case InstrOp::Float32FromUInt32:
+    case InstrOp::Float32FromInt32Bits:
+    case InstrOp::Float32FromSInt64:
+    case InstrOp::Float32FromUInt64:
+    case InstrOp::Float64Abs:
+    case InstrOp::Float64Neg:
+    case InstrOp::Float64Ceil:
+    case InstrOp::Float64Floor:
+    case InstrOp::Float64Sqrt:
+    case InstrOp::Float64FromFloat32:
+    case InstrOp::Float64FromSInt32:
+    case InstrOp::Float64FromUInt32:
+    case InstrOp::Float64FromSInt64:
+    case InstrOp::Float64FromUInt64:
+    case InstrOp::Float64FromInt64Bits:
+      return 1;
+
+    case InstrOp::Int32CallFFI:
+      return FFIHandler::arity(FFIHandler::CallID(payload));
+
+    case InstrOp::Br:
+    case InstrOp::Fuel:
+    case InstrOp::End:
+      *pushes = 0;
+      return 0;
+    case InstrOp::BrIf:
+      *pushes = 0;
+      return 1;
+    case InstrOp::MemoryCopy:
+    case InstrOp::MemoryFill:
+      *pushes = 0;
+      return 3;
+
+    default:
+      // Everything else, the stores included, pops two and pushes one.
+      return 2;
+  }
+}
+
+bool
+wasm::MeasureDepths(vector<Instr>& code, uint32_t* maxDepth,
+                    const char** why) {
+  vector<uint32_t> depths(code.size(), noDepth);
+  uint32_t depth = 0;
+  bool fallsThrough = true;
+  *maxDepth = 0;
+  for (size_t i = 0; i < code.size(); ++i) {
+    Instr& instr = code[i];
+    if (depths[i] == noDepth)
+      depths[i] = fallsThrough ? depth : 0;
+    else if (fallsThrough && depth != depths[i]) {
+      *why = "operand stack depth mismatch at branch target";
+      return false;
+    }
+    depth = depths[i];
+    instr.depth = uint16_t(depth);
+
+    uint32_t pushes;
+    uint32_t pops = Pops(instr.op, instr.payload, &pushes);
+    if (pops > depth) {
+      *why = "operand stack underflow";
+      return false;
+    }
+    depth = depth - pops + pushes;
+    if (depth > maxInstrDepth) {
+      *why = "operand stack too deep";
+      return false;
+    }
+    if (depth > *maxDepth)
+      *maxDepth = depth;
+
+    if (instr.op == InstrOp::Br || instr.op == InstrOp::BrIf) {
+      uint32_t& target = depths[instr.payload];
+      if (target == noDepth)
+        target = depth;
+      else if (target != depth) {
+        *why = "operand stack depth mismatch at branch target";
+        return false;
+      }
+    }
+    fallsThrough = instr.op != InstrOp::Br;
+  }
+  return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Instr.h"
+#include <algorithm>
+#include <cinttypes>
+using namespace std;
+using namespace wasm;
+
+static bool
+IsBranch(InstrOp op) {
+  return op == InstrOp::Br || op == InstrOp::BrIf;
+}
+
+static InstrOp
+FusedLoadHeapLocal(InstrOp load) {
+  switch (load) {
+    case InstrOp::Int32LoadHeapWithOffset:
+      return InstrOp::Int32LoadHeapLocalWithOffset;
+    case InstrOp::Float32LoadHeapWithOffset:
+      return InstrOp::Float32LoadHeapLocalWithOffset;
+    case InstrOp::Float64LoadHeapWithOffset:
+      return InstrOp::Float64LoadHeapLocalWithOffset;
+    default:
+      return InstrOp::End;
+  }
+}
+
+static InstrOp
+FusedBrIf(InstrOp compare) {
+  switch (compare) {
+    case InstrOp::Int32Slt:
+      return InstrOp::BrIfInt32Slt;
+    case InstrOp::Int32Eq:
+      return InstrOp::BrIfInt32Eq;
+    default:
+      return InstrOp::End;
+  }
+}
+
+// The sequences fused here were chosen from PairCounts profiles. An
+// instruction which is the target of a branch can only begin a sequence, as
+// the instructions a superinstruction absorbs are skipped over.
+void
+wasm::Fuse(vector<Instr>& code) {
+  vector<bool> isTarget(code.size(), false);
+  for (const Instr& instr : code)
+    if (IsBranch(instr.op))
+      isTarget[instr.payload] = true;
+
+  size_t i = 0;
+  while (i + 1 < code.size()) {
+    Instr& first = code[i];
+    InstrOp second = code[i + 1].op;
+
+    if (first.op == InstrOp::Int32GetLocal && i + 2 < code.size() &&
+        second == InstrOp::Int32Literal &&
+        code[i + 2].op == InstrOp::Int32Add && !isTarget[i + 1] &&
+        !isTarget[i + 2]) {
+      first.op = InstrOp::Int32AddLocalLiteral;
+      i += 3;
+      continue;
+    }
+
+    if (first.op == InstrOp::Int32GetLocal &&
+        FusedLoadHeapLocal(second) != InstrOp::End && !isTarget[i + 1]) {
+      first.op = FusedLoadHeapLocal(second);
+      i += 2;
+      continue;
+    }
+
+    if (FusedBrIf(first.op) != InstrOp::End && second == InstrOp::BrIf &&
+        !isTarget[i + 1]) {
+      first.op = FusedBrIf(first.op);
+      i += 2;
+      continue;
+    }
+
+    ++i;
+  }
+}
+
+void
+PairCounts::dump(FILE* out) const {
+  vector<size_t> order;
+  for (size_t i = 0; i < counts_.size(); ++i)
+    if (counts_[i] != 0)
+      order.push_back(i);
+  sort(order.begin(), order.end(),
+       [this](size_t l, size_t r) { return counts_[l] > counts_[r]; });
+
+  for (size_t i : order) {
+    fprintf(out, "%" PRIu64 " %s %s\n", counts_[i],
+            InstrName(InstrOp(i / numInstrOps)),
+            InstrName(InstrOp(i % numInstrOps)));
+  }
+}
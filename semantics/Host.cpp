@@ -35,9 +35,6 @@ wasm::AssertHostRequirements() {
   assert(numeric_limits<float>::has_denorm == denorm_present);
   assert(numeric_limits<double>::has_denorm == denorm_present);
 
-  assert(numeric_limits<float>::has_denorm_loss);
-  assert(numeric_limits<double>::has_denorm_loss);
-
   assert(numeric_limits<float>::round_style == round_to_nearest);
   assert(numeric_limits<double>::round_style == round_to_nearest);
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_INSTR_H
+#define WEBASSEMBLY_SEMANTICS_INSTR_H
+
+#include "semantics/Run.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace wasm {
+
+class Context;
+class Profile;
+struct Module;
+struct Routine;
+
+enum class InstrOp : std::uint16_t {
+#define INSTR(name) name,
+#include "semantics/Instrs.def"
+#undef INSTR
+};
+
+const std::size_t numInstrOps = std::size_t(InstrOp::End) + 1;
+
+const char* InstrName(InstrOp op);
+
+// A decoded instruction. With threaded dispatch, handler holds the address of
+// the code implementing op, so dispatching to it is a single indirect jump.
+// depth, which fits in what would otherwise be padding, is the number of
+// operands its frame has on the stack before it executes; see MeasureDepths.
+struct Instr {
+  const void* handler;
+  InstrOp op;
+  std::uint16_t depth;
+  std::uint32_t payload;
+};
+
+// The greatest operand stack depth a routine's frame may reach.
+const std::uint32_t maxInstrDepth = 0xffff;
+
+// Counts of dynamically adjacent instruction pairs, for choosing which
+// sequences are worth fusing into superinstructions.
+class PairCounts {
+  std::vector<std::uint64_t> counts_;
+
+public:
+  PairCounts()
+    : counts_(numInstrOps * numInstrOps, 0) {}
+
+  void record(InstrOp first, InstrOp second) {
+    ++counts_[std::size_t(first) * numInstrOps + std::size_t(second)];
+  }
+
+  // Write the nonzero counts, most frequent first, one pair per line.
+  void dump(std::FILE* out) const;
+};
+
+// Decode and validate the body of a routine of module into a flat instruction
+// stream terminated by End. Branch payloads remain node indices, which are
+// also instruction indices. On failure, returns false and sets why to the
+// reason.
+bool Decode(const Module& module, const Routine& routine,
+            std::vector<Instr>* code, const char** why);
+
+// Insert a Fuel instruction at the start of each basic block of decoded
+// code, charging the number of instructions in the block, and retarget
+// branches to it. Fuel is thus charged once per block rather than once per
+// instruction, yet comes to exactly the number of instructions executed,
+// whichever engine runs the code. Runs before Fuse.
+void Meter(std::vector<Instr>& code);
+
+// Set the depth of each instruction of decoded code and set maxDepth to the
+// greatest depth reached. Every way of reaching an instruction, by falling
+// through or by a branch, must agree on its depth, so that a branch resets
+// the stack to operands that were actually pushed; an instruction reached
+// only by a later branch has an empty stack. On failure, returns false and
+// sets why to the reason, as when an instruction pops more operands than its
+// frame has or depths disagree. Runs after Meter and before Fuse.
+bool MeasureDepths(std::vector<Instr>& code, std::uint32_t* maxDepth,
+                   const char** why);
+
+// Rewrite common instruction sequences into superinstructions.
+void Fuse(std::vector<Instr>& code);
+
+// Fill in the handlers of code for the given dispatch.
+void Link(std::vector<Instr>& code, Dispatch dispatch);
+
+// Return the threaded-code handler for op, or null if the host compiler does
+// not support threaded dispatch.
+const void* ThreadedHandler(InstrOp op);
+
+// Execute code, the routine at index. If profile is non-null, executions and
+// cycles are added to its sites, and otherwise if pairCounts is non-null,
+// instruction pairs are counted as they execute, and otherwise if position is
+// non-null, the index of each instruction is stored there before it executes;
+// any of them uses switch dispatch regardless of dispatch.
+void Interpret(const Instr* code, Dispatch dispatch, Context* context,
+               PairCounts* pairCounts = nullptr, Profile* profile = nullptr,
+               std::uint32_t index = 0, std::uint32_t* position = nullptr);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,1257 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Jit.h"
+#include "semantics/Context.h"
+#include "semantics/Operators.h"
+#include "semantics/X64Assembler.h"
+#include "implementation/FFIHandler.h"
+#include "implementation/Features.h"
+#include "module/Module.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+using namespace std;
+using namespace wasm;
+
+template <typename T>
+static inline T
+FromBits(uint64_t bits) {
+  T value;
+  memcpy(&value, &bits, sizeof(T));
+  return value;
+}
+
+template <typename T>
+static inline uint64_t
+ToBits(T value) {
+  uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(T));
+  return bits;
+}
+
+// Slow paths, called from compiled code. Values are passed and returned as
+// raw bits, zero-extended to 64 bits, as they are held in stack slots. Each
+// computes exactly what the corresponding interpreter handler does.
+
+static uint64_t
+NaNFloat32(Context* context, uint64_t l, uint64_t r) {
+  return ToBits(
+    nan_float32(context, FromBits<float>(l), FromBits<float>(r)));
+}
+
+static uint64_t
+NaNFloat64(Context* context, uint64_t l, uint64_t r) {
+  return ToBits(
+    nan_float64(context, FromBits<double>(l), FromBits<double>(r)));
+}
+
+static uint64_t
+DivFloat32(Context* context, uint64_t lBits, uint64_t rBits) {
+  float l = FromBits<float>(lBits);
+  float r = FromBits<float>(rBits);
+  float x =
+    r == 0 ? (l == 0 ? float(NAN) : copysignf(INFINITY, l * r)) : l / r;
+  if (x != x)
+    x = nan_float32(context, l, r);
+  return ToBits(x);
+}
+
+static uint64_t
+DivFloat64(Context* context, uint64_t lBits, uint64_t rBits) {
+  double l = FromBits<double>(lBits);
+  double r = FromBits<double>(rBits);
+  double x = r == 0 ? (l == 0 ? NAN : copysign(INFINITY, l * r)) : l / r;
+  if (x != x)
+    x = nan_float64(context, l, r);
+  return ToBits(x);
+}
+
+static uint64_t
+CeilFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  float x = ceilf(o);
+  if (x != x)
+    x = nan_float32(context, o);
+  return ToBits(x);
+}
+
+static uint64_t
+FloorFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  float x = floorf(o);
+  if (x != x)
+    x = nan_float32(context, o);
+  return ToBits(x);
+}
+
+static uint64_t
+CeilFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  double x = ceil(o);
+  if (x != x)
+    x = nan_float64(context, o);
+  return ToBits(x);
+}
+
+static uint64_t
+FloorFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  double x = floor(o);
+  if (x != x)
+    x = nan_float64(context, o);
+  return ToBits(x);
+}
+
+static uint64_t
+ConvertSInt32FromFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
+    context->trap("float to signed integer conversion failure");
+    return 0;
+  }
+  return ToBits(int32_t(o));
+}
+
+static uint64_t
+ConvertSInt32FromFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
+    context->trap("float to signed integer conversion failure");
+    return 0;
+  }
+  return ToBits(int32_t(o));
+}
+
+static uint64_t
+ConvertUint32FromFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
+    context->trap("float to unsigned integer conversion failure");
+    return 0;
+  }
+  return ToBits(int32_t(uint32_t(o)));
+}
+
+static uint64_t
+ConvertUint32FromFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
+    context->trap("float to unsigned integer conversion failure");
+    return 0;
+  }
+  return ToBits(int32_t(uint32_t(o)));
+}
+
+static uint64_t
+ConvertSInt64FromFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+    context->trap("float to signed integer conversion failure");
+    return 0;
+  }
+  return ToBits(int64_t(o));
+}
+
+static uint64_t
+ConvertSInt64FromFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+    context->trap("float to signed integer conversion failure");
+    return 0;
+  }
+  return ToBits(int64_t(o));
+}
+
+static uint64_t
+ConvertUint64FromFloat64(Context* context, uint64_t bits) {
+  double o = FromBits<double>(bits);
+  if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+    context->trap("float to unsigned integer conversion failure");
+    return 0;
+  }
+  return ToBits(uint64_t(o));
+}
+
+static uint64_t
+ConvertUint64FromFloat32(Context* context, uint64_t bits) {
+  float o = FromBits<float>(bits);
+  if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+    context->trap("float to unsigned integer conversion failure");
+    return 0;
+  }
+  return ToBits(uint64_t(o));
+}
+
+// SSE converts only signed integers; these round as the interpreter does.
+static uint64_t
+ConvertFloat32FromUInt64(Context*, uint64_t bits) {
+  return ToBits(float(bits));
+}
+
+static uint64_t
+ConvertFloat64FromUInt64(Context*, uint64_t bits) {
+  return ToBits(double(bits));
+}
+
+static uint64_t
+LoadHeap32(Context* context, int32_t p, int32_t i, uint32_t p2align) {
+  return ToBits(context->load_heap_int32(p, i, p2align));
+}
+
+static uint64_t
+LoadHeap64(Context* context, int32_t p, int32_t i, uint32_t p2align) {
+  return ToBits(context->load_heap_float64(p, i, p2align));
+}
+
+static void
+StoreHeap32(Context* context, int32_t p, int32_t i, uint32_t p2align,
+            uint64_t v) {
+  context->store_heap_int32(p, i, p2align, FromBits<int32_t>(v));
+}
+
+static void
+StoreHeap64(Context* context, int32_t p, int32_t i, uint32_t p2align,
+            uint64_t v) {
+  context->store_heap_float64(p, i, p2align, FromBits<double>(v));
+}
+
+static void
+CopyHeap(Context* context, int32_t d, int32_t s, int32_t n) {
+  context->copy_heap(d, s, n);
+}
+
+static void
+FillHeap(Context* context, int32_t d, int32_t v, int32_t n) {
+  context->fill_heap(d, v, n);
+}
+
+static uint64_t
+CallForeign(Context* context, uint32_t callee, const uint64_t* args) {
+  return ToBits(context->call_ffi(callee, args));
+}
+
+static uint64_t
+Call(Context* context, uint32_t index) {
+  context->call(index);
+  return context->pop_bits();
+}
+
+static void
+Poll(Context* context) {
+  context->poll();
+}
+
+static void
+OutOfFuel(Context* context) {
+  context->out_of_fuel();
+}
+
+static void
+Return(Context* context, uint64_t bits) {
+  context->push_bits(bits);
+}
+
+static void
+Trap(Context* context, const char* why) {
+  context->trap(why);
+}
+
+namespace {
+
+typedef X64Assembler Asm;
+
+// Registers holding the compiled routine's arguments for its whole body.
+// They're callee-saved, so calls to slow paths preserve them.
+const Asm::Reg slotsReg = Asm::rbx;
+const Asm::Reg contextReg = Asm::r12;
+const Asm::Reg memoryReg = Asm::r13;
+const Asm::Reg globalsReg = Asm::r14;
+const Asm::Reg countersReg = Asm::r15;
+
+const uint32_t noDepth = ~uint32_t(0);
+
+// Operand stack depths are known at each instruction, since the stack is
+// empty at branches and their targets, so each stack entry is given a fixed
+// slot. An instruction reached only by a branch takes the depth the branch
+// had; values a routine leaves behind at a branch are never read again, so
+// they needn't be carried over.
+class JitCompiler {
+  Asm a_;
+  const vector<Instr>& code_;
+  const Module& module_;
+  uint32_t numLocals_;
+  bool uncheckedHeap_;
+  uint32_t depth_;
+  uint32_t maxDepth_;
+  bool ok_;
+  // The native offset of each instruction, and the depth at each branch
+  // target.
+  vector<size_t> offsets_;
+  vector<uint32_t> targetDepths_;
+  // Jumps to fill in at the end: to instructions, to the epilogue, and to
+  // trap stubs.
+  vector<pair<size_t, uint32_t>> branches_;
+  vector<size_t> returns_;
+  vector<pair<size_t, const char*>> traps_;
+
+  static int32_t disp(uint32_t slot) { return int32_t(slot * 8); }
+  int32_t local(uint32_t index) const { return disp(index); }
+  int32_t stack(uint32_t depth) const { return disp(numLocals_ + depth); }
+  // The slot of the nth entry from the top of the stack.
+  int32_t top(uint32_t n = 0) const { return stack(depth_ - 1 - n); }
+
+  // Account for an instruction popping pops entries and pushing pushes.
+  void adjust(uint32_t pops, uint32_t pushes) {
+    if (pops > depth_) {
+      ok_ = false;
+      return;
+    }
+    depth_ = depth_ - pops + pushes;
+    maxDepth_ = max(maxDepth_, depth_);
+  }
+
+  // Replace the top pops entries with rax.
+  void result(uint32_t pops) {
+    adjust(pops, 1);
+    if (ok_)
+      a_.store(true, slotsReg, top(), Asm::rax);
+  }
+
+  void trapIf(Asm::Cond cc, const char* why) {
+    traps_.push_back(make_pair(a_.jcc(cc), why));
+  }
+
+  void branch(size_t fixup, uint32_t target) {
+    branches_.push_back(make_pair(fixup, target));
+    if (targetDepths_[target] == noDepth)
+      targetDepths_[target] = depth_;
+  }
+
+  // Jump to target. A backward jump is a safe point, so it counts down and
+  // polls the context first when the count reaches zero.
+  void jump(uint32_t index, uint32_t target) {
+    if (target > index) {
+      branch(a_.jmp(), target);
+      return;
+    }
+    a_.decMem32(countersReg, offsetof(Context::Counters, countdown));
+    branch(a_.jcc(Asm::ne), target);
+    callSlowPath(reinterpret_cast<const void*>(Poll));
+    branch(a_.jmp(), target);
+  }
+
+  // Call a slow path with the context and up to three further arguments
+  // already in rsi, rdx and rcx.
+  void callSlowPath(const void* function) {
+    a_.mov(true, Asm::rdi, contextReg);
+    a_.call(function);
+  }
+
+  // Having computed a float result in xmm0, move it to rax, replacing it with
+  // the result of a NaN slow path if it's NaN. The slow path receives the
+  // operands at the given slots, or the result itself if l is null.
+  void nanCheck(bool isDouble, const int32_t* l, const int32_t* r) {
+    a_.movFromXmm(isDouble, Asm::rax, Asm::xmm0);
+    a_.ucomis(isDouble, Asm::xmm0, Asm::xmm0);
+    size_t done = a_.jcc(Asm::np);
+    if (l)
+      a_.load(isDouble, Asm::rsi, slotsReg, *l);
+    else
+      a_.mov(true, Asm::rsi, Asm::rax);
+    if (r)
+      a_.load(isDouble, Asm::rdx, slotsReg, *r);
+    else
+      a_.alu(false, Asm::xorOp, Asm::rdx, Asm::rdx);
+    callSlowPath(reinterpret_cast<const void*>(isDouble ? NaNFloat64
+                                                         : NaNFloat32));
+    a_.bind(done);
+  }
+
+  // Sign-extend the dividend in rax into rdx.
+  void signExtend(bool w) {
+    if (w)
+      a_.cqo();
+    else
+      a_.cdq();
+  }
+
+  void unarySlowPath(bool isDouble, uint64_t (*function)(Context*, uint64_t)) {
+    a_.load(isDouble, Asm::rsi, slotsReg, top());
+    callSlowPath(reinterpret_cast<const void*>(function));
+    result(1);
+  }
+
+  void binarySlowPath(bool isDouble,
+                      uint64_t (*function)(Context*, uint64_t, uint64_t)) {
+    a_.load(isDouble, Asm::rsi, slotsReg, top(1));
+    a_.load(isDouble, Asm::rdx, slotsReg, top());
+    callSlowPath(reinterpret_cast<const void*>(function));
+    result(2);
+  }
+
+  void getLocal(bool w, uint32_t index);
+  void setLocal(bool w, uint32_t index);
+  void loadGlobal(bool w, uint32_t index);
+  void storeGlobal(bool w, uint32_t index);
+  void literal(bool w, uint32_t index);
+  void loadHeap(bool w, uint32_t offset, uint32_t p2align);
+  void storeHeap(bool w, uint32_t offset, uint32_t p2align);
+  void intBinary(bool w, InstrOp op);
+  void intCompare(bool w, Asm::Cond cc);
+  void floatArithmetic(bool isDouble, Asm::SSEOp op);
+  void floatCompare(bool isDouble, InstrOp op);
+  void floatSign(bool isDouble, InstrOp op);
+  void floatConvert(bool toDouble);
+  void intToFloat(bool toDouble, bool isUnsigned);
+  void int64ToFloat(bool toDouble);
+  void prologue();
+  void epilogue();
+  bool instr(const Instr& instr);
+
+public:
+  JitCompiler(const vector<Instr>& code, const Module& module,
+              uint32_t numLocals, bool uncheckedHeap)
+    : code_(code)
+    , module_(module)
+    , numLocals_(numLocals)
+    , uncheckedHeap_(uncheckedHeap)
+    , depth_(0)
+    , maxDepth_(0)
+    , ok_(true)
+    , offsets_(code.size())
+    , targetDepths_(code.size(), noDepth) {}
+
+  bool compile(JitCode* out);
+};
+
+} // namespace
+
+void
+JitCompiler::getLocal(bool w, uint32_t index) {
+  a_.load(w, Asm::rax, slotsReg, local(index));
+  result(0);
+}
+
+void
+JitCompiler::setLocal(bool w, uint32_t index) {
+  adjust(1, 1);
+  if (!ok_)
+    return;
+  a_.load(w, Asm::rax, slotsReg, top());
+  a_.store(true, slotsReg, local(index), Asm::rax);
+}
+
+void
+JitCompiler::loadGlobal(bool w, uint32_t index) {
+  a_.load(w, Asm::rax, globalsReg, disp(index));
+  result(0);
+}
+
+void
+JitCompiler::storeGlobal(bool w, uint32_t index) {
+  adjust(1, 1);
+  if (!ok_)
+    return;
+  a_.load(w, Asm::rax, slotsReg, top());
+  a_.store(true, globalsReg, disp(index), Asm::rax);
+}
+
+// Literals are stored zero-extended, so a 32-bit literal is its low bits.
+void
+JitCompiler::literal(bool w, uint32_t index) {
+  uint64_t bits = module_.literals_[index];
+  if (w)
+    a_.movImm64(Asm::rax, bits);
+  else
+    a_.movImm32(Asm::rax, uint32_t(bits));
+  result(0);
+}
+
+// With a guarded memory, the effective address is formed in 64 bits and
+// used directly: every address outside the memory faults, and the fault is
+// reported as a trap. Otherwise accesses go through the same checks as the
+// interpreter's.
+void
+JitCompiler::loadHeap(bool w, uint32_t offset, uint32_t p2align) {
+  adjust(1, 1);
+  if (!ok_)
+    return;
+  if (uncheckedHeap_) {
+    a_.load(false, Asm::rax, slotsReg, top());
+    if (offset != 0) {
+      a_.movImm32(Asm::rcx, offset);
+      a_.alu(true, Asm::addOp, Asm::rax, Asm::rcx);
+    }
+    a_.loadIndexed(w, Asm::rax, memoryReg, Asm::rax);
+  } else {
+    a_.load(false, Asm::rsi, slotsReg, top());
+    a_.movImm32(Asm::rdx, offset);
+    a_.movImm32(Asm::rcx, p2align);
+    callSlowPath(reinterpret_cast<const void*>(w ? LoadHeap64 : LoadHeap32));
+  }
+  a_.store(true, slotsReg, top(), Asm::rax);
+}
+
+// The stored value stays on the stack as the result, so only the address is
+// popped.
+void
+JitCompiler::storeHeap(bool w, uint32_t offset, uint32_t p2align) {
+  adjust(2, 2);
+  if (!ok_)
+    return;
+  if (uncheckedHeap_) {
+    a_.load(false, Asm::rax, slotsReg, top());
+    if (offset != 0) {
+      a_.movImm32(Asm::rcx, offset);
+      a_.alu(true, Asm::addOp, Asm::rax, Asm::rcx);
+    }
+    a_.load(w, Asm::rcx, slotsReg, top(1));
+    a_.storeIndexed(w, memoryReg, Asm::rax, Asm::rcx);
+  } else {
+    a_.load(false, Asm::rsi, slotsReg, top());
+    a_.movImm32(Asm::rdx, offset);
+    a_.movImm32(Asm::rcx, p2align);
+    a_.load(w, Asm::r8, slotsReg, top(1));
+    callSlowPath(reinterpret_cast<const void*>(w ? StoreHeap64 : StoreHeap32));
+  }
+  adjust(1, 0);
+}
+
+// Integer operators of either width; w selects 64 bits. 32-bit operations
+// zero-extend their results into the full register, as slots hold them.
+void
+JitCompiler::intBinary(bool w, InstrOp op) {
+  if (depth_ < 2) {
+    ok_ = false;
+    return;
+  }
+  a_.load(w, Asm::rax, slotsReg, top(1));
+  a_.load(w, Asm::rcx, slotsReg, top());
+
+  int32_t width = w ? 64 : 32;
+  switch (op) {
+    case InstrOp::Int32Add:
+    case InstrOp::Int64Add:
+      a_.alu(w, Asm::addOp, Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Int32Sub:
+    case InstrOp::Int64Sub:
+      a_.alu(w, Asm::subOp, Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Int32Mul:
+    case InstrOp::Int64Mul:
+      a_.imul(w, Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Int32And:
+    case InstrOp::Int64And:
+      a_.alu(w, Asm::andOp, Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Int32Ior:
+    case InstrOp::Int64Ior:
+      a_.alu(w, Asm::orOp, Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Int32Xor:
+    case InstrOp::Int64Xor:
+      a_.alu(w, Asm::xorOp, Asm::rax, Asm::rcx);
+      break;
+    // Shifts of the width or more give zero; see IntOperators.
+    case InstrOp::Int32Shl:
+    case InstrOp::Int64Shl:
+    case InstrOp::Int32Shr:
+    case InstrOp::Int64Shr: {
+      bool left = op == InstrOp::Int32Shl || op == InstrOp::Int64Shl;
+      a_.shiftCl(w, left ? 4 : 5, Asm::rax);
+      a_.alu(false, Asm::xorOp, Asm::rdx, Asm::rdx);
+      a_.cmpImm(w, Asm::rcx, width);
+      a_.cmov(w, Asm::ge, Asm::rax, Asm::rdx);
+      break;
+    }
+    case InstrOp::Int32Sar:
+    case InstrOp::Int64Sar:
+      a_.movImm32(Asm::rdx, width - 1);
+      a_.cmpImm(w, Asm::rcx, width - 1);
+      a_.cmov(w, Asm::g, Asm::rcx, Asm::rdx);
+      a_.shiftCl(w, 7, Asm::rax);
+      break;
+    case InstrOp::Int32SDiv:
+    case InstrOp::Int64SDiv: {
+      a_.test(w, Asm::rcx, Asm::rcx);
+      trapIf(Asm::e, "signed integer division by zero");
+      if (w) {
+        a_.movImm64(Asm::rdx, uint64_t(INT64_MIN));
+        a_.alu(true, Asm::cmpOp, Asm::rax, Asm::rdx);
+      } else {
+        a_.cmpImm(false, Asm::rax, INT32_MIN);
+      }
+      size_t ok = a_.jcc(Asm::ne);
+      a_.cmpImm(w, Asm::rcx, -1);
+      trapIf(Asm::e, "signed integer division overflow");
+      a_.bind(ok);
+      signExtend(w);
+      a_.div(w, 7, Asm::rcx);
+      break;
+    }
+    case InstrOp::Int32UDiv:
+    case InstrOp::Int64UDiv:
+      a_.test(w, Asm::rcx, Asm::rcx);
+      trapIf(Asm::e, "unsigned integer division by zero");
+      a_.alu(false, Asm::xorOp, Asm::rdx, Asm::rdx);
+      a_.div(w, 6, Asm::rcx);
+      break;
+    // x % -1 is zero, but the minimum % -1 overflows in idiv, so it's done
+    // without dividing.
+    case InstrOp::Int32SRem:
+    case InstrOp::Int64SRem: {
+      a_.test(w, Asm::rcx, Asm::rcx);
+      trapIf(Asm::e, "unsigned integer remainder by zero");
+      a_.cmpImm(w, Asm::rcx, -1);
+      size_t divide = a_.jcc(Asm::ne);
+      a_.alu(false, Asm::xorOp, Asm::rdx, Asm::rdx);
+      size_t done = a_.jmp();
+      a_.bind(divide);
+      signExtend(w);
+      a_.div(w, 7, Asm::rcx);
+      a_.bind(done);
+      a_.mov(w, Asm::rax, Asm::rdx);
+      break;
+    }
+    case InstrOp::Int32URem:
+    case InstrOp::Int64URem:
+      a_.test(w, Asm::rcx, Asm::rcx);
+      trapIf(Asm::e, "unsigned integer remainder by zero");
+      a_.alu(false, Asm::xorOp, Asm::rdx, Asm::rdx);
+      a_.div(w, 6, Asm::rcx);
+      a_.mov(w, Asm::rax, Asm::rdx);
+      break;
+    default:
+      ok_ = false;
+      return;
+  }
+  result(2);
+}
+
+void
+JitCompiler::intCompare(bool w, Asm::Cond cc) {
+  if (depth_ < 2) {
+    ok_ = false;
+    return;
+  }
+  a_.load(w, Asm::rax, slotsReg, top(1));
+  a_.load(w, Asm::rcx, slotsReg, top());
+  a_.alu(w, Asm::cmpOp, Asm::rax, Asm::rcx);
+  a_.setcc(cc, Asm::rax);
+  a_.movzx8(Asm::rax, Asm::rax);
+  result(2);
+}
+
+void
+JitCompiler::floatArithmetic(bool isDouble, Asm::SSEOp op) {
+  if (depth_ < 2) {
+    ok_ = false;
+    return;
+  }
+  int32_t l = top(1), r = top();
+  a_.sseLoad(isDouble, Asm::xmm0, slotsReg, l);
+  a_.sseOp(isDouble, op, Asm::xmm0, slotsReg, r);
+  nanCheck(isDouble, &l, &r);
+  result(2);
+}
+
+// Comparisons with a NaN are false. ucomis reports unordered as ZF, PF and CF
+// all set, so less-than is computed as r above l, which excludes it.
+void
+JitCompiler::floatCompare(bool isDouble, InstrOp op) {
+  if (depth_ < 2) {
+    ok_ = false;
+    return;
+  }
+  switch (op) {
+    case InstrOp::Float32Eq:
+    case InstrOp::Float64Eq:
+      a_.sseLoad(isDouble, Asm::xmm0, slotsReg, top(1));
+      a_.ucomisMem(isDouble, Asm::xmm0, slotsReg, top());
+      a_.setcc(Asm::e, Asm::rax);
+      a_.setcc(Asm::np, Asm::rcx);
+      a_.and8(Asm::rax, Asm::rcx);
+      break;
+    case InstrOp::Float32Lt:
+    case InstrOp::Float64Lt:
+      a_.sseLoad(isDouble, Asm::xmm0, slotsReg, top());
+      a_.ucomisMem(isDouble, Asm::xmm0, slotsReg, top(1));
+      a_.setcc(Asm::a, Asm::rax);
+      break;
+    default:
+      a_.sseLoad(isDouble, Asm::xmm0, slotsReg, top());
+      a_.ucomisMem(isDouble, Asm::xmm0, slotsReg, top(1));
+      a_.setcc(Asm::ae, Asm::rax);
+      break;
+  }
+  a_.movzx8(Asm::rax, Asm::rax);
+  result(2);
+}
+
+// Abs, Neg and Copysign only touch the sign bit, NaNs included.
+void
+JitCompiler::floatSign(bool isDouble, InstrOp op) {
+  uint8_t sign = isDouble ? 63 : 31;
+  if (op == InstrOp::Float32Copysign || op == InstrOp::Float64Copysign) {
+    if (depth_ < 2) {
+      ok_ = false;
+      return;
+    }
+    a_.load(isDouble, Asm::rax, slotsReg, top(1));
+    a_.load(isDouble, Asm::rcx, slotsReg, top());
+    a_.bitOp(isDouble, 6, Asm::rax, sign);
+    a_.shiftImm(isDouble, 5, Asm::rcx, sign);
+    a_.shiftImm(isDouble, 4, Asm::rcx, sign);
+    a_.alu(isDouble, Asm::orOp, Asm::rax, Asm::rcx);
+    result(2);
+    return;
+  }
+  if (depth_ < 1) {
+    ok_ = false;
+    return;
+  }
+  bool isAbs = op == InstrOp::Float32Abs || op == InstrOp::Float64Abs;
+  a_.load(isDouble, Asm::rax, slotsReg, top());
+  a_.bitOp(isDouble, isAbs ? 6 : 7, Asm::rax, sign);
+  result(1);
+}
+
+// A NaN result is passed to the slow path as the operand, as the interpreter
+// converts the operand to the result type before choosing NaN bits.
+void
+JitCompiler::floatConvert(bool toDouble) {
+  if (depth_ < 1) {
+    ok_ = false;
+    return;
+  }
+  // cvtss2sd has the float32 prefix and cvtsd2ss the float64 one.
+  a_.sseOp(!toDouble, Asm::cvt, Asm::xmm0, slotsReg, top());
+  nanCheck(toDouble, nullptr, nullptr);
+  result(1);
+}
+
+// Unsigned operands are zero-extended and converted as 64-bit signed
+// integers, which represents every value exactly.
+void
+JitCompiler::intToFloat(bool toDouble, bool isUnsigned) {
+  if (depth_ < 1) {
+    ok_ = false;
+    return;
+  }
+  a_.load(false, Asm::rax, slotsReg, top());
+  a_.cvtsi2s(toDouble, isUnsigned, Asm::xmm0, Asm::rax);
+  a_.movFromXmm(toDouble, Asm::rax, Asm::xmm0);
+  result(1);
+}
+
+void
+JitCompiler::int64ToFloat(bool toDouble) {
+  if (depth_ < 1) {
+    ok_ = false;
+    return;
+  }
+  a_.load(true, Asm::rax, slotsReg, top());
+  a_.cvtsi2s(toDouble, true, Asm::xmm0, Asm::rax);
+  a_.movFromXmm(toDouble, Asm::rax, Asm::xmm0);
+  result(1);
+}
+
+bool
+JitCompiler::instr(const Instr& instr) {
+  uint32_t index = uint32_t(&instr - code_.data());
+  uint32_t payload = instr.payload;
+  switch (instr.op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Float32GetLocal:
+      getLocal(false, payload);
+      break;
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float64GetLocal:
+      getLocal(true, payload);
+      break;
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Float32SetLocal:
+      setLocal(false, payload);
+      break;
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float64SetLocal:
+      setLocal(true, payload);
+      break;
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+      loadGlobal(false, payload);
+      break;
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+      loadGlobal(true, payload);
+      break;
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+      storeGlobal(false, payload);
+      break;
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float64StoreGlobal:
+      storeGlobal(true, payload);
+      break;
+    case InstrOp::Int32Literal:
+    case InstrOp::Float32Literal:
+      literal(false, payload);
+      break;
+    case InstrOp::Int64Literal:
+    case InstrOp::Float64Literal:
+      literal(true, payload);
+      break;
+    case InstrOp::Int32AddressOf:
+      a_.movImm32(Asm::rax, payload);
+      result(0);
+      break;
+
+    case InstrOp::Int32LoadHeap:
+    case InstrOp::Float32LoadHeap:
+      loadHeap(false, 0, payload);
+      break;
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Float64LoadHeap:
+      loadHeap(true, 0, payload);
+      break;
+    case InstrOp::Int32StoreHeap:
+    case InstrOp::Float32StoreHeap:
+      storeHeap(false, 0, payload);
+      break;
+    case InstrOp::Int64StoreHeap:
+    case InstrOp::Float64StoreHeap:
+      storeHeap(true, 0, payload);
+      break;
+    case InstrOp::Int32LoadHeapWithOffset:
+    case InstrOp::Float32LoadHeapWithOffset:
+      loadHeap(false, uint32_t(module_.literals_[payload]), 0);
+      break;
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Float64LoadHeapWithOffset:
+      loadHeap(true, uint32_t(module_.literals_[payload]), 0);
+      break;
+    case InstrOp::Int32StoreHeapWithOffset:
+    case InstrOp::Float32StoreHeapWithOffset:
+      storeHeap(false, uint32_t(module_.literals_[payload]), 0);
+      break;
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset:
+      storeHeap(true, uint32_t(module_.literals_[payload]), 0);
+      break;
+
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Float64CallDirect:
+      a_.movImm32(Asm::rsi, payload);
+      callSlowPath(reinterpret_cast<const void*>(Call));
+      result(0);
+      break;
+
+    case InstrOp::Int32Add:
+    case InstrOp::Int32Sub:
+    case InstrOp::Int32Mul:
+    case InstrOp::Int32SDiv:
+    case InstrOp::Int32UDiv:
+    case InstrOp::Int32SRem:
+    case InstrOp::Int32URem:
+    case InstrOp::Int32And:
+    case InstrOp::Int32Ior:
+    case InstrOp::Int32Xor:
+    case InstrOp::Int32Shl:
+    case InstrOp::Int32Shr:
+    case InstrOp::Int32Sar:
+      intBinary(false, instr.op);
+      break;
+    case InstrOp::Int32Eq:
+      intCompare(false, Asm::e);
+      break;
+    case InstrOp::Int32Slt:
+      intCompare(false, Asm::l);
+      break;
+    case InstrOp::Int32Sle:
+      intCompare(false, Asm::le);
+      break;
+    case InstrOp::Int32Ult:
+      intCompare(false, Asm::b);
+      break;
+    case InstrOp::Int32Ule:
+      intCompare(false, Asm::be);
+      break;
+    case InstrOp::Int64Add:
+    case InstrOp::Int64Sub:
+    case InstrOp::Int64Mul:
+    case InstrOp::Int64SDiv:
+    case InstrOp::Int64UDiv:
+    case InstrOp::Int64SRem:
+    case InstrOp::Int64URem:
+    case InstrOp::Int64And:
+    case InstrOp::Int64Ior:
+    case InstrOp::Int64Xor:
+    case InstrOp::Int64Shl:
+    case InstrOp::Int64Shr:
+    case InstrOp::Int64Sar:
+      intBinary(true, instr.op);
+      break;
+    case InstrOp::Int64Eq:
+      intCompare(true, Asm::e);
+      break;
+    case InstrOp::Int64Slt:
+      intCompare(true, Asm::l);
+      break;
+    case InstrOp::Int64Sle:
+      intCompare(true, Asm::le);
+      break;
+    case InstrOp::Int64Ult:
+      intCompare(true, Asm::b);
+      break;
+    case InstrOp::Int64Ule:
+      intCompare(true, Asm::be);
+      break;
+    case InstrOp::Float32Eq:
+    case InstrOp::Float32Lt:
+    case InstrOp::Float32Le:
+      floatCompare(false, instr.op);
+      break;
+    case InstrOp::Float64Eq:
+    case InstrOp::Float64Lt:
+    case InstrOp::Float64Le:
+      floatCompare(true, instr.op);
+      break;
+    case InstrOp::SInt32FromFloat64:
+      unarySlowPath(true, ConvertSInt32FromFloat64);
+      break;
+    case InstrOp::SInt32FromFloat32:
+      unarySlowPath(false, ConvertSInt32FromFloat32);
+      break;
+    case InstrOp::Uint32FromFloat64:
+      unarySlowPath(true, ConvertUint32FromFloat64);
+      break;
+    case InstrOp::Uint32FromFloat32:
+      unarySlowPath(false, ConvertUint32FromFloat32);
+      break;
+    case InstrOp::SInt64FromFloat64:
+      unarySlowPath(true, ConvertSInt64FromFloat64);
+      break;
+    case InstrOp::SInt64FromFloat32:
+      unarySlowPath(false, ConvertSInt64FromFloat32);
+      break;
+    case InstrOp::Uint64FromFloat64:
+      unarySlowPath(true, ConvertUint64FromFloat64);
+      break;
+    case InstrOp::Uint64FromFloat32:
+      unarySlowPath(false, ConvertUint64FromFloat32);
+      break;
+    case InstrOp::Int32fromFloat32Bits:
+    case InstrOp::Float32FromInt32Bits:
+    case InstrOp::Int64FromFloat64Bits:
+    case InstrOp::Float64FromInt64Bits:
+    case InstrOp::Int64FromUInt32:
+      // The bits are unchanged.
+      adjust(1, 1);
+      break;
+    case InstrOp::Int32FromInt64:
+      if (depth_ < 1)
+        return false;
+      a_.load(false, Asm::rax, slotsReg, top());
+      result(1);
+      break;
+    case InstrOp::Int64FromSInt32:
+      if (depth_ < 1)
+        return false;
+      a_.loadSx32(Asm::rax, slotsReg, top());
+      result(1);
+      break;
+
+    case InstrOp::Float32Add:
+      floatArithmetic(false, Asm::add);
+      break;
+    case InstrOp::Float32Sub:
+      floatArithmetic(false, Asm::sub);
+      break;
+    case InstrOp::Float32Mul:
+      floatArithmetic(false, Asm::mul);
+      break;
+    case InstrOp::Float32Div:
+      binarySlowPath(false, DivFloat32);
+      break;
+    case InstrOp::Float32Abs:
+    case InstrOp::Float32Neg:
+    case InstrOp::Float32Copysign:
+      floatSign(false, instr.op);
+      break;
+    case InstrOp::Float32Ceil:
+      unarySlowPath(false, CeilFloat32);
+      break;
+    case InstrOp::Float32Floor:
+      unarySlowPath(false, FloorFloat32);
+      break;
+    case InstrOp::Float32Sqrt: {
+      if (depth_ < 1)
+        return false;
+      int32_t o = top();
+      a_.sseOp(false, Asm::sqrt, Asm::xmm0, slotsReg, o);
+      nanCheck(false, &o, nullptr);
+      result(1);
+      break;
+    }
+    case InstrOp::Float32FromFloat64:
+      floatConvert(false);
+      break;
+    case InstrOp::Float32FromSInt32:
+      intToFloat(false, false);
+      break;
+    case InstrOp::Float32FromUInt32:
+      intToFloat(false, true);
+      break;
+    case InstrOp::Float32FromSInt64:
+      int64ToFloat(false);
+      break;
+    case InstrOp::Float32FromUInt64:
+      unarySlowPath(true, ConvertFloat32FromUInt64);
+      break;
+
+    case InstrOp::Float64Add:
+      floatArithmetic(true, Asm::add);
+      break;
+    case InstrOp::Float64Sub:
+      floatArithmetic(true, Asm::sub);
+      break;
+    case InstrOp::Float64Mul:
+      floatArithmetic(true, Asm::mul);
+      break;
+    case InstrOp::Float64Div:
+      binarySlowPath(true, DivFloat64);
+      break;
+    case InstrOp::Float64Abs:
+    case InstrOp::Float64Neg:
+    case InstrOp::Float64Copysign:
+      floatSign(true, instr.op);
+      break;
+    case InstrOp::Float64Ceil:
+      unarySlowPath(true, CeilFloat64);
+      break;
+    case InstrOp::Float64Floor:
+      unarySlowPath(true, FloorFloat64);
+      break;
+    case InstrOp::Float64Sqrt: {
+      if (depth_ < 1)
+        return false;
+      int32_t o = top();
+      a_.sseOp(true, Asm::sqrt, Asm::xmm0, slotsReg, o);
+      nanCheck(true, &o, nullptr);
+      result(1);
+      break;
+    }
+    case InstrOp::Float64FromFloat32:
+      floatConvert(true);
+      break;
+    case InstrOp::Float64FromSInt32:
+      intToFloat(true, false);
+      break;
+    case InstrOp::Float64FromUInt32:
+      intToFloat(true, true);
+      break;
+    case InstrOp::Float64FromSInt64:
+      int64ToFloat(true);
+      break;
+    case InstrOp::Float64FromUInt64:
+      unarySlowPath(true, ConvertFloat64FromUInt64);
+      break;
+
+    case InstrOp::Br:
+      jump(index, payload);
+      break;
+    case InstrOp::BrIf: {
+      if (depth_ < 1)
+        return false;
+      a_.load(false, Asm::rax, slotsReg, top());
+      adjust(1, 0);
+      a_.test(false, Asm::rax, Asm::rax);
+      if (payload > index) {
+        branch(a_.jcc(Asm::ne), payload);
+        break;
+      }
+      size_t notTaken = a_.jcc(Asm::e);
+      jump(index, payload);
+      a_.bind(notTaken);
+      break;
+    }
+    case InstrOp::MemoryCopy:
+    case InstrOp::MemoryFill:
+      if (depth_ < 3)
+        return false;
+      a_.load(false, Asm::rsi, slotsReg, top(2));
+      a_.load(false, Asm::rdx, slotsReg, top(1));
+      a_.load(false, Asm::rcx, slotsReg, top());
+      callSlowPath(reinterpret_cast<const void*>(
+        instr.op == InstrOp::MemoryCopy ? CopyHeap : FillHeap));
+      adjust(3, 0);
+      break;
+    case InstrOp::Int32CallFFI: {
+      // Operands are passed in place, as an array of stack slots.
+      uint32_t arity = FFIHandler::arity(FFIHandler::CallID(payload));
+      if (depth_ < arity)
+        return false;
+      a_.movImm32(Asm::rsi, payload);
+      a_.lea(Asm::rdx, slotsReg, stack(depth_ - arity));
+      callSlowPath(reinterpret_cast<const void*>(CallForeign));
+      result(arity);
+      break;
+    }
+
+    case InstrOp::Fuel: {
+      if (payload > uint32_t(INT32_MAX))
+        return false;
+      a_.subMemImm32(true, countersReg, offsetof(Context::Counters, fuel),
+                     int32_t(payload));
+      size_t enough = a_.jcc(Asm::ge);
+      callSlowPath(reinterpret_cast<const void*>(OutOfFuel));
+      a_.bind(enough);
+      break;
+    }
+
+    case InstrOp::End:
+      if (depth_ > 0) {
+        a_.load(true, Asm::rsi, slotsReg, top());
+        callSlowPath(reinterpret_cast<const void*>(Return));
+      }
+      break;
+
+    default:
+      // Indirect calls, and superinstructions, which only fused code has.
+      return false;
+  }
+  return ok_;
+}
+
+// The compiled routine is called as
+//   void (*)(uint64_t* slots, Context*, uint8_t* memory, uint64_t* globals,
+//            Context::Counters*)
+// and keeps its arguments in callee-saved registers. Five pushes and the
+// return address leave the stack aligned for calls.
+void
+JitCompiler::prologue() {
+  a_.push(slotsReg);
+  a_.push(contextReg);
+  a_.push(memoryReg);
+  a_.push(globalsReg);
+  a_.push(countersReg);
+  a_.mov(true, slotsReg, Asm::rdi);
+  a_.mov(true, contextReg, Asm::rsi);
+  a_.mov(true, memoryReg, Asm::rdx);
+  a_.mov(true, globalsReg, Asm::rcx);
+  a_.mov(true, countersReg, Asm::r8);
+}
+
+void
+JitCompiler::epilogue() {
+  a_.pop(countersReg);
+  a_.pop(globalsReg);
+  a_.pop(memoryReg);
+  a_.pop(contextReg);
+  a_.pop(slotsReg);
+  a_.ret();
+}
+
+bool
+JitCompiler::compile(JitCode* out) {
+  // Keep every slot displacement within 32 bits.
+  const uint64_t maxSlots = uint64_t(1) << 28;
+  if (uint64_t(numLocals_) + code_.size() >= maxSlots ||
+      module_.numGlobals_ >= maxSlots)
+    return false;
+
+  prologue();
+  bool fallsThrough = true;
+  for (size_t i = 0; i < code_.size(); ++i) {
+    if (!fallsThrough)
+      depth_ = targetDepths_[i] != noDepth ? targetDepths_[i] : 0;
+    else if (targetDepths_[i] == noDepth)
+      targetDepths_[i] = depth_;
+    offsets_[i] = a_.size();
+    if (!instr(code_[i]))
+      return false;
+    fallsThrough = code_[i].op != InstrOp::Br;
+  }
+  size_t epilogueOffset = a_.size();
+  epilogue();
+
+  for (const pair<size_t, const char*>& trap : traps_) {
+    a_.bind(trap.first);
+    a_.movImm64(Asm::rsi, reinterpret_cast<uint64_t>(trap.second));
+    callSlowPath(reinterpret_cast<const void*>(Trap));
+    returns_.push_back(a_.jmp());
+  }
+  for (size_t fixup : returns_)
+    a_.patch(fixup, epilogueOffset);
+  for (const pair<size_t, uint32_t>& branch : branches_)
+    a_.patch(branch.first, offsets_[branch.second]);
+
+  return out->install(a_.code(), numLocals_ + maxDepth_);
+}
+
+bool
+wasm::JitCompile(const vector<Instr>& code, const Module& module,
+                 uint32_t numLocals, bool uncheckedHeap, JitCode* out) {
+  if (!WASM_HAVE_JIT)
+    return false;
+  JitCompiler compiler(code, module, numLocals, uncheckedHeap);
+  return compiler.compile(out);
+}
+
+void
+wasm::ExecuteJit(const JitCode& code, Context* context, uint64_t* globals,
+                 uint8_t* memory) {
+  typedef void (*Entry)(uint64_t*, Context*, uint8_t*, uint64_t*,
+                        Context::Counters*);
+  uint64_t* slots = context->push_slots(code.numSlots());
+  Entry entry = reinterpret_cast<Entry>(const_cast<void*>(code.entry()));
+  entry(slots, context, memory, globals, context->counters());
+  context->pop_slots(slots);
+}
+
+bool
+JitCode::install(const vector<uint8_t>& bytes, uint32_t numSlots) {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t size = (bytes.size() + pageSize - 1) & ~(pageSize - 1);
+  void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED)
+    return false;
+  memcpy(code, bytes.data(), bytes.size());
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(code, size);
+    return false;
+  }
+  code_ = code;
+  size_ = size;
+  numSlots_ = numSlots;
+  return true;
+}
+
+JitCode::~JitCode() {
+  if (code_ != nullptr)
+    munmap(code_, size_);
+}
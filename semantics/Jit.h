@@ -0,0 +1,78 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_JIT_H
+#define WEBASSEMBLY_SEMANTICS_JIT_H
+
+#include "semantics/Instr.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wasm {
+
+class Context;
+struct Module;
+
+// Machine code for one routine, in memory which is mapped executable once
+// the code is written and never writable again.
+class JitCode {
+  void* code_;
+  std::size_t size_;
+  // Locals, followed by the operand stack.
+  std::uint32_t numSlots_;
+
+public:
+  JitCode()
+    : code_(nullptr)
+    , size_(0)
+    , numSlots_(0) {}
+  ~JitCode();
+
+  JitCode(const JitCode&) = delete;
+  JitCode& operator=(const JitCode&) = delete;
+
+  bool install(const std::vector<std::uint8_t>& bytes,
+               std::uint32_t numSlots);
+
+  const void* entry() const { return code_; }
+  std::size_t size() const { return size_; }
+  std::uint32_t numSlots() const { return numSlots_; }
+};
+
+// Compile a decoded, unfused stack-form routine to straight-line x86-64 code.
+// The operand stack is resolved at compile time to fixed slots following the
+// routine's locals, so instructions read and write memory operands directly,
+// with no dispatch between them. Operations with slow paths (NaN results,
+// traps, division, rounding, conversions and calls) call back into the same
+// Context, NaNBits and TrapHandler code the interpreter uses, so results are
+// bit-identical to it. If uncheckedHeap is set, the process's linear memory
+// is guarded, and heap accesses are emitted inline without bounds checks.
+// Backward branches are safe points, as in the interpreter.
+//
+// Returns false if the routine uses something the JIT doesn't support, such
+// as indirect calls, or the host can't run the generated code; the routine
+// should then be interpreted.
+bool JitCompile(const std::vector<Instr>& code, const Module& module,
+                std::uint32_t numLocals, bool uncheckedHeap, JitCode* out);
+
+// Run compiled code with the given globals and linear memory.
+void ExecuteJit(const JitCode& code, Context* context,
+                std::uint64_t* globals, std::uint8_t* memory);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Instr.h"
+using namespace std;
+using namespace wasm;
+
+static bool
+IsBranch(InstrOp op) {
+  return op == InstrOp::Br || op == InstrOp::BrIf;
+}
+
+// A block begins at the start of the routine, at each branch target, and
+// after each branch. A block ends at a branch or at the next block, so once
+// it's entered, every instruction in it executes unless one traps.
+void
+wasm::Meter(vector<Instr>& code) {
+  vector<bool> isLeader(code.size(), false);
+  if (!code.empty())
+    isLeader[0] = true;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (!IsBranch(code[i].op))
+      continue;
+    isLeader[code[i].payload] = true;
+    if (i + 1 < code.size())
+      isLeader[i + 1] = true;
+  }
+
+  // Branches to a block enter it through its Fuel instruction.
+  vector<Instr> metered;
+  vector<uint32_t> newIndex(code.size());
+  size_t fuel = 0;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (isLeader[i]) {
+      fuel = metered.size();
+      metered.push_back(Instr{nullptr, InstrOp::Fuel, 0, 0});
+    }
+    newIndex[i] = uint32_t(fuel);
+    metered.push_back(code[i]);
+    ++metered[fuel].payload;
+  }
+  for (Instr& instr : metered)
+    if (IsBranch(instr.op))
+      instr.payload = newIndex[instr.payload];
+  code.swap(metered);
+}
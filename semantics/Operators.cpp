@@ -14,668 +14,971 @@
  * limitations under the License.
  */
 
+#include "semantics/Instr.h"
+#include "semantics/Context.h"
+#include "semantics/Operators.h"
+#include "semantics/Profile.h"
+#include "process/ExprStack.h"
+#include "implementation/Features.h"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <math.h>
 using namespace wasm;
 
-void
-InterpretInt32(Node* node, Context* context) {
-  switch (node->opcode) {
-    case GetLocal: {
-      int32_t x = context->load_local_int32(node->payload);
-      context->push_int32(x);
-      break;
-    }
-    case SetLocal: {
-      int32_t v = context->pop_int32();
-      context->store_local_int32(node->payload, v);
-      context->push_int32(v);
-      break;
-    }
-    case LoadHeap: {
-      int32_t p = context->pop_int32();
+// The interpreter loop. Each handler is both a switch case and, when the host
+// compiler supports it, a label whose address is stored in the instructions
+// that use it. With Threaded set, each handler ends by jumping directly to
+// the next instruction's handler, giving every handler its own indirect
+// branch to predict; otherwise control returns to the shared switch. With
+// CountPairs set, every dispatch through the switch records the pair of
+// instructions it connects, and with Profiled set, it charges the cycles
+// since the last one to the last one's site in sites. With Sampled set, it
+// stores the index of the instruction about to execute in *position, where a
+// sampler can read it.
+//
+// Operands are kept in an ExprStack, whose top entry lives in a register; it's
+// flushed to the context's stack around calls, and a branch sets it to the
+// depth of its target.
+//
+// Called with a null pc, this returns the handler table instead, since the
+// label addresses aren't visible outside this function.
+template <bool Threaded, bool CountPairs, bool Profiled, bool Sampled>
+static const void* const*
+Execute(const Instr* code, Context* context, PairCounts* pairCounts,
+        Profile* profile, Profile::Site* sites, uint32_t* position) {
+  const Instr* pc = code;
+#if WASM_HAVE_COMPUTED_GOTO
+  static const void* const handlers[] = {
+#define INSTR(name) &&Do##name,
+#include "semantics/Instrs.def"
+#undef INSTR
+  };
+  if (pc == nullptr)
+    return handlers;
+#define OP(name)                                                               \
+  case InstrOp::name:                                                          \
+  Do##name
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (Threaded)                                                              \
+      goto *pc->handler;                                                       \
+    goto dispatch;                                                             \
+  } while (0)
+#else
+  if (pc == nullptr)
+    return nullptr;
+#define OP(name) case InstrOp::name
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ++pc;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+// A backward jump, which ends every loop iteration, is a safe point.
+#define JUMP(target)                                                           \
+  do {                                                                         \
+    const Instr* to = code + (target);                                         \
+    if (to <= pc)                                                              \
+      context->safe_point();                                                   \
+    pc = to;                                                                   \
+    stack.reset(frame, pc->depth);                                             \
+    DISPATCH();                                                                \
+  } while (0)
+
+// The integer operators of width W, from IntOperators.
+#define INT_BINARY(W, name, fn)                                                \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = stack.pop_int##W();                                         \
+    int##W##_t l = stack.pop_int##W();                                         \
+    int##W##_t x = IntOperators<Types::int##W>::fn(l, r);                      \
+    stack.push_int##W(x);                                                      \
+    NEXT();                                                                    \
+  }
+#define INT_DIVIDE(W, name, fn)                                                \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = stack.pop_int##W();                                         \
+    int##W##_t l = stack.pop_int##W();                                         \
+    int##W##_t x;                                                              \
+    if (const char* why = IntOperators<Types::int##W>::fn(l, r, &x)) {         \
+      context->trap(why);                                                      \
+      return nullptr;                                                          \
+    }                                                                          \
+    stack.push_int##W(x);                                                      \
+    NEXT();                                                                    \
+  }
+#define INT_COMPARE(W, name, fn)                                               \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = stack.pop_int##W();                                         \
+    int##W##_t l = stack.pop_int##W();                                         \
+    bool x = IntOperators<Types::int##W>::fn(l, r);                            \
+    stack.push_boolean(x);                                                     \
+    NEXT();                                                                    \
+  }
+#define INT_OPERATORS(W)                                                       \
+  INT_BINARY(W, Add, add)                                                      \
+  INT_BINARY(W, Sub, sub)                                                      \
+  INT_BINARY(W, Mul, mul)                                                      \
+  INT_DIVIDE(W, SDiv, sdiv)                                                    \
+  INT_DIVIDE(W, UDiv, udiv)                                                    \
+  INT_DIVIDE(W, SRem, srem)                                                    \
+  INT_DIVIDE(W, URem, urem)                                                    \
+  INT_BINARY(W, And, and_)                                                     \
+  INT_BINARY(W, Ior, ior)                                                      \
+  INT_BINARY(W, Xor, xor_)                                                     \
+  INT_BINARY(W, Shl, shl)                                                      \
+  INT_BINARY(W, Shr, shr)                                                      \
+  INT_BINARY(W, Sar, sar)                                                      \
+  INT_COMPARE(W, Eq, eq)                                                       \
+  INT_COMPARE(W, Slt, slt)                                                     \
+  INT_COMPARE(W, Sle, sle)                                                     \
+  INT_COMPARE(W, Ult, ult)                                                     \
+  INT_COMPARE(W, Ule, ule)
+
+  InstrOp prev = InstrOp::End;
+  // Cycles spent in callees are excluded by keeping track of the profile's
+  // total, to which each call adds its own time on return.
+  uint64_t start = Profiled ? Profile::cycles() : 0;
+  uint64_t entryCalleeCycles = Profiled ? profile->calleeCycles() : 0;
+  uint64_t last = start;
+  uint64_t lastCalleeCycles = entryCalleeCycles;
+  Profile::Site* site = nullptr;
+  // This frame's operands start at frame, above its caller's.
+  EvalStack& evalStack = context->eval_stack();
+  uint64_t* frame = evalStack.top();
+  ExprStack stack(frame);
+#if WASM_HAVE_COMPUTED_GOTO
+  if (Threaded)
+    goto *pc->handler;
+#endif
+dispatch:
+  if (CountPairs) {
+    pairCounts->record(prev, pc->op);
+    prev = pc->op;
+  }
+  if (Profiled) {
+    uint64_t now = Profile::cycles();
+    uint64_t calleeCycles = profile->calleeCycles();
+    if (site)
+      site->cycles += now - last - (calleeCycles - lastCalleeCycles);
+    site = &sites[pc - code];
+    ++site->count;
+    last = now;
+    lastCalleeCycles = calleeCycles;
+  }
+  if (Sampled)
+    *position = uint32_t(pc - code);
+  switch (pc->op) {
+    // int32
+    OP(Int32GetLocal): {
+      int32_t x = context->load_local_int32(pc->payload);
+      stack.push_int32(x);
+      NEXT();
+    }
+    OP(Int32SetLocal): {
+      int32_t v = stack.pop_int32();
+      context->store_local_int32(pc->payload, v);
+      stack.push_int32(v);
+      NEXT();
+    }
+    OP(Int32LoadHeap): {
+      int32_t p = stack.pop_int32();
       int32_t i = 0;
-      int32_t x = context->load_heap_int32(p, i, node->payload);
-      context->push_int32(x);
-      break;
+      int32_t x = context->load_heap_int32(p, i, pc->payload);
+      stack.push_int32(x);
+      NEXT();
     }
-    case StoreHeap: {
-      int32_t p = context->pop_int32();
-      int32_t v = context->pop_int32();
+    OP(Int32StoreHeap): {
+      int32_t p = stack.pop_int32();
+      int32_t v = stack.pop_int32();
       int32_t i = 0;
-      context->store_heap_int32(p, i, node->payload, v);
-      context->push_int32(v);
-      break;
+      context->store_heap_int32(p, i, pc->payload, v);
+      stack.push_int32(v);
+      NEXT();
     }
-    case LoadHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      int32_t i = context->read_literal_int32(node->payload);
+    OP(Int32LoadHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int32_t i = context->read_literal_int32(pc->payload);
       int32_t x = context->load_heap_int32(p, i);
-      context->push_int32(x);
-      break;
-    }
-    case StoreHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      int32_t v = context->pop_int32();
-      int32_t i = context->read_literal_int32(node->payload);
-      context->store_heap_int32(p, i, node->payload, v);
-      context->push_int32(v);
-      break;
-    }
-    case LoadGlobal: {
-      int32_t x = context->load_global_int32(node->payload);
-      context->push_int32(x);
-      break;
-    }
-    case StoreGlobal: {
-      int32_t v = context->pop_int32();
-      context->store_global_int32(node->payload, v);
-      context->push_int32(v);
-      break;
-    }
-    case CallDirect: {
-      assert(false && "direct call unimplemented");
-      break;
-    }
-    case CallIndirect: {
+      stack.push_int32(x);
+      NEXT();
+    }
+    OP(Int32StoreHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int32_t v = stack.pop_int32();
+      int32_t i = context->read_literal_int32(pc->payload);
+      context->store_heap_int32(p, i, 0, v);
+      stack.push_int32(v);
+      NEXT();
+    }
+    OP(Int32LoadGlobal): {
+      int32_t x = context->load_global_int32(pc->payload);
+      stack.push_int32(x);
+      NEXT();
+    }
+    OP(Int32StoreGlobal): {
+      int32_t v = stack.pop_int32();
+      context->store_global_int32(pc->payload, v);
+      stack.push_int32(v);
+      NEXT();
+    }
+    OP(Int32CallDirect): {
+      evalStack.set_top(stack.flush());
+      context->call(pc->payload);
+      stack.reload(evalStack.top());
+      NEXT();
+    }
+    OP(Int32CallIndirect): {
       assert(false && "indirect call unimplemented");
-      break;
-    }
-    case AddressOf: {
-      int32_t x = context->addressof(node->payload);
-      context->push_int32(x);
-      break;
-    }
-    case Literal: {
-      int32_t x = context->read_literal_int32(node->payload);
-      context->push_int32(x);
-      break;
-    }
-    case Int32Add: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = uint32_t(l) + r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32Sub: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = uint32_t(l) - r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32Mul: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = uint32_t(l) * r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32SDiv: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      if (r == 0) {
-        context->trap("signed integer division by zero");
-        return;
-      }
-      if (l == INT32_MIN && r == -1) {
-        context->trap("signed integer division overflow");
-        return;
-      }
-      int32_t x = l / r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32UDiv: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      if (r == 0) {
-        context->trap("unsigned integer division by zero");
-        return;
-      }
-      int32_t x = uint32_t(l) / r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32SRem: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      if (r == 0) {
-        context->trap("unsigned integer remainder by zero");
-        return;
-      }
-      int32_t x = (l == INT32_MIN && r == -1) ? 0 : (l % r);
-      context->push_int32(x);
-      break;
-    }
-    case Int32URem: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      if (r == 0) {
-        context->trap("unsigned integer remainder by zero");
-        return;
-      }
-      int32_t x = uint32_t(l) % r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32And: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = l & r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32Ior: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = l | r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32Xor: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = l ^ r;
-      context->push_int32(x);
-      break;
-    }
-    case Int32Shl: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = r >= 32 ? 0 : (uint32_t(l) << r);
-      context->push_int32(x);
-      break;
-    }
-    case Int32Shr: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = r >= 32 ? 0 : (uint32_t(l) >> r);
-      context->push_int32(x);
-      break;
-    }
-    case Int32Sar: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      int32_t x = int32_t(l) >> (r > 31 ? 31 : r);
-      context->push_int32(x);
-      break;
-    }
-    case Int32Eq: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
+      return nullptr;
+    }
+    OP(Int32AddressOf): {
+      int32_t x = context->addressof(pc->payload);
+      stack.push_int32(x);
+      NEXT();
+    }
+    OP(Int32Literal): {
+      int32_t x = context->read_literal_int32(pc->payload);
+      stack.push_int32(x);
+      NEXT();
+    }
+    INT_OPERATORS(32)
+    OP(Float32Eq): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       bool x = l == r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case Int32Slt: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
+    OP(Float32Lt): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       bool x = l < r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case Int32Sle: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
+    OP(Float32Le): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       bool x = l <= r;
-      context->push_boolean(x);
-      break;
-    }
-    case Int32Ult: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      bool x = uint32_t(l) < r;
-      context->push_boolean(x);
-      break;
-    }
-    case Int32Ule: {
-      int32_t r = context->pop_int32();
-      int32_t l = context->pop_int32();
-      bool x = uint32_t(l) <= r;
-      context->push_boolean(x);
-      break;
-    }
-    case Float32Eq: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
-      bool x = l == r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case Float32Lt: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
-      bool x = l < r;
-      context->push_boolean(x);
-      break;
-    }
-    case Float32Le: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
-      bool x = l <= r;
-      context->push_boolean(x);
-      break;
-    }
-    case Float64Eq: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Eq): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       bool x = l == r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case Float64Lt: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Lt): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       bool x = l < r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case Float64Le: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Le): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       bool x = l <= r;
-      context->push_boolean(x);
-      break;
+      stack.push_boolean(x);
+      NEXT();
     }
-    case SInt32FromFloat64: {
-      double o = context->pop_float64();
+    OP(SInt32FromFloat64): {
+      double o = stack.pop_float64();
       if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
         context->trap("float to signed integer conversion failure");
-        return;
+        return nullptr;
       }
       int32_t i = o;
-      context->push_int32(i);
-      break;
+      stack.push_int32(i);
+      NEXT();
     }
-    case SInt32FromFloat32: {
-      float o = context->pop_float32();
+    OP(SInt32FromFloat32): {
+      float o = stack.pop_float32();
       if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
         context->trap("float to signed integer conversion failure");
-        return;
+        return nullptr;
       }
       int32_t i = o;
-      context->push_int32(i);
-      break;
+      stack.push_int32(i);
+      NEXT();
     }
-    case Uint32FromFloat64: {
-      double o = context->pop_float64();
+    OP(Uint32FromFloat64): {
+      double o = stack.pop_float64();
       if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
         context->trap("float to unsigned integer conversion failure");
-        return;
+        return nullptr;
       }
-      int32_t i = o;
-      context->push_int32(i);
-      break;
+      int32_t i = uint32_t(o);
+      stack.push_int32(i);
+      NEXT();
     }
-    case Uint32FromFloat32: {
-      float o = context->pop_float32();
+    OP(Uint32FromFloat32): {
+      float o = stack.pop_float32();
       if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
         context->trap("float to unsigned integer conversion failure");
-        return;
+        return nullptr;
       }
-      int32_t i = o;
-      context->push_int32(i);
-      break;
+      int32_t i = uint32_t(o);
+      stack.push_int32(i);
+      NEXT();
     }
-    case Int32fromFloat32Bits: {
-      float o = context->pop_float32();
+    OP(Int32fromFloat32Bits): {
+      float o = stack.pop_float32();
       int32_t x;
-      static_assert(sizeof(o) == sizeof(x));
+      static_assert(sizeof(o) == sizeof(x), "");
       memcpy(&x, &o, sizeof(o));
-      context->push_int32(x);
-      break;
+      stack.push_int32(x);
+      NEXT();
+    }
+    OP(Int32FromInt64): {
+      int64_t o = stack.pop_int64();
+      int32_t x = int32_t(o);
+      stack.push_int32(x);
+      NEXT();
     }
-  }
-}
 
-void
-InterpretFloat32(Node* node, Context* context) {
-  switch (node->opcode) {
-    case GetLocal: {
-      float x = context->load_local_float32(node->payload);
-      context->push_float32(x);
-      break;
-    }
-    case SetLocal: {
-      float v = context->pop_float32();
-      context->store_local_float32(node->payload, v);
-      context->push_float32(v);
-      break;
-    }
-    case LoadHeap: {
-      int32_t p = context->pop_int32();
+    // int64
+    OP(Int64GetLocal): {
+      int64_t x = context->load_local_int64(pc->payload);
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(Int64SetLocal): {
+      int64_t v = stack.pop_int64();
+      context->store_local_int64(pc->payload, v);
+      stack.push_int64(v);
+      NEXT();
+    }
+    OP(Int64LoadHeap): {
+      int32_t p = stack.pop_int32();
+      int32_t i = 0;
+      int64_t x = context->load_heap_int64(p, i, pc->payload);
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(Int64StoreHeap): {
+      int32_t p = stack.pop_int32();
+      int64_t v = stack.pop_int64();
+      int32_t i = 0;
+      context->store_heap_int64(p, i, pc->payload, v);
+      stack.push_int64(v);
+      NEXT();
+    }
+    OP(Int64LoadHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int32_t i = context->read_literal_int32(pc->payload);
+      int64_t x = context->load_heap_int64(p, i);
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(Int64StoreHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int64_t v = stack.pop_int64();
+      int32_t i = context->read_literal_int32(pc->payload);
+      context->store_heap_int64(p, i, 0, v);
+      stack.push_int64(v);
+      NEXT();
+    }
+    OP(Int64LoadGlobal): {
+      int64_t x = context->load_global_int64(pc->payload);
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(Int64StoreGlobal): {
+      int64_t v = stack.pop_int64();
+      context->store_global_int64(pc->payload, v);
+      stack.push_int64(v);
+      NEXT();
+    }
+    OP(Int64CallDirect): {
+      evalStack.set_top(stack.flush());
+      context->call(pc->payload);
+      stack.reload(evalStack.top());
+      NEXT();
+    }
+    OP(Int64CallIndirect): {
+      assert(false && "indirect call unimplemented");
+      return nullptr;
+    }
+    OP(Int64Literal): {
+      int64_t x = context->read_literal_int64(pc->payload);
+      stack.push_int64(x);
+      NEXT();
+    }
+    INT_OPERATORS(64)
+    OP(Int64FromSInt32): {
+      int32_t o = stack.pop_int32();
+      int64_t x = o;
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(Int64FromUInt32): {
+      int32_t o = stack.pop_int32();
+      int64_t x = uint32_t(o);
+      stack.push_int64(x);
+      NEXT();
+    }
+    OP(SInt64FromFloat64): {
+      double o = stack.pop_float64();
+      if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = o;
+      stack.push_int64(i);
+      NEXT();
+    }
+    OP(SInt64FromFloat32): {
+      float o = stack.pop_float32();
+      if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = o;
+      stack.push_int64(i);
+      NEXT();
+    }
+    OP(Uint64FromFloat64): {
+      double o = stack.pop_float64();
+      if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = uint64_t(o);
+      stack.push_int64(i);
+      NEXT();
+    }
+    OP(Uint64FromFloat32): {
+      float o = stack.pop_float32();
+      if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = uint64_t(o);
+      stack.push_int64(i);
+      NEXT();
+    }
+    OP(Int64FromFloat64Bits): {
+      double o = stack.pop_float64();
+      int64_t x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      stack.push_int64(x);
+      NEXT();
+    }
+
+    // float32
+    OP(Float32GetLocal): {
+      float x = context->load_local_float32(pc->payload);
+      stack.push_float32(x);
+      NEXT();
+    }
+    OP(Float32SetLocal): {
+      float v = stack.pop_float32();
+      context->store_local_float32(pc->payload, v);
+      stack.push_float32(v);
+      NEXT();
+    }
+    OP(Float32LoadHeap): {
+      int32_t p = stack.pop_int32();
       int32_t i = 0;
-      float x = context->load_heap_float32(p, i, node->payload);
-      context->push_float32(x);
-      break;
+      float x = context->load_heap_float32(p, i, pc->payload);
+      stack.push_float32(x);
+      NEXT();
     }
-    case StoreHeap: {
-      int32_t p = context->pop_int32();
-      float v = context->pop_float32();
+    OP(Float32StoreHeap): {
+      int32_t p = stack.pop_int32();
+      float v = stack.pop_float32();
       int32_t i = 0;
-      context->store_heap_float32(p, i, node->payload, v);
-      context->push_float32(v);
-      break;
-    }
-    case LoadHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      int32_t i = context->read_literal_int32(node->payload);
-      float x = context->load_heap_float32(p, i, node->payload);
-      context->push_float32(x);
-      break;
-    }
-    case StoreHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      float v = context->pop_float32();
-      int32_t i = context->read_literal_int32(node->payload);
-      context->store_heap_float32(p, i, node->payload v);
-      context->push_float32(v);
-      break;
-    }
-    case LoadGlobal: {
-      float x = context->load_global_float32(node->payload);
-      context->push_float32(x);
-      break;
-    }
-    case StoreGlobal: {
-      float v = context->pop_float32();
-      context->store_global_float32(node->payload, v);
-      context->push_float32(v);
-      break;
-    }
-    case CallDirect: {
-      assert(false && "direct call unimplemented");
-      break;
-    }
-    case CallIndirect: {
+      context->store_heap_float32(p, i, pc->payload, v);
+      stack.push_float32(v);
+      NEXT();
+    }
+    OP(Float32LoadHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int32_t i = context->read_literal_int32(pc->payload);
+      float x = context->load_heap_float32(p, i);
+      stack.push_float32(x);
+      NEXT();
+    }
+    OP(Float32StoreHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      float v = stack.pop_float32();
+      int32_t i = context->read_literal_int32(pc->payload);
+      context->store_heap_float32(p, i, 0, v);
+      stack.push_float32(v);
+      NEXT();
+    }
+    OP(Float32LoadGlobal): {
+      float x = context->load_global_float32(pc->payload);
+      stack.push_float32(x);
+      NEXT();
+    }
+    OP(Float32StoreGlobal): {
+      float v = stack.pop_float32();
+      context->store_global_float32(pc->payload, v);
+      stack.push_float32(v);
+      NEXT();
+    }
+    OP(Float32CallDirect): {
+      evalStack.set_top(stack.flush());
+      context->call(pc->payload);
+      stack.reload(evalStack.top());
+      NEXT();
+    }
+    OP(Float32CallIndirect): {
       assert(false && "indirect call unimplemented");
-      break;
+      return nullptr;
     }
-    case Literal: {
-      float x = context->read_literal_float32(node->payload);
-      context->push_float32(x);
-      break;
+    OP(Float32Literal): {
+      float x = context->read_literal_float32(pc->payload);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Add: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
+    OP(Float32Add): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       float x = l + r;
       if (x != x)
-        x = nan_float32(node->opcode, l, r);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, l, r);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Sub: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
+    OP(Float32Sub): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       float x = l - r;
       if (x != x)
-        x = nan_float32(node->opcode, l, r);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, l, r);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Mul: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
+    OP(Float32Mul): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       float x = l * r;
       if (x != x)
-        x = nan_float32(node->opcode, l, r);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, l, r);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Div: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
+    OP(Float32Div): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       // C++ annoyingly says that division by 0 is UB even for floating point.
       float x =
         r == 0 ? (l == 0 ? float(NAN) : copysignf(INFINITY, l * r)) : l / r;
       if (x != x)
-        x = nan_float32(node->opcode, l, r);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, l, r);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Abs: {
-      float o = context->pop_float32();
+    OP(Float32Abs): {
+      float o = stack.pop_float32();
       float x = fabsf(o);
-      context->push_float32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Neg: {
-      float o = context->pop_float32();
+    OP(Float32Neg): {
+      float o = stack.pop_float32();
       float x = -o;
-      context->push_float32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Copysign: {
-      float r = context->pop_float32();
-      float l = context->pop_float32();
+    OP(Float32Copysign): {
+      float r = stack.pop_float32();
+      float l = stack.pop_float32();
       float x = copysignf(l, r);
-      context->push_float32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Ceil: {
-      float o = context->pop_float32();
+    OP(Float32Ceil): {
+      float o = stack.pop_float32();
       float x = ceilf(o);
       if (x != x)
-        x = nan_float32(node->opcode, o);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, o);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Floor: {
-      float o = context->pop_float32();
+    OP(Float32Floor): {
+      float o = stack.pop_float32();
       float x = floorf(o);
       if (x != x)
-        x = nan_float32(node->opcode, o);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, o);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32Sqrt: {
-      float o = context->pop_float32();
+    OP(Float32Sqrt): {
+      float o = stack.pop_float32();
       float x = sqrtf(o);
       if (x != x)
-        x = nan_float32(node->opcode, o);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, o);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32FromFloat64: {
-      double o = context->pop_float64();
+    OP(Float32FromFloat64): {
+      double o = stack.pop_float64();
       float x = o;
       if (x != x)
-        x = nan_float32(node->opcode, o);
-      context->push_float32(x);
-      break;
+        x = nan_float32(context, o);
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32FromSInt32: {
-      int32_t o = context->pop_int32();
+    OP(Float32FromSInt32): {
+      int32_t o = stack.pop_int32();
       float x = o;
-      context->push_float32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32FromUInt32: {
-      int32_t o = context->pop_int32();
+    OP(Float32FromUInt32): {
+      int32_t o = stack.pop_int32();
       float x = uint32_t(o);
-      context->push_float32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
     }
-    case Float32FromInt32Bits: {
-      int32_t o = context->pop_int32();
+    OP(Float32FromInt32Bits): {
+      int32_t o = stack.pop_int32();
       float x;
-      static_assert(sizeof(o) == sizeof(x));
+      static_assert(sizeof(o) == sizeof(x), "");
       memcpy(&x, &o, sizeof(o));
-      context->push_int32(x);
-      break;
+      stack.push_float32(x);
+      NEXT();
+    }
+    OP(Float32FromSInt64): {
+      int64_t o = stack.pop_int64();
+      float x = o;
+      stack.push_float32(x);
+      NEXT();
+    }
+    OP(Float32FromUInt64): {
+      int64_t o = stack.pop_int64();
+      float x = uint64_t(o);
+      stack.push_float32(x);
+      NEXT();
     }
-  }
-}
 
-void
-InterpretFloat64(Node* node, Context* context) {
-  switch (node->opcode) {
-    case GetLocal: {
-      double x = context->load_local_float64(node->payload);
-      context->push_float64(x);
-      break;
-    }
-    case SetLocal: {
-      double v = context->pop_float64();
-      context->store_local_float64(node->payload, v);
-      context->push_float64(v);
-      break;
-    }
-    case LoadHeap: {
-      int32_t p = context->pop_int32();
+    // float64
+    OP(Float64GetLocal): {
+      double x = context->load_local_float64(pc->payload);
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64SetLocal): {
+      double v = stack.pop_float64();
+      context->store_local_float64(pc->payload, v);
+      stack.push_float64(v);
+      NEXT();
+    }
+    OP(Float64LoadHeap): {
+      int32_t p = stack.pop_int32();
       int32_t i = 0;
-      double x = context->load_heap_float64(p, i, node->payload);
-      context->push_float64(x);
-      break;
+      double x = context->load_heap_float64(p, i, pc->payload);
+      stack.push_float64(x);
+      NEXT();
     }
-    case StoreHeap: {
-      int32_t p = context->pop_int32();
-      double v = context->pop_float64();
+    OP(Float64StoreHeap): {
+      int32_t p = stack.pop_int32();
+      double v = stack.pop_float64();
       int32_t i = 0;
-      context->store_heap_float64(p, i, node->payload, v);
-      context->push_float64(v);
-      break;
-    }
-    case LoadHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      int32_t i = context->read_literal_int32(node->payload);
-      double x = context->load_heap_float64(p, i, node->payload);
-      context->push_float64(x);
-      break;
-    }
-    case StoreHeapWithOffset: {
-      int32_t p = context->pop_int32();
-      double v = context->pop_float64();
-      int32_t i = context->read_literal_int32(node->payload);
-      context->store_heap_float64(p, i, node->payload, v);
-      context->push_float64(v);
-      break;
-    }
-    case LoadGlobal: {
-      double x = context->load_global_float64(node->payload);
-      context->push_float64(x);
-      break;
-    }
-    case StoreGlobal: {
-      double v = context->pop_float64();
-      context->store_global_float64(node->payload, v);
-      context->push_float64(v);
-      break;
-    }
-    case CallDirect: {
-      assert(false && "direct call unimplemented");
-      break;
-    }
-    case CallIndirect: {
+      context->store_heap_float64(p, i, pc->payload, v);
+      stack.push_float64(v);
+      NEXT();
+    }
+    OP(Float64LoadHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      int32_t i = context->read_literal_int32(pc->payload);
+      double x = context->load_heap_float64(p, i);
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64StoreHeapWithOffset): {
+      int32_t p = stack.pop_int32();
+      double v = stack.pop_float64();
+      int32_t i = context->read_literal_int32(pc->payload);
+      context->store_heap_float64(p, i, 0, v);
+      stack.push_float64(v);
+      NEXT();
+    }
+    OP(Float64LoadGlobal): {
+      double x = context->load_global_float64(pc->payload);
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64StoreGlobal): {
+      double v = stack.pop_float64();
+      context->store_global_float64(pc->payload, v);
+      stack.push_float64(v);
+      NEXT();
+    }
+    OP(Float64CallDirect): {
+      evalStack.set_top(stack.flush());
+      context->call(pc->payload);
+      stack.reload(evalStack.top());
+      NEXT();
+    }
+    OP(Float64CallIndirect): {
       assert(false && "indirect call unimplemented");
-      break;
+      return nullptr;
     }
-    case Literal: {
-      double x = context->read_literal_float64(node->payload);
-      context->push_float64(x);
-      break;
+    OP(Float64Literal): {
+      double x = context->read_literal_float64(pc->payload);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Add: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Add): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       double x = l + r;
       if (x != x)
-        x = nan_float64(node->opcode, l, r);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, l, r);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Sub: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Sub): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       double x = l - r;
       if (x != x)
-        x = nan_float64(node->opcode, l, r);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, l, r);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Mul: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Mul): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       double x = l * r;
       if (x != x)
-        x = nan_float64(node->opcode, l, r);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, l, r);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Div: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Div): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       // C++ annoyingly says that division by 0 is UB even for floating point.
       double x = r == 0 ? (l == 0 ? NAN : copysign(INFINITY, l * r)) : l / r;
       if (x != x)
-        x = nan_float64(node->opcode, l, r);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, l, r);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Abs: {
-      double o = context->pop_float64();
+    OP(Float64Abs): {
+      double o = stack.pop_float64();
       double x = fabs(o);
-      context->push_float64(x);
-      break;
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Neg: {
-      double o = context->pop_float64();
+    OP(Float64Neg): {
+      double o = stack.pop_float64();
       double x = -o;
-      context->push_float64(x);
-      break;
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Copysign: {
-      double r = context->pop_float64();
-      double l = context->pop_float64();
+    OP(Float64Copysign): {
+      double r = stack.pop_float64();
+      double l = stack.pop_float64();
       double x = copysign(l, r);
-      context->push_float64(x);
-      break;
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Ceil: {
-      double o = context->pop_float64();
+    OP(Float64Ceil): {
+      double o = stack.pop_float64();
       double x = ceil(o);
       if (x != x)
-        x = nan_float64(node->opcode, o);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, o);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Floor: {
-      double o = context->pop_float64();
+    OP(Float64Floor): {
+      double o = stack.pop_float64();
       double x = floor(o);
       if (x != x)
-        x = nan_float64(node->opcode, o);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, o);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64Sqrt: {
-      double o = context->pop_float64();
+    OP(Float64Sqrt): {
+      double o = stack.pop_float64();
       double x = sqrt(o);
       if (x != x)
-        x = nan_float64(node->opcode, o);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, o);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64FromFloat32: {
-      float o = context->pop_float32();
+    OP(Float64FromFloat32): {
+      float o = stack.pop_float32();
       double x = o;
       if (x != x)
-        x = nan_float64(node->opcode, o);
-      context->push_float64(x);
-      break;
+        x = nan_float64(context, o);
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64FromSInt32: {
-      int32_t o = context->pop_int32();
+    OP(Float64FromSInt32): {
+      int32_t o = stack.pop_int32();
       double x = o;
-      context->push_float64(x);
-      break;
+      stack.push_float64(x);
+      NEXT();
     }
-    case Float64FromUInt32: {
-      int32_t o = context->pop_int32();
+    OP(Float64FromUInt32): {
+      int32_t o = stack.pop_int32();
       double x = uint32_t(o);
-      context->push_float64(x);
-      break;
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64FromSInt64): {
+      int64_t o = stack.pop_int64();
+      double x = o;
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64FromUInt64): {
+      int64_t o = stack.pop_int64();
+      double x = uint64_t(o);
+      stack.push_float64(x);
+      NEXT();
+    }
+    OP(Float64FromInt64Bits): {
+      int64_t o = stack.pop_int64();
+      double x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      stack.push_float64(x);
+      NEXT();
+    }
+
+    // statements
+    OP(Br): {
+      JUMP(pc->payload);
+    }
+    OP(BrIf): {
+      int32_t c = stack.pop_int32();
+      if (c)
+        JUMP(pc->payload);
+      NEXT();
+    }
+    OP(MemoryCopy): {
+      int32_t n = stack.pop_int32();
+      int32_t s = stack.pop_int32();
+      int32_t d = stack.pop_int32();
+      context->copy_heap(d, s, n);
+      NEXT();
+    }
+    OP(MemoryFill): {
+      int32_t n = stack.pop_int32();
+      int32_t v = stack.pop_int32();
+      int32_t d = stack.pop_int32();
+      context->fill_heap(d, v, n);
+      NEXT();
+    }
+    OP(Int32CallFFI): {
+      evalStack.set_top(stack.flush());
+      context->call_ffi(pc->payload);
+      stack.reload(evalStack.top());
+      NEXT();
+    }
+    OP(Fuel): {
+      context->consume_fuel(pc->payload);
+      NEXT();
+    }
+
+    // superinstructions
+    OP(Int32AddLocalLiteral): {
+      int32_t l = context->load_local_int32(pc[0].payload);
+      int32_t r = context->read_literal_int32(pc[1].payload);
+      int32_t x = uint32_t(l) + r;
+      stack.push_int32(x);
+      pc += 2;
+      NEXT();
+    }
+    OP(Int32LoadHeapLocalWithOffset): {
+      int32_t p = context->load_local_int32(pc[0].payload);
+      int32_t i = context->read_literal_int32(pc[1].payload);
+      int32_t x = context->load_heap_int32(p, i);
+      stack.push_int32(x);
+      pc += 1;
+      NEXT();
+    }
+    OP(Float32LoadHeapLocalWithOffset): {
+      int32_t p = context->load_local_int32(pc[0].payload);
+      int32_t i = context->read_literal_int32(pc[1].payload);
+      float x = context->load_heap_float32(p, i);
+      stack.push_float32(x);
+      pc += 1;
+      NEXT();
+    }
+    OP(Float64LoadHeapLocalWithOffset): {
+      int32_t p = context->load_local_int32(pc[0].payload);
+      int32_t i = context->read_literal_int32(pc[1].payload);
+      double x = context->load_heap_float64(p, i);
+      stack.push_float64(x);
+      pc += 1;
+      NEXT();
+    }
+    OP(BrIfInt32Slt): {
+      int32_t r = stack.pop_int32();
+      int32_t l = stack.pop_int32();
+      if (l < r)
+        JUMP(pc[1].payload);
+      pc += 1;
+      NEXT();
+    }
+    OP(BrIfInt32Eq): {
+      int32_t r = stack.pop_int32();
+      int32_t l = stack.pop_int32();
+      if (l == r)
+        JUMP(pc[1].payload);
+      pc += 1;
+      NEXT();
+    }
+
+    OP(End): {
+      evalStack.set_top(stack.flush());
+      if (Profiled)
+        profile->calleeCycles() =
+          entryCalleeCycles + (Profile::cycles() - start);
+      return nullptr;
     }
   }
+
+#undef INT_BINARY
+#undef INT_DIVIDE
+#undef INT_COMPARE
+#undef INT_OPERATORS
+#undef OP
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+  return nullptr;
+}
+
+const void*
+wasm::ThreadedHandler(InstrOp op) {
+  const void* const* handlers = Execute<true, false, false, false>(
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+  return handlers ? handlers[size_t(op)] : nullptr;
+}
+
+void
+wasm::Interpret(const Instr* code, Dispatch dispatch, Context* context,
+                PairCounts* pairCounts, Profile* profile, uint32_t index,
+                uint32_t* position) {
+  if (profile)
+    Execute<false, false, true, false>(code, context, nullptr, profile,
+                                       profile->sites(index, code), nullptr);
+  else if (pairCounts)
+    Execute<false, true, false, false>(code, context, pairCounts, nullptr,
+                                       nullptr, nullptr);
+  else if (position)
+    Execute<false, false, false, true>(code, context, nullptr, nullptr,
+                                       nullptr, position);
+  else if (WASM_HAVE_COMPUTED_GOTO && dispatch == Dispatch::threaded)
+    Execute<true, false, false, false>(code, context, nullptr, nullptr,
+                                       nullptr, nullptr);
+  else
+    Execute<false, false, false, false>(code, context, nullptr, nullptr,
+                                        nullptr, nullptr);
 }
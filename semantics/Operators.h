@@ -0,0 +1,105 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_OPERATORS_H
+#define WEBASSEMBLY_SEMANTICS_OPERATORS_H
+
+#include "semantics/Context.h"
+#include "semantics/Types.h"
+#include "implementation/NaNBits.h"
+#include <limits>
+#include <type_traits>
+
+namespace wasm {
+
+// The integer operators, shared by int32 and int64 and by the engines which
+// compute in C++. Arithmetic wraps around. Shift counts of the width or more
+// give zero, or copies of the sign bit for Sar; smaller ones, negative ones
+// included, are masked to the width, as the host's shift instructions mask
+// them. The division operators return null and set x, or return why they
+// trap.
+template <Types T>
+struct IntOperators {
+  typedef typename TypeTraits<T>::HostTy Int;
+  typedef typename std::make_unsigned<Int>::type Uint;
+  static const Int width = sizeof(Int) * 8;
+  static const Int mask = width - 1;
+
+  static Int add(Int l, Int r) { return Uint(l) + Uint(r); }
+  static Int sub(Int l, Int r) { return Uint(l) - Uint(r); }
+  static Int mul(Int l, Int r) { return Uint(l) * Uint(r); }
+  static Int and_(Int l, Int r) { return l & r; }
+  static Int ior(Int l, Int r) { return l | r; }
+  static Int xor_(Int l, Int r) { return l ^ r; }
+  static Int shl(Int l, Int r) {
+    return r >= width ? 0 : Uint(l) << (r & mask);
+  }
+  static Int shr(Int l, Int r) {
+    return r >= width ? 0 : Uint(l) >> (r & mask);
+  }
+  static Int sar(Int l, Int r) { return l >> ((r > mask ? mask : r) & mask); }
+
+  static bool eq(Int l, Int r) { return l == r; }
+  static bool slt(Int l, Int r) { return l < r; }
+  static bool sle(Int l, Int r) { return l <= r; }
+  static bool ult(Int l, Int r) { return Uint(l) < Uint(r); }
+  static bool ule(Int l, Int r) { return Uint(l) <= Uint(r); }
+
+  static const char* sdiv(Int l, Int r, Int* x) {
+    if (r == 0)
+      return "signed integer division by zero";
+    if (l == std::numeric_limits<Int>::min() && r == -1)
+      return "signed integer division overflow";
+    *x = l / r;
+    return nullptr;
+  }
+  static const char* udiv(Int l, Int r, Int* x) {
+    if (r == 0)
+      return "unsigned integer division by zero";
+    *x = Uint(l) / Uint(r);
+    return nullptr;
+  }
+  // The minimum divided by -1 overflows, but its remainder is zero.
+  static const char* srem(Int l, Int r, Int* x) {
+    if (r == 0)
+      return "unsigned integer remainder by zero";
+    *x = r == -1 ? 0 : l % r;
+    return nullptr;
+  }
+  static const char* urem(Int l, Int r, Int* x) {
+    if (r == 0)
+      return "unsigned integer remainder by zero";
+    *x = Uint(l) % Uint(r);
+    return nullptr;
+  }
+};
+
+// Compute the result of a float32 operator whose result was NaN. If an
+// operand is a NaN, its bits may be propagated; otherwise the implementation
+// chooses the NaN bits.
+inline float
+nan_float32(Context* context, float l, float r = 0) {
+  return context->nan_bits().float32(l, r);
+}
+
+inline double
+nan_float64(Context* context, double l, double r = 0) {
+  return context->nan_bits().float64(l, r);
+}
+
+} // namespace wasm
+
+#endif // include guard
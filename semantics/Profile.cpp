@@ -0,0 +1,104 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Profile.h"
+#include <algorithm>
+#include <cinttypes>
+using namespace std;
+using namespace wasm;
+
+Profile::Site*
+Profile::sites(uint32_t index, const Instr* code) {
+  if (index >= routines_.size())
+    routines_.resize(index + 1);
+  vector<Site>& sites = routines_[index];
+  if (sites.empty()) {
+    // Code ends at its first End.
+    size_t i = 0;
+    do
+      sites.push_back(Site{code[i].op, 0, 0});
+    while (code[i++].op != InstrOp::End);
+  }
+  return sites.data();
+}
+
+static bool
+Hotter(const Profile::Site& l, const Profile::Site& r) {
+  return l.cycles > r.cycles;
+}
+
+void
+Profile::dump(FILE* out) const {
+  vector<Site> ops(numInstrOps);
+  for (size_t op = 0; op < numInstrOps; ++op)
+    ops[op] = Site{InstrOp(op), 0, 0};
+  // Each routine's total, with op unused.
+  vector<Site> totals(routines_.size(), Site{InstrOp::End, 0, 0});
+  for (size_t routine = 0; routine < routines_.size(); ++routine) {
+    for (const Site& site : routines_[routine]) {
+      ops[size_t(site.op)].count += site.count;
+      ops[size_t(site.op)].cycles += site.cycles;
+      totals[routine].count += site.count;
+      totals[routine].cycles += site.cycles;
+    }
+  }
+
+  ops.erase(remove_if(ops.begin(), ops.end(),
+                      [](const Site& site) { return site.count == 0; }),
+            ops.end());
+  stable_sort(ops.begin(), ops.end(), Hotter);
+  fprintf(out, "{\n  \"unit\": \"%s\",\n  \"instructions\": [", unit());
+  for (size_t i = 0; i < ops.size(); ++i) {
+    fprintf(out,
+            "%s\n    {\"op\": \"%s\", \"count\": %" PRIu64
+            ", \"cycles\": %" PRIu64 "}",
+            i ? "," : "", InstrName(ops[i].op), ops[i].count, ops[i].cycles);
+  }
+
+  vector<size_t> order;
+  for (size_t routine = 0; routine < routines_.size(); ++routine)
+    if (totals[routine].count != 0)
+      order.push_back(routine);
+  stable_sort(order.begin(), order.end(), [&totals](size_t l, size_t r) {
+    return Hotter(totals[l], totals[r]);
+  });
+  fprintf(out, "\n  ],\n  \"routines\": [");
+  for (size_t i = 0; i < order.size(); ++i) {
+    const vector<Site>& sites = routines_[order[i]];
+    fprintf(out,
+            "%s\n    {\"routine\": %zu, \"count\": %" PRIu64
+            ", \"cycles\": %" PRIu64 ", \"sites\": [",
+            i ? "," : "", order[i], totals[order[i]].count,
+            totals[order[i]].cycles);
+    vector<size_t> hot;
+    for (size_t index = 0; index < sites.size(); ++index)
+      if (sites[index].count != 0)
+        hot.push_back(index);
+    stable_sort(hot.begin(), hot.end(), [&sites](size_t l, size_t r) {
+      return Hotter(sites[l], sites[r]);
+    });
+    for (size_t j = 0; j < hot.size(); ++j) {
+      const Site& site = sites[hot[j]];
+      fprintf(out,
+              "%s\n      {\"index\": %zu, \"op\": \"%s\", \"count\": %" PRIu64
+              ", \"cycles\": %" PRIu64 "}",
+              j ? "," : "", hot[j], InstrName(site.op), site.count,
+              site.cycles);
+    }
+    fprintf(out, "\n    ]}");
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_PROFILE_H
+#define WEBASSEMBLY_SEMANTICS_PROFILE_H
+
+#include "semantics/Instr.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace wasm {
+
+// Executions and cycles of the stack form, by site: a routine and the index
+// of an instruction in its code, which is its node's index unless Meter has
+// inserted Fuel instructions. An instruction's cycles run from its dispatch
+// to the next one's, less any spent in the routines it calls, so a routine's
+// sites add up to the time spent in the routine itself.
+class Profile {
+public:
+  struct Site {
+    InstrOp op;
+    std::uint64_t count;
+    std::uint64_t cycles;
+  };
+
+private:
+  // Indexed by routine, then by instruction. Empty for routines which haven't
+  // been interpreted.
+  std::vector<std::vector<Site>> routines_;
+  std::uint64_t calleeCycles_;
+
+public:
+  Profile()
+    : calleeCycles_(0) {}
+
+  // Timestamp-counter ticks where the host has one, and otherwise
+  // nanoseconds.
+  static std::uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+  static const char* unit() {
+#if defined(__x86_64__) || defined(__i386__)
+    return "cycles";
+#else
+    return "nanoseconds";
+#endif
+  }
+
+  // The sites of code, the routine at index.
+  Site* sites(std::uint32_t index, const Instr* code);
+
+  // The cycles spent in interpreted routines which have returned, for
+  // subtracting from their callers'.
+  std::uint64_t& calleeCycles() { return calleeCycles_; }
+
+  // Write totals by instruction and then by routine and site, each hottest
+  // first, as JSON.
+  void dump(std::FILE* out) const;
+};
+
+} // namespace wasm
+
+#endif // include guard
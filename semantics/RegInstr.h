@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_REGINSTR_H
+#define WEBASSEMBLY_SEMANTICS_REGINSTR_H
+
+#include "semantics/Instr.h"
+#include <cstdint>
+#include <vector>
+
+namespace wasm {
+
+struct Module;
+struct Routine;
+
+// An instruction in register form. Operands and results are indices of slots
+// in the routine's frame, which holds its locals, then the constants it uses,
+// then its temporaries. Register instructions reuse InstrOp: GetLocal,
+// Literal and AddressOf are folded into operands and never appear, and
+// SetLocal is a move from a to dst.
+//
+// Heap and global accesses keep their alignment or global index in payload,
+// and branches keep their target, as an index into the register code. End's
+// a is the slot holding the routine's result, or noSlot if it has none.
+// The WithOffset forms take their offset from a constant slot: b for loads,
+// payload for stores, whose b is the stored value. MemoryCopy and MemoryFill
+// take their size from the slot in payload. Int32CallFFI's operands are in
+// consecutive slots starting at a.
+const std::uint32_t noSlot = ~std::uint32_t(0);
+
+struct RegInstr {
+  const void* handler;
+  InstrOp op;
+  std::uint32_t dst;
+  std::uint32_t a;
+  std::uint32_t b;
+  std::uint32_t payload;
+};
+
+struct RegisterCode {
+  std::vector<RegInstr> code;
+  // Initial values of the constant slots, which start at constantBase.
+  std::vector<std::uint64_t> constants;
+  std::uint32_t constantBase;
+  std::uint32_t numSlots;
+};
+
+// Translate a decoded, unfused stack-form routine into register form.
+RegisterCode Translate(const std::vector<Instr>& code, const Module& module,
+                       const Routine& routine, Dispatch dispatch);
+
+// Return the threaded-code handler for op in the register interpreter, or
+// null if the host compiler does not support threaded dispatch.
+const void* RegisterHandler(InstrOp op);
+
+void InterpretRegisters(const RegisterCode& code, Dispatch dispatch,
+                        Context* context);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,845 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/RegInstr.h"
+#include "semantics/Context.h"
+#include "semantics/Operators.h"
+#include "implementation/Features.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+using namespace std;
+using namespace wasm;
+
+// Frame slots hold the raw bits of their values, zero-extended to 64 bits.
+template <typename T>
+static inline T
+Get(const uint64_t* regs, uint32_t slot) {
+  T value;
+  memcpy(&value, &regs[slot], sizeof(T));
+  return value;
+}
+
+template <typename T>
+static inline void
+Set(uint64_t* regs, uint32_t slot, T value) {
+  uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(T));
+  regs[slot] = bits;
+}
+
+// The register-form interpreter loop. Dispatch works as in Operators.cpp;
+// only operand access differs.
+template <bool Threaded>
+static const void* const*
+Execute(const RegInstr* code, uint64_t* regs, Context* context) {
+  const RegInstr* pc = code;
+#if WASM_HAVE_COMPUTED_GOTO
+  static const void* const handlers[] = {
+#define INSTR(name) &&Do##name,
+#include "semantics/Instrs.def"
+#undef INSTR
+  };
+  if (pc == nullptr)
+    return handlers;
+#define OP(name)                                                               \
+  case InstrOp::name:                                                          \
+  Do##name
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (Threaded)                                                              \
+      goto *pc->handler;                                                       \
+    goto dispatch;                                                             \
+  } while (0)
+  if (Threaded)
+    goto *pc->handler;
+#else
+  if (pc == nullptr)
+    return nullptr;
+#define OP(name) case InstrOp::name
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ++pc;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+// A backward jump, which ends every loop iteration, is a safe point.
+#define JUMP(target)                                                           \
+  do {                                                                         \
+    const RegInstr* to = code + (target);                                      \
+    if (to <= pc)                                                              \
+      context->safe_point();                                                   \
+    pc = to;                                                                   \
+    DISPATCH();                                                                \
+  } while (0)
+
+// The integer operators of width W, from IntOperators.
+#define INT_BINARY(W, name, fn)                                                \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = Get<int##W##_t>(regs, pc->b);                               \
+    int##W##_t l = Get<int##W##_t>(regs, pc->a);                               \
+    int##W##_t x = IntOperators<Types::int##W>::fn(l, r);                      \
+    Set(regs, pc->dst, x);                                                     \
+    NEXT();                                                                    \
+  }
+#define INT_DIVIDE(W, name, fn)                                                \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = Get<int##W##_t>(regs, pc->b);                               \
+    int##W##_t l = Get<int##W##_t>(regs, pc->a);                               \
+    int##W##_t x;                                                              \
+    if (const char* why = IntOperators<Types::int##W>::fn(l, r, &x)) {         \
+      context->trap(why);                                                      \
+      return nullptr;                                                          \
+    }                                                                          \
+    Set(regs, pc->dst, x);                                                     \
+    NEXT();                                                                    \
+  }
+#define INT_COMPARE(W, name, fn)                                               \
+  OP(Int##W##name): {                                                          \
+    int##W##_t r = Get<int##W##_t>(regs, pc->b);                               \
+    int##W##_t l = Get<int##W##_t>(regs, pc->a);                               \
+    bool x = IntOperators<Types::int##W>::fn(l, r);                            \
+    Set(regs, pc->dst, int32_t(x));                                            \
+    NEXT();                                                                    \
+  }
+#define INT_OPERATORS(W)                                                       \
+  INT_BINARY(W, Add, add)                                                      \
+  INT_BINARY(W, Sub, sub)                                                      \
+  INT_BINARY(W, Mul, mul)                                                      \
+  INT_DIVIDE(W, SDiv, sdiv)                                                    \
+  INT_DIVIDE(W, UDiv, udiv)                                                    \
+  INT_DIVIDE(W, SRem, srem)                                                    \
+  INT_DIVIDE(W, URem, urem)                                                    \
+  INT_BINARY(W, And, and_)                                                     \
+  INT_BINARY(W, Ior, ior)                                                      \
+  INT_BINARY(W, Xor, xor_)                                                     \
+  INT_BINARY(W, Shl, shl)                                                      \
+  INT_BINARY(W, Shr, shr)                                                      \
+  INT_BINARY(W, Sar, sar)                                                      \
+  INT_COMPARE(W, Eq, eq)                                                       \
+  INT_COMPARE(W, Slt, slt)                                                     \
+  INT_COMPARE(W, Sle, sle)                                                     \
+  INT_COMPARE(W, Ult, ult)                                                     \
+  INT_COMPARE(W, Ule, ule)
+
+dispatch:
+  switch (pc->op) {
+    // int32
+    OP(Int32SetLocal): {
+      regs[pc->dst] = regs[pc->a];
+      NEXT();
+    }
+    OP(Int32LoadHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = 0;
+      int32_t x = context->load_heap_int32(p, i, pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int32StoreHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t v = Get<int32_t>(regs, pc->b);
+      int32_t i = 0;
+      context->store_heap_int32(p, i, pc->payload, v);
+      NEXT();
+    }
+    OP(Int32LoadHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = Get<int32_t>(regs, pc->b);
+      int32_t x = context->load_heap_int32(p, i);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int32StoreHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t v = Get<int32_t>(regs, pc->b);
+      int32_t i = Get<int32_t>(regs, pc->payload);
+      context->store_heap_int32(p, i, 0, v);
+      NEXT();
+    }
+    OP(Int32LoadGlobal): {
+      int32_t x = context->load_global_int32(pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int32StoreGlobal): {
+      int32_t v = Get<int32_t>(regs, pc->a);
+      context->store_global_int32(pc->payload, v);
+      NEXT();
+    }
+    OP(Int32CallDirect): {
+      context->call(pc->payload);
+      regs[pc->dst] = context->pop_bits();
+      NEXT();
+    }
+    OP(Int32CallIndirect): {
+      assert(false && "indirect call unimplemented");
+      return nullptr;
+    }
+    INT_OPERATORS(32)
+    OP(Float32Eq): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      bool x = l == r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(Float32Lt): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      bool x = l < r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(Float32Le): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      bool x = l <= r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(Float64Eq): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      bool x = l == r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(Float64Lt): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      bool x = l < r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(Float64Le): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      bool x = l <= r;
+      Set(regs, pc->dst, int32_t(x));
+      NEXT();
+    }
+    OP(SInt32FromFloat64): {
+      double o = Get<double>(regs, pc->a);
+      if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int32_t i = o;
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(SInt32FromFloat32): {
+      float o = Get<float>(regs, pc->a);
+      if (!(o > double(INT32_MIN) - 1 && o < double(INT32_MAX) + 1)) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int32_t i = o;
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Uint32FromFloat64): {
+      double o = Get<double>(regs, pc->a);
+      if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int32_t i = uint32_t(o);
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Uint32FromFloat32): {
+      float o = Get<float>(regs, pc->a);
+      if (!(o > -1.0 && o < double(UINT32_MAX) + 1)) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int32_t i = uint32_t(o);
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Int32fromFloat32Bits): {
+      float o = Get<float>(regs, pc->a);
+      int32_t x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int32FromInt64): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      int32_t x = int32_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+
+    // int64
+    OP(Int64SetLocal): {
+      regs[pc->dst] = regs[pc->a];
+      NEXT();
+    }
+    OP(Int64LoadHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = 0;
+      int64_t x = context->load_heap_int64(p, i, pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int64StoreHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int64_t v = Get<int64_t>(regs, pc->b);
+      int32_t i = 0;
+      context->store_heap_int64(p, i, pc->payload, v);
+      NEXT();
+    }
+    OP(Int64LoadHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = Get<int32_t>(regs, pc->b);
+      int64_t x = context->load_heap_int64(p, i);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int64StoreHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int64_t v = Get<int64_t>(regs, pc->b);
+      int32_t i = Get<int32_t>(regs, pc->payload);
+      context->store_heap_int64(p, i, 0, v);
+      NEXT();
+    }
+    OP(Int64LoadGlobal): {
+      int64_t x = context->load_global_int64(pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int64StoreGlobal): {
+      int64_t v = Get<int64_t>(regs, pc->a);
+      context->store_global_int64(pc->payload, v);
+      NEXT();
+    }
+    OP(Int64CallDirect): {
+      context->call(pc->payload);
+      regs[pc->dst] = context->pop_bits();
+      NEXT();
+    }
+    OP(Int64CallIndirect): {
+      assert(false && "indirect call unimplemented");
+      return nullptr;
+    }
+    INT_OPERATORS(64)
+    OP(Int64FromSInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      int64_t x = o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Int64FromUInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      int64_t x = uint32_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(SInt64FromFloat64): {
+      double o = Get<double>(regs, pc->a);
+      if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = o;
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(SInt64FromFloat32): {
+      float o = Get<float>(regs, pc->a);
+      if (!(o >= double(INT64_MIN) && o < -double(INT64_MIN))) {
+        context->trap("float to signed integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = o;
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Uint64FromFloat64): {
+      double o = Get<double>(regs, pc->a);
+      if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = uint64_t(o);
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Uint64FromFloat32): {
+      float o = Get<float>(regs, pc->a);
+      if (!(o > -1.0 && o < -2 * double(INT64_MIN))) {
+        context->trap("float to unsigned integer conversion failure");
+        return nullptr;
+      }
+      int64_t i = uint64_t(o);
+      Set(regs, pc->dst, i);
+      NEXT();
+    }
+    OP(Int64FromFloat64Bits): {
+      double o = Get<double>(regs, pc->a);
+      int64_t x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+
+    // float32
+    OP(Float32SetLocal): {
+      regs[pc->dst] = regs[pc->a];
+      NEXT();
+    }
+    OP(Float32LoadHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = 0;
+      float x = context->load_heap_float32(p, i, pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32StoreHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      float v = Get<float>(regs, pc->b);
+      int32_t i = 0;
+      context->store_heap_float32(p, i, pc->payload, v);
+      NEXT();
+    }
+    OP(Float32LoadHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = Get<int32_t>(regs, pc->b);
+      float x = context->load_heap_float32(p, i);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32StoreHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      float v = Get<float>(regs, pc->b);
+      int32_t i = Get<int32_t>(regs, pc->payload);
+      context->store_heap_float32(p, i, 0, v);
+      NEXT();
+    }
+    OP(Float32LoadGlobal): {
+      float x = context->load_global_float32(pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32StoreGlobal): {
+      float v = Get<float>(regs, pc->a);
+      context->store_global_float32(pc->payload, v);
+      NEXT();
+    }
+    OP(Float32CallDirect): {
+      context->call(pc->payload);
+      regs[pc->dst] = context->pop_bits();
+      NEXT();
+    }
+    OP(Float32CallIndirect): {
+      assert(false && "indirect call unimplemented");
+      return nullptr;
+    }
+    OP(Float32Add): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      float x = l + r;
+      if (x != x)
+        x = nan_float32(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Sub): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      float x = l - r;
+      if (x != x)
+        x = nan_float32(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Mul): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      float x = l * r;
+      if (x != x)
+        x = nan_float32(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Div): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      // C++ annoyingly says that division by 0 is UB even for floating point.
+      float x =
+        r == 0 ? (l == 0 ? float(NAN) : copysignf(INFINITY, l * r)) : l / r;
+      if (x != x)
+        x = nan_float32(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Abs): {
+      float o = Get<float>(regs, pc->a);
+      float x = fabsf(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Neg): {
+      float o = Get<float>(regs, pc->a);
+      float x = -o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Copysign): {
+      float r = Get<float>(regs, pc->b);
+      float l = Get<float>(regs, pc->a);
+      float x = copysignf(l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Ceil): {
+      float o = Get<float>(regs, pc->a);
+      float x = ceilf(o);
+      if (x != x)
+        x = nan_float32(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Floor): {
+      float o = Get<float>(regs, pc->a);
+      float x = floorf(o);
+      if (x != x)
+        x = nan_float32(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32Sqrt): {
+      float o = Get<float>(regs, pc->a);
+      float x = sqrtf(o);
+      if (x != x)
+        x = nan_float32(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromFloat64): {
+      double o = Get<double>(regs, pc->a);
+      float x = o;
+      if (x != x)
+        x = nan_float32(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromSInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      float x = o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromUInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      float x = uint32_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromInt32Bits): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      float x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromSInt64): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      float x = o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float32FromUInt64): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      float x = uint64_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+
+    // float64
+    OP(Float64SetLocal): {
+      regs[pc->dst] = regs[pc->a];
+      NEXT();
+    }
+    OP(Float64LoadHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = 0;
+      double x = context->load_heap_float64(p, i, pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64StoreHeap): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      double v = Get<double>(regs, pc->b);
+      int32_t i = 0;
+      context->store_heap_float64(p, i, pc->payload, v);
+      NEXT();
+    }
+    OP(Float64LoadHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      int32_t i = Get<int32_t>(regs, pc->b);
+      double x = context->load_heap_float64(p, i);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64StoreHeapWithOffset): {
+      int32_t p = Get<int32_t>(regs, pc->a);
+      double v = Get<double>(regs, pc->b);
+      int32_t i = Get<int32_t>(regs, pc->payload);
+      context->store_heap_float64(p, i, 0, v);
+      NEXT();
+    }
+    OP(Float64LoadGlobal): {
+      double x = context->load_global_float64(pc->payload);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64StoreGlobal): {
+      double v = Get<double>(regs, pc->a);
+      context->store_global_float64(pc->payload, v);
+      NEXT();
+    }
+    OP(Float64CallDirect): {
+      context->call(pc->payload);
+      regs[pc->dst] = context->pop_bits();
+      NEXT();
+    }
+    OP(Float64CallIndirect): {
+      assert(false && "indirect call unimplemented");
+      return nullptr;
+    }
+    OP(Float64Add): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      double x = l + r;
+      if (x != x)
+        x = nan_float64(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Sub): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      double x = l - r;
+      if (x != x)
+        x = nan_float64(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Mul): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      double x = l * r;
+      if (x != x)
+        x = nan_float64(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Div): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      // C++ annoyingly says that division by 0 is UB even for floating point.
+      double x = r == 0 ? (l == 0 ? NAN : copysign(INFINITY, l * r)) : l / r;
+      if (x != x)
+        x = nan_float64(context, l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Abs): {
+      double o = Get<double>(regs, pc->a);
+      double x = fabs(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Neg): {
+      double o = Get<double>(regs, pc->a);
+      double x = -o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Copysign): {
+      double r = Get<double>(regs, pc->b);
+      double l = Get<double>(regs, pc->a);
+      double x = copysign(l, r);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Ceil): {
+      double o = Get<double>(regs, pc->a);
+      double x = ceil(o);
+      if (x != x)
+        x = nan_float64(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Floor): {
+      double o = Get<double>(regs, pc->a);
+      double x = floor(o);
+      if (x != x)
+        x = nan_float64(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64Sqrt): {
+      double o = Get<double>(regs, pc->a);
+      double x = sqrt(o);
+      if (x != x)
+        x = nan_float64(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromFloat32): {
+      float o = Get<float>(regs, pc->a);
+      double x = o;
+      if (x != x)
+        x = nan_float64(context, o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromSInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      double x = o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromUInt32): {
+      int32_t o = Get<int32_t>(regs, pc->a);
+      double x = uint32_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromSInt64): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      double x = o;
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromUInt64): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      double x = uint64_t(o);
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+    OP(Float64FromInt64Bits): {
+      int64_t o = Get<int64_t>(regs, pc->a);
+      double x;
+      static_assert(sizeof(o) == sizeof(x), "");
+      memcpy(&x, &o, sizeof(o));
+      Set(regs, pc->dst, x);
+      NEXT();
+    }
+
+
+    // statements
+    OP(Br): {
+      JUMP(pc->payload);
+    }
+    OP(BrIf): {
+      int32_t c = Get<int32_t>(regs, pc->a);
+      if (c)
+        JUMP(pc->payload);
+      NEXT();
+    }
+    OP(MemoryCopy): {
+      int32_t d = Get<int32_t>(regs, pc->a);
+      int32_t s = Get<int32_t>(regs, pc->b);
+      int32_t n = Get<int32_t>(regs, pc->payload);
+      context->copy_heap(d, s, n);
+      NEXT();
+    }
+    OP(MemoryFill): {
+      int32_t d = Get<int32_t>(regs, pc->a);
+      int32_t v = Get<int32_t>(regs, pc->b);
+      int32_t n = Get<int32_t>(regs, pc->payload);
+      context->fill_heap(d, v, n);
+      NEXT();
+    }
+    OP(Int32CallFFI): {
+      Set(regs, pc->dst, context->call_ffi(pc->payload, &regs[pc->a]));
+      NEXT();
+    }
+    OP(Fuel): {
+      context->consume_fuel(pc->payload);
+      NEXT();
+    }
+
+    OP(Int32AddLocalLiteral):
+    OP(Int32LoadHeapLocalWithOffset):
+    OP(Float32LoadHeapLocalWithOffset):
+    OP(Float64LoadHeapLocalWithOffset):
+    OP(BrIfInt32Slt):
+    OP(BrIfInt32Eq): {
+      assert(false && "superinstructions are only formed in the stack form");
+      return nullptr;
+    }
+    OP(Int32GetLocal):
+    OP(Int32AddressOf):
+    OP(Int32Literal):
+    OP(Int64GetLocal):
+    OP(Int64Literal):
+    OP(Float32GetLocal):
+    OP(Float32Literal):
+    OP(Float64GetLocal):
+    OP(Float64Literal): {
+      assert(false && "folded into operands by Translate");
+      return nullptr;
+    }
+    OP(End): {
+      if (pc->a != noSlot)
+        context->push_bits(regs[pc->a]);
+      return nullptr;
+    }
+  }
+
+#undef INT_BINARY
+#undef INT_DIVIDE
+#undef INT_COMPARE
+#undef INT_OPERATORS
+#undef OP
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+  return nullptr;
+}
+
+const void*
+wasm::RegisterHandler(InstrOp op) {
+  const void* const* handlers = Execute<true>(nullptr, nullptr, nullptr);
+  return handlers ? handlers[size_t(op)] : nullptr;
+}
+
+void
+wasm::InterpretRegisters(const RegisterCode& code, Dispatch dispatch,
+                         Context* context) {
+  uint64_t* regs = context->push_slots(code.numSlots);
+  copy(code.constants.begin(), code.constants.end(),
+       regs + code.constantBase);
+
+  if (WASM_HAVE_COMPUTED_GOTO && dispatch == Dispatch::threaded)
+    Execute<true>(code.code.data(), regs, context);
+  else
+    Execute<false>(code.code.data(), regs, context);
+  context->pop_slots(regs);
+}
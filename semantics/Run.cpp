@@ -15,9 +15,236 @@
  */
 
 #include "semantics/Run.h"
+#include "semantics/Context.h"
+#include "semantics/CodeCache.h"
+#include "semantics/Scheduler.h"
+#include "implementation/FFIHandler.h"
+#include "implementation/Fiber.h"
+#include "implementation/Implementation.h"
+#include "implementation/TrapHandler.h"
+#include "module/Module.h"
+#include "process/Environment.h"
+#include "process/GlobalVariables.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "process/Snapshot.h"
+#include "process/TrustedStack.h"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
 using namespace wasm;
 
+namespace {
+
+// Runs a context on a fiber, so that it can be abandoned when it runs out of
+// fuel or time. The deadline is delivered by a timer thread, which sets a
+// flag that the context only reads when it polls at a safe point, so the
+// running code never reads the clock.
+class Limiter final : public Poller {
+  Context& context_;
+  uint32_t start_;
+  Fiber fiber_;
+  atomic<bool> expired_;
+  bool timedOut_;
+  bool trapped_;
+
+  static void Body(void* arg) {
+    Limiter* limiter = static_cast<Limiter*>(arg);
+    limiter->trapped_ = !limiter->context_.start(limiter->start_);
+  }
+
+public:
+  Limiter(Context& context, uint32_t start)
+    : context_(context)
+    , start_(start)
+    , expired_(false)
+    , timedOut_(false)
+    , trapped_(false) {}
+
+  void poll() override {
+    if (expired_.load(memory_order_relaxed))
+      time_out();
+  }
+
+  void time_out() override {
+    timedOut_ = true;
+    fiber_.suspend();
+  }
+
+  // Map the fiber's stack. Returns false if it can't be mapped.
+  bool create(size_t stackSize) {
+    return fiber_.create(stackSize, Body, this);
+  }
+
+  Status run(double deadline);
+};
+
+} // namespace
+
+// A call takes at least two slots of the arena, and on any engine, less than
+// this many times as much machine stack. The rest is for the frames below
+// the process's and the room calls keep; see Context::invoke.
+static const size_t machineStackPerArenaByte = 32;
+static const size_t machineStackBase = size_t(1) << 20;
+
+size_t
+wasm::MachineStackSize(size_t arenaSize) {
+  return arenaSize * machineStackPerArenaByte + machineStackBase;
+}
+
+// The room left on the calling thread's stack, or zero if it isn't known.
+static size_t
+ThreadStackRoom() {
+  char here;
+  const void* limit = Fiber::StackLimit();
+  return limit ? size_t(uintptr_t(&here) - uintptr_t(limit)) : 0;
+}
+
+Status
+Limiter::run(double deadline) {
+  context_.set_poller(this);
+
+  mutex lock;
+  condition_variable wake;
+  bool done = false;
+  thread timer;
+  if (deadline > 0) {
+    timer = thread([&] {
+      unique_lock<mutex> guard(lock);
+      if (!wake.wait_for(guard, chrono::duration<double>(deadline),
+                         [&] { return done; }))
+        expired_.store(true, memory_order_relaxed);
+    });
+  }
+
+  // Returns when the process finishes or times out. A timed out process is
+  // never resumed.
+  fiber_.resume();
+  {
+    lock_guard<mutex> guard(lock);
+    done = true;
+  }
+  wake.notify_one();
+  if (timer.joinable())
+    timer.join();
+  context_.set_poller(nullptr);
+  if (timedOut_)
+    return Status::timeout;
+  return trapped_ ? Status::failure : Status::success;
+}
+
+// Use the saved code in options.cacheDirectory, if any. On a miss, compile
+// everything so that the saved code is complete. Failing to save only costs
+// the next run the same work. Only interpreted code is saved.
+static void
+Prepare(CodeCache& codeCache, const RunOptions& options) {
+  string savedPath;
+  if (options.cacheDirectory && (options.engine == Engine::stack ||
+                                 options.engine == Engine::register_)) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016" PRIx64 ".wcc", codeCache.key());
+    savedPath = string(options.cacheDirectory) + name;
+    if (codeCache.open(savedPath.c_str()))
+      savedPath.clear();
+  }
+
+  if (options.jobs != 0 || !savedPath.empty())
+    codeCache.compileAll(options.jobs != 0 ? options.jobs : 1,
+                         options.compileStats);
+  if (!savedPath.empty())
+    codeCache.save(savedPath.c_str());
+}
+
+Status
+wasm::run(Implementation& implementation, Process& process,
+          const RunOptions& options) {
+  CodeCache codeCache(*process.module_, implementation.trapHandler_.get(),
+                      options, !process.linearMemory_->checked());
+  Prepare(codeCache, options);
+  return run(implementation, process, codeCache, options);
+}
+
+Status
+wasm::run(Implementation& implementation, Process& process,
+          CodeCache& codeCache, const RunOptions& options) {
+  const Module& module = *process.module_;
+  if (module.startRoutine_ >= module.numRoutines())
+    return Status::failure;
+  if (codeCache.uncheckedHeap() && process.linearMemory_->checked())
+    return Status::failure;
+
+  Context context(implementation, process, codeCache, options);
+  bool limited = options.fuel != 0 || options.deadline != 0;
+  size_t stackSize = MachineStackSize(process.trustedStack_->arena_size());
+  if (!limited && ThreadStackRoom() >= stackSize)
+    return context.start(module.startRoutine_) ? Status::success
+                                               : Status::failure;
+  Limiter limiter(context, module.startRoutine_);
+  if (!limiter.create(stackSize)) {
+    if (limited)
+      return Status::failure;
+    // Without a stack of its own, the process makes do with the thread's,
+    // and its calls trap sooner.
+    return context.start(module.startRoutine_) ? Status::success
+                                               : Status::failure;
+  }
+  return limiter.run(options.deadline);
+}
+
 Status
-wasm::run(Implementation& implementation, Process& process) {
-  return Status::oom;
+wasm::RunInstances(const Snapshot& snapshot, size_t count,
+                   NaNBits::Kind nanBitsKind, bool guardPages,
+                   size_t stackSize, const RunOptions& options,
+                   const ScheduleOptions& scheduleOptions) {
+  if (count == 0)
+    return Status::success;
+
+  // The shared code can only access memory unchecked if every instance's
+  // memory is guarded.
+  vector<unique_ptr<Implementation>> implementations;
+  vector<unique_ptr<Process>> processes;
+  vector<Instance> instances;
+  bool guarded = guardPages;
+  for (size_t i = 0; i < count; ++i) {
+    implementations.emplace_back(new Implementation(nanBitsKind));
+    processes.emplace_back(new Process());
+    Implementation& implementation = *implementations.back();
+    Process& process = *processes.back();
+    if (guardPages && !process.linearMemory_->reserveGuarded(
+                        implementation.trapHandler_.get()))
+      guarded = false;
+    // An unguarded stack checks its allocations instead.
+    process.trustedStack_->reserve(
+      stackSize, guardPages ? implementation.trapHandler_.get() : nullptr);
+    if (!snapshot.instantiate(process))
+      return Status::oom;
+    instances.push_back(Instance{&implementation, &process});
+  }
+
+  RunOptions instanceOptions = options;
+  instanceOptions.pairCounts = nullptr;
+  instanceOptions.profile = nullptr;
+  instanceOptions.sampler = nullptr;
+  if (instanceOptions.jobs == 0)
+    instanceOptions.jobs = scheduleOptions.threads;
+  CodeCache codeCache(*snapshot.module(),
+                      implementations[0]->trapHandler_.get(),
+                      instanceOptions, guarded);
+  Prepare(codeCache, instanceOptions);
+  codeCache.freeze(instanceOptions.jobs);
+
+  vector<Status> statuses;
+  Schedule(instances, codeCache, instanceOptions, scheduleOptions, &statuses);
+  for (Status status : statuses)
+    if (status != Status::success)
+      return status;
+  return Status::success;
 }
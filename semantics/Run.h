@@ -17,14 +17,120 @@
 #ifndef WEBASSEMBLY_SEMANTICS_RUN_H
 #define WEBASSEMBLY_SEMANTICS_RUN_H
 
+#include "implementation/NaNBits.h"
+#include <cstddef>
+#include <cstdint>
+
 namespace wasm {
 
+class AotLibrary;
+class CodeCache;
+struct CompileStats;
 class Implementation;
+class PairCounts;
 class Process;
+class Profile;
+class Sampler;
+struct ScheduleOptions;
+class Snapshot;
 
 enum class Status { success, failure, oom, timeout };
 
-Status run(Implementation& implementation, Process& process);
+// How the interpreter dispatches from one instruction to the next. Threaded
+// dispatch falls back to switch if the host compiler doesn't support it.
+enum class Dispatch { switch_, threaded };
+
+// Which form of code the interpreter executes. The stack form evaluates
+// expression trees on an operand stack; the register form is translated from
+// it and reads and writes frame slots directly. The JIT compiles the stack
+// form to machine code when a routine is first called, and aot runs code
+// translated to C++ and compiled beforehand; see Aot.h.
+enum class Engine { stack, register_, jit, aot };
+
+struct RunOptions {
+  Dispatch dispatch;
+  Engine engine;
+  // Whether to form superinstructions in the stack form.
+  bool fuse;
+  // If non-null, count executed instruction pairs of the stack form.
+  PairCounts* pairCounts;
+  // If non-null, count executions and cycles of the stack form by site,
+  // instead of pairs; see Profile.h. Code run by the other engines isn't
+  // counted.
+  Profile* profile;
+  // If non-null, the sampler running on the process, for which stack-form
+  // code records its position in the innermost frame; see Sampler.h.
+  Sampler* sampler;
+  // Bytes of compiled code to keep before evicting the least recently called
+  // routines. Zero means no limit.
+  std::size_t codeCacheLimit;
+  // If nonzero, compile every routine up front on this many threads, rather
+  // than each one when it is first called.
+  unsigned jobs;
+  // If non-null and jobs is nonzero, receives timings of the compilation.
+  CompileStats* compileStats;
+  // If non-null, a directory in which compiled code is saved, keyed by the
+  // module's contents and the interpreter's build, for reuse by later runs.
+  const char* cacheDirectory;
+  // For Engine::aot, the module's translated code.
+  const AotLibrary* aotLibrary;
+  // If nonzero, the number of instructions the process may execute before
+  // it's stopped with Status::timeout. Fuel is charged a basic block at a
+  // time, but the count is exact and the same on every engine, so a process
+  // runs out at the same point every time.
+  std::uint64_t fuel;
+  // If nonzero, seconds of wall-clock time the process may run before it's
+  // stopped with Status::timeout. Schedule has its own time limits, and
+  // ignores this.
+  double deadline;
+
+  RunOptions()
+    : dispatch(Dispatch::threaded)
+    , engine(Engine::stack)
+    , fuse(true)
+    , pairCounts(nullptr)
+    , profile(nullptr)
+    , sampler(nullptr)
+    , codeCacheLimit(0)
+    , jobs(0)
+    , compileStats(nullptr)
+    , cacheDirectory(nullptr)
+    , aotLibrary(nullptr)
+    , fuel(0)
+    , deadline(0) {}
+};
+
+Status run(Implementation& implementation, Process& process,
+           const RunOptions& options = RunOptions());
+
+// Run process with code from codeCache, which must have been created for the
+// process's module with the same options. Fails if the cache's code accesses
+// memory unchecked but the process's memory isn't guarded.
+//
+// With a fuel limit or a deadline, or if the calling thread's stack has less
+// room than MachineStackSize asks for, the process runs on a stack of its
+// own, which is abandoned if it times out; its globals and memory are left as
+// they were. A process which traps is left likewise, and fails.
+Status run(Implementation& implementation, Process& process,
+           CodeCache& codeCache, const RunOptions& options);
+
+// The machine stack a process whose trusted stack has an arena of arenaSize
+// bytes runs on, so that the arena runs out before it does. Calls also check
+// the machine stack, so a process on a smaller one traps sooner.
+std::size_t MachineStackSize(std::size_t arenaSize);
+
+// Run count processes instantiated from snapshot, multiplexed over worker
+// threads by Schedule. The module and its compiled code, frozen before the
+// first process starts, are shared by all of them; each has its own
+// implementation, so NaN bits are generated independently. Pair counts,
+// profiles and samples aren't collected. Returns the status of the first
+// process, in instantiation order, which didn't succeed. Each process's
+// trusted stack gets an arena of stackSize bytes, guarded if guardPages is
+// set and the host allows it.
+Status RunInstances(const Snapshot& snapshot, std::size_t count,
+                    NaNBits::Kind nanBitsKind, bool guardPages,
+                    std::size_t stackSize, const RunOptions& options,
+                    const ScheduleOptions& scheduleOptions);
 
 } // namespace wasm
 
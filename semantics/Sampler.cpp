@@ -0,0 +1,187 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Sampler.h"
+#include "implementation/Features.h"
+#include "process/TrustedStack.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+using namespace std;
+using namespace wasm;
+
+// A sample is a header word, holding the number of frames and whether any
+// were left out, then the innermost frame's position, then the routines of
+// the frames, outermost first.
+// Older C libraries don't name the field SIGEV_THREAD_ID notifies.
+#if WASM_HAVE_SAMPLER && !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static const uint32_t truncatedBit = uint32_t(1) << 31;
+
+// The running sampler, for the signal handler.
+static atomic<Sampler*> active(nullptr);
+
+Sampler::Sampler(double interval, double duration, size_t bufferSize)
+  : interval_(interval)
+  , duration_(duration)
+  , buffer_(new uint32_t[bufferSize])
+  , capacity_(bufferSize)
+  , used_(0)
+  , samples_(0)
+  , dropped_(0)
+  , remaining_(0)
+  , stack_(nullptr)
+  , timer_()
+  , running_(false) {}
+
+Sampler::~Sampler() {
+  stop();
+}
+
+void
+Sampler::Handle(int) {
+  int savedErrno = errno;
+  if (Sampler* sampler = active.load(memory_order_relaxed))
+    sampler->sample();
+  errno = savedErrno;
+}
+
+void
+Sampler::sample() {
+  const TrustedStack& stack = *stack_;
+  size_t depth = stack.depth();
+  size_t recorded = min(depth, stack.capacity());
+  size_t first = recorded > maxDepth ? recorded - maxDepth : 0;
+  size_t count = recorded - first;
+
+  size_t used = used_.load(memory_order_relaxed);
+  if (capacity_ - used < count + 2) {
+    dropped_.fetch_add(1, memory_order_relaxed);
+  } else {
+    buffer_[used] = uint32_t(count) | (first != 0 ? truncatedBit : 0);
+    buffer_[used + 1] = depth != 0 && depth == recorded
+                          ? stack.frame(depth - 1).position
+                          : TrustedStack::noPosition;
+    for (size_t i = 0; i < count; ++i)
+      buffer_[used + 2 + i] = stack.frame(first + i).routine;
+    used_.store(used + count + 2, memory_order_relaxed);
+    samples_.fetch_add(1, memory_order_relaxed);
+  }
+
+  // timer_settime is async-signal-safe.
+  if (remaining_.load(memory_order_relaxed) != 0 &&
+      remaining_.fetch_sub(1, memory_order_relaxed) == 1) {
+    itimerspec disarm;
+    memset(&disarm, 0, sizeof(disarm));
+    timer_settime(timer_, 0, &disarm, nullptr);
+  }
+}
+
+bool
+Sampler::start(const TrustedStack& stack, const char** why) {
+#if WASM_HAVE_SAMPLER
+  Sampler* expected = nullptr;
+  if (running_ || !active.compare_exchange_strong(expected, this)) {
+    *why = "another sampler is running";
+    return false;
+  }
+  stack_ = &stack;
+  remaining_ = duration_ > 0 ? size_t(ceil(duration_ / interval_)) : 0;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = Handle;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  if (sigaction(SIGPROF, &action, &previous_) != 0) {
+    active = nullptr;
+    *why = "cannot handle SIGPROF";
+    return false;
+  }
+
+  sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = pid_t(syscall(SYS_gettid));
+  itimerspec spec;
+  spec.it_interval.tv_sec = time_t(interval_);
+  spec.it_interval.tv_nsec = long((interval_ - floor(interval_)) * 1e9);
+  if (spec.it_interval.tv_sec == 0 && spec.it_interval.tv_nsec == 0)
+    spec.it_interval.tv_nsec = 1;
+  spec.it_value = spec.it_interval;
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer_) != 0) {
+    sigaction(SIGPROF, &previous_, nullptr);
+    active = nullptr;
+    *why = "cannot create a CPU-time timer";
+    return false;
+  }
+  timer_settime(timer_, 0, &spec, nullptr);
+  running_ = true;
+  return true;
+#else
+  (void)stack;
+  *why = "sampling is unavailable on this host";
+  return false;
+#endif
+}
+
+// A signal generated before the timer is deleted is delivered as the call
+// returns, so the handler can be restored after.
+void
+Sampler::stop() {
+  if (!running_)
+    return;
+  timer_delete(timer_);
+  active = nullptr;
+  sigaction(SIGPROF, &previous_, nullptr);
+  running_ = false;
+}
+
+void
+Sampler::dump(FILE* out) const {
+  map<string, uint64_t> stacks;
+  size_t used = used_.load();
+  string name;
+  for (size_t i = 0; i < used;) {
+    uint32_t count = buffer_[i] & ~truncatedBit;
+    uint32_t position = buffer_[i + 1];
+    name.clear();
+    if (buffer_[i] & truncatedBit)
+      name = "[truncated]";
+    for (uint32_t j = 0; j < count; ++j) {
+      if (!name.empty())
+        name += ';';
+      name += "routine" + to_string(buffer_[i + 2 + j]);
+    }
+    if (count == 0)
+      name = "[host]";
+    else if (position != TrustedStack::noPosition)
+      name += ";@" + to_string(position);
+    ++stacks[name];
+    i += count + 2;
+  }
+  for (const auto& stack : stacks)
+    fprintf(out, "%s %" PRIu64 "\n", stack.first.c_str(), stack.second);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_SAMPLER_H
+#define WEBASSEMBLY_SEMANTICS_SAMPLER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <signal.h>
+#include <time.h>
+
+namespace wasm {
+
+class TrustedStack;
+
+// Samples a process's call stack at intervals of the CPU time of the thread
+// running it, for finding the routines its time goes to. A SIGPROF timer
+// drives it. The signal handler copies the trusted stack into a buffer
+// allocated up front, taking no locks and allocating nothing, and counts
+// samples there's no room for as dropped. While stack-form code is sampled,
+// it records its position in the innermost routine, at the cost of switch
+// dispatch; a sampler that isn't running costs nothing.
+//
+// One sampler may run at a time. It's started and stopped on the thread
+// which runs the process.
+class Sampler {
+  double interval_;
+  double duration_;
+  std::unique_ptr<std::uint32_t[]> buffer_;
+  std::size_t capacity_;
+  // Written by the signal handler.
+  std::atomic<std::size_t> used_;
+  std::atomic<std::size_t> samples_;
+  std::atomic<std::size_t> dropped_;
+  // Ticks left before the timer is disarmed, if there's a duration.
+  std::atomic<std::size_t> remaining_;
+  const TrustedStack* stack_;
+  timer_t timer_;
+  struct sigaction previous_;
+  bool running_;
+
+  static void Handle(int);
+  void sample();
+
+public:
+  // Buffer words, of which a sample takes two plus one per frame.
+  static const std::size_t defaultBufferSize = std::size_t(1) << 20;
+  // Frames beyond this many from the innermost aren't sampled.
+  static const std::size_t maxDepth = 1024;
+
+  // Sample every interval seconds, for duration seconds in all, or until
+  // stopped if duration is zero.
+  explicit Sampler(double interval, double duration = 0,
+                   std::size_t bufferSize = defaultBufferSize);
+  ~Sampler();
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+
+  // Start sampling stack. On failure, returns false and sets why to the
+  // reason.
+  bool start(const TrustedStack& stack, const char** why);
+  void stop();
+
+  std::size_t samples() const { return samples_.load(); }
+  std::size_t dropped() const { return dropped_.load(); }
+
+  // Write the samples as collapsed stacks, as flame graph tools read them:
+  // a line per distinct stack, its frames outermost first, separated by
+  // semicolons, then the number of samples of it. A routine's frame is named
+  // by its index, and the innermost is followed by a frame for the position
+  // in it, if that was recorded.
+  void dump(std::FILE* out) const;
+};
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/Scheduler.h"
+#include "semantics/CodeCache.h"
+#include "semantics/Context.h"
+#include "implementation/Fiber.h"
+#include "implementation/TrapHandler.h"
+#include "module/Module.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "process/TrustedStack.h"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+using namespace std;
+using namespace wasm;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+class Scheduler;
+
+// A process and the state of its execution, which lasts across slices. The
+// context and fiber exist only while the process is started and unfinished.
+struct Task final : Poller {
+  Scheduler* scheduler;
+  Instance instance;
+  unique_ptr<Context> context;
+  unique_ptr<Fiber> fiber;
+  Status status;
+  bool timedOut;
+  // The worker running the task, when its current slice started, and its
+  // running time in earlier slices.
+  unsigned worker;
+  Clock::time_point sliceStart;
+  Clock::duration used;
+
+  void poll() override;
+  void time_out() override;
+};
+
+// A worker's runnable tasks. The owner takes from the front and returns
+// suspended tasks to the back, and thieves take from the back, all under
+// lock.
+struct Queue {
+  mutex lock;
+  deque<Task*> tasks;
+};
+
+class Scheduler {
+  CodeCache& codeCache_;
+  const RunOptions& options_;
+  Clock::duration slice_;
+  Clock::duration budget_;
+  vector<unique_ptr<Queue>> queues_;
+  atomic<size_t> remaining_;
+
+  bool take(unsigned worker, Task** task);
+  bool steal(unsigned worker, Task** task);
+  void push(unsigned worker, Task* task);
+  bool start(Task& task);
+  void runSlice(unsigned worker, Task& task);
+
+  static void Body(void* arg);
+
+public:
+  Scheduler(CodeCache& codeCache, const RunOptions& options,
+            const ScheduleOptions& scheduleOptions, vector<Task>& tasks);
+
+  // Whether any task is queued behind worker's current one.
+  bool waiting(unsigned worker);
+
+  Clock::duration slice() const { return slice_; }
+  Clock::duration budget() const { return budget_; }
+
+  void run(unsigned worker);
+};
+
+} // namespace
+
+// Called every Context::pollInterval safe points. The task's frames keep
+// their state in its context, so suspending it here is safe, and so is never
+// resuming it.
+void
+Task::poll() {
+  Clock::duration running = Clock::now() - sliceStart;
+  if (scheduler->budget() != Clock::duration::zero() &&
+      used + running >= scheduler->budget())
+    time_out();
+  if (scheduler->slice() != Clock::duration::zero() &&
+      running >= scheduler->slice() && scheduler->waiting(worker))
+    fiber->suspend();
+}
+
+void
+Task::time_out() {
+  timedOut = true;
+  fiber->suspend();
+}
+
+Scheduler::Scheduler(CodeCache& codeCache, const RunOptions& options,
+                     const ScheduleOptions& scheduleOptions,
+                     vector<Task>& tasks)
+  : codeCache_(codeCache)
+  , options_(options)
+  , slice_(chrono::duration_cast<Clock::duration>(
+      chrono::duration<double>(scheduleOptions.timeSlice)))
+  , budget_(chrono::duration_cast<Clock::duration>(
+      chrono::duration<double>(scheduleOptions.timeBudget)))
+  , remaining_(tasks.size()) {
+  unsigned threads = max(scheduleOptions.threads, 1u);
+  for (unsigned i = 0; i < threads; ++i)
+    queues_.emplace_back(new Queue());
+  for (size_t i = 0; i < tasks.size(); ++i)
+    queues_[i % threads]->tasks.push_back(&tasks[i]);
+}
+
+bool
+Scheduler::take(unsigned worker, Task** task) {
+  Queue& queue = *queues_[worker];
+  lock_guard<mutex> guard(queue.lock);
+  if (queue.tasks.empty())
+    return false;
+  *task = queue.tasks.front();
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool
+Scheduler::steal(unsigned worker, Task** task) {
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    Queue& victim = *queues_[(worker + i) % queues_.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if (victim.tasks.empty())
+      continue;
+    *task = victim.tasks.back();
+    victim.tasks.pop_back();
+    return true;
+  }
+  return false;
+}
+
+void
+Scheduler::push(unsigned worker, Task* task) {
+  Queue& queue = *queues_[worker];
+  lock_guard<mutex> guard(queue.lock);
+  queue.tasks.push_back(task);
+}
+
+bool
+Scheduler::waiting(unsigned worker) {
+  Queue& queue = *queues_[worker];
+  lock_guard<mutex> guard(queue.lock);
+  return !queue.tasks.empty();
+}
+
+void
+Scheduler::Body(void* arg) {
+  Task* task = static_cast<Task*>(arg);
+  uint32_t start = task->instance.process->module_->startRoutine_;
+  task->status =
+    task->context->start(start) ? Status::success : Status::failure;
+}
+
+// Set up a task's first slice. Returns false, having set its status, if it
+// can't run; the checks are run's.
+bool
+Scheduler::start(Task& task) {
+  Process& process = *task.instance.process;
+  const Module& module = *process.module_;
+  if (module.startRoutine_ >= module.numRoutines() ||
+      (codeCache_.uncheckedHeap() && process.linearMemory_->checked())) {
+    task.status = Status::failure;
+    return false;
+  }
+
+  task.fiber.reset(new Fiber());
+  if (!task.fiber->create(
+        MachineStackSize(process.trustedStack_->arena_size()), Body,
+        &task)) {
+    task.fiber.reset();
+    task.status = Status::oom;
+    return false;
+  }
+  task.context.reset(
+    new Context(*task.instance.implementation, process, codeCache_, options_));
+  task.context->set_poller(&task);
+  return true;
+}
+
+void
+Scheduler::runSlice(unsigned worker, Task& task) {
+  if (!task.fiber && !start(task)) {
+    --remaining_;
+    return;
+  }
+
+  task.worker = worker;
+  task.sliceStart = Clock::now();
+  bool finished = task.fiber->resume();
+  task.used += Clock::now() - task.sliceStart;
+  if (!finished && !task.timedOut) {
+    push(worker, &task);
+    return;
+  }
+
+  // A timed out task is abandoned on its fiber's stack. Nothing there owns
+  // anything, since frames keep their state in the context.
+  if (task.timedOut)
+    task.status = Status::timeout;
+  task.context.reset();
+  task.fiber.reset();
+  --remaining_;
+}
+
+// Idle workers spin until every task has finished, since a task running
+// elsewhere may yet be suspended and need a thread.
+void
+Scheduler::run(unsigned worker) {
+  // Any task's fiber may be resumed here.
+  TrapHandler::PrepareThread();
+  while (remaining_.load() != 0) {
+    Task* task;
+    if (take(worker, &task) || steal(worker, &task))
+      runSlice(worker, *task);
+    else
+      this_thread::yield();
+  }
+}
+
+void
+wasm::Schedule(const vector<Instance>& instances, CodeCache& codeCache,
+               const RunOptions& options,
+               const ScheduleOptions& scheduleOptions,
+               vector<Status>* statuses) {
+  assert(codeCache.frozen() && "processes share the code cache");
+  vector<Task> tasks(instances.size());
+  Scheduler scheduler(codeCache, options, scheduleOptions, tasks);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i].scheduler = &scheduler;
+    tasks[i].instance = instances[i];
+    tasks[i].status = Status::success;
+    tasks[i].timedOut = false;
+    tasks[i].used = Clock::duration::zero();
+  }
+
+  unsigned jobs = unsigned(min<size_t>(max(scheduleOptions.threads, 1u),
+                                       max<size_t>(tasks.size(), 1)));
+  vector<thread> threads;
+  for (unsigned worker = 1; worker < jobs; ++worker)
+    threads.emplace_back([&scheduler, worker] { scheduler.run(worker); });
+  scheduler.run(0);
+  for (thread& t : threads)
+    t.join();
+
+  statuses->clear();
+  for (const Task& task : tasks)
+    statuses->push_back(task.status);
+}
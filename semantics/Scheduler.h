@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_SCHEDULER_H
+#define WEBASSEMBLY_SEMANTICS_SCHEDULER_H
+
+#include "semantics/Run.h"
+#include <cstddef>
+#include <vector>
+
+namespace wasm {
+
+class CodeCache;
+class Implementation;
+struct Process;
+
+// A process to run, and the implementation it runs against. Processes move
+// between threads, so no two may share an implementation.
+struct Instance {
+  Implementation* implementation;
+  Process* process;
+};
+
+struct ScheduleOptions {
+  // Worker threads, including the calling one.
+  unsigned threads;
+  // Seconds a process runs before it yields its thread to a waiting one.
+  // Zero runs each process to completion once started.
+  double timeSlice;
+  // Seconds a process may run in all before it's stopped. Zero means no
+  // limit.
+  double timeBudget;
+
+  ScheduleOptions()
+    : threads(1)
+    , timeSlice(0.001)
+    , timeBudget(0) {}
+};
+
+// Run many processes over a fixed set of worker threads. Each worker has a
+// queue of runnable processes; it runs the one at the front, and when that
+// process's slice expires with others waiting, it's suspended at its next
+// safe point (see Context.h) and goes to the back. A worker with an empty
+// queue steals from the back of another's, so the load balances. A busy
+// process thus delays the others queued behind it by about one slice each,
+// rather than by its whole run.
+//
+// Each process runs on a machine stack of its own, with code from codeCache,
+// which must be frozen and built for every process's module. A process which
+// exceeds its budget is abandoned where it stopped, with its globals and
+// memory as they were, and its status is Status::timeout. One which traps is
+// left likewise, and its status is Status::failure; the others run on.
+// statuses receives each instance's status, in order.
+void Schedule(const std::vector<Instance>& instances, CodeCache& codeCache,
+              const RunOptions& options,
+              const ScheduleOptions& scheduleOptions,
+              std::vector<Status>* statuses);
+
+} // namespace wasm
+
+#endif // include guard
@@ -0,0 +1,395 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "semantics/RegInstr.h"
+#include "implementation/FFIHandler.h"
+#include "module/Module.h"
+#include <map>
+using namespace std;
+using namespace wasm;
+
+namespace {
+
+// Translates stack-form code by simulating its operand stack. Each entry of
+// the simulated stack is the slot holding that value: a local for GetLocal,
+// a constant for Literal, and otherwise the temporary reserved for the
+// entry's stack depth. Since a temporary is only reused once its depth has
+// been popped, only locals can be overwritten while still on the stack, and
+// SetLocal copies those entries out first. Operands may stay on the stack
+// across a branch, so each way into a branch target leaves them in the same
+// place: the temporaries of their depths, into which any that are elsewhere
+// are moved before the branch or the fall-through.
+class Translator {
+  const Module& module_;
+  RegisterCode& out_;
+  map<uint64_t, uint32_t> constantSlots_;
+  vector<uint32_t> stack_;
+  uint32_t tempBase_;
+  uint32_t maxDepth_;
+  uint32_t lastDst_;
+  bool fallsThrough_;
+  vector<bool> isTarget_;
+  // The index of the first register instruction of each stack instruction.
+  vector<uint32_t> regIndex_;
+
+  uint32_t constant(uint64_t bits) {
+    auto it = constantSlots_.find(bits);
+    if (it != constantSlots_.end())
+      return it->second;
+    uint32_t slot = out_.constantBase + out_.constants.size();
+    out_.constants.push_back(bits);
+    constantSlots_[bits] = slot;
+    return slot;
+  }
+
+  uint32_t pop() {
+    uint32_t slot = stack_.back();
+    stack_.pop_back();
+    return slot;
+  }
+
+  void push(uint32_t slot) {
+    stack_.push_back(slot);
+    if (stack_.size() > maxDepth_)
+      maxDepth_ = stack_.size();
+  }
+
+  uint32_t nextTemp() const { return tempBase_ + stack_.size(); }
+
+  // Move each operand into the temporary of its depth. A temporary only ever
+  // holds the operand at its own depth, so none is overwritten before it's
+  // moved.
+  void canonicalize() {
+    for (size_t depth = 0; depth < stack_.size(); ++depth) {
+      uint32_t temp = tempBase_ + depth;
+      if (stack_[depth] != temp) {
+        emit(InstrOp::Int32SetLocal, temp, stack_[depth], 0, 0);
+        stack_[depth] = temp;
+      }
+    }
+  }
+
+  void emit(InstrOp op, uint32_t dst, uint32_t a, uint32_t b,
+            uint32_t payload) {
+    out_.code.push_back(RegInstr{nullptr, op, dst, a, b, payload});
+    lastDst_ = dst;
+  }
+
+  // Emit an instruction computing a new value and push its result.
+  void emitValue(InstrOp op, uint32_t a, uint32_t b, uint32_t payload) {
+    uint32_t dst = nextTemp();
+    emit(op, dst, a, b, payload);
+    push(dst);
+  }
+
+  void setLocal(InstrOp op, uint32_t local) {
+    uint32_t v = pop();
+
+    bool spilled = false;
+    for (size_t depth = 0; depth < stack_.size(); ++depth) {
+      if (stack_[depth] == local) {
+        uint32_t temp = tempBase_ + depth;
+        emit(op, temp, local, 0, 0);
+        stack_[depth] = temp;
+        spilled = true;
+      }
+    }
+
+    // If v was just computed into a temporary, compute it into the local
+    // instead of moving it there.
+    if (!spilled && v >= tempBase_ && v == lastDst_)
+      out_.code.back().dst = local;
+    else if (v != local)
+      emit(op, local, v, 0, 0);
+
+    push(local);
+  }
+
+public:
+  Translator(const Module& module, const Routine& routine, RegisterCode& out)
+    : module_(module)
+    , out_(out)
+    , tempBase_(0)
+    , maxDepth_(0)
+    , lastDst_(noSlot)
+    , fallsThrough_(true) {
+    out_.constantBase = routine.numLocals_;
+  }
+
+  void scan(const vector<Instr>& code);
+  void translate(const Instr& instr);
+  void finish();
+};
+
+} // namespace
+
+// Constants are assigned slots before translation so that the temporaries
+// can follow them. Branch targets are found too, since an instruction after
+// a label can't be merged into the one before it.
+void
+Translator::scan(const vector<Instr>& code) {
+  isTarget_.assign(code.size(), false);
+  for (const Instr& instr : code) {
+    switch (instr.op) {
+      case InstrOp::Br:
+      case InstrOp::BrIf:
+        isTarget_[instr.payload] = true;
+        break;
+      case InstrOp::Int32Literal:
+      case InstrOp::Int64Literal:
+      case InstrOp::Float32Literal:
+      case InstrOp::Float64Literal:
+      case InstrOp::Int32LoadHeapWithOffset:
+      case InstrOp::Int32StoreHeapWithOffset:
+      case InstrOp::Int64LoadHeapWithOffset:
+      case InstrOp::Int64StoreHeapWithOffset:
+      case InstrOp::Float32LoadHeapWithOffset:
+      case InstrOp::Float32StoreHeapWithOffset:
+      case InstrOp::Float64LoadHeapWithOffset:
+      case InstrOp::Float64StoreHeapWithOffset:
+        constant(module_.literals_[instr.payload]);
+        break;
+      case InstrOp::Int32AddressOf:
+        constant(instr.payload);
+        break;
+      default:
+        break;
+    }
+  }
+  tempBase_ = out_.constantBase + out_.constants.size();
+}
+
+void
+Translator::translate(const Instr& instr) {
+  InstrOp op = instr.op;
+  uint32_t payload = instr.payload;
+
+  // A branch target's operands are in the temporaries of their depths, and
+  // so are those of code after a Br, which only a branch can reach.
+  bool isTarget = isTarget_[regIndex_.size()];
+  if (isTarget && fallsThrough_)
+    canonicalize();
+  if (isTarget || !fallsThrough_) {
+    stack_.clear();
+    for (uint32_t depth = 0; depth < instr.depth; ++depth)
+      push(tempBase_ + depth);
+    lastDst_ = noSlot;
+  }
+  fallsThrough_ = op != InstrOp::Br;
+  regIndex_.push_back(out_.code.size());
+
+  switch (op) {
+    case InstrOp::Int32GetLocal:
+    case InstrOp::Int64GetLocal:
+    case InstrOp::Float32GetLocal:
+    case InstrOp::Float64GetLocal:
+      push(payload);
+      break;
+    case InstrOp::Int32Literal:
+    case InstrOp::Int64Literal:
+    case InstrOp::Float32Literal:
+    case InstrOp::Float64Literal:
+      push(constant(module_.literals_[payload]));
+      break;
+    case InstrOp::Int32AddressOf:
+      push(constant(payload));
+      break;
+    case InstrOp::Int32SetLocal:
+    case InstrOp::Int64SetLocal:
+    case InstrOp::Float32SetLocal:
+    case InstrOp::Float64SetLocal:
+      setLocal(op, payload);
+      break;
+
+    case InstrOp::Int32LoadHeap:
+    case InstrOp::Int64LoadHeap:
+    case InstrOp::Float32LoadHeap:
+    case InstrOp::Float64LoadHeap: {
+      uint32_t p = pop();
+      emitValue(op, p, 0, payload);
+      break;
+    }
+    case InstrOp::Int32LoadHeapWithOffset:
+    case InstrOp::Int64LoadHeapWithOffset:
+    case InstrOp::Float32LoadHeapWithOffset:
+    case InstrOp::Float64LoadHeapWithOffset: {
+      uint32_t p = pop();
+      uint32_t i = constant(module_.literals_[payload]);
+      emitValue(op, p, i, 0);
+      break;
+    }
+    case InstrOp::Int32StoreHeap:
+    case InstrOp::Int64StoreHeap:
+    case InstrOp::Float32StoreHeap:
+    case InstrOp::Float64StoreHeap: {
+      uint32_t p = pop();
+      uint32_t v = pop();
+      emit(op, noSlot, p, v, payload);
+      push(v);
+      break;
+    }
+    case InstrOp::Int32StoreHeapWithOffset:
+    case InstrOp::Int64StoreHeapWithOffset:
+    case InstrOp::Float32StoreHeapWithOffset:
+    case InstrOp::Float64StoreHeapWithOffset: {
+      uint32_t p = pop();
+      uint32_t v = pop();
+      uint32_t i = constant(module_.literals_[payload]);
+      emit(op, noSlot, p, v, i);
+      push(v);
+      break;
+    }
+    case InstrOp::Int32LoadGlobal:
+    case InstrOp::Int64LoadGlobal:
+    case InstrOp::Float32LoadGlobal:
+    case InstrOp::Float64LoadGlobal:
+      emitValue(op, 0, 0, payload);
+      break;
+    case InstrOp::Int32StoreGlobal:
+    case InstrOp::Int64StoreGlobal:
+    case InstrOp::Float32StoreGlobal:
+    case InstrOp::Float64StoreGlobal: {
+      uint32_t v = pop();
+      emit(op, noSlot, v, 0, payload);
+      push(v);
+      break;
+    }
+    case InstrOp::Int32CallDirect:
+    case InstrOp::Int32CallIndirect:
+    case InstrOp::Int64CallDirect:
+    case InstrOp::Int64CallIndirect:
+    case InstrOp::Float32CallDirect:
+    case InstrOp::Float32CallIndirect:
+    case InstrOp::Float64CallDirect:
+    case InstrOp::Float64CallIndirect:
+      emitValue(op, 0, 0, payload);
+      break;
+
+    case InstrOp::SInt32FromFloat64:
+    case InstrOp::SInt32FromFloat32:
+    case InstrOp::Uint32FromFloat64:
+    case InstrOp::Uint32FromFloat32:
+    case InstrOp::Int32fromFloat32Bits:
+    case InstrOp::Int32FromInt64:
+    case InstrOp::Int64FromSInt32:
+    case InstrOp::Int64FromUInt32:
+    case InstrOp::SInt64FromFloat64:
+    case InstrOp::SInt64FromFloat32:
+    case InstrOp::Uint64FromFloat64:
+    case InstrOp::Uint64FromFloat32:
+    case InstrOp::Int64FromFloat64Bits:
+    case InstrOp::Float32Abs:
+    case InstrOp::Float32Neg:
+    case InstrOp::Float32Ceil:
+    case InstrOp::Float32Floor:
+    case InstrOp::Float32Sqrt:
+    case InstrOp::Float32FromFloat64:
+    case InstrOp::Float32FromSInt32:
+    case InstrOp::Float32FromUInt32:
+    case InstrOp::Float32FromInt32Bits:
+    case InstrOp::Float32FromSInt64:
+    case InstrOp::Float32FromUInt64:
+    case InstrOp::Float64Abs:
+    case InstrOp::Float64Neg:
+    case InstrOp::Float64Ceil:
+    case InstrOp::Float64Floor:
+    case InstrOp::Float64Sqrt:
+    case InstrOp::Float64FromFloat32:
+    case InstrOp::Float64FromSInt32:
+    case InstrOp::Float64FromUInt32:
+    case InstrOp::Float64FromSInt64:
+    case InstrOp::Float64FromUInt64:
+    case InstrOp::Float64FromInt64Bits: {
+      uint32_t o = pop();
+      emitValue(op, o, 0, 0);
+      break;
+    }
+
+    case InstrOp::Br:
+      canonicalize();
+      emit(op, noSlot, 0, 0, payload);
+      break;
+    case InstrOp::BrIf: {
+      uint32_t c = pop();
+      canonicalize();
+      emit(op, noSlot, c, 0, payload);
+      break;
+    }
+    case InstrOp::MemoryCopy:
+    case InstrOp::MemoryFill: {
+      uint32_t n = pop();
+      uint32_t v = pop();
+      uint32_t d = pop();
+      emit(op, noSlot, d, v, n);
+      break;
+    }
+    case InstrOp::Int32CallFFI: {
+      // Operands are passed in consecutive slots: the temporaries of their
+      // depths, into which any that are elsewhere are moved.
+      unsigned arity = FFIHandler::arity(FFIHandler::CallID(payload));
+      size_t first = stack_.size() - arity;
+      for (size_t depth = first; depth < stack_.size(); ++depth)
+        if (stack_[depth] != tempBase_ + depth)
+          emit(InstrOp::Int32SetLocal, tempBase_ + depth, stack_[depth], 0, 0);
+      stack_.resize(first);
+      emitValue(op, nextTemp(), 0, payload);
+      break;
+    }
+
+    case InstrOp::Fuel:
+      emit(op, noSlot, 0, 0, payload);
+      break;
+
+    case InstrOp::End:
+      emit(op, noSlot, stack_.empty() ? noSlot : stack_.back(), 0, 0);
+      break;
+
+    default: {
+      // Everything else is a binary operator.
+      uint32_t r = pop();
+      uint32_t l = pop();
+      emitValue(op, l, r, 0);
+      break;
+    }
+  }
+}
+
+// Branch targets are stack-form indices until all of the code is translated.
+void
+Translator::finish() {
+  out_.numSlots = tempBase_ + maxDepth_;
+  for (RegInstr& instr : out_.code)
+    if (instr.op == InstrOp::Br || instr.op == InstrOp::BrIf)
+      instr.payload = regIndex_[instr.payload];
+}
+
+RegisterCode
+wasm::Translate(const vector<Instr>& code, const Module& module,
+                const Routine& routine, Dispatch dispatch) {
+  RegisterCode out;
+  Translator translator(module, routine, out);
+  translator.scan(code);
+  for (const Instr& instr : code)
+    translator.translate(instr);
+  translator.finish();
+
+  if (dispatch == Dispatch::threaded) {
+    for (RegInstr& instr : out.code)
+      instr.handler = RegisterHandler(instr.op);
+  }
+
+  return out;
+}
@@ -21,7 +21,7 @@
 
 namespace wasm {
 
-enum class Types {
+enum class Types : std::uint8_t {
   int32,
   int64,
   float32,
@@ -29,7 +29,7 @@ enum class Types {
   void_,
 };
 
-template <typename TypeTy>
+template <Types TypeTy>
 struct TypeTraits {};
 
 template <>
@@ -0,0 +1,342 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WEBASSEMBLY_SEMANTICS_X64ASSEMBLER_H
+#define WEBASSEMBLY_SEMANTICS_X64ASSEMBLER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace wasm {
+
+// Just enough of an x86-64 assembler for the baseline JIT. Memory operands
+// are a base register plus a 32-bit displacement, or a base register plus an
+// index register; the base may not be rsp or r12, whose encodings differ.
+class X64Assembler {
+public:
+  enum Reg : std::uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15,
+  };
+
+  enum XReg : std::uint8_t { xmm0, xmm1 };
+
+  // Condition codes, as encoded in jcc, setcc and cmovcc.
+  enum Cond : std::uint8_t {
+    o, no, b, ae, e, ne, be, a, s, ns, p, np, l, ge, le, g,
+  };
+
+  // SSE arithmetic opcodes, after the 0F escape.
+  enum SSEOp : std::uint8_t {
+    sqrt = 0x51,
+    add = 0x58,
+    mul = 0x59,
+    cvt = 0x5A, // cvtss2sd or cvtsd2ss, by prefix.
+    sub = 0x5C,
+  };
+
+  // Integer ALU opcodes of the "op r/m, r" form.
+  enum ALUOp : std::uint8_t {
+    addOp = 0x01,
+    orOp = 0x09,
+    andOp = 0x21,
+    subOp = 0x29,
+    xorOp = 0x31,
+    cmpOp = 0x39,
+  };
+
+private:
+  std::vector<std::uint8_t> code_;
+
+  void rex(bool w, unsigned reg, unsigned index, unsigned base) {
+    std::uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) |
+                     (base >> 3);
+    if (r != 0x40)
+      byte(r);
+  }
+
+  void modrmReg(unsigned reg, unsigned rm) {
+    byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+
+  void modrmMem(unsigned reg, Reg base, std::int32_t disp) {
+    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    dword(disp);
+  }
+
+  // [base + index] with a zero 8-bit displacement, which works even for a
+  // base of rbp or r13.
+  void modrmIndexed(unsigned reg, Reg base, Reg index) {
+    byte(0x44 | ((reg & 7) << 3));
+    byte(((index & 7) << 3) | (base & 7));
+    byte(0);
+  }
+
+public:
+  const std::vector<std::uint8_t>& code() const { return code_; }
+  std::size_t size() const { return code_.size(); }
+
+  void byte(std::uint8_t x) { code_.push_back(x); }
+  void dword(std::uint32_t x) {
+    for (int i = 0; i < 4; ++i)
+      byte(x >> (8 * i));
+  }
+  void qword(std::uint64_t x) {
+    for (int i = 0; i < 8; ++i)
+      byte(x >> (8 * i));
+  }
+
+  // Loads and stores of 32 bits zero-extend into the full register.
+  void load(bool w, Reg dst, Reg base, std::int32_t disp) {
+    rex(w, dst, 0, base);
+    byte(0x8B);
+    modrmMem(dst, base, disp);
+  }
+  void store(bool w, Reg base, std::int32_t disp, Reg src) {
+    rex(w, src, 0, base);
+    byte(0x89);
+    modrmMem(src, base, disp);
+  }
+  void loadIndexed(bool w, Reg dst, Reg base, Reg index) {
+    rex(w, dst, index, base);
+    byte(0x8B);
+    modrmIndexed(dst, base, index);
+  }
+  void storeIndexed(bool w, Reg base, Reg index, Reg src) {
+    rex(w, src, index, base);
+    byte(0x89);
+    modrmIndexed(src, base, index);
+  }
+  // Compute the address base + disp (lea).
+  void lea(Reg dst, Reg base, std::int32_t disp) {
+    rex(true, dst, 0, base);
+    byte(0x8D);
+    modrmMem(dst, base, disp);
+  }
+  // Load 32 bits and sign-extend them to 64 (movsxd).
+  void loadSx32(Reg dst, Reg base, std::int32_t disp) {
+    rex(true, dst, 0, base);
+    byte(0x63);
+    modrmMem(dst, base, disp);
+  }
+
+  void movImm32(Reg dst, std::uint32_t imm) {
+    rex(false, 0, 0, dst);
+    byte(0xB8 + (dst & 7));
+    dword(imm);
+  }
+  void movImm64(Reg dst, std::uint64_t imm) {
+    rex(true, 0, 0, dst);
+    byte(0xB8 + (dst & 7));
+    qword(imm);
+  }
+  void mov(bool w, Reg dst, Reg src) {
+    rex(w, src, 0, dst);
+    byte(0x89);
+    modrmReg(src, dst);
+  }
+
+  void alu(bool w, ALUOp op, Reg dst, Reg src) {
+    rex(w, src, 0, dst);
+    byte(op);
+    modrmReg(src, dst);
+  }
+  // The immediate is sign-extended to 64 bits if w is set.
+  void cmpImm(bool w, Reg dst, std::int32_t imm) {
+    rex(w, 0, 0, dst);
+    byte(0x81);
+    modrmReg(7, dst);
+    dword(imm);
+  }
+  void decMem32(Reg base, std::int32_t disp) {
+    rex(false, 0, 0, base);
+    byte(0xFF);
+    modrmMem(1, base, disp);
+  }
+  void subMemImm32(bool w, Reg base, std::int32_t disp, std::int32_t imm) {
+    rex(w, 0, 0, base);
+    byte(0x81);
+    modrmMem(5, base, disp);
+    dword(imm);
+  }
+  void imul(bool w, Reg dst, Reg src) {
+    rex(w, dst, 0, src);
+    byte(0x0F);
+    byte(0xAF);
+    modrmReg(dst, src);
+  }
+  void test(bool w, Reg l, Reg r) {
+    rex(w, r, 0, l);
+    byte(0x85);
+    modrmReg(r, l);
+  }
+
+  // Shifts of a register by cl. ext is 4 for shl, 5 for shr and 7 for sar.
+  void shiftCl(bool w, unsigned ext, Reg dst) {
+    rex(w, 0, 0, dst);
+    byte(0xD3);
+    modrmReg(ext, dst);
+  }
+  void shiftImm(bool w, unsigned ext, Reg dst, std::uint8_t count) {
+    rex(w, 0, 0, dst);
+    byte(0xC1);
+    modrmReg(ext, dst);
+    byte(count);
+  }
+  // Bit test and reset (ext 6) or complement (ext 7).
+  void bitOp(bool w, unsigned ext, Reg dst, std::uint8_t bit) {
+    rex(w, 0, 0, dst);
+    byte(0x0F);
+    byte(0xBA);
+    modrmReg(ext, dst);
+    byte(bit);
+  }
+
+  // Sign-extend eax into edx, or rax into rdx.
+  void cdq() { byte(0x99); }
+  void cqo() {
+    byte(0x48);
+    byte(0x99);
+  }
+  // Signed (ext 7) or unsigned (ext 6) division of edx:eax, or of rdx:rax if
+  // w is set.
+  void div(bool w, unsigned ext, Reg divisor) {
+    rex(w, 0, 0, divisor);
+    byte(0xF7);
+    modrmReg(ext, divisor);
+  }
+
+  // Set the low byte of a legacy register (rax through rbx) to a condition.
+  void setcc(Cond cc, Reg dst) {
+    byte(0x0F);
+    byte(0x90 + cc);
+    modrmReg(0, dst);
+  }
+  void and8(Reg dst, Reg src) {
+    byte(0x20);
+    modrmReg(src, dst);
+  }
+  void movzx8(Reg dst, Reg src) {
+    rex(false, dst, 0, src);
+    byte(0x0F);
+    byte(0xB6);
+    modrmReg(dst, src);
+  }
+  void cmov(bool w, Cond cc, Reg dst, Reg src) {
+    rex(w, dst, 0, src);
+    byte(0x0F);
+    byte(0x40 + cc);
+    modrmReg(dst, src);
+  }
+
+  // SSE scalar operations; double selects sd over ss.
+  void sseLoad(bool isDouble, XReg dst, Reg base, std::int32_t disp) {
+    sseMem(isDouble ? 0xF2 : 0xF3, 0x10, dst, base, disp);
+  }
+  void sseOp(bool isDouble, SSEOp op, XReg dst, Reg base, std::int32_t disp) {
+    sseMem(isDouble ? 0xF2 : 0xF3, op, dst, base, disp);
+  }
+  void ucomis(bool isDouble, XReg l, XReg r) {
+    if (isDouble)
+      byte(0x66);
+    byte(0x0F);
+    byte(0x2E);
+    modrmReg(l, r);
+  }
+  void ucomisMem(bool isDouble, XReg l, Reg base, std::int32_t disp) {
+    if (isDouble)
+      byte(0x66);
+    rex(false, l, 0, base);
+    byte(0x0F);
+    byte(0x2E);
+    modrmMem(l, base, disp);
+  }
+  // Move bits from an SSE register to a general register.
+  void movFromXmm(bool w, Reg dst, XReg src) {
+    byte(0x66);
+    rex(w, src, 0, dst);
+    byte(0x0F);
+    byte(0x7E);
+    modrmReg(src, dst);
+  }
+  // Convert a signed 32- or 64-bit integer to a float.
+  void cvtsi2s(bool isDouble, bool w, XReg dst, Reg src) {
+    byte(isDouble ? 0xF2 : 0xF3);
+    rex(w, dst, 0, src);
+    byte(0x0F);
+    byte(0x2A);
+    modrmReg(dst, src);
+  }
+  void sseMem(std::uint8_t prefix, std::uint8_t op, XReg reg, Reg base,
+              std::int32_t disp) {
+    byte(prefix);
+    rex(false, reg, 0, base);
+    byte(0x0F);
+    byte(op);
+    modrmMem(reg, base, disp);
+  }
+
+  void push(Reg r) {
+    rex(false, 0, 0, r);
+    byte(0x50 + (r & 7));
+  }
+  void pop(Reg r) {
+    rex(false, 0, 0, r);
+    byte(0x58 + (r & 7));
+  }
+  void adjustRsp(std::int8_t delta) {
+    byte(0x48);
+    byte(0x83);
+    modrmReg(delta < 0 ? 5 : 0, rsp);
+    byte(delta < 0 ? -delta : delta);
+  }
+  void ret() { byte(0xC3); }
+
+  // Call an absolute address, clobbering rax.
+  void call(const void* target) {
+    std::uint64_t address;
+    std::memcpy(&address, &target, sizeof(address));
+    movImm64(rax, address);
+    byte(0xFF);
+    modrmReg(2, rax);
+  }
+
+  // Jumps with 32-bit displacements. These return the offset of the
+  // displacement, to be filled in by bind or patch.
+  std::size_t jmp() {
+    byte(0xE9);
+    dword(0);
+    return size() - 4;
+  }
+  std::size_t jcc(Cond cc) {
+    byte(0x0F);
+    byte(0x80 + cc);
+    dword(0);
+    return size() - 4;
+  }
+  // Point the jump whose displacement is at fixup to target.
+  void patch(std::size_t fixup, std::size_t target) {
+    std::uint32_t rel = std::uint32_t(target - (fixup + 4));
+    std::memcpy(&code_[fixup], &rel, 4);
+  }
+  // Point the jump whose displacement is at fixup here.
+  void bind(std::size_t fixup) { patch(fixup, size()); }
+};
+
+} // namespace wasm
+
+#endif // include guard
@@ -14,10 +14,31 @@
  * limitations under the License.
  */
 
+#include "implementation/Features.h"
+#include "implementation/FFIHandler.h"
 #include "implementation/Implementation.h"
+#include "implementation/TrapHandler.h"
+#include "semantics/Aot.h"
+#include "semantics/CodeCache.h"
 #include "semantics/Host.h"
+#include "semantics/Instr.h"
+#include "semantics/Profile.h"
+#include "semantics/Run.h"
+#include "semantics/Sampler.h"
+#include "semantics/Scheduler.h"
 #include "module/Module.h"
+#include "process/Environment.h"
+#include "process/GlobalVariables.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "process/Snapshot.h"
+#include "process/TrustedStack.h"
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <vector>
 using namespace wasm;
 
 static int
@@ -26,6 +47,7 @@ Error(const char* what, ...) {
   va_start(ap, what);
   fprintf(stderr, "wasm-shell: command-line error: ");
   vfprintf(stderr, what, ap);
+  fputc('\n', stderr);
   va_end(ap);
   return 2; // as in sh(1).
 }
@@ -37,6 +59,18 @@ main(int argc, char* argv[]) {
   const char* moduleName = nullptr;
   std::vector<const char*> args;
   NaNBits::Kind nanBitsKind = NaNBits::Kind::Random;
+  RunOptions runOptions;
+  const char* pairProfileName = nullptr;
+  const char* profileName = nullptr;
+  const char* sampleName = nullptr;
+  double sampleInterval = 10e-3;
+  double sampleDuration = 0;
+  const char* aotEmitName = nullptr;
+  const char* aotName = nullptr;
+  bool guardPages = true;
+  size_t stackSize = TrustedStack::defaultArenaSize;
+  unsigned long instances = 1;
+  ScheduleOptions scheduleOptions;
 
   // Parse command-line options.
   bool sawDashDash = false;
@@ -56,12 +90,12 @@ main(int argc, char* argv[]) {
         const char* val = equals ? equals + 1 : nullptr;
 
         if (strncmp(argName, "nanbits", len) == 0) {
-          if (val && strcmp(val, "random"))
+          if (val && strcmp(val, "random") == 0)
             nanBitsKind = NaNBits::Kind::Random;
-          else if (val && strcmp(val, "canonical"))
-            nanBitsKind = NaNBits::Kind::Canonical;
-          else if (val && strcmp(val, "inverse"))
+          else if (val && strcmp(val, "canonical") == 0)
             nanBitsKind = NaNBits::Kind::Canonical;
+          else if (val && strcmp(val, "inverse") == 0)
+            nanBitsKind = NaNBits::Kind::Inverse;
           else if (!val)
             return Error("--nanbits usage: --nanbits=<kind>");
           else
@@ -71,6 +105,202 @@ main(int argc, char* argv[]) {
           continue;
         }
 
+        if (strncmp(argName, "dispatch", len) == 0) {
+          if (val && strcmp(val, "switch") == 0)
+            runOptions.dispatch = Dispatch::switch_;
+          else if (val && strcmp(val, "threaded") == 0)
+            runOptions.dispatch = Dispatch::threaded;
+          else if (!val)
+            return Error("--dispatch usage: --dispatch=<kind>");
+          else
+            return Error("unknown --dispatch kind: %s (expected switch or "
+                         "threaded)",
+                         val);
+          continue;
+        }
+
+        if (strncmp(argName, "engine", len) == 0) {
+          if (val && strcmp(val, "stack") == 0)
+            runOptions.engine = Engine::stack;
+          else if (val && strcmp(val, "register") == 0)
+            runOptions.engine = Engine::register_;
+          else if (val && strcmp(val, "jit") == 0) {
+            if (!WASM_HAVE_JIT)
+              return Error("--engine=jit is unavailable on this host");
+            runOptions.engine = Engine::jit;
+          } else if (!val)
+            return Error("--engine usage: --engine=<kind>");
+          else
+            return Error("unknown --engine kind: %s (expected stack, "
+                         "register, or jit)",
+                         val);
+          continue;
+        }
+
+        if (strncmp(argName, "fuse", len) == 0) {
+          if (val && strcmp(val, "on") == 0)
+            runOptions.fuse = true;
+          else if (val && strcmp(val, "off") == 0)
+            runOptions.fuse = false;
+          else
+            return Error("--fuse usage: --fuse=<on|off>");
+          continue;
+        }
+
+        if (strncmp(argName, "bounds-checks", len) == 0) {
+          if (val && strcmp(val, "guard") == 0)
+            guardPages = true;
+          else if (val && strcmp(val, "explicit") == 0)
+            guardPages = false;
+          else if (!val)
+            return Error("--bounds-checks usage: --bounds-checks=<kind>");
+          else
+            return Error("unknown --bounds-checks kind: %s (expected guard "
+                         "or explicit)",
+                         val);
+          continue;
+        }
+
+        if (strncmp(argName, "stack-size", len) == 0) {
+          char* end;
+          stackSize = val ? strtoul(val, &end, 10) : 0;
+          if (stackSize == 0 || *end != '\0')
+            return Error("--stack-size usage: --stack-size=<bytes>");
+          continue;
+        }
+
+        if (strncmp(argName, "instances", len) == 0) {
+          char* end;
+          instances = val ? strtoul(val, &end, 10) : 0;
+          if (instances == 0 || *end != '\0')
+            return Error("--instances usage: --instances=<count>");
+          continue;
+        }
+
+        if (strncmp(argName, "threads", len) == 0) {
+          char* end;
+          scheduleOptions.threads = val ? strtoul(val, &end, 10) : 0;
+          if (scheduleOptions.threads == 0 || *end != '\0')
+            return Error("--threads usage: --threads=<count>");
+          continue;
+        }
+
+        if (strncmp(argName, "time-slice", len) == 0) {
+          char* end;
+          double ms = val ? strtod(val, &end) : -1;
+          if (!val || *end != '\0' || !(ms >= 0))
+            return Error("--time-slice usage: --time-slice=<milliseconds>");
+          scheduleOptions.timeSlice = ms / 1e3;
+          continue;
+        }
+
+        if (strncmp(argName, "time-budget", len) == 0) {
+          char* end;
+          double ms = val ? strtod(val, &end) : -1;
+          if (!val || *end != '\0' || !(ms >= 0))
+            return Error("--time-budget usage: --time-budget=<milliseconds>");
+          scheduleOptions.timeBudget = ms / 1e3;
+          continue;
+        }
+
+        if (strncmp(argName, "fuel", len) == 0) {
+          char* end;
+          runOptions.fuel = val ? strtoull(val, &end, 10) : 0;
+          if (runOptions.fuel == 0 || *end != '\0')
+            return Error("--fuel usage: --fuel=<instructions>");
+          continue;
+        }
+
+        if (strncmp(argName, "deadline", len) == 0) {
+          char* end;
+          double ms = val ? strtod(val, &end) : -1;
+          if (!val || *end != '\0' || !(ms > 0))
+            return Error("--deadline usage: --deadline=<milliseconds>");
+          runOptions.deadline = ms / 1e3;
+          continue;
+        }
+
+        if (strncmp(argName, "jobs", len) == 0) {
+          char* end;
+          runOptions.jobs = val ? strtoul(val, &end, 10) : 0;
+          if (runOptions.jobs == 0 || *end != '\0')
+            return Error("--jobs usage: --jobs=<threads>");
+          continue;
+        }
+
+        if (strncmp(argName, "cache-dir", len) == 0) {
+          if (!val)
+            return Error("--cache-dir usage: --cache-dir=<directory>");
+          runOptions.cacheDirectory = val;
+          continue;
+        }
+
+        if (strncmp(argName, "code-cache-limit", len) == 0) {
+          char* end;
+          runOptions.codeCacheLimit = val ? strtoul(val, &end, 10) : 0;
+          if (!val || *end != '\0')
+            return Error("--code-cache-limit usage: "
+                         "--code-cache-limit=<bytes>");
+          continue;
+        }
+
+        if (strncmp(argName, "aot", len) == 0) {
+          if (!val)
+            return Error("--aot usage: --aot=<file.so>");
+          aotName = val;
+          continue;
+        }
+
+        if (strncmp(argName, "aot-emit", len) == 0) {
+          if (!val)
+            return Error("--aot-emit usage: --aot-emit=<file.cpp>");
+          aotEmitName = val;
+          continue;
+        }
+
+        if (strncmp(argName, "pair-profile", len) == 0) {
+          if (!val)
+            return Error("--pair-profile usage: --pair-profile=<file>");
+          pairProfileName = val;
+          continue;
+        }
+
+        if (strncmp(argName, "profile", len) == 0) {
+          if (!val)
+            return Error("--profile usage: --profile=<file.json>");
+          profileName = val;
+          continue;
+        }
+
+        if (strncmp(argName, "sample", len) == 0) {
+          if (!val)
+            return Error("--sample usage: --sample=<file>");
+          if (!WASM_HAVE_SAMPLER)
+            return Error("--sample is unavailable on this host");
+          sampleName = val;
+          continue;
+        }
+
+        if (strncmp(argName, "sample-interval", len) == 0) {
+          char* end;
+          double ms = val ? strtod(val, &end) : -1;
+          if (!val || *end != '\0' || !(ms > 0))
+            return Error("--sample-interval usage: "
+                         "--sample-interval=<milliseconds>");
+          sampleInterval = ms / 1e3;
+          continue;
+        }
+
+        if (strncmp(argName, "sample-duration", len) == 0) {
+          char* end;
+          double ms = val ? strtod(val, &end) : -1;
+          if (!val || *end != '\0' || !(ms > 0))
+            return Error("--sample-duration usage: "
+                         "--sample-duration=<milliseconds>");
+          sampleDuration = ms / 1e3;
+          continue;
+        }
+
         return Error("unknown command-line option: %s", arg);
       }
     }
@@ -83,16 +313,140 @@ main(int argc, char* argv[]) {
     }
   }
 
+  if (moduleName == nullptr)
+    return Error("usage: wasm-shell [options] <module> [args...]");
+
   Implementation implementation(nanBitsKind);
 
-  Module module(moduleName);
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  const char* why;
+  if (!module->load(moduleName, &why)) {
+    fprintf(stderr, "wasm-shell: %s: %s\n", moduleName, why);
+    return EXIT_FAILURE;
+  }
+
+  // Translating a module only needs the module.
+  if (aotEmitName) {
+    FILE* out = fopen(aotEmitName, "w");
+    if (!out)
+      return Error("cannot open --aot-emit file: %s", aotEmitName);
+    bool ok = EmitAot(*module, out, &why);
+    if (fclose(out) != 0 && ok) {
+      ok = false;
+      why = "error writing translated code";
+    }
+    if (!ok) {
+      remove(aotEmitName);
+      fprintf(stderr, "wasm-shell: %s: %s\n", moduleName, why);
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  AotLibrary aotLibrary;
+  if (aotName) {
+    if (!aotLibrary.open(aotName, *module, &why)) {
+      fprintf(stderr, "wasm-shell: %s: %s\n", aotName, why);
+      return EXIT_FAILURE;
+    }
+    runOptions.engine = Engine::aot;
+    runOptions.aotLibrary = &aotLibrary;
+  }
+
+  Process process;
+
+  if (guardPages && !process.linearMemory_->reserveGuarded(
+                      implementation.trapHandler_.get()))
+    fprintf(stderr, "wasm-shell: guard pages unavailable; using explicit "
+                    "bounds checks\n");
+  if (!process.trustedStack_->reserve(
+        stackSize, guardPages ? implementation.trapHandler_.get() : nullptr))
+    fprintf(stderr, "wasm-shell: stack guard page unavailable; using explicit "
+                    "stack checks\n");
+
+  process.load(module, implementation.trapHandler_.get());
+
+  PairCounts pairCounts;
+  if (pairProfileName)
+    runOptions.pairCounts = &pairCounts;
+
+  // Only the stack form is profiled.
+  Profile profile;
+  if (profileName) {
+    if (runOptions.engine != Engine::stack)
+      return Error("--profile requires --engine=stack");
+    runOptions.profile = &profile;
+  }
+
+  CompileStats compileStats = CompileStats();
+  runOptions.compileStats = &compileStats;
+
+  // Further instances are cloned from the state the first one started in.
+  Snapshot snapshot;
+  if (instances > 1 && !snapshot.capture(process))
+    return Error("--instances: snapshots are unavailable on this host");
 
-  Process process(args);
+  // Only the first instance is sampled.
+  Sampler sampler(sampleInterval, sampleDuration);
+  if (sampleName) {
+    if (!sampler.start(*process.trustedStack_, &why)) {
+      fprintf(stderr, "wasm-shell: --sample: %s\n", why);
+      return EXIT_FAILURE;
+    }
+    runOptions.sampler = &sampler;
+  }
+
+  Status status = run(implementation, process, runOptions);
 
-  process.importFFI(implementation.FFIHandler());
-  process.load(module);
+  if (sampleName) {
+    sampler.stop();
+    runOptions.sampler = nullptr;
+  }
+
+  if (runOptions.jobs != 0) {
+    fprintf(stderr,
+            "wasm-shell: compiled %zu routines on %u threads in %.3f ms "
+            "(%.3f ms of work, %.2fx speedup)\n",
+            compileStats.routines, compileStats.jobs,
+            compileStats.seconds * 1e3, compileStats.workSeconds * 1e3,
+            compileStats.seconds > 0
+              ? compileStats.workSeconds / compileStats.seconds
+              : 1.0);
+    runOptions.compileStats = nullptr;
+  }
 
-  Status status = run(implementation, process);
+  // They share the module and its compiled code, and take turns on
+  // --threads threads.
+  if (instances > 1 && status == Status::success)
+    status = RunInstances(snapshot, instances - 1, nanBitsKind, guardPages,
+                          stackSize, runOptions, scheduleOptions);
+
+  if (pairProfileName) {
+    FILE* out = fopen(pairProfileName, "w");
+    if (!out)
+      return Error("cannot open --pair-profile file: %s", pairProfileName);
+    pairCounts.dump(out);
+    fclose(out);
+  }
+
+  if (profileName) {
+    FILE* out = fopen(profileName, "w");
+    if (!out)
+      return Error("cannot open --profile file: %s", profileName);
+    profile.dump(out);
+    fclose(out);
+  }
+
+  if (sampleName) {
+    FILE* out = fopen(sampleName, "w");
+    if (!out)
+      return Error("cannot open --sample file: %s", sampleName);
+    sampler.dump(out);
+    fclose(out);
+    if (sampler.dropped() != 0)
+      fprintf(stderr, "wasm-shell: --sample: dropped %zu of %zu samples\n",
+              sampler.dropped(), sampler.samples() + sampler.dropped());
+  }
 
   switch (status) {
     case Status::success:
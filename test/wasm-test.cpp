@@ -0,0 +1,1650 @@
+/*
+ * Copyright 2015 WebAssembly Community Group
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "implementation/FFIHandler.h"
+#include "implementation/Features.h"
+#include "implementation/Implementation.h"
+#include "implementation/TrapHandler.h"
+#include "semantics/Aot.h"
+#include "semantics/CodeCache.h"
+#include "semantics/CodeCacheFormat.h"
+#include "semantics/Host.h"
+#include "semantics/Instr.h"
+#include "semantics/Profile.h"
+#include "semantics/Run.h"
+#include "semantics/Sampler.h"
+#include "semantics/Scheduler.h"
+#include "module/Module.h"
+#include "module/ModuleFormat.h"
+#include "process/Environment.h"
+#include "process/GlobalVariables.h"
+#include "process/LinearMemory.h"
+#include "process/Process.h"
+#include "process/Snapshot.h"
+#include "process/TrustedStack.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using namespace wasm;
+
+// Regression tests. Each runs small modules, built here, in a child process,
+// since a crash, or a trap outside a run, ends the process it happens in, and
+// checks what the child wrote and how it exited. Prints a line per test and exits with the number
+// that failed.
+
+static int
+Error(const char* what, ...) {
+  va_list ap;
+  va_start(ap, what);
+  fprintf(stderr, "wasm-test: command-line error: ");
+  vfprintf(stderr, what, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+  return 2; // as in sh(1).
+}
+
+struct TestRoutine {
+  std::uint32_t numLocals;
+  std::vector<Node> body;
+};
+
+struct TestInitializer {
+  std::uint32_t address;
+  std::string bytes;
+};
+
+// A module, of which routine 0 is the start routine.
+struct TestModule {
+  std::vector<TestRoutine> routines;
+  std::vector<std::uint64_t> literals;
+  std::vector<TestInitializer> initializers;
+  std::uint32_t numGlobals;
+  std::uint64_t memorySize;
+
+  TestModule()
+    : numGlobals(0)
+    , memorySize(0) {}
+
+  // The index of a literal with the given bits, added if it's new.
+  std::uint32_t literal(std::uint64_t bits) {
+    for (std::size_t i = 0; i < literals.size(); ++i)
+      if (literals[i] == bits)
+        return i;
+    literals.push_back(bits);
+    return literals.size() - 1;
+  }
+};
+
+static Node
+N(Types type, Opcode opcode, std::uint32_t payload = 0) {
+  return Node{type, opcode, payload};
+}
+
+// Write module to a temporary file and load it, as wasm-bench does. The file
+// is unlinked once it's mapped.
+static bool
+LoadModule(const TestModule& module, Module* loaded, const char** why) {
+  std::vector<std::uint8_t> out(sizeof(ModuleHeader) +
+                                3 * sizeof(SectionHeader));
+  auto append = [&out](const void* data, std::size_t size) {
+    std::size_t offset = (out.size() + 7) & ~std::size_t(7);
+    out.resize(offset + size);
+    if (size != 0)
+      memcpy(&out[offset], data, size);
+    return offset;
+  };
+
+  std::vector<RoutineHeader> routines;
+  for (const TestRoutine& routine : module.routines) {
+    RoutineHeader header = RoutineHeader();
+    header.numLocals = routine.numLocals;
+    header.numNodes = routine.body.size();
+    header.bodyOffset = append(routine.body.data(),
+                               routine.body.size() * sizeof(Node));
+    routines.push_back(header);
+  }
+  std::vector<InitializerHeader> initializers;
+  for (const TestInitializer& initializer : module.initializers) {
+    InitializerHeader header = InitializerHeader();
+    header.address = initializer.address;
+    header.size = initializer.bytes.size();
+    header.dataOffset = append(initializer.bytes.data(),
+                               initializer.bytes.size());
+    initializers.push_back(header);
+  }
+
+  SectionHeader sections[3] = {};
+  sections[0].id = SectionID::routines;
+  sections[0].size = routines.size() * sizeof(RoutineHeader);
+  sections[0].offset = append(routines.data(), sections[0].size);
+  sections[1].id = SectionID::literals;
+  sections[1].size = module.literals.size() * sizeof(std::uint64_t);
+  sections[1].offset = append(module.literals.data(), sections[1].size);
+  sections[2].id = SectionID::initializers;
+  sections[2].size = initializers.size() * sizeof(InitializerHeader);
+  sections[2].offset = append(initializers.data(), sections[2].size);
+
+  ModuleHeader header = ModuleHeader();
+  memcpy(header.magic, moduleMagic, sizeof(moduleMagic));
+  header.version = moduleVersion;
+  header.numSections = 3;
+  header.numGlobals = module.numGlobals;
+  header.memorySize = module.memorySize;
+  memcpy(&out[0], &header, sizeof(header));
+  memcpy(&out[sizeof(header)], sections, sizeof(sections));
+
+  const char* dir = getenv("TMPDIR");
+  std::string path = std::string(dir ? dir : "/tmp") + "/wasm-test-XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    *why = "cannot create a temporary module file";
+    return false;
+  }
+  bool written = write(fd, out.data(), out.size()) == ssize_t(out.size());
+  close(fd);
+  bool ok = written && loaded->load(path.c_str(), why);
+  unlink(path.c_str());
+  if (!written)
+    *why = "cannot write a temporary module file";
+  return ok;
+}
+
+// How a module is run, as wasm-shell's options would set it up.
+struct Setup {
+  RunOptions runOptions;
+  bool guardPages;
+  std::size_t stackSize;
+  std::size_t instances;
+  ScheduleOptions scheduleOptions;
+
+  Setup()
+    : guardPages(true)
+    , stackSize(TrustedStack::defaultArenaSize)
+    , instances(1) {}
+};
+
+// The root of the source tree, which translated code is compiled against.
+static std::string
+SourceRoot() {
+  std::string root = __FILE__;
+  for (int i = 0; i < 2; ++i) {
+    std::size_t slash = root.rfind('/');
+    root = slash == std::string::npos ? "." : root.substr(0, slash);
+  }
+  return root.empty() ? "/" : root;
+}
+
+// Create a new directory for temporary files, under $TMPDIR or /tmp.
+static bool
+MakeTempDirectory(std::string* path) {
+  const char* dir = getenv("TMPDIR");
+  *path = std::string(dir ? dir : "/tmp") + "/wasm-test-XXXXXX";
+  return mkdtemp(&(*path)[0]) != nullptr;
+}
+
+// Translate module to C++, compile it with the host compiler, $CXX or c++,
+// as AotRuntime.h describes, and load it into library, as wasm-shell's
+// --aot-emit and --aot do. The files are removed once it's loaded. If
+// loadedModule is set, the library is loaded for it instead, as a stale one
+// would be.
+static bool
+CompileAot(const Module& module, AotLibrary* library, const char** why,
+           const Module* loadedModule = nullptr) {
+  std::string path;
+  if (!MakeTempDirectory(&path)) {
+    *why = "cannot create a temporary directory";
+    return false;
+  }
+  std::string source = path + "/module.cpp", object = path + "/module.so";
+  FILE* out = fopen(source.c_str(), "w");
+  bool ok = out && EmitAot(module, out, why);
+  if (out && fclose(out) != 0 && ok) {
+    ok = false;
+    *why = "error writing translated code";
+  }
+  if (!out)
+    *why = "cannot create a translated source file";
+  if (ok) {
+    const char* compiler = getenv("CXX");
+    std::string command = std::string(compiler ? compiler : "c++") +
+                          " -std=c++11 -O2 -shared -fPIC -I'" + SourceRoot() +
+                          "' '" + source + "' -o '" + object + "'";
+    ok = system(command.c_str()) == 0;
+    if (!ok)
+      *why = "cannot compile translated code";
+  }
+  ok = ok && library->open(object.c_str(),
+                           loadedModule ? *loadedModule : module, why);
+  unlink(source.c_str());
+  unlink(object.c_str());
+  rmdir(path.c_str());
+  return ok;
+}
+
+// Run module as wasm-shell does, returning its exit status. The process is
+// torn down before the implementation, as in wasm-shell.
+static int
+RunModule(const TestModule& testModule, const Setup& setup) {
+  Implementation implementation(NaNBits::Kind::Canonical);
+  TrapHandler* trapHandler = implementation.trapHandler_.get();
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  const char* why;
+  if (!LoadModule(testModule, module.get(), &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+
+  RunOptions runOptions = setup.runOptions;
+  AotLibrary aotLibrary;
+  if (runOptions.engine == Engine::aot) {
+    if (!CompileAot(*module, &aotLibrary, &why)) {
+      fprintf(stderr, "%s\n", why);
+      return EXIT_FAILURE;
+    }
+    runOptions.aotLibrary = &aotLibrary;
+  }
+
+  Process process;
+  if (setup.guardPages)
+    process.linearMemory_->reserveGuarded(trapHandler);
+  process.trustedStack_->reserve(setup.stackSize,
+                                 setup.guardPages ? trapHandler : nullptr);
+  process.load(module, trapHandler);
+
+  Snapshot snapshot;
+  if (setup.instances > 1 && !snapshot.capture(process))
+    return EXIT_FAILURE;
+  Status status = run(implementation, process, runOptions);
+  if (setup.instances > 1 && status == Status::success)
+    status = RunInstances(snapshot, setup.instances - 1,
+                          NaNBits::Kind::Canonical, setup.guardPages,
+                          setup.stackSize, runOptions,
+                          setup.scheduleOptions);
+  switch (status) {
+    case Status::success:
+      return EXIT_SUCCESS;
+    case Status::timeout:
+      return 124;
+    default:
+      return EXIT_FAILURE;
+  }
+}
+
+// What a child wrote and how it ended: its exit status, or 128 plus the
+// signal that killed it, as in sh(1).
+struct Outcome {
+  int status;
+  std::string out;
+  std::string err;
+};
+
+static std::string
+ReadAll(FILE* file) {
+  std::string contents;
+  rewind(file);
+  char buffer[4096];
+  std::size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) != 0)
+    contents.append(buffer, n);
+  fclose(file);
+  return contents;
+}
+
+static Outcome
+RunChild(const std::function<int()>& body) {
+  fflush(stdout);
+  fflush(stderr);
+  FILE* out = tmpfile();
+  FILE* err = tmpfile();
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fileno(out), STDOUT_FILENO);
+    dup2(fileno(err), STDERR_FILENO);
+    exit(body());
+  }
+  int wstatus = 0;
+  while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR)
+    continue;
+  Outcome outcome;
+  outcome.status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus)
+                                      : 128 + WTERMSIG(wstatus);
+  outcome.out = ReadAll(out);
+  outcome.err = ReadAll(err);
+  return outcome;
+}
+
+static Outcome
+Run(const TestModule& module, const Setup& setup = Setup()) {
+  return RunChild([&module, &setup] { return RunModule(module, setup); });
+}
+
+// Each engine, as wasm-shell's --engine names it. Modules run on aot, which
+// wasm-shell selects with --aot, are first compiled with the host compiler.
+struct EngineName {
+  Engine engine;
+  const char* name;
+};
+
+static std::vector<EngineName>
+Engines() {
+  std::vector<EngineName> engines = {{Engine::stack, "stack"},
+                                     {Engine::register_, "register"}};
+  if (WASM_HAVE_JIT)
+    engines.push_back({Engine::jit, "jit"});
+  engines.push_back({Engine::aot, "aot"});
+  return engines;
+}
+
+// Failures are reported as they're found, and counted for the current test.
+static unsigned failures;
+
+static void
+Fail(const char* test, const char* what, ...) {
+  va_list ap;
+  va_start(ap, what);
+  printf("  %s: ", test);
+  vprintf(what, ap);
+  printf("\n");
+  va_end(ap);
+  ++failures;
+}
+
+static void
+ExpectOutcome(const char* test, const Outcome& outcome, int status,
+              const std::string& out, const char* trap = nullptr) {
+  if (outcome.status != status)
+    Fail(test, "exited with status %d, expected %d; stderr: %s",
+         outcome.status, status, outcome.err.c_str());
+  if (outcome.out.size() != out.size())
+    Fail(test, "wrote %zu bytes to stdout, expected %zu", outcome.out.size(),
+         out.size());
+  else if (outcome.out != out)
+    Fail(test, "wrote other bytes to stdout than expected");
+  if (trap && outcome.err.find(std::string("TRAP: ") + trap) ==
+                std::string::npos)
+    Fail(test, "didn't trap with \"%s\"; stderr: %s", trap,
+         outcome.err.c_str());
+}
+
+// Routine 0 writes a payload larger than the I/O queue copies, which is
+// written from memory, and then does what's in tail.
+static TestModule
+WriteModule(const std::string& payload, const std::vector<Node>& tail) {
+  Types I = Types::int32;
+  TestModule module;
+  module.memorySize = 1 << 16;
+  module.initializers.push_back(TestInitializer{0, payload});
+  std::vector<Node> body = {
+    N(I, Literal, module.literal(STDOUT_FILENO)),
+    N(I, Literal, module.literal(0)),
+    N(I, Literal, module.literal(payload.size())),
+    N(I, CallFFI, std::uint32_t(FFIHandler::CallID::write)),
+  };
+  body.insert(body.end(), tail.begin(), tail.end());
+  module.routines.push_back(TestRoutine{0, body});
+  return module;
+}
+
+// Queued writes are made after the run, before the process's memory goes
+// away, and when a trap exits, whether memory is guarded or not.
+static void
+TestQueuedWrites() {
+  std::string payload(1000, 'x');
+  for (std::size_t i = 0; i < payload.size(); ++i)
+    payload[i] = 'a' + i % 26;
+  for (bool guardPages : {true, false}) {
+    Setup setup;
+    setup.guardPages = guardPages;
+    const char* suffix = guardPages ? "guard" : "explicit";
+
+    std::string test = std::string("write-then-exit.") + suffix;
+    ExpectOutcome(test.c_str(), Run(WriteModule(payload, {}), setup),
+                  EXIT_SUCCESS, payload);
+
+    test = std::string("write-then-trap.") + suffix;
+    TestModule module = WriteModule(payload, {});
+    module.routines[0].body.push_back(
+      N(Types::int32, Literal, module.literal(0x7fffff00)));
+    module.routines[0].body.push_back(N(Types::int32, LoadHeap));
+    ExpectOutcome(test.c_str(), Run(module, setup), EXIT_FAILURE, payload,
+                  "linear memory address out of bounds");
+  }
+}
+
+// Add a routine to module with body, which leaves a value of type on the
+// stack, followed by code which stores the value at address 0 and writes its
+// bytes to stdout. A branch to the end of body goes to the store.
+static void
+AddResultRoutine(TestModule* module, std::uint32_t numLocals,
+                 const std::vector<Node>& body, Types type) {
+  Types I = Types::int32;
+  std::uint32_t size = type == Types::int64 || type == Types::float64 ? 8 : 4;
+  module->memorySize = std::max<std::uint64_t>(module->memorySize, 1 << 16);
+  std::vector<Node> nodes = body;
+  nodes.insert(nodes.end(),
+               {N(I, Literal, module->literal(0)), N(type, StoreHeap),
+                N(I, Literal, module->literal(STDOUT_FILENO)),
+                N(I, Literal, module->literal(0)),
+                N(I, Literal, module->literal(size)),
+                N(I, CallFFI, std::uint32_t(FFIHandler::CallID::write))});
+  module->routines.push_back(TestRoutine{numLocals, nodes});
+}
+
+template <typename T>
+static std::string
+Bytes(T value) {
+  return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// The operand stack must be as deep at a branch target however it's reached,
+// and every engine then computes the same value.
+static void
+TestBranchDepths() {
+  Types I = Types::int32, V = Types::void_;
+  for (const EngineName& engine : Engines()) {
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    std::string suffix = std::string(".") + engine.name;
+
+    // Adds 2 to 7 unless the branch is taken.
+    for (std::int32_t taken : {0, 1}) {
+      TestModule module;
+      AddResultRoutine(&module, 0,
+                       {N(I, Literal, module.literal(7)),
+                        N(I, Literal, module.literal(taken)), N(V, BrIf, 5),
+                        N(I, Literal, module.literal(2)), N(I, Int32Add)},
+                       I);
+      std::string test = std::string("branch-depths.agree") +
+                         (taken ? ".taken" : "") + suffix;
+      ExpectOutcome(test.c_str(), Run(module, setup), EXIT_SUCCESS,
+                    Bytes(std::int32_t(taken ? 7 : 9)));
+    }
+
+    TestModule module;
+    module.routines.push_back(TestRoutine{
+      0, {N(I, Literal, module.literal(0)), N(V, BrIf, 3),
+          N(I, Literal, module.literal(5))}});
+    // Translation rejects the module before it runs, rather than trapping.
+    const char* why = "operand stack depth mismatch at branch target";
+    std::string test = "branch-depths.disagree" + suffix;
+    Outcome outcome = Run(module, setup);
+    if (engine.engine == Engine::aot) {
+      ExpectOutcome(test.c_str(), outcome, EXIT_FAILURE, "");
+      if (outcome.err.find(why) == std::string::npos)
+        Fail(test.c_str(), "wasn't rejected; stderr: %s",
+             outcome.err.c_str());
+    } else {
+      ExpectOutcome(test.c_str(), outcome, EXIT_FAILURE, "", why);
+    }
+  }
+}
+
+// Routine 0 converts operand, a literal of type from, with op, and writes
+// the result.
+static TestModule
+ConvertModule(Types from, std::uint64_t operand, Types to, Opcode op) {
+  TestModule module;
+  AddResultRoutine(&module, 0,
+                   {N(from, Literal, module.literal(operand)), N(to, op)}, to);
+  return module;
+}
+
+template <typename T>
+static std::uint64_t
+Bits(T value) {
+  std::uint64_t bits = 0;
+  memcpy(&bits, &value, sizeof(value));
+  return bits;
+}
+
+// Conversions between int64 and the float types, at the edges of the
+// integer's range, agree on every engine, and trap as the int32 ones do.
+static void
+TestInt64Conversions() {
+  Types I64 = Types::int64, F32 = Types::float32, F64 = Types::float64;
+  const char* signedFailure = "float to signed integer conversion failure";
+  const char* unsignedFailure = "float to unsigned integer conversion failure";
+  struct Case {
+    const char* name;
+    Types from;
+    std::uint64_t operand;
+    Types to;
+    Opcode op;
+    // The result's bytes, or empty if it traps with why.
+    std::string result;
+    const char* why;
+  };
+  const Case cases[] = {
+    {"sint64.float64.min", F64, Bits(-9223372036854775808.0), I64,
+     SInt64FromFloat64, Bytes(INT64_MIN), nullptr},
+    {"sint64.float64.max", F64, Bits(9223372036854774784.0), I64,
+     SInt64FromFloat64, Bytes(INT64_C(9223372036854774784)), nullptr},
+    {"sint64.float64.over", F64, Bits(9223372036854775808.0), I64,
+     SInt64FromFloat64, "", signedFailure},
+    {"sint64.float64.nan", F64, Bits(double(NAN)), I64, SInt64FromFloat64,
+     "", signedFailure},
+    {"sint64.float32.truncate", F32, Bits(-1.5f), I64, SInt64FromFloat32,
+     Bytes(INT64_C(-1)), nullptr},
+    {"sint64.float32.under", F32, Bits(-9223373136366403584.0f), I64,
+     SInt64FromFloat32, "", signedFailure},
+    {"uint64.float64.max", F64, Bits(18446744073709549568.0), I64,
+     Uint64FromFloat64, Bytes(UINT64_C(18446744073709549568)), nullptr},
+    {"uint64.float64.truncate", F64, Bits(-0.5), I64, Uint64FromFloat64,
+     Bytes(UINT64_C(0)), nullptr},
+    {"uint64.float64.under", F64, Bits(-1.0), I64, Uint64FromFloat64, "",
+     unsignedFailure},
+    {"uint64.float32.over", F32, Bits(18446744073709551616.0f), I64,
+     Uint64FromFloat32, "", unsignedFailure},
+    {"uint64.float32.high", F32, Bits(9223372036854775808.0f), I64,
+     Uint64FromFloat32, Bytes(UINT64_C(9223372036854775808)), nullptr},
+    {"float64.sint64", I64, std::uint64_t(INT64_C(-1)), F64,
+     Float64FromSInt64, Bytes(-1.0), nullptr},
+    {"float64.uint64", I64, UINT64_MAX, F64, Float64FromUInt64,
+     Bytes(18446744073709551616.0), nullptr},
+    {"float32.sint64", I64, std::uint64_t(INT64_MIN), F32, Float32FromSInt64,
+     Bytes(-9223372036854775808.0f), nullptr},
+    // Rounds once, to the nearest float, rather than through float64.
+    {"float32.uint64.round", I64, UINT64_C(0x8000008000000001), F32,
+     Float32FromUInt64, Bytes(9223373136366403584.0f), nullptr},
+    {"int64.float64.bits", F64, Bits(1.0), I64, Int64FromFloat64Bits,
+     Bytes(UINT64_C(0x3ff0000000000000)), nullptr},
+    {"float64.int64.bits", I64, UINT64_C(0x3ff0000000000000), F64,
+     Float64FromInt64Bits, Bytes(1.0), nullptr},
+  };
+  for (const EngineName& engine : Engines()) {
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    for (const Case& c : cases) {
+      std::string test = std::string(c.name) + "." + engine.name;
+      Outcome outcome =
+        Run(ConvertModule(c.from, c.operand, c.to, c.op), setup);
+      if (c.why)
+        ExpectOutcome(test.c_str(), outcome, EXIT_FAILURE, "", c.why);
+      else
+        ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS, c.result);
+    }
+  }
+}
+
+// The int32 and float operators, and the heap accesses, agree bit for bit on
+// every engine, at the edges where machine instructions differ from their
+// semantics: shift counts out of range, division traps, and NaN bits, which
+// are canonical whatever the operands' payloads.
+static void
+TestOperators() {
+  Types I = Types::int32, F32 = Types::float32, F64 = Types::float64;
+  const std::uint32_t nan32 = 0x7fc00000, payload32 = 0x7fa00001;
+  const std::uint64_t nan64 = UINT64_C(0x7ff8000000000000),
+                      payload64 = UINT64_C(0x7ff4000000000001);
+  struct Case {
+    const char* name;
+    std::vector<Node> body;
+    Types type;
+    // The result's bytes, or empty if it traps with why.
+    std::string result;
+    const char* why;
+  };
+  TestModule module;
+  auto Int32 = [&module](std::uint32_t value) {
+    return N(Types::int32, Literal, module.literal(value));
+  };
+  auto Float32 = [&module](float value) {
+    return N(Types::float32, Literal, module.literal(Bits(value)));
+  };
+  auto Float64 = [&module](double value) {
+    return N(Types::float64, Literal, module.literal(Bits(value)));
+  };
+  auto Float32Bits = [&module](std::uint32_t bits) {
+    return N(Types::float32, Literal, module.literal(bits));
+  };
+  auto Float64Bits = [&module](std::uint64_t bits) {
+    return N(Types::float64, Literal, module.literal(bits));
+  };
+  const std::vector<Case> cases = {
+    {"int32.add.wrap", {Int32(0x7fffffff), Int32(1), N(I, Int32Add)}, I,
+     Bytes(INT32_MIN), nullptr},
+    {"int32.mul.wrap", {Int32(65537), Int32(65537), N(I, Int32Mul)}, I,
+     Bytes(std::int32_t(0x20001)), nullptr},
+    {"int32.sdiv", {Int32(-7), Int32(2), N(I, Int32SDiv)}, I,
+     Bytes(std::int32_t(-3)), nullptr},
+    {"int32.udiv", {Int32(-7), Int32(2), N(I, Int32UDiv)}, I,
+     Bytes(std::int32_t(0x7ffffffc)), nullptr},
+    {"int32.srem", {Int32(-7), Int32(2), N(I, Int32SRem)}, I,
+     Bytes(std::int32_t(-1)), nullptr},
+    {"int32.srem.overflow", {Int32(INT32_MIN), Int32(-1), N(I, Int32SRem)},
+     I, Bytes(std::int32_t(0)), nullptr},
+    {"int32.urem", {Int32(-7), Int32(16), N(I, Int32URem)}, I,
+     Bytes(std::int32_t(9)), nullptr},
+    {"int32.sdiv.zero", {Int32(1), Int32(0), N(I, Int32SDiv)}, I, "",
+     "signed integer division by zero"},
+    {"int32.sdiv.overflow", {Int32(INT32_MIN), Int32(-1), N(I, Int32SDiv)},
+     I, "", "signed integer division overflow"},
+    {"int32.udiv.zero", {Int32(1), Int32(0), N(I, Int32UDiv)}, I, "",
+     "unsigned integer division by zero"},
+    {"int32.shl", {Int32(3), Int32(30), N(I, Int32Shl)}, I,
+     Bytes(std::int32_t(0xc0000000)), nullptr},
+    {"int32.shl.wide", {Int32(1), Int32(33), N(I, Int32Shl)}, I,
+     Bytes(std::int32_t(0)), nullptr},
+    {"int32.shr.wide", {Int32(-1), Int32(32), N(I, Int32Shr)}, I,
+     Bytes(std::int32_t(0)), nullptr},
+    {"int32.sar", {Int32(0x80000000), Int32(4), N(I, Int32Sar)}, I,
+     Bytes(std::int32_t(0xf8000000)), nullptr},
+    {"int32.sar.wide", {Int32(0x80000000), Int32(40), N(I, Int32Sar)}, I,
+     Bytes(std::int32_t(-1)), nullptr},
+    {"int32.slt", {Int32(-1), Int32(0), N(I, Int32Slt)}, I,
+     Bytes(std::int32_t(1)), nullptr},
+    {"int32.ult", {Int32(-1), Int32(0), N(I, Int32Ult)}, I,
+     Bytes(std::int32_t(0)), nullptr},
+    {"int32.bits", {Int32(6), Int32(3), N(I, Int32Xor), Int32(12),
+                    N(I, Int32Ior), Int32(7), N(I, Int32And)},
+     I, Bytes(std::int32_t(5)), nullptr},
+    {"float32.add", {Float32(0.1f), Float32(0.2f), N(F32, Float32Add)}, F32,
+     Bytes(0.1f + 0.2f), nullptr},
+    {"float32.div.nan", {Float32(0), Float32(0), N(F32, Float32Div)}, F32,
+     Bytes(nan32), nullptr},
+    {"float32.add.payload",
+     {Float32Bits(payload32), Float32(1), N(F32, Float32Add)}, F32,
+     Bytes(nan32), nullptr},
+    {"float32.sqrt.nan", {Float32(-1), N(F32, Float32Sqrt)}, F32,
+     Bytes(nan32), nullptr},
+    {"float32.copysign",
+     {Float32(2), Float32(-0.0f), N(F32, Float32Copysign)}, F32, Bytes(-2.0f),
+     nullptr},
+    {"float32.floor", {Float32(-1.5f), N(F32, Float32Floor)}, F32,
+     Bytes(-2.0f), nullptr},
+    {"float32.ceil", {Float32(-1.5f), N(F32, Float32Ceil)}, F32,
+     Bytes(-1.0f), nullptr},
+    {"float32.lt.nan", {Float32Bits(nan32), Float32(1), N(I, Float32Lt)}, I,
+     Bytes(std::int32_t(0)), nullptr},
+    {"float32.from.uint32", {Int32(0xffffffff), N(F32, Float32FromUInt32)},
+     F32, Bytes(4294967296.0f), nullptr},
+    {"float64.mul", {Float64(0.1), Float64(3), N(F64, Float64Mul)}, F64,
+     Bytes(0.1 * 3), nullptr},
+    {"float64.sub.nan",
+     {Float64Bits(UINT64_C(0x7ff0000000000000)),
+      Float64Bits(UINT64_C(0x7ff0000000000000)), N(F64, Float64Sub)},
+     F64, Bytes(nan64), nullptr},
+    {"float64.div.payload",
+     {Float64(1), Float64Bits(payload64), N(F64, Float64Div)}, F64,
+     Bytes(nan64), nullptr},
+    {"float64.sqrt", {Float64(2), N(F64, Float64Sqrt)}, F64,
+     Bytes(std::sqrt(2.0)), nullptr},
+    {"float64.abs.neg", {Float64(-3), N(F64, Float64Abs), N(F64, Float64Neg)},
+     F64, Bytes(-3.0), nullptr},
+    {"float64.le", {Float64(-0.0), Float64(0), N(I, Float64Le)}, I,
+     Bytes(std::int32_t(1)), nullptr},
+    {"float64.from.float32", {Float32(0.1f), N(F64, Float64FromFloat32)},
+     F64, Bytes(double(0.1f)), nullptr},
+    {"float32.from.float64", {Float64(0.1), N(F32, Float32FromFloat64)}, F32,
+     Bytes(float(0.1)), nullptr},
+    {"int32.from.float64", {Float64(-2.9), N(I, SInt32FromFloat64)}, I,
+     Bytes(std::int32_t(-2)), nullptr},
+    {"int32.from.float32.over", {Float32(2147483648.0f),
+                                 N(I, SInt32FromFloat32)},
+     I, "", "float to signed integer conversion failure"},
+    // Stores leave their value, which the loads at the same address add to.
+    {"heap.int32",
+     {Int32(-5), Int32(8), N(I, StoreHeap), Int32(8), N(I, LoadHeap),
+      N(I, Int32Add)},
+     I, Bytes(std::int32_t(-10)), nullptr},
+    {"heap.float32.offset",
+     {Float32(1.5f), Int32(8),
+      N(F32, StoreHeapWithOffset, module.literal(4)), Int32(4),
+      N(F32, LoadHeapWithOffset, module.literal(8)), N(F32, Float32Add)},
+     F32, Bytes(3.0f), nullptr},
+    {"heap.float64.offset",
+     {Float64(2.5), Int32(16),
+      N(F64, StoreHeapWithOffset, module.literal(8)), Int32(8),
+      N(F64, LoadHeapWithOffset, module.literal(16)), N(F64, Float64Add)},
+     F64, Bytes(5.0), nullptr},
+  };
+  for (const EngineName& engine : Engines()) {
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    for (const Case& c : cases) {
+      TestModule caseModule = module;
+      AddResultRoutine(&caseModule, 0, c.body, c.type);
+      std::string test = std::string(c.name) + "." + engine.name;
+      Outcome outcome = Run(caseModule, setup);
+      if (c.why)
+        ExpectOutcome(test.c_str(), outcome, EXIT_FAILURE, "", c.why);
+      else
+        ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS, c.result);
+    }
+  }
+}
+
+// Operands left on the stack across a branch reach its target with the same
+// values however it's reached, in a local, a constant, or a temporary.
+static void
+TestBranchOperands() {
+  Types I = Types::int32, V = Types::void_;
+  struct Case {
+    const char* name;
+    std::uint32_t numLocals;
+    std::vector<Node> body;
+    std::int32_t result;
+  };
+  TestModule module;
+  auto L = [&module](std::int32_t value) {
+    return N(Types::int32, Literal, module.literal(std::uint32_t(value)));
+  };
+  const std::vector<Case> cases = {
+    {"taken", 0, {L(7), L(1), N(V, BrIf, 5), L(2), N(I, Int32Add)}, 7},
+    {"not-taken", 0, {L(7), L(0), N(V, BrIf, 5), L(2), N(I, Int32Add)}, 9},
+    {"br", 0, {L(7), N(V, Br, 3), L(9), L(1), N(I, Int32Add)}, 8},
+    // The local is overwritten at the target, after its value was carried.
+    {"local", 1,
+     {L(7), N(I, SetLocal, 0), L(1), N(V, BrIf, 6), L(2), N(I, Int32Add),
+      L(5), N(I, SetLocal, 0), N(I, Int32Add)},
+     12},
+    // Sums 4 + 3 + 2 + 1, carrying the sum around the loop.
+    {"loop", 1,
+     {L(0), L(4), N(I, SetLocal, 0), N(V, BrIf, 4), N(I, GetLocal, 0),
+      N(I, Int32Add), N(I, GetLocal, 0), L(-1), N(I, Int32Add),
+      N(I, SetLocal, 0), N(V, BrIf, 4)},
+     10},
+  };
+  // Metering adds a block of its own at each target.
+  for (const EngineName& engine : Engines()) {
+    for (bool metered : {false, true}) {
+      Setup setup;
+      setup.runOptions.engine = engine.engine;
+      setup.runOptions.fuel = metered ? INT64_MAX : 0;
+      for (const Case& c : cases) {
+        TestModule caseModule = module;
+        AddResultRoutine(&caseModule, c.numLocals, c.body, I);
+        std::string test = std::string(c.name) + "." + engine.name +
+                           (metered ? ".metered" : "");
+        ExpectOutcome(test.c_str(), Run(caseModule, setup), EXIT_SUCCESS,
+                      Bytes(c.result));
+      }
+    }
+  }
+}
+
+// Out-of-bounds accesses trap even if their results are unused or
+// overwritten, including those of translated code, which the host compiler
+// mustn't drop from guarded memory.
+static void
+TestHeapBounds() {
+  Types I = Types::int32, L = Types::int64;
+  TestModule module;
+  auto Int32 = [&module](std::uint32_t value) {
+    return N(Types::int32, Literal, module.literal(value));
+  };
+  struct Case {
+    const char* name;
+    std::vector<Node> body;
+  };
+  const std::vector<Case> cases = {
+    {"dead-load", {Int32(0xfffe), N(I, LoadHeap), Int32(0), N(I, Int32Mul)}},
+    {"dead-load.int64",
+     {Int32(0xfffc), N(L, LoadHeap), N(I, Int32FromInt64), Int32(0),
+      N(I, Int32Mul)}},
+    {"overwritten-store",
+     {Int32(1), Int32(0xfffe), N(I, StoreHeap), Int32(2), Int32(0xfffe),
+      N(I, StoreHeap), N(I, Int32Add)}},
+  };
+  for (const EngineName& engine : Engines()) {
+    for (bool guardPages : {true, false}) {
+      Setup setup;
+      setup.runOptions.engine = engine.engine;
+      setup.guardPages = guardPages;
+      for (const Case& c : cases) {
+        TestModule caseModule = module;
+        AddResultRoutine(&caseModule, 0, c.body, I);
+        std::string test = std::string(c.name) + "." + engine.name +
+                           (guardPages ? ".guard" : ".explicit");
+        ExpectOutcome(test.c_str(), Run(caseModule, setup), EXIT_FAILURE, "",
+                      "linear memory address out of bounds");
+      }
+    }
+  }
+}
+
+// Routine 0 sums 4 + 3 + 2 + 1 in a loop, stores the sum in global 0, adds
+// the result of routine 1, which loads the global, and writes the total, 20.
+static TestModule
+CacheModule() {
+  Types I = Types::int32, V = Types::void_;
+  TestModule module;
+  module.numGlobals = 1;
+  auto L = [&module](std::int32_t value) {
+    return N(Types::int32, Literal, module.literal(std::uint32_t(value)));
+  };
+  AddResultRoutine(&module, 1,
+                   {L(0), L(4), N(I, SetLocal, 0), N(V, BrIf, 4),
+                    N(I, GetLocal, 0), N(I, Int32Add), N(I, GetLocal, 0),
+                    L(-1), N(I, Int32Add), N(I, SetLocal, 0), N(V, BrIf, 4),
+                    N(I, StoreGlobal, 0), N(I, CallDirect, 1),
+                    N(I, Int32Add)},
+                   I);
+  module.routines.push_back(TestRoutine{0, {N(I, LoadGlobal, 0)}});
+  return module;
+}
+
+static std::string
+ReadFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  return file ? ReadAll(file) : std::string();
+}
+
+static bool
+WriteFile(const std::string& path, const std::string& contents) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool written =
+    fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  return fclose(file) == 0 && written;
+}
+
+// The paths of the files in dir.
+static std::vector<std::string>
+ListDirectory(const std::string& dir) {
+  std::vector<std::string> paths;
+  if (DIR* d = opendir(dir.c_str())) {
+    while (dirent* entry = readdir(d))
+      if (entry->d_name[0] != '.')
+        paths.push_back(dir + "/" + entry->d_name);
+    closedir(d);
+  }
+  return paths;
+}
+
+// Saved routines and their instructions, in the bytes of a code cache file.
+static SavedRoutine*
+SavedRoutines(std::string& file) {
+  return reinterpret_cast<SavedRoutine*>(&file[sizeof(CodeCacheHeader)]);
+}
+
+template <typename T>
+static T*
+SavedCode(std::string& file, const SavedRoutine& routine) {
+  return reinterpret_cast<T*>(&file[routine.codeOffset]);
+}
+
+// Saved code is used by later runs, and code which doesn't check out,
+// because the file is corrupt, truncated or stale, is compiled from the
+// module again rather than executed.
+static void
+TestCodeCacheRestore() {
+  struct Corruption {
+    const char* name;
+    std::function<void(std::string& file)> apply;
+  };
+  // Each applies to every saved routine.
+  auto each = [](const std::function<void(std::string&, SavedRoutine&)>& f) {
+    return [f](std::string& file) {
+      const CodeCacheHeader* header =
+        reinterpret_cast<const CodeCacheHeader*>(file.data());
+      for (std::uint32_t i = 0; i < header->numRoutines; ++i)
+        f(file, SavedRoutines(file)[i]);
+    };
+  };
+  auto truncate = [](std::string& file) { file.resize(file.size() / 2); };
+  auto noEnd = each([](std::string&, SavedRoutine& r) { --r.numInstrs; });
+
+  const std::vector<Corruption> stackCorruptions = {
+    {"payloads", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i)
+         SavedCode<SavedInstr>(file, r)[i].payload = 0x7fffffff;
+     })},
+    {"depths", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i)
+         SavedCode<SavedInstr>(file, r)[i].depth = 0;
+     })},
+    {"ops", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i)
+         SavedCode<SavedInstr>(file, r)[i].op =
+           std::uint16_t(InstrOp::Int32AddLocalLiteral);
+     })},
+    {"no-end", noEnd},
+    {"truncated", truncate},
+  };
+  const std::vector<Corruption> registerCorruptions = {
+    {"slots", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i) {
+         SavedRegInstr& instr = SavedCode<SavedRegInstr>(file, r)[i];
+         instr.dst = instr.a = instr.b = 0x7fffffff;
+       }
+     })},
+    {"payloads", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i)
+         SavedCode<SavedRegInstr>(file, r)[i].payload = 0x7fffffff;
+     })},
+    {"num-slots", each([](std::string&, SavedRoutine& r) { r.numSlots = 1; })},
+    {"ops", each([](std::string& file, SavedRoutine& r) {
+       for (std::uint32_t i = 0; i < r.numInstrs; ++i)
+         SavedCode<SavedRegInstr>(file, r)[i].op =
+           std::uint32_t(InstrOp::Int32GetLocal);
+     })},
+    {"no-end", noEnd},
+    {"truncated", truncate},
+  };
+
+  TestModule module = CacheModule();
+  std::string result = Bytes(std::int32_t(20));
+  for (const EngineName& engine : Engines()) {
+    if (engine.engine != Engine::stack && engine.engine != Engine::register_)
+      continue;
+    std::string suffix = std::string(".") + engine.name;
+    std::string dir;
+    if (!MakeTempDirectory(&dir)) {
+      Fail(("save" + suffix).c_str(), "cannot create a temporary directory");
+      continue;
+    }
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    setup.runOptions.cacheDirectory = dir.c_str();
+
+    ExpectOutcome(("save" + suffix).c_str(), Run(module, setup), EXIT_SUCCESS,
+                  result);
+    std::vector<std::string> paths = ListDirectory(dir);
+    std::string saved = paths.size() == 1 ? ReadFile(paths[0]) : "";
+    if (saved.size() < sizeof(CodeCacheHeader)) {
+      Fail(("save" + suffix).c_str(), "saved %zu files", paths.size());
+    } else {
+      ExpectOutcome(("restore" + suffix).c_str(), Run(module, setup),
+                    EXIT_SUCCESS, result);
+      for (const Corruption& corruption : engine.engine == Engine::stack
+                                            ? stackCorruptions
+                                            : registerCorruptions) {
+        std::string test = std::string("corrupt.") + corruption.name + suffix;
+        std::string file = saved;
+        corruption.apply(file);
+        if (!WriteFile(paths[0], file))
+          Fail(test.c_str(), "cannot write the saved code");
+        ExpectOutcome(test.c_str(), Run(module, setup), EXIT_SUCCESS, result);
+      }
+    }
+    for (const std::string& path : ListDirectory(dir))
+      unlink(path.c_str());
+    rmdir(dir.c_str());
+  }
+}
+
+// Routine 0 sets global 0 to depth and calls routine 1, which has numLocals
+// locals, and calls itself while it counts the global down to zero.
+static TestModule
+RecursionModule(std::uint32_t depth, std::uint32_t numLocals = 0) {
+  Types I = Types::int32, V = Types::void_;
+  TestModule module;
+  module.numGlobals = 1;
+  module.routines.push_back(TestRoutine{
+    0, {N(I, Literal, module.literal(depth)), N(I, StoreGlobal, 0),
+        N(I, CallDirect, 1)}});
+  module.routines.push_back(TestRoutine{
+    numLocals,
+    {N(I, LoadGlobal, 0), N(I, Literal, module.literal(0)), N(I, Int32Eq),
+     N(V, BrIf, 11), N(I, LoadGlobal, 0), N(I, Literal, module.literal(-1)),
+     N(I, Int32Add), N(I, StoreGlobal, 0), N(I, CallDirect, 1),
+     N(I, Int32Add), N(V, BrIf, 11), N(I, Literal, module.literal(0))}});
+  return module;
+}
+
+// Routines are decoded when they're first called, so an invalid one which is
+// never called doesn't stop the run, and one which is traps when it's called.
+// Under a code cache limit which evicts every other routine at each call,
+// including those still running, the results are the same. Translated code
+// is excluded, since translation rejects an invalid routine up front.
+static void
+TestLazyRoutines() {
+  Types I = Types::int32;
+  for (const EngineName& engine : Engines()) {
+    if (engine.engine == Engine::aot)
+      continue;
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    std::string suffix = std::string(".") + engine.name;
+
+    TestModule uncalled;
+    AddResultRoutine(&uncalled, 0, {N(I, Literal, uncalled.literal(7))}, I);
+    uncalled.routines.push_back(TestRoutine{0, {N(I, Int32Add)}});
+    ExpectOutcome(("lazy.uncalled" + suffix).c_str(), Run(uncalled, setup),
+                  EXIT_SUCCESS, Bytes(std::int32_t(7)));
+
+    TestModule called;
+    AddResultRoutine(&called, 0, {N(I, CallDirect, 1)}, I);
+    called.routines.push_back(TestRoutine{0, {N(I, Int32Add)}});
+    ExpectOutcome(("lazy.called" + suffix).c_str(), Run(called, setup),
+                  EXIT_FAILURE, "", "operand stack underflow");
+
+    Setup evicting = setup;
+    evicting.runOptions.codeCacheLimit = 1;
+    ExpectOutcome(("lazy.evicting" + suffix).c_str(),
+                  Run(CacheModule(), evicting), EXIT_SUCCESS,
+                  Bytes(std::int32_t(20)));
+    ExpectOutcome(("lazy.evicting.recursion" + suffix).c_str(),
+                  Run(RecursionModule(1000), evicting), EXIT_SUCCESS, "");
+  }
+}
+
+// Routine 0 calls each of the other count - 1 routines, which return their
+// index, and writes the sum.
+static TestModule
+ManyRoutinesModule(std::uint32_t count) {
+  Types I = Types::int32;
+  TestModule module;
+  std::vector<Node> body = {N(I, CallDirect, 1)};
+  for (std::uint32_t i = 2; i < count; ++i)
+    body.insert(body.end(), {N(I, CallDirect, i), N(I, Int32Add)});
+  AddResultRoutine(&module, 0, body, I);
+  for (std::uint32_t i = 1; i < count; ++i)
+    module.routines.push_back(
+      TestRoutine{0, {N(I, Literal, module.literal(i))}});
+  return module;
+}
+
+// Compiling every routine up front, on any number of threads, gives the same
+// results as compiling each when it's called, and of several invalid
+// routines, the one with the lowest index traps, even if none is called.
+static void
+TestCompileAll() {
+  const std::uint32_t count = 64;
+  for (const EngineName& engine : Engines()) {
+    for (unsigned jobs : {0u, 1u, 4u}) {
+      Setup setup;
+      setup.runOptions.engine = engine.engine;
+      setup.runOptions.jobs = jobs;
+      std::string suffix =
+        std::string(".") + engine.name + "." + std::to_string(jobs);
+      ExpectOutcome(("compile-all" + suffix).c_str(),
+                    Run(ManyRoutinesModule(count), setup), EXIT_SUCCESS,
+                    Bytes(std::int32_t(count * (count - 1) / 2)));
+
+      // Translation rejects an invalid routine however the rest is compiled.
+      if (engine.engine == Engine::aot)
+        continue;
+      TestModule invalid = ManyRoutinesModule(count);
+      invalid.routines.push_back(
+        TestRoutine{0, {N(Types::int32, LoadGlobal)}});
+      invalid.routines.push_back(TestRoutine{0, {N(Types::int32, GetLocal)}});
+      Outcome outcome = Run(invalid, setup);
+      std::string test = "compile-all.invalid" + suffix;
+      if (jobs == 0) {
+        ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS,
+                      Bytes(std::int32_t(count * (count - 1) / 2)));
+      } else {
+        ExpectOutcome(test.c_str(), outcome, EXIT_FAILURE, "",
+                      "invalid global index");
+        if (outcome.err.find("invalid local index") != std::string::npos)
+          Fail(test.c_str(), "trapped for a later routine; stderr: %s",
+               outcome.err.c_str());
+      }
+    }
+  }
+
+  Outcome outcome = RunChild([count] {
+    std::shared_ptr<Module> module = std::make_shared<Module>();
+    const char* why;
+    if (!LoadModule(ManyRoutinesModule(count), module.get(), &why)) {
+      fprintf(stderr, "%s\n", why);
+      return EXIT_FAILURE;
+    }
+    Implementation implementation(NaNBits::Kind::Canonical);
+    CodeCache codeCache(*module, implementation.trapHandler_.get(),
+                        RunOptions());
+    CompileStats stats;
+    codeCache.compileAll(4, &stats);
+    printf("%zu routines on %u threads", stats.routines, stats.jobs);
+    return EXIT_SUCCESS;
+  });
+  ExpectOutcome("compile-all.stats", outcome, EXIT_SUCCESS,
+                std::to_string(count) + " routines on 4 threads");
+}
+
+// The machine stack a process runs on is sized from its trusted stack, so
+// the trusted stack runs out first, and recursion which fits in it completes
+// on any stack, engine, or thread.
+static void
+TestCallStackExhaustion() {
+  for (const EngineName& engine : Engines()) {
+    Setup setup;
+    setup.runOptions.engine = engine.engine;
+    std::string suffix = std::string(".") + engine.name;
+
+    // Frames without locals take the least room in the trusted stack.
+    ExpectOutcome(("zero-locals" + suffix).c_str(),
+                  Run(RecursionModule(1000000), setup), EXIT_FAILURE, "",
+                  "call stack exhausted");
+    ExpectOutcome(("default-size" + suffix).c_str(),
+                  Run(RecursionModule(20000), setup), EXIT_SUCCESS, "");
+
+    // Instances after the first run on the scheduler's fibers.
+    Setup instances = setup;
+    instances.instances = 2;
+    ExpectOutcome(("instances" + suffix).c_str(),
+                  Run(RecursionModule(5000), instances), EXIT_SUCCESS, "");
+
+    Setup large = setup;
+    large.stackSize = std::size_t(64) << 20;
+    ExpectOutcome(("large-arena" + suffix).c_str(),
+                  Run(RecursionModule(200000), large), EXIT_SUCCESS, "");
+    large.runOptions.fuel = INT64_MAX;
+    ExpectOutcome(("large-arena.fuel" + suffix).c_str(),
+                  Run(RecursionModule(200000), large), EXIT_SUCCESS, "");
+  }
+}
+
+// Routine 0 writes 7 if global 0 is 0, loads from out of bounds if it's 1,
+// and otherwise loops forever.
+static TestModule
+InstanceModule() {
+  Types I = Types::int32, V = Types::void_;
+  TestModule module;
+  module.numGlobals = 1;
+  AddResultRoutine(&module, 0,
+                   {N(I, Literal, module.literal(7)), N(I, LoadGlobal, 0),
+                    N(I, Literal, module.literal(0)), N(I, Int32Eq),
+                    N(V, BrIf, 14), N(I, LoadGlobal, 0),
+                    N(I, Literal, module.literal(1)), N(I, Int32Eq),
+                    N(V, BrIf, 11), N(I, Literal, module.literal(1)),
+                    N(V, BrIf, 9), N(I, Literal, module.literal(0x7fffff00)),
+                    N(I, LoadHeap), N(I, Int32Add)},
+                   I);
+  return module;
+}
+
+static const char*
+StatusName(Status status) {
+  switch (status) {
+    case Status::success:
+      return "success";
+    case Status::failure:
+      return "failure";
+    case Status::oom:
+      return "oom";
+    case Status::timeout:
+      return "timeout";
+  }
+  return "unknown";
+}
+
+// Schedule an instance of module for each of globals, which sets its global
+// 0, sharing code compiled as RunInstances does. Writes each instance's
+// status to stderr as "status: <name>".
+static int
+ScheduleModule(const TestModule& testModule, const Setup& setup,
+               const std::vector<std::int32_t>& globals) {
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  const char* why;
+  if (!LoadModule(testModule, module.get(), &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+
+  RunOptions runOptions = setup.runOptions;
+  AotLibrary aotLibrary;
+  if (runOptions.engine == Engine::aot) {
+    if (!CompileAot(*module, &aotLibrary, &why)) {
+      fprintf(stderr, "%s\n", why);
+      return EXIT_FAILURE;
+    }
+    runOptions.aotLibrary = &aotLibrary;
+  }
+
+  Implementation loader(NaNBits::Kind::Canonical);
+  Process loaded;
+  loaded.load(module, loader.trapHandler_.get());
+  Snapshot snapshot;
+  if (!snapshot.capture(loaded))
+    return EXIT_FAILURE;
+
+  std::vector<std::unique_ptr<Implementation>> implementations;
+  std::vector<std::unique_ptr<Process>> processes;
+  std::vector<Instance> instances;
+  bool guarded = setup.guardPages;
+  for (std::int32_t global : globals) {
+    implementations.emplace_back(new Implementation(NaNBits::Kind::Canonical));
+    processes.emplace_back(new Process());
+    TrapHandler* trapHandler = implementations.back()->trapHandler_.get();
+    Process& process = *processes.back();
+    if (setup.guardPages &&
+        !process.linearMemory_->reserveGuarded(trapHandler))
+      guarded = false;
+    process.trustedStack_->reserve(setup.stackSize,
+                                   setup.guardPages ? trapHandler : nullptr);
+    if (!snapshot.instantiate(process))
+      return EXIT_FAILURE;
+    process.globalVariables_->store(0, global);
+    instances.push_back(Instance{implementations.back().get(), &process});
+  }
+
+  CodeCache codeCache(*module, implementations[0]->trapHandler_.get(),
+                      runOptions, guarded);
+  codeCache.freeze(1);
+  std::vector<Status> statuses;
+  Schedule(instances, codeCache, runOptions, setup.scheduleOptions,
+           &statuses);
+  for (Status status : statuses)
+    fprintf(stderr, "status: %s\n", StatusName(status));
+  return EXIT_SUCCESS;
+}
+
+// Instances sharing worker threads and code each end on their own: one
+// which traps fails, and the others run to completion.
+static void
+TestInstanceTraps() {
+  TestModule module = InstanceModule();
+  for (const EngineName& engine : Engines()) {
+    for (bool guardPages : {true, false}) {
+      for (unsigned threads : {1u, 2u}) {
+        Setup setup;
+        setup.runOptions.engine = engine.engine;
+        setup.guardPages = guardPages;
+        setup.scheduleOptions.threads = threads;
+        std::string test = std::string("instance-traps.") + engine.name +
+                           (guardPages ? ".guard" : ".explicit") + "." +
+                           std::to_string(threads);
+        std::vector<std::int32_t> globals = {0, 1, 0};
+        Outcome outcome = RunChild([&module, &setup, &globals] {
+          return ScheduleModule(module, setup, globals);
+        });
+        ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS,
+                      Bytes(std::int32_t(7)) + Bytes(std::int32_t(7)),
+                      "linear memory address out of bounds");
+        if (outcome.err.find("status: success\nstatus: failure\n"
+                             "status: success\n") == std::string::npos)
+          Fail(test.c_str(), "wrong statuses; stderr: %s",
+               outcome.err.c_str());
+      }
+    }
+  }
+}
+
+// An instance which runs out of fuel or time is stopped without holding up
+// the others, whether they finish or trap, and is the only one to time out.
+static void
+TestInstanceLimits() {
+  TestModule module = InstanceModule();
+  for (const EngineName& engine : Engines()) {
+    for (bool fuel : {true, false}) {
+      for (unsigned threads : {1u, 2u}) {
+        Setup setup;
+        setup.runOptions.engine = engine.engine;
+        if (fuel)
+          setup.runOptions.fuel = 1000000;
+        else
+          setup.scheduleOptions.timeBudget = 0.05;
+        setup.scheduleOptions.threads = threads;
+        std::string test = std::string("instance-limits.") + engine.name +
+                           (fuel ? ".fuel" : ".budget") + "." +
+                           std::to_string(threads);
+        std::vector<std::int32_t> globals = {2, 0, 1, 0};
+        Outcome outcome = RunChild([&module, &setup, &globals] {
+          return ScheduleModule(module, setup, globals);
+        });
+        ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS,
+                      Bytes(std::int32_t(7)) + Bytes(std::int32_t(7)),
+                      "linear memory address out of bounds");
+        if (outcome.err.find("status: timeout\nstatus: success\n"
+                             "status: failure\nstatus: success\n") ==
+            std::string::npos)
+          Fail(test.c_str(), "wrong statuses; stderr: %s",
+               outcome.err.c_str());
+      }
+    }
+  }
+}
+
+// Routine 0 writes the 4 bytes of memory at 64, then global 0.
+static TestModule
+SnapshotModule() {
+  Types I = Types::int32;
+  TestModule module;
+  module.numGlobals = 1;
+  module.initializers.push_back(TestInitializer{64, "wxyz"});
+  AddResultRoutine(&module, 0,
+                   {N(I, Literal, module.literal(STDOUT_FILENO)),
+                    N(I, Literal, module.literal(64)),
+                    N(I, Literal, module.literal(4)),
+                    N(I, CallFFI, std::uint32_t(FFIHandler::CallID::write)),
+                    N(I, LoadGlobal, 0), N(I, Int32Add)},
+                   I);
+  return module;
+}
+
+// Processes instantiated from a snapshot start with the captured process's
+// memory and globals, including changes made after it was loaded, and share
+// its memory copy-on-write, so one process's writes aren't seen by the
+// snapshot, by processes instantiated before them, or by those after.
+static int
+CheckSnapshot(bool guardPages) {
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  const char* why;
+  if (!LoadModule(SnapshotModule(), module.get(), &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+  Implementation loader(NaNBits::Kind::Canonical);
+  Process loaded;
+  loaded.load(module, loader.trapHandler_.get());
+  loaded.globalVariables_->store(0, std::int32_t(5));
+  memcpy(loaded.linearMemory_->data() + 64, "WXYZ", 4);
+  Snapshot snapshot;
+  if (!snapshot.capture(loaded))
+    return EXIT_FAILURE;
+  loaded.globalVariables_->store(0, std::int32_t(0));
+  memcpy(loaded.linearMemory_->data() + 64, "0000", 4);
+
+  std::vector<std::unique_ptr<Implementation>> implementations;
+  for (int i = 0; i < 3; ++i)
+    implementations.emplace_back(new Implementation(NaNBits::Kind::Canonical));
+  Process processes[3];
+  auto instantiate = [&](int i) {
+    Process& process = processes[i];
+    TrapHandler* trapHandler = implementations[i]->trapHandler_.get();
+    if (guardPages)
+      process.linearMemory_->reserveGuarded(trapHandler);
+    process.trustedStack_->reserve(TrustedStack::defaultArenaSize,
+                                   guardPages ? trapHandler : nullptr);
+    return snapshot.instantiate(process);
+  };
+  if (!instantiate(0) || !instantiate(1))
+    return EXIT_FAILURE;
+  processes[0].globalVariables_->store(0, std::int32_t(6));
+  memcpy(processes[0].linearMemory_->data() + 64, "abcd", 4);
+  if (!instantiate(2))
+    return EXIT_FAILURE;
+
+  // Each writes what it sees.
+  for (int i = 0; i < 3; ++i) {
+    if (run(*implementations[i], processes[i]) != Status::success)
+      return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Run module in a new process, as wasm-shell does.
+static Status
+RunProcess(const std::shared_ptr<Module>& module,
+           const RunOptions& runOptions) {
+  Implementation implementation(NaNBits::Kind::Canonical);
+  Process process;
+  process.load(module, implementation.trapHandler_.get());
+  return run(implementation, process, runOptions);
+}
+
+// A translated module's library is only loaded for the module it was
+// translated from, and its routines, which are all translated, consume fuel
+// exactly as interpreted ones do, running out at the same instruction.
+static int
+CheckAotLibrary() {
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  std::shared_ptr<Module> other = std::make_shared<Module>();
+  const char* why;
+  if (!LoadModule(CacheModule(), module.get(), &why) ||
+      !LoadModule(InstanceModule(), other.get(), &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+
+  AotLibrary stale;
+  if (CompileAot(*module, &stale, &why, other.get())) {
+    fprintf(stderr, "loaded for another module\n");
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "stale: %s\n", why);
+
+  AotLibrary library;
+  if (!CompileAot(*module, &library, &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+  for (std::uint32_t i = 0; i < module->numRoutines(); ++i) {
+    if (!library.routine(i)) {
+      fprintf(stderr, "routine %u wasn't translated\n", i);
+      return EXIT_FAILURE;
+    }
+  }
+
+  RunOptions stack, aot;
+  aot.engine = Engine::aot;
+  aot.aotLibrary = &library;
+  for (std::uint64_t fuel = 1;; ++fuel) {
+    stack.fuel = aot.fuel = fuel;
+    Status expected = RunProcess(module, stack);
+    Status status = RunProcess(module, aot);
+    if (status != expected) {
+      fprintf(stderr, "with fuel %llu: %s, expected %s\n",
+              (unsigned long long)fuel, StatusName(status),
+              StatusName(expected));
+      return EXIT_FAILURE;
+    }
+    if (expected == Status::success)
+      return EXIT_SUCCESS;
+  }
+}
+
+static void
+TestAotLibrary() {
+  Outcome outcome = RunChild(CheckAotLibrary);
+  ExpectOutcome("aot-library", outcome, EXIT_SUCCESS,
+                Bytes(std::int32_t(20)) + Bytes(std::int32_t(20)));
+  if (outcome.err.find("stale: translated from a different module") ==
+      std::string::npos)
+    Fail("aot-library", "stale library wasn't rejected; stderr: %s",
+         outcome.err.c_str());
+}
+
+static void
+TestSnapshot() {
+  std::string expected = "abcd" + Bytes(std::int32_t(6)) + "WXYZ" +
+                         Bytes(std::int32_t(5)) + "WXYZ" +
+                         Bytes(std::int32_t(5));
+  for (bool guardPages : {true, false}) {
+    std::string test =
+      std::string("snapshot.") + (guardPages ? "guard" : "explicit");
+    ExpectOutcome(test.c_str(),
+                  RunChild([guardPages] { return CheckSnapshot(guardPages); }),
+                  EXIT_SUCCESS, expected);
+  }
+}
+
+// Run module on the stack engine without superinstructions, with options
+// set by setUp, as wasm-shell's --profile and --sample do.
+static int
+RunObserved(const TestModule& testModule,
+            const std::function<bool(Process&, RunOptions*)>& setUp) {
+  std::shared_ptr<Module> module = std::make_shared<Module>();
+  const char* why;
+  if (!LoadModule(testModule, module.get(), &why)) {
+    fprintf(stderr, "%s\n", why);
+    return EXIT_FAILURE;
+  }
+  Implementation implementation(NaNBits::Kind::Canonical);
+  Process process;
+  process.load(module, implementation.trapHandler_.get());
+  RunOptions runOptions;
+  runOptions.fuse = false;
+  if (!setUp(process, &runOptions))
+    return EXIT_FAILURE;
+  return run(implementation, process, runOptions) == Status::success
+           ? EXIT_SUCCESS
+           : EXIT_FAILURE;
+}
+
+// The profile counts each site of the stack form as often as it runs: the
+// loop's sites four times, the rest once, in the routine they belong to.
+static void
+TestProfile() {
+  Outcome outcome = RunChild([] {
+    Profile profile;
+    int status = RunObserved(
+      CacheModule(), [&profile](Process&, RunOptions* options) {
+        options->profile = &profile;
+        return true;
+      });
+    profile.dump(stderr);
+    return status;
+  });
+  ExpectOutcome("profile", outcome, EXIT_SUCCESS, Bytes(std::int32_t(20)));
+  const char* expected[] = {
+    "{\"routine\": 0, ",
+    "{\"routine\": 1, ",
+    "{\"index\": 4, \"op\": \"Int32GetLocal\", \"count\": 4, ",
+    "{\"index\": 10, \"op\": \"BrIf\", \"count\": 4, ",
+    "{\"index\": 12, \"op\": \"Int32CallDirect\", \"count\": 1, ",
+    "{\"index\": 0, \"op\": \"Int32LoadGlobal\", \"count\": 1, ",
+  };
+  for (const char* text : expected)
+    if (outcome.err.find(text) == std::string::npos)
+      Fail("profile", "no %s in profile: %s", text, outcome.err.c_str());
+
+  // Code run by the other engines isn't counted.
+  outcome = RunChild([] {
+    Profile profile;
+    int status = RunObserved(
+      CacheModule(), [&profile](Process&, RunOptions* options) {
+        options->engine = Engine::register_;
+        options->profile = &profile;
+        return true;
+      });
+    profile.dump(stderr);
+    return status;
+  });
+  ExpectOutcome("profile.register", outcome, EXIT_SUCCESS,
+                Bytes(std::int32_t(20)));
+  if (outcome.err.find("\"routines\": [\n  ]") == std::string::npos)
+    Fail("profile.register", "counted other code: %s", outcome.err.c_str());
+}
+
+// Routine 0 calls routine 1, which calls routine 2, which counts a local
+// down from count and returns 0, which routine 0 writes.
+static TestModule
+NestedLoopModule(std::int32_t count) {
+  Types I = Types::int32, V = Types::void_;
+  TestModule module;
+  auto L = [&module](std::int32_t value) {
+    return N(Types::int32, Literal, module.literal(std::uint32_t(value)));
+  };
+  AddResultRoutine(&module, 0, {N(I, CallDirect, 1)}, I);
+  module.routines.push_back(TestRoutine{0, {N(I, CallDirect, 2)}});
+  module.routines.push_back(TestRoutine{
+    1,
+    {L(count), N(I, SetLocal, 0), N(V, BrIf, 3), N(I, GetLocal, 0), L(-1),
+     N(I, Int32Add), N(I, SetLocal, 0), N(V, BrIf, 3), L(0)}});
+  return module;
+}
+
+// Samples are of the whole call stack, outermost first, with the position in
+// the innermost routine, written as collapsed stacks. Samples beyond the
+// buffer are counted as dropped rather than written.
+static void
+TestSampler() {
+  for (std::size_t bufferSize : {Sampler::defaultBufferSize, std::size_t(8)}) {
+    bool small = bufferSize != Sampler::defaultBufferSize;
+    std::string test = small ? "sampler.dropped" : "sampler";
+    Outcome outcome = RunChild([bufferSize] {
+      Sampler sampler(0.001, 0, bufferSize);
+      int status = RunObserved(
+        NestedLoopModule(20000000),
+        [&sampler](Process& process, RunOptions* options) {
+          const char* why;
+          if (!sampler.start(*process.trustedStack_, &why)) {
+            fprintf(stderr, "%s\n", why);
+            return false;
+          }
+          options->sampler = &sampler;
+          return true;
+        });
+      sampler.stop();
+      sampler.dump(stderr);
+      fprintf(stderr, "samples: %zu, dropped: %zu\n", sampler.samples(),
+              sampler.dropped());
+      return status;
+    });
+    ExpectOutcome(test.c_str(), outcome, EXIT_SUCCESS,
+                  Bytes(std::int32_t(0)));
+    // Some samples land on each of the loop's instructions.
+    if (("\n" + outcome.err).find("\nroutine0;routine1;routine2;@") ==
+        std::string::npos)
+      Fail(test.c_str(), "no samples in the loop; stderr: %s",
+           outcome.err.c_str());
+    bool dropped = outcome.err.find(", dropped: 0\n") == std::string::npos;
+    if (dropped != small)
+      Fail(test.c_str(), "%s samples; stderr: %s",
+           small ? "didn't drop" : "dropped", outcome.err.c_str());
+  }
+}
+
+struct Test {
+  const char* name;
+  void (*run)();
+};
+
+static const Test tests[] = {
+  {"queued-writes", TestQueuedWrites},
+  {"branch-depths", TestBranchDepths},
+  {"branch-operands", TestBranchOperands},
+  {"heap-bounds", TestHeapBounds},
+  {"code-cache-restore", TestCodeCacheRestore},
+  {"int64-conversions", TestInt64Conversions},
+  {"operators", TestOperators},
+  {"lazy-routines", TestLazyRoutines},
+  {"compile-all", TestCompileAll},
+  {"call-stack-exhaustion", TestCallStackExhaustion},
+  {"instance-traps", TestInstanceTraps},
+  {"instance-limits", TestInstanceLimits},
+  {"aot-library", TestAotLibrary},
+  {"snapshot", TestSnapshot},
+  {"profile", TestProfile},
+  {"sampler", TestSampler},
+};
+
+int
+main(int argc, char* argv[]) {
+  AssertHostRequirements();
+
+  const char* filter = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (strncmp(arg, "--filter=", 9) == 0) {
+      filter = arg + 9;
+      continue;
+    }
+    return Error("unknown command-line option: %s", arg);
+  }
+
+  unsigned failed = 0;
+  for (const Test& test : tests) {
+    if (filter && !strstr(test.name, filter))
+      continue;
+    unsigned before = failures;
+    test.run();
+    bool passed = failures == before;
+    printf("%s %s\n", passed ? "PASS" : "FAIL", test.name);
+    fflush(stdout);
+    if (!passed)
+      ++failed;
+  }
+  return failed;
+}